@@ -5,12 +5,38 @@
 #include "os_cfg.h"
 #include "lib_syscall.h"
 #include "malloc.h"
+#include "comm/clock.h"
+#include "comm/cpu_instr.h"
 #include <string.h>
+#include <sys/select.h>
+#include <sys/file.h>
+
+int sys_call_sysenter (syscall_args_t * args);
+
+// -1: not checked, 0: call gate, 1: SYSENTER
+static int sys_entry = -1;
+
+/**
+ * Select the entry of system calls, the kernel enables SYSENTER whenever the CPU has it
+ */
+int sys_entry_set (int fast) {
+    int old = sys_entry;
+    sys_entry = fast && cpu_has_sysenter();
+    return old;
+}
 
 /**
  * System call
  */
 static inline int sys_call (syscall_args_t * args) {
+    if (sys_entry < 0) {
+        sys_entry_set(1);
+    }
+
+    if (sys_entry) {
+        return sys_call_sysenter(args);
+    }
+
     const unsigned long sys_gate_addr[] = {0, SELECTOR_SYSCALL | 0};  // Use priority level 0
     int ret;
 
@@ -40,6 +66,44 @@ int msleep (int ms) {
     return sys_call(&args);
 }
 
+int nanosleep (const struct timespec * req, struct timespec * rem) {
+    syscall_args_t args;
+    args.id = SYS_nanosleep;
+    args.arg0 = (int)req;
+    args.arg1 = (int)rem;
+    return sys_call(&args);
+}
+
+int usleep (useconds_t us) {
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    return nanosleep(&ts, (struct timespec *)0);
+}
+
+int timer_slack (int ns) {
+    syscall_args_t args;
+    args.id = SYS_timer_slack;
+    args.arg0 = ns;
+    return sys_call(&args);
+}
+
+int sched_setattr (int pid, const sched_attr_t * attr) {
+    syscall_args_t args;
+    args.id = SYS_sched_setattr;
+    args.arg0 = pid;
+    args.arg1 = (int)attr;
+    return sys_call(&args);
+}
+
+int sched_getattr (int pid, sched_attr_t * attr) {
+    syscall_args_t args;
+    args.id = SYS_sched_getattr;
+    args.arg0 = pid;
+    args.arg1 = (int)attr;
+    return sys_call(&args);
+}
+
 int getpid() {
     syscall_args_t args;
     args.id = SYS_getpid;
@@ -60,6 +124,44 @@ int fork() {
     return sys_call(&args);
 }
 
+int spawn(const char *name, char * const *argv, char * const *env, const int * fd_map) {
+    syscall_args_t args;
+    args.id = SYS_spawn;
+    args.arg0 = (int)name;
+    args.arg1 = (int)argv;
+    args.arg2 = (int)env;
+    args.arg3 = (int)fd_map;
+    return sys_call(&args);
+}
+
+int clone(void (*entry)(void *), void * stack, void * arg, void * tls) {
+    syscall_args_t args;
+    args.id = SYS_clone;
+    args.arg0 = (int)entry;
+    args.arg1 = (int)stack;
+    args.arg2 = (int)arg;
+    args.arg3 = (int)tls;
+    return sys_call(&args);
+}
+
+/**
+ * @brief Exit current thread only, _exit ends the whole process
+ */
+void thread_exit (int status) {
+    syscall_args_t args;
+    args.id = SYS_thread_exit;
+    args.arg0 = status;
+    sys_call(&args);
+}
+
+int join(int tid, int * status) {
+    syscall_args_t args;
+    args.id = SYS_join;
+    args.arg0 = tid;
+    args.arg1 = (int)status;
+    return sys_call(&args);
+}
+
 int execve(const char *name, char * const *argv, char * const *env) {
     syscall_args_t args;
     args.id = SYS_execve;
@@ -69,6 +171,24 @@ int execve(const char *name, char * const *argv, char * const *env) {
     return sys_call(&args);
 }
 
+int uring_setup (uring_t * ring, int entries, int flags) {
+    syscall_args_t args;
+    args.id = SYS_uring_setup;
+    args.arg0 = (int)ring;
+    args.arg1 = entries;
+    args.arg2 = flags;
+    return sys_call(&args);
+}
+
+int uring_enter (int to_submit, int min_complete, int flags) {
+    syscall_args_t args;
+    args.id = SYS_uring_enter;
+    args.arg0 = to_submit;
+    args.arg1 = min_complete;
+    args.arg2 = flags;
+    return sys_call(&args);
+}
+
 int yield (void) {
     syscall_args_t args;
     args.id = SYS_yield;
@@ -90,6 +210,131 @@ void _exit(int status) {
     for (;;) {}
 }
 
+int task_usage (int pid, task_usage_t * usage) {
+    syscall_args_t args;
+    args.id = SYS_getrusage;
+    args.arg0 = pid;
+    args.arg1 = (int)usage;
+    return sys_call(&args);
+}
+
+int task_list (task_usage_t * buf, int count) {
+    syscall_args_t args;
+    args.id = SYS_task_list;
+    args.arg0 = (int)buf;
+    args.arg1 = count;
+    return sys_call(&args);
+}
+
+int sched_latency (int pid, sched_latency_t * latency) {
+    syscall_args_t args;
+    args.id = SYS_sched_latency;
+    args.arg0 = pid;
+    args.arg1 = (int)latency;
+    return sys_call(&args);
+}
+
+int sched_trace (sched_event_t * buf, int count) {
+    syscall_args_t args;
+    args.id = SYS_sched_trace;
+    args.arg0 = (int)buf;
+    args.arg1 = count;
+    return sys_call(&args);
+}
+
+int syscall_stat (syscall_stat_t * buf, int count, int flags) {
+    syscall_args_t args;
+    args.id = SYS_syscall_stat;
+    args.arg0 = (int)buf;
+    args.arg1 = count;
+    args.arg2 = flags;
+    return sys_call(&args);
+}
+
+int strace (int pid, int on) {
+    syscall_args_t args;
+    args.id = SYS_strace;
+    args.arg0 = pid;
+    args.arg1 = on;
+    return sys_call(&args);
+}
+
+int strace_read (syscall_event_t * buf, int count, unsigned int seq) {
+    syscall_args_t args;
+    args.id = SYS_strace_read;
+    args.arg0 = (int)buf;
+    args.arg1 = count;
+    args.arg2 = seq;
+    return sys_call(&args);
+}
+
+int futex (volatile unsigned int * uaddr, int op, unsigned int val, const struct timespec * timeout) {
+    syscall_args_t args;
+    args.id = SYS_futex;
+    args.arg0 = (int)uaddr;
+    args.arg1 = op;
+    args.arg2 = val;
+    args.arg3 = (int)timeout;
+    return sys_call(&args);
+}
+
+/**
+ * Time page mapped by kernel, it's at the same address after fork
+ */
+static const volatile time_page_t * get_time_page (void) {
+    static const volatile time_page_t * page;
+    static int checked;
+
+    if (!checked) {
+        syscall_args_t args;
+        args.id = SYS_time_page;
+        page = (const volatile time_page_t *)sys_call(&args);
+        if (page && (page->magic != TIME_PAGE_MAGIC)) {
+            page = (const volatile time_page_t *)0;
+        }
+        checked = 1;
+    }
+    return page;
+}
+
+int clock_gettime (clockid_t clock_id, struct timespec * tp) {
+    // read the time page without system call
+    const volatile time_page_t * page = get_time_page();
+    if (page && tp && ((clock_id == CLOCK_MONOTONIC) || (clock_id == CLOCK_REALTIME))) {
+        uint32_t nsec;
+        uint64_t sec = clock_div64(clock_page_ns(page), NSEC_PER_SEC, &nsec);
+        if (clock_id == CLOCK_REALTIME) {
+            sec += page->boot_sec;
+        }
+
+        tp->tv_sec = sec;
+        tp->tv_nsec = nsec;
+        return 0;
+    }
+
+    syscall_args_t args;
+    args.id = SYS_clock_gettime;
+    args.arg0 = (int)clock_id;
+    args.arg1 = (int)tp;
+    return sys_call(&args);
+}
+
+int gettimeofday (struct timeval * tv, void * tz) {
+    struct timespec ts;
+    if (tv && (get_time_page() != (const volatile time_page_t *)0)) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / NSEC_PER_USEC;
+        return 0;
+    }
+
+    syscall_args_t args;
+    args.id = SYS_gettimeofday;
+    args.arg0 = (int)tv;
+    args.arg1 = (int)tz;
+    return sys_call(&args);
+}
+
 int open(const char *name, int flags, ...) {
     // 不考虑支持太多参数
     syscall_args_t args;
@@ -144,6 +389,386 @@ int fstat(int file, struct stat *st) {
     return sys_call(&args);
 }
 
+ssize_t readv (int fd, const struct iovec * iov, int iovcnt) {
+    syscall_args_t args;
+    args.id = SYS_readv;
+    args.arg0 = fd;
+    args.arg1 = (int)iov;
+    args.arg2 = iovcnt;
+    return sys_call(&args);
+}
+
+ssize_t writev (int fd, const struct iovec * iov, int iovcnt) {
+    syscall_args_t args;
+    args.id = SYS_writev;
+    args.arg0 = fd;
+    args.arg1 = (int)iov;
+    args.arg2 = iovcnt;
+    return sys_call(&args);
+}
+
+ssize_t pread (int fd, void * buf, size_t nbytes, off_t offset) {
+    syscall_args_t args;
+    args.id = SYS_pread;
+    args.arg0 = fd;
+    args.arg1 = (int)buf;
+    args.arg2 = nbytes;
+    args.arg3 = offset;
+    return sys_call(&args);
+}
+
+ssize_t pwrite (int fd, const void * buf, size_t nbytes, off_t offset) {
+    syscall_args_t args;
+    args.id = SYS_pwrite;
+    args.arg0 = fd;
+    args.arg1 = (int)buf;
+    args.arg2 = nbytes;
+    args.arg3 = offset;
+    return sys_call(&args);
+}
+
+ssize_t sendfile (int out_fd, int in_fd, off_t * offset, size_t count) {
+    syscall_args_t args;
+    args.id = SYS_sendfile;
+    args.arg0 = out_fd;
+    args.arg1 = in_fd;
+    args.arg2 = (int)offset;
+    args.arg3 = count;
+    return sys_call(&args);
+}
+
+ssize_t copy_file_range (int fd_in, off_t * off_in, int fd_out, off_t * off_out, size_t len, unsigned int flags) {
+    copy_range_t range;
+    range.fd_in = fd_in;
+    range.off_in = off_in;
+    range.fd_out = fd_out;
+    range.off_out = off_out;
+    range.len = len;
+    range.flags = flags;
+
+    syscall_args_t args;
+    args.id = SYS_copy_file_range;
+    args.arg0 = (int)&range;
+    return sys_call(&args);
+}
+
+int pipe2 (int fds[2], int flags) {
+    syscall_args_t args;
+    args.id = SYS_pipe;
+    args.arg0 = (int)fds;
+    args.arg1 = flags;
+    return sys_call(&args);
+}
+
+int pipe (int fds[2]) {
+    return pipe2(fds, 0);
+}
+
+/**
+ * @brief Wait until some of fds are ready, or timeout ms passed, forever if timeout < 0
+ * return the number of fds ready, 0 if time is out
+ */
+int poll (struct pollfd * fds, int nfds, int timeout) {
+    syscall_args_t args;
+    args.id = SYS_poll;
+    args.arg0 = (int)fds;
+    args.arg1 = nfds;
+    args.arg2 = timeout;
+    return sys_call(&args);
+}
+
+/**
+ * @brief select on poll, at most POLL_FD_MAX fds in the sets
+ */
+int select (int n, fd_set * readfds, fd_set * writefds, fd_set * exceptfds, struct timeval * timeout) {
+    struct pollfd fds[POLL_FD_MAX];
+    int nfds = 0;
+
+    for (int fd = 0; fd < n; fd++) {
+        short events = 0;
+        if (readfds && FD_ISSET(fd, readfds)) {
+            events |= POLLIN;
+        }
+        if (writefds && FD_ISSET(fd, writefds)) {
+            events |= POLLOUT;
+        }
+        if (events == 0) {
+            continue;
+        } else if (nfds == POLL_FD_MAX) {
+            return -1;
+        }
+
+        fds[nfds].fd = fd;
+        fds[nfds].events = events;
+        fds[nfds++].revents = 0;
+    }
+
+    int ms = timeout ? (int)timeout->tv_sec * 1000 + (int)timeout->tv_usec / 1000 : -1;
+    int err = poll(fds, nfds, ms);
+    if (err < 0) {
+        return -1;
+    }
+
+    // the sets are the result on return
+    int ready = 0;
+    for (int i = 0; i < nfds; i++) {
+        int fd = fds[i].fd;
+        if (readfds && FD_ISSET(fd, readfds) && !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+            FD_CLR(fd, readfds);
+        }
+        if (writefds && FD_ISSET(fd, writefds) && !(fds[i].revents & (POLLOUT | POLLERR))) {
+            FD_CLR(fd, writefds);
+        }
+        ready += (readfds && FD_ISSET(fd, readfds)) + (writefds && FD_ISSET(fd, writefds));
+    }
+    if (exceptfds) {
+        FD_ZERO(exceptfds);
+    }
+    return ready;
+}
+
+/**
+ * @brief Create an interest set of fds, size is ignored
+ */
+int epoll_create (int size) {
+    syscall_args_t args;
+    args.id = SYS_epoll_create;
+    args.arg0 = size;
+    return sys_call(&args);
+}
+
+/**
+ * @brief Add, change or delete fd in the interest set
+ */
+int epoll_ctl (int epfd, int op, int fd, struct epoll_event * event) {
+    syscall_args_t args;
+    args.id = SYS_epoll_ctl;
+    args.arg0 = epfd;
+    args.arg1 = op;
+    args.arg2 = fd;
+    args.arg3 = (int)event;
+    return sys_call(&args);
+}
+
+/**
+ * @brief Wait until some fds in the set are ready, or timeout ms passed, forever if timeout < 0
+ * the fds ready are checked only, not all of the set
+ */
+int epoll_wait (int epfd, struct epoll_event * events, int maxevents, int timeout) {
+    syscall_args_t args;
+    args.id = SYS_epoll_wait;
+    args.arg0 = epfd;
+    args.arg1 = (int)events;
+    args.arg2 = maxevents;
+    args.arg3 = timeout;
+    return sys_call(&args);
+}
+
+/**
+ * Rings of the MQ_RING queues opened, found by mqd. It's copied to the child with the fds on fork
+ * the geometry is the one given by the kernel, the ring may be written by any process opening it
+ */
+typedef struct _mq_ring_fd_t {
+    mq_ring_t * ring;
+    unsigned int slots;         // power of 2
+    unsigned int slot_size;
+    int msgsize;
+    int nonblock;
+}mq_ring_fd_t;
+
+static mq_ring_fd_t mq_rings[MQ_RING_FD_NR];
+
+static void mq_ring_set (int mqd, mq_attr_t * attr) {
+    if ((mqd >= 0) && (mqd < MQ_RING_FD_NR)) {
+        mq_rings[mqd].ring = (mq_ring_t *)attr->ring;
+        mq_rings[mqd].slots = attr->maxmsg;
+        mq_rings[mqd].slot_size = MQ_RING_SLOT_SIZE(attr->msgsize);
+        mq_rings[mqd].msgsize = attr->msgsize;
+    }
+}
+
+static mq_ring_fd_t * mq_ring_get (int mqd) {
+    if ((mqd >= 0) && (mqd < MQ_RING_FD_NR) && mq_rings[mqd].ring) {
+        return mq_rings + mqd;
+    }
+    return (mq_ring_fd_t *)0;
+}
+
+/**
+ * @brief Open the message queue by name, create it with attr if O_CREAT is given
+ * attr is filled with the attributes of the queue if it's given
+ */
+int mq_open (const char * name, int flags, mq_attr_t * attr) {
+    mq_attr_t local = {0, MQ_MAXMSG_DEFAULT, MQ_MSGSIZE_DEFAULT, 0, (void *)0};
+    if (!attr) {
+        attr = &local;
+    }
+
+    syscall_args_t args;
+    args.id = SYS_mq_open;
+    args.arg0 = (int)name;
+    args.arg1 = flags;
+    args.arg2 = (int)attr;
+    int mqd = sys_call(&args);
+    if (mqd >= 0) {
+        mq_ring_set(mqd, attr);
+        if (mqd < MQ_RING_FD_NR) {
+            mq_rings[mqd].nonblock = (flags & O_NONBLOCK) != 0;
+        }
+    }
+    return mqd;
+}
+
+int mq_close (int mqd) {
+    if ((mqd >= 0) && (mqd < MQ_RING_FD_NR)) {
+        mq_rings[mqd].ring = (mq_ring_t *)0;
+    }
+    return close(mqd);
+}
+
+int mq_unlink (const char * name) {
+    syscall_args_t args;
+    args.id = SYS_mq_unlink;
+    args.arg0 = (int)name;
+    return sys_call(&args);
+}
+
+/**
+ * @brief Put the message into the ring, sleep on head only when it's full
+ */
+static int mq_ring_send (mq_ring_fd_t * rfd, const void * msg, int len) {
+    mq_ring_t * ring = rfd->ring;
+    if ((len < 0) || (len > rfd->msgsize)) {
+        return -1;
+    }
+
+    unsigned int tail = ring->tail;
+    while (tail - ring->head >= rfd->slots) {
+        if (rfd->nonblock) {
+            return -1;
+        }
+
+        // the flag is seen by the consumer, or the head moved by it is seen here
+        __sync_lock_test_and_set(&ring->wait_send, 1);
+        unsigned int head = ring->head;
+        if (tail - head >= rfd->slots) {
+            futex(&ring->head, FUTEX_WAIT, head, (const struct timespec *)0);
+        }
+    }
+
+    char * slot = ring->data + (tail & (rfd->slots - 1)) * rfd->slot_size;
+    *(int *)slot = len;
+    memcpy(slot + sizeof(int), msg, len);
+
+    // the message is written before it's published
+    __sync_synchronize();
+    ring->tail = tail + 1;
+    if (__sync_lock_test_and_set(&ring->wait_recv, 0)) {
+        futex(&ring->tail, FUTEX_WAKE, 1, (const struct timespec *)0);
+    }
+    return 0;
+}
+
+/**
+ * @brief Take the message from the ring, sleep on tail only when it's empty
+ */
+static int mq_ring_receive (mq_ring_fd_t * rfd, void * buf, int len) {
+    mq_ring_t * ring = rfd->ring;
+    if (len < rfd->msgsize) {
+        return -1;
+    }
+
+    unsigned int head = ring->head;
+    while (ring->tail == head) {
+        if (rfd->nonblock) {
+            return -1;
+        }
+
+        __sync_lock_test_and_set(&ring->wait_recv, 1);
+        unsigned int tail = ring->tail;
+        if (tail == head) {
+            futex(&ring->tail, FUTEX_WAIT, tail, (const struct timespec *)0);
+        }
+    }
+
+    // the message is read after its tail is seen
+    __sync_synchronize();
+    char * slot = ring->data + (head & (rfd->slots - 1)) * rfd->slot_size;
+    int size = *(volatile int *)slot;
+    if ((size >= 0) && (size <= rfd->msgsize)) {
+        memcpy(buf, slot + sizeof(int), (size < len) ? size : len);
+    }
+
+    // the slot is read before it's given back
+    __sync_synchronize();
+    ring->head = head + 1;
+    if (__sync_lock_test_and_set(&ring->wait_send, 0)) {
+        futex(&ring->head, FUTEX_WAKE, 1, (const struct timespec *)0);
+    }
+
+    // the broken one is dropped, not to be seen again
+    if ((size < 0) || (size > rfd->msgsize)) {
+        return -1;
+    }
+    return (size < len) ? size : len;
+}
+
+/**
+ * @brief Send the message with prio, block until there is free space unless O_NONBLOCK is given
+ * prio is ignored by the MQ_RING queue, which is passed in user space in FIFO order
+ */
+int mq_send (int mqd, const void * msg, int len, unsigned int prio) {
+    mq_ring_fd_t * rfd = mq_ring_get(mqd);
+    if (rfd) {
+        return mq_ring_send(rfd, msg, len);
+    }
+
+    syscall_args_t args;
+    args.id = SYS_mq_send;
+    args.arg0 = mqd;
+    args.arg1 = (int)msg;
+    args.arg2 = len;
+    args.arg3 = prio;
+    return sys_call(&args);
+}
+
+/**
+ * @brief Receive the oldest message of the highest priority, block until there is one unless O_NONBLOCK
+ * buf should be able to hold msgsize bytes, return the length of the message
+ */
+int mq_receive (int mqd, void * buf, int len, unsigned int * prio) {
+    mq_ring_fd_t * rfd = mq_ring_get(mqd);
+    if (rfd) {
+        if (prio) {
+            *prio = 0;
+        }
+        return mq_ring_receive(rfd, buf, len);
+    }
+
+    syscall_args_t args;
+    args.id = SYS_mq_receive;
+    args.arg0 = mqd;
+    args.arg1 = (int)buf;
+    args.arg2 = len;
+    args.arg3 = (int)prio;
+    return sys_call(&args);
+}
+
+/**
+ * @brief Get the attributes of the queue, the ring is found again with it, e.g. after exec
+ */
+int mq_getattr (int mqd, mq_attr_t * attr) {
+    syscall_args_t args;
+    args.id = SYS_mq_getattr;
+    args.arg0 = mqd;
+    args.arg1 = (int)attr;
+    int err = sys_call(&args);
+    if (err == 0) {
+        mq_ring_set(mqd, attr);
+    }
+    return err;
+}
+
 /**
  * 判断文件描述符与tty关联
  */
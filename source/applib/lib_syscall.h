@@ -10,6 +10,13 @@
 #include "dev/tty.h"
 
 #include <sys/stat.h>
+#include <time.h>
+#include <sys/time.h>
+
+// newlib only defines it with _POSIX_MONOTONIC_CLOCK, the kernel supports it
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC         ((clockid_t) 4)
+#endif
 typedef struct _syscall_args_t {
     int id;
     int arg0;
@@ -18,14 +25,285 @@ typedef struct _syscall_args_t {
     int arg3;
 }syscall_args_t;
 
+/**
+ * CPU and scheduling usage of a task, see getrusage/task_list
+ */
+typedef struct _task_usage_t {
+    int pid;
+    int ppid;
+    char state;             // R: ready/running, B: blocked, S: sleep, W: wait child, Z: zombie
+    int cpu;                // CPU which the task is on
+    char name[32];
+    unsigned int utime;     // ticks in user mode
+    unsigned int stime;     // ticks in kernel mode
+    unsigned int nvcsw;     // voluntary context switches
+    unsigned int nivcsw;    // involuntary context switches
+    unsigned int wait_ticks;    // ticks waiting to run while ready
+    unsigned int page_faults;
+    int policy;             // SCHED_POLICY_xxx
+    unsigned int dl_misses;     // deadlines missed
+    unsigned int dl_throttles;  // times the runtime is used up in a period
+}task_usage_t;
+
+/**
+ * Scheduling class, see sched_setattr
+ * a deadline task gets runtime_ns CPU time in each period_ns, before deadline_ns from the start of period.
+ * it's throttled until the next period if the runtime is used up, and yield() gives up the rest of it
+ */
+#define SCHED_POLICY_NORMAL     0       // round robin by time slice
+#define SCHED_POLICY_DEADLINE   6       // earliest deadline first, before normal tasks
+
+typedef struct _sched_attr_t {
+    int policy;
+    unsigned int runtime_ns;
+    unsigned int deadline_ns;
+    unsigned int period_ns;
+}sched_attr_t;
+
+#define SCHED_LAT_HIST_SIZE     16      // log2 buckets of latency in us
+
+/**
+ * Latency from wakeup to run, see sched_latency
+ */
+typedef struct _sched_latency_t {
+    unsigned int count;     // number of wakeups
+    unsigned int total_us;
+    unsigned int max_us;
+    unsigned int hist[SCHED_LAT_HIST_SIZE];     // hist[i]: [2^i, 2^(i+1)) us, hist[0] includes 0, the last one is open
+}sched_latency_t;
+
+#define SCHED_EVENT_WAKEUP      1       // inserted into the ready list
+#define SCHED_EVENT_SWITCH      2       // switched to
+
+/**
+ * Scheduler trace event, see sched_trace
+ */
+typedef struct _sched_event_t {
+    unsigned long long tsc;     // time stamp counter
+    int type;
+    int pid;
+    int cpu;
+    unsigned int latency_us;    // wakeup to run latency of switch event, 0 if it was not woken up
+}sched_event_t;
+
+#define SYSCALL_STAT_ENABLE     (1 << 0)    // start counting in syscall_stat
+#define SYSCALL_STAT_DISABLE    (1 << 1)
+#define SYSCALL_STAT_RESET      (1 << 2)
+
+/**
+ * Counters of a syscall, see syscall_stat
+ */
+typedef struct _syscall_stat_t {
+    unsigned int count;
+    unsigned long long cycles;      // total TSC cycles in the handler
+    unsigned long long max_cycles;
+}syscall_stat_t;
+
+/**
+ * Syscall done by a traced task, see strace_read
+ */
+typedef struct _syscall_event_t {
+    unsigned int seq;               // increases by 1 for each event, a gap means events lost
+    int pid;
+    int id;
+    int args[4];
+    int ret;                        // 0 for exit, which doesn't return
+    unsigned int cycles;
+}syscall_event_t;
+
+#define FUTEX_WAIT              0       // sleep if the word is still the value
+#define FUTEX_WAKE              1       // wake up some of the sleepers
+
+#define SPAWN_FD_NR             3       // fds given by the fd map of spawn: stdin, stdout and stderr
+
+#define UIO_MAXIOV              16      // segments of readv/writev
+
+/**
+ * Segment of readv/writev, newlib has no sys/uio.h
+ */
+struct iovec {
+    void * iov_base;
+    size_t iov_len;
+};
+
+/**
+ * Arguments of copy_file_range, more than a syscall can take
+ * the offsets are used and updated if they're not NULL, otherwise the positions are
+ */
+typedef struct _copy_range_t {
+    int fd_in;
+    off_t * off_in;
+    int fd_out;
+    off_t * off_out;
+    int len;
+    unsigned int flags;         // must be 0
+}copy_range_t;
+
+#define POLLIN                  0x001   // data to read
+#define POLLOUT                 0x004   // writing doesn't block
+#define POLLERR                 0x008   // no reader of the pipe, always reported
+#define POLLHUP                 0x010   // no writer of the pipe, always reported
+#define POLLNVAL                0x020   // fd is not opened, always reported
+
+#define POLL_FD_MAX             16      // fds of one poll
+
+/**
+ * Fd and events of poll, newlib has no poll.h
+ */
+struct pollfd {
+    int fd;
+    short events;           // POLLIN/POLLOUT
+    short revents;          // events ready, set by poll
+};
+
+#define EPOLL_CTL_ADD           1
+#define EPOLL_CTL_DEL           2
+#define EPOLL_CTL_MOD           3
+
+/**
+ * Interest of epoll_ctl, or the ready one in epoll_wait
+ */
+struct epoll_event {
+    unsigned int events;    // POLLxxx
+    unsigned int data;      // given by the user, e.g. the fd
+};
+
+#define MQ_NAME_SIZE            16
+#define MQ_MAXMSG_DEFAULT       16      // messages in a queue if attr is not given
+#define MQ_MSGSIZE_DEFAULT      64      // bytes of a message if attr is not given
+#define MQ_PRIO_MAX             32      // priorities are 0 ~ MQ_PRIO_MAX - 1, received from high to low
+#define MQ_RING                 (1 << 0)    // attr flags, see mq_ring_t
+#define MQ_RING_FD_NR           128     // mqd of the MQ_RING queues looked up in user space, the same as the fds
+#define MQ_RING_SLOT_SIZE(msgsize)  (((msgsize) + sizeof(int) + 3) & ~3)   // length of message and data, 4 bytes aligned
+
+/**
+ * Attributes of a message queue, given to create it and returned by mq_open/mq_getattr
+ */
+typedef struct _mq_attr_t {
+    int flags;              // MQ_RING
+    int maxmsg;             // may be less than given, a queue is at most a page. Slots of the ring, power of 2
+    int msgsize;            // max bytes of a message
+    int curmsgs;            // messages in the queue
+    void * ring;            // mq_ring_t of the MQ_RING queue
+}mq_attr_t;
+
+/**
+ * Ring of the MQ_RING queue, mapped into the processes which open the queue until they close it.
+ * Messages are passed in user space by one producer and one consumer, in FIFO order without priorities.
+ * Each side moves its own index, and enters the kernel only to sleep in futex on the index
+ * of the other side, or to wake the other side up sleeping on its own one. The geometry is
+ * not kept here where every opener can write, but taken from the attributes of mq_open
+ */
+typedef struct _mq_ring_t {
+    volatile unsigned int head __attribute__((aligned(64)));   // next slot to read, moved by the consumer
+    volatile unsigned int wait_send;                            // the producer sleeps on head
+    volatile unsigned int tail __attribute__((aligned(64)));   // next slot to write, moved by the producer
+    volatile unsigned int wait_recv;                            // the consumer sleeps on tail
+    char data[] __attribute__((aligned(64)));
+}mq_ring_t;
+
+#define URING_OP_NOP            0
+#define URING_OP_READ           1       // fd, addr, len
+#define URING_OP_WRITE          2       // fd, addr, len
+#define URING_OP_OPEN           3       // addr: path, arg: flags
+#define URING_OP_CLOSE          4       // fd
+#define URING_OP_LSEEK          5       // fd, off, arg: whence
+
+#define URING_SETUP_POLL        (1 << 0)    // a kernel thread polls the submission ring
+#define URING_SQ_NEED_WAKEUP    (1 << 0)    // sq flags: the poller sleeps, wake it up in uring_enter
+#define URING_ENTER_WAKEUP      (1 << 0)    // wake up the poller
+
+/**
+ * Submission entry, the request is done as the syscall of op
+ */
+typedef struct _uring_sqe_t {
+    int op;
+    int fd;
+    int addr;
+    int len;
+    int off;
+    int arg;
+    unsigned int user_data;     // copied to the completion
+}uring_sqe_t;
+
+/**
+ * Completion entry
+ */
+typedef struct _uring_cqe_t {
+    unsigned int user_data;
+    int res;                    // return value of the syscall
+}uring_cqe_t;
+
+/**
+ * Indices of a ring, they increase freely and wrap with mask
+ * the producer moves the tail and the consumer moves the head
+ */
+typedef struct _uring_ring_t {
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    unsigned int mask;          // entries - 1
+    volatile unsigned int flags;
+}uring_ring_t;
+
+/**
+ * Submission and completion rings shared with the kernel, registered by uring_setup
+ */
+typedef struct _uring_t {
+    uring_ring_t sq;
+    uring_ring_t cq;
+    uring_sqe_t * sqes;
+    uring_cqe_t * cqes;
+    int flags;                  // URING_SETUP_xxx
+    unsigned int sqe_tail;      // entries got by uring_get_sqe, published to sq.tail by uring_submit
+}uring_t;
+
+int sys_entry_set (int fast);
 int msleep (int ms);
 int fork(void);
+int vfork(void) __attribute__((returns_twice));
+int spawn(const char *name, char * const *argv, char * const *env, const int * fd_map);
+int clone(void (*entry)(void *), void * stack, void * arg, void * tls);
+int join(int tid, int * status);
+void thread_exit (int status);
 int getpid(void);
 int yield (void);
 int execve(const char *name, char * const *argv, char * const *env);
+int uring_setup (uring_t * ring, int entries, int flags);
+ssize_t readv (int fd, const struct iovec * iov, int iovcnt);
+ssize_t writev (int fd, const struct iovec * iov, int iovcnt);
+ssize_t sendfile (int out_fd, int in_fd, off_t * offset, size_t count);
+ssize_t copy_file_range (int fd_in, off_t * off_in, int fd_out, off_t * off_out, size_t len, unsigned int flags);
+int pipe (int fds[2]);
+int pipe2 (int fds[2], int flags);
+int poll (struct pollfd * fds, int nfds, int timeout);
+int epoll_create (int size);
+int epoll_ctl (int epfd, int op, int fd, struct epoll_event * event);
+int epoll_wait (int epfd, struct epoll_event * events, int maxevents, int timeout);
+int mq_open (const char * name, int flags, mq_attr_t * attr);
+int mq_close (int mqd);
+int mq_unlink (const char * name);
+int mq_send (int mqd, const void * msg, int len, unsigned int prio);
+int mq_receive (int mqd, void * buf, int len, unsigned int * prio);
+int mq_getattr (int mqd, mq_attr_t * attr);
+int uring_enter (int to_submit, int min_complete, int flags);
 int print_msg(char * fmt, int arg);
 int wait(int* status);
 void _exit(int status);
+int task_usage (int pid, task_usage_t * usage);
+int task_list (task_usage_t * buf, int count);
+int sched_latency (int pid, sched_latency_t * latency);
+int sched_trace (sched_event_t * buf, int count);
+int syscall_stat (syscall_stat_t * buf, int count, int flags);
+int strace (int pid, int on);
+int strace_read (syscall_event_t * buf, int count, unsigned int seq);
+int futex (volatile unsigned int * uaddr, int op, unsigned int val, const struct timespec * timeout);
+int clock_gettime (clockid_t clock_id, struct timespec * tp);
+int gettimeofday (struct timeval * tv, void * tz);
+int nanosleep (const struct timespec * req, struct timespec * rem);
+int usleep (useconds_t us);
+int timer_slack (int ns);
+int sched_setattr (int pid, const sched_attr_t * attr);
+int sched_getattr (int pid, sched_attr_t * attr);
 
 int open(const char *name, int flags, ...);
 int read(int file, char *ptr, int len);
@@ -55,4 +333,60 @@ struct dirent* readdir(DIR* dir);
 int closedir(DIR *dir);
 int unlink(const char *pathname);
 
+/**
+ * Minimal pthread, threads are created by clone
+ * exit() from any thread ends only that thread, the process is gone after all of them exit
+ */
+#define PTHREAD_STACK_DEFAULT   (64*1024)   // stack size of thread if not set in attr
+
+int pthread_attr_init (pthread_attr_t * attr);
+int pthread_attr_destroy (pthread_attr_t * attr);
+int pthread_attr_setstacksize (pthread_attr_t * attr, size_t stacksize);
+int pthread_create (pthread_t * thread, const pthread_attr_t * attr, void *(*start)(void *), void * arg);
+int pthread_join (pthread_t thread, void ** value);
+void pthread_exit (void * value) __attribute__((noreturn));
+pthread_t pthread_self (void);
+int pthread_equal (pthread_t t1, pthread_t t2);
+
+int pthread_mutex_init (pthread_mutex_t * mutex, const pthread_mutexattr_t * attr);
+int pthread_mutex_destroy (pthread_mutex_t * mutex);
+int pthread_mutex_lock (pthread_mutex_t * mutex);
+int pthread_mutex_trylock (pthread_mutex_t * mutex);
+int pthread_mutex_unlock (pthread_mutex_t * mutex);
+
+int pthread_cond_init (pthread_cond_t * cond, const pthread_condattr_t * attr);
+int pthread_cond_destroy (pthread_cond_t * cond);
+int pthread_cond_wait (pthread_cond_t * cond, pthread_mutex_t * mutex);
+int pthread_cond_signal (pthread_cond_t * cond);
+int pthread_cond_broadcast (pthread_cond_t * cond);
+
+/**
+ * Counting semaphore on futex, named usem to keep apart from sem_t in the kernel
+ */
+typedef struct _usem_t {
+    volatile unsigned int count;
+    volatile unsigned int waiters;
+}usem_t;
+
+int usem_init (usem_t * sem, unsigned int value);
+int usem_wait (usem_t * sem);
+int usem_trywait (usem_t * sem);
+int usem_post (usem_t * sem);
+int usem_getvalue (usem_t * sem, int * value);
+
+/**
+ * Helpers of uring
+ */
+int uring_init (uring_t * ring, int entries, int flags);
+uring_sqe_t * uring_get_sqe (uring_t * ring);
+int uring_submit (uring_t * ring);
+uring_cqe_t * uring_peek_cqe (uring_t * ring);
+uring_cqe_t * uring_wait_cqe (uring_t * ring);
+void uring_cqe_seen (uring_t * ring);
+
+#ifndef PTHREAD_MUTEX_INITIALIZER
+#define PTHREAD_MUTEX_INITIALIZER   _PTHREAD_MUTEX_INITIALIZER
+#define PTHREAD_COND_INITIALIZER    _PTHREAD_COND_INITIALIZER
+#endif
+
 #endif //LIB_SYSCALL_H
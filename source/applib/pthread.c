@@ -0,0 +1,302 @@
+/**
+ * Minimal pthread on clone
+ *
+ * Mutex, condition variable and semaphore are words in user memory. They're changed by
+ * atomic instructions without any syscall, futex is called only to sleep under contention.
+ */
+#include "lib_syscall.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+
+#define MUTEX_UNLOCKED      0       // any value other than the two below is unlocked, including the initializer
+#define MUTEX_LOCKED        1       // nobody is waiting
+#define MUTEX_CONTENDED     2       // someone may be sleeping in futex
+
+#define COND_WAITERS        1       // bit 0 of condition variable, someone may be sleeping
+#define COND_SEQ_INC        2       // the sequence is in the other bits
+
+/**
+ * Thread control block, gs of the thread is based at it
+ */
+typedef struct _thread_t {
+    struct _thread_t * self;        // read through gs:0
+    int tid;
+    void * (*start)(void *);
+    void * arg;
+    char * stack;
+}thread_t;
+
+static thread_t main_thread;        // the task started by execve, without TLS
+
+static volatile pthread_t malloc_owner;
+static int malloc_count;
+static pthread_mutex_t malloc_mutex;
+
+int pthread_attr_init (pthread_attr_t * attr) {
+    attr->is_initialized = 1;
+    attr->stackaddr = (void *)0;
+    attr->stacksize = PTHREAD_STACK_DEFAULT;
+    attr->detachstate = PTHREAD_CREATE_JOINABLE;
+    return 0;
+}
+
+int pthread_attr_destroy (pthread_attr_t * attr) {
+    attr->is_initialized = 0;
+    return 0;
+}
+
+int pthread_attr_setstacksize (pthread_attr_t * attr, size_t stacksize) {
+    if (stacksize < 4096) {
+        return EINVAL;
+    }
+
+    attr->stacksize = stacksize;
+    return 0;
+}
+
+/**
+ * @brief Entry of thread, it never returns
+ */
+static void thread_entry (void * arg) {
+    thread_t * thread = (thread_t *)arg;
+    pthread_exit(thread->start(thread->arg));
+}
+
+int pthread_create (pthread_t * thread, const pthread_attr_t * attr, void *(*start)(void *), void * arg) {
+    int stack_size = PTHREAD_STACK_DEFAULT;
+    if (attr && attr->is_initialized) {
+        stack_size = attr->stacksize;
+    }
+    stack_size = (stack_size + 15) & ~15;
+
+    thread_t * new_thread = (thread_t *)malloc(sizeof(thread_t));
+    if (new_thread == (thread_t *)0) {
+        return EAGAIN;
+    }
+
+    new_thread->self = new_thread;
+    new_thread->start = start;
+    new_thread->arg = arg;
+    new_thread->stack = (char *)malloc(stack_size);
+    if (new_thread->stack == (char *)0) {
+        free(new_thread);
+        return EAGAIN;
+    }
+
+    int tid = clone(thread_entry, new_thread->stack + stack_size, new_thread, new_thread);
+    if (tid < 0) {
+        free(new_thread->stack);
+        free(new_thread);
+        return EAGAIN;
+    }
+
+    new_thread->tid = tid;
+    *thread = (pthread_t)new_thread;
+    return 0;
+}
+
+int pthread_join (pthread_t thread, void ** value) {
+    thread_t * curr = (thread_t *)thread;
+    if ((curr == (thread_t *)0) || (curr == &main_thread)) {
+        return ESRCH;
+    }
+
+    // the value is passed by the exit status
+    int status;
+    if (join(curr->tid, &status) < 0) {
+        return ESRCH;
+    }
+
+    if (value) {
+        *value = (void *)status;
+    }
+
+    free(curr->stack);
+    free(curr);
+    return 0;
+}
+
+void pthread_exit (void * value) {
+    thread_exit((int)value);
+    for (;;) {}
+}
+
+pthread_t pthread_self (void) {
+    // threads without TLS has the same gs as ds
+    unsigned short gs, ds;
+    __asm__ __volatile__("mov %%gs, %0\n\tmov %%ds, %1" : "=r"(gs), "=r"(ds));
+    if (gs == ds) {
+        return (pthread_t)&main_thread;
+    }
+
+    thread_t * self;
+    __asm__ __volatile__("movl %%gs:0, %0" : "=r"(self));
+    return (pthread_t)self;
+}
+
+int pthread_equal (pthread_t t1, pthread_t t2) {
+    return t1 == t2;
+}
+
+static inline int mutex_is_unlocked (pthread_mutex_t v) {
+    return (v != MUTEX_LOCKED) && (v != MUTEX_CONTENDED);
+}
+
+int pthread_mutex_init (pthread_mutex_t * mutex, const pthread_mutexattr_t * attr) {
+    *mutex = MUTEX_UNLOCKED;
+    return 0;
+}
+
+int pthread_mutex_destroy (pthread_mutex_t * mutex) {
+    return 0;
+}
+
+int pthread_mutex_lock (pthread_mutex_t * mutex) {
+    volatile pthread_mutex_t * word = (volatile pthread_mutex_t *)mutex;
+
+    // uncontended, only one atomic instruction
+    pthread_mutex_t v = *word;
+    if (mutex_is_unlocked(v) && __sync_bool_compare_and_swap(word, v, MUTEX_LOCKED)) {
+        return 0;
+    }
+
+    // mark it contended, so the owner will wake us up when it unlocks
+    if (v != MUTEX_CONTENDED) {
+        v = __sync_lock_test_and_set(word, MUTEX_CONTENDED);
+    }
+    while (!mutex_is_unlocked(v)) {
+        futex(word, FUTEX_WAIT, MUTEX_CONTENDED, (const struct timespec *)0);
+        v = __sync_lock_test_and_set(word, MUTEX_CONTENDED);
+    }
+    return 0;
+}
+
+int pthread_mutex_trylock (pthread_mutex_t * mutex) {
+    volatile pthread_mutex_t * word = (volatile pthread_mutex_t *)mutex;
+
+    pthread_mutex_t v = *word;
+    if (mutex_is_unlocked(v) && __sync_bool_compare_and_swap(word, v, MUTEX_LOCKED)) {
+        return 0;
+    }
+    return EBUSY;
+}
+
+int pthread_mutex_unlock (pthread_mutex_t * mutex) {
+    volatile pthread_mutex_t * word = (volatile pthread_mutex_t *)mutex;
+    if (__sync_lock_test_and_set(word, MUTEX_UNLOCKED) == MUTEX_CONTENDED) {
+        futex(word, FUTEX_WAKE, 1, (const struct timespec *)0);
+    }
+    return 0;
+}
+
+int pthread_cond_init (pthread_cond_t * cond, const pthread_condattr_t * attr) {
+    *cond = 0;
+    return 0;
+}
+
+int pthread_cond_destroy (pthread_cond_t * cond) {
+    return 0;
+}
+
+int pthread_cond_wait (pthread_cond_t * cond, pthread_mutex_t * mutex) {
+    volatile pthread_cond_t * word = (volatile pthread_cond_t *)cond;
+
+    // woken up by any signal after the mutex is released, spurious wakeup is allowed
+    pthread_cond_t seq = __sync_fetch_and_or(word, COND_WAITERS) | COND_WAITERS;
+
+    pthread_mutex_unlock(mutex);
+    futex(word, FUTEX_WAIT, seq, (const struct timespec *)0);
+    pthread_mutex_lock(mutex);
+    return 0;
+}
+
+int pthread_cond_signal (pthread_cond_t * cond) {
+    volatile pthread_cond_t * word = (volatile pthread_cond_t *)cond;
+
+    // without waiters, no syscall. The bit is cleared when nobody is woken up,
+    // a waiter going to sleep just then sees the word changed and returns at once
+    if (__sync_fetch_and_add(word, COND_SEQ_INC) & COND_WAITERS) {
+        if (futex(word, FUTEX_WAKE, 1, (const struct timespec *)0) == 0) {
+            __sync_fetch_and_and(word, ~COND_WAITERS);
+        }
+    }
+    return 0;
+}
+
+int pthread_cond_broadcast (pthread_cond_t * cond) {
+    volatile pthread_cond_t * word = (volatile pthread_cond_t *)cond;
+
+    if (__sync_fetch_and_add(word, COND_SEQ_INC) & COND_WAITERS) {
+        __sync_fetch_and_and(word, ~COND_WAITERS);
+        futex(word, FUTEX_WAKE, INT_MAX, (const struct timespec *)0);
+    }
+    return 0;
+}
+
+int usem_init (usem_t * sem, unsigned int value) {
+    sem->count = value;
+    sem->waiters = 0;
+    return 0;
+}
+
+int usem_trywait (usem_t * sem) {
+    unsigned int count = sem->count;
+    while (count) {
+        unsigned int old = __sync_val_compare_and_swap(&sem->count, count, count - 1);
+        if (old == count) {
+            return 0;
+        }
+        count = old;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+int usem_wait (usem_t * sem) {
+    if (usem_trywait(sem) == 0) {
+        return 0;
+    }
+
+    // sleep only while the count is 0, post wakes up one waiter after increasing it
+    __sync_fetch_and_add(&sem->waiters, 1);
+    while (usem_trywait(sem) < 0) {
+        futex(&sem->count, FUTEX_WAIT, 0, (const struct timespec *)0);
+    }
+    __sync_fetch_and_sub(&sem->waiters, 1);
+    return 0;
+}
+
+int usem_post (usem_t * sem) {
+    __sync_fetch_and_add(&sem->count, 1);
+    if (sem->waiters) {
+        futex(&sem->count, FUTEX_WAKE, 1, (const struct timespec *)0);
+    }
+    return 0;
+}
+
+int usem_getvalue (usem_t * sem, int * value) {
+    *value = (int)sem->count;
+    return 0;
+}
+
+/**
+ * @brief Lock of newlib malloc, the heap is shared by threads
+ * it's recursive, malloc may be entered again by the same thread
+ */
+void __malloc_lock (struct _reent * reent) {
+    pthread_t self = pthread_self();
+    if (malloc_owner != self) {
+        pthread_mutex_lock(&malloc_mutex);
+        malloc_owner = self;
+    }
+    malloc_count++;
+}
+
+void __malloc_unlock (struct _reent * reent) {
+    if (--malloc_count == 0) {
+        malloc_owner = 0;
+        pthread_mutex_unlock(&malloc_mutex);
+    }
+}
@@ -0,0 +1,113 @@
+/**
+ * Helpers of the submission and completion rings
+ *
+ * Entries are got and filled one by one, then published together by uring_submit.
+ * In the polled mode, the kernel is entered only when the poller sleeps.
+ */
+#include "lib_syscall.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Allocate the rings and register them
+ */
+int uring_init (uring_t * ring, int entries, int flags) {
+    memset(ring, 0, sizeof(uring_t));
+    ring->sqes = (uring_sqe_t *)malloc(sizeof(uring_sqe_t) * entries);
+    ring->cqes = (uring_cqe_t *)malloc(sizeof(uring_cqe_t) * entries);
+    if (!ring->sqes || !ring->cqes) {
+        goto init_failed;
+    }
+
+    if (uring_setup(ring, entries, flags) < 0) {
+        goto init_failed;
+    }
+    return 0;
+
+init_failed:
+    free(ring->sqes);
+    free(ring->cqes);
+    ring->sqes = (uring_sqe_t *)0;
+    ring->cqes = (uring_cqe_t *)0;
+    return -1;
+}
+
+/**
+ * Get a free submission entry, NULL if the sq is full
+ */
+uring_sqe_t * uring_get_sqe (uring_t * ring) {
+    unsigned int tail = ring->sqe_tail;
+    if (tail - ring->sq.head > ring->sq.mask) {
+        return (uring_sqe_t *)0;
+    }
+
+    uring_sqe_t * sqe = ring->sqes + (tail & ring->sq.mask);
+    memset(sqe, 0, sizeof(uring_sqe_t));
+    ring->sqe_tail = tail + 1;
+    return sqe;
+}
+
+/**
+ * Publish the entries got, return the number of them
+ */
+int uring_submit (uring_t * ring) {
+    int count = ring->sqe_tail - ring->sq.tail;
+
+    // the entries must be seen before the tail
+    __asm__ __volatile__("":::"memory");
+    ring->sq.tail = ring->sqe_tail;
+
+    if (ring->flags & URING_SETUP_POLL) {
+        // pairs with the poller setting the flag and checking the tail
+        __sync_synchronize();
+        if (ring->sq.flags & URING_SQ_NEED_WAKEUP) {
+            uring_enter(0, 0, URING_ENTER_WAKEUP);
+        }
+        return count;
+    }
+
+    // the ones left last time when the cq was full are done first
+    uring_enter(ring->sq.tail - ring->sq.head, 0, 0);
+    return count;
+}
+
+/**
+ * Get the first completion, NULL if there is none
+ */
+uring_cqe_t * uring_peek_cqe (uring_t * ring) {
+    unsigned int head = ring->cq.head;
+    if (head == ring->cq.tail) {
+        return (uring_cqe_t *)0;
+    }
+
+    __asm__ __volatile__("":::"memory");
+    return ring->cqes + (head & ring->cq.mask);
+}
+
+/**
+ * Wait for the first completion, NULL if nothing submitted is left
+ */
+uring_cqe_t * uring_wait_cqe (uring_t * ring) {
+    uring_cqe_t * cqe;
+    while ((cqe = uring_peek_cqe(ring)) == (uring_cqe_t *)0) {
+        // each request submitted has one completion
+        if (ring->sq.tail == ring->cq.head) {
+            return (uring_cqe_t *)0;
+        }
+
+        if (ring->flags & URING_SETUP_POLL) {
+            uring_enter(0, 1, 0);
+        } else {
+            uring_enter(ring->sq.tail - ring->sq.head, 0, 0);
+        }
+    }
+    return cqe;
+}
+
+/**
+ * The first completion is taken, give the entry back to the kernel
+ */
+void uring_cqe_seen (uring_t * ring) {
+    __asm__ __volatile__("":::"memory");
+    ring->cq.head++;
+}
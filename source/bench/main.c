@@ -0,0 +1,391 @@
+/**
+ * Micro benchmarks of the kernel, print the average cost of one iteration
+ * Usage: bench [-n count] [-w width] [test ...]
+ * tests:
+ *  fork: fork a child which exits at once, then wait it
+ *  vfork: the same with vfork
+ *  bomb: fork width children at once, then wait all of them
+ *  getpid: getpid through the default system call entry (SYSENTER if supported)
+ *  gate: getpid through the call gate
+ *  uring: nop requests in batches of width through the rings, in a child process
+ *  upoll: the same with the polled rings
+ *  pipe: send one page through a pipe to a child, which reads it into a page aligned buffer
+ *  mutex: lock and unlock a mutex nobody else uses, no syscall is needed
+ *  pingpong: two threads pass the turn to each other by a mutex and condition variable
+ *  mq: send a message through a message queue to a child, by the system calls
+ *  mqring: the same through the ring of the queue in user space
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include "lib_syscall.h"
+#include "main.h"
+
+/**
+ * Get the time in us, 32 bits is enough for a test
+ */
+static uint32_t now_us (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int bench_fork (int count, int width, uint32_t * us) {
+    for (int i = 0; i < count; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            return -1;
+        } else if (pid == 0) {
+            _exit(0);
+        }
+
+        int status;
+        wait(&status);
+    }
+    return count;
+}
+
+static int bench_vfork (int count, int width, uint32_t * us) {
+    for (int i = 0; i < count; i++) {
+        int pid = vfork();
+        if (pid < 0) {
+            return -1;
+        } else if (pid == 0) {
+            _exit(0);
+        }
+
+        int status;
+        wait(&status);
+    }
+    return count;
+}
+
+static int bench_bomb (int count, int width, uint32_t * us) {
+    int total = 0;
+    for (int i = 0; i < count; i += width) {
+        int forked = 0;
+        for (int j = 0; (j < width) && (i + j < count); j++) {
+            int pid = fork();
+            if (pid < 0) {
+                break;
+            } else if (pid == 0) {
+                _exit(0);
+            }
+            forked++;
+        }
+
+        for (int j = 0; j < forked; j++) {
+            int status;
+            wait(&status);
+        }
+
+        // out of task structs, nothing more can be done
+        if (forked == 0) {
+            return -1;
+        }
+        total += forked;
+    }
+    return total;
+}
+
+static int bench_getpid (int count, int width, uint32_t * us) {
+    for (int i = 0; i < count; i++) {
+        getpid();
+    }
+    return count;
+}
+
+static int bench_gate (int count, int width, uint32_t * us) {
+    int old = sys_entry_set(0);
+    bench_getpid(count, width, us);
+    sys_entry_set(old);
+    return count;
+}
+
+/**
+ * Run the requests in a child, as the rings can be set up only once in a process
+ * the child passes the time back in the exit status
+ */
+static int run_uring (int count, int width, uint32_t * us, int flags) {
+    int pid = fork();
+    if (pid < 0) {
+        return -1;
+    } else if (pid == 0) {
+        uring_t ring;
+        if (uring_init(&ring, URING_ENTRIES, flags) < 0) {
+            _exit(-1);
+        }
+
+        if (width > URING_ENTRIES) {
+            width = URING_ENTRIES;
+        }
+
+        uint32_t start = now_us();
+        for (int i = 0; i < count; i += width) {
+            int batch = 0;
+            for (; (batch < width) && (i + batch < count); batch++) {
+                uring_sqe_t * sqe = uring_get_sqe(&ring);
+                sqe->op = URING_OP_NOP;
+                sqe->user_data = i + batch;
+            }
+            uring_submit(&ring);
+
+            for (int j = 0; j < batch; j++) {
+                if (uring_wait_cqe(&ring) == (uring_cqe_t *)0) {
+                    _exit(-1);
+                }
+                uring_cqe_seen(&ring);
+            }
+        }
+        _exit(now_us() - start);
+    }
+
+    int status;
+    wait(&status);
+    if (status < 0) {
+        return -1;
+    }
+
+    *us = status;
+    return count;
+}
+
+static int bench_uring (int count, int width, uint32_t * us) {
+    return run_uring(count, width, us, 0);
+}
+
+static int bench_upoll (int count, int width, uint32_t * us) {
+    return run_uring(count, width, us, URING_SETUP_POLL);
+}
+
+static char pipe_buf[BENCH_PAGE_SIZE] __attribute__((aligned(BENCH_PAGE_SIZE)));
+
+static int bench_pipe (int count, int width, uint32_t * us) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        return -1;
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    } else if (pid == 0) {
+        close(fds[1]);
+        while (read(fds[0], pipe_buf, sizeof(pipe_buf)) > 0) {}
+        _exit(0);
+    }
+
+    close(fds[0]);
+    int done = 0;
+    for (; done < count; done++) {
+        if (write(fds[1], pipe_buf, sizeof(pipe_buf)) != sizeof(pipe_buf)) {
+            break;
+        }
+    }
+    close(fds[1]);
+
+    int status;
+    wait(&status);
+    return done;
+}
+
+static int bench_mutex (int count, int width, uint32_t * us) {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+    return count;
+}
+
+static pthread_mutex_t pp_mutex;
+static pthread_cond_t pp_cond;
+static volatile int pp_turn;
+static int pp_count;
+
+/**
+ * Wait for the turn of me, then give it to the other
+ */
+static void * pingpong_entry (void * arg) {
+    int me = (int)arg;
+    for (int i = 0; i < pp_count; i++) {
+        pthread_mutex_lock(&pp_mutex);
+        while (pp_turn != me) {
+            pthread_cond_wait(&pp_cond, &pp_mutex);
+        }
+        pp_turn = !me;
+        pthread_cond_signal(&pp_cond);
+        pthread_mutex_unlock(&pp_mutex);
+    }
+    return (void *)0;
+}
+
+static int bench_pingpong (int count, int width, uint32_t * us) {
+    pthread_mutex_init(&pp_mutex, (const pthread_mutexattr_t *)0);
+    pthread_cond_init(&pp_cond, (const pthread_condattr_t *)0);
+    pp_turn = 0;
+    pp_count = count;
+
+    pthread_t thread;
+    if (pthread_create(&thread, (const pthread_attr_t *)0, pingpong_entry, (void *)1) != 0) {
+        return -1;
+    }
+    pingpong_entry((void *)0);
+    pthread_join(thread, (void **)0);
+    return count;
+}
+
+/**
+ * Send count messages to a child, which receives until an empty one comes
+ */
+static int run_mq (int count, int flags) {
+    static char msg[BENCH_MSG_SIZE];
+    mq_attr_t attr = {flags, BENCH_MQ_MAXMSG, BENCH_MSG_SIZE, 0, (void *)0};
+
+    mq_unlink(BENCH_MQ_NAME);
+    int mqd = mq_open(BENCH_MQ_NAME, O_CREAT | O_EXCL | O_RDWR, &attr);
+    if (mqd < 0) {
+        return -1;
+    }
+    mq_unlink(BENCH_MQ_NAME);
+
+    int pid = fork();
+    if (pid < 0) {
+        mq_close(mqd);
+        return -1;
+    } else if (pid == 0) {
+        while (mq_receive(mqd, msg, sizeof(msg), (unsigned int *)0) > 0) {}
+        _exit(0);
+    }
+
+    int done = 0;
+    for (; done < count; done++) {
+        if (mq_send(mqd, msg, sizeof(msg), 0) < 0) {
+            break;
+        }
+    }
+    mq_send(mqd, msg, 0, 0);
+
+    int status;
+    wait(&status);
+    mq_close(mqd);
+    return done;
+}
+
+static int bench_mq (int count, int width, uint32_t * us) {
+    return run_mq(count, 0);
+}
+
+static int bench_mqring (int count, int width, uint32_t * us) {
+    return run_mq(count, MQ_RING);
+}
+
+/**
+ * A test returns the iterations done, and may set us if only part of it is timed
+ */
+typedef struct _bench_t {
+    const char * name;
+    int (*run)(int count, int width, uint32_t * us);
+}bench_t;
+
+static const bench_t bench_list[] = {
+    {"fork", bench_fork},
+    {"vfork", bench_vfork},
+    {"bomb", bench_bomb},
+    {"getpid", bench_getpid},
+    {"gate", bench_gate},
+    {"uring", bench_uring},
+    {"upoll", bench_upoll},
+    {"pipe", bench_pipe},
+    {"mutex", bench_mutex},
+    {"pingpong", bench_pingpong},
+    {"mq", bench_mq},
+    {"mqring", bench_mqring},
+};
+
+static int run_bench (const bench_t * bench, int count, int width) {
+    uint32_t us = 0;
+    uint32_t start = now_us();
+    int done = bench->run(count, width, &us);
+    uint32_t elapsed = us ? us : now_us() - start;
+    if (done <= 0) {
+        fprintf(stderr, "%s: failed\n", bench->name);
+        return -1;
+    }
+
+    printf("%-8s %8d iterations %10u us %8u ns/iter\n", bench->name, done, elapsed,
+            elapsed / done * 1000 + elapsed % done * 1000 / done);
+    return 0;
+}
+
+int main (int argc, char ** argv) {
+    int count = BENCH_COUNT_DEFAULT;
+    int width = BENCH_WIDTH_DEFAULT;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "n:w:h")) != -1) {
+        switch (ch) {
+            case 'h':
+                puts("kernel micro benchmarks");
+                puts("Usage: bench [-n count] [-w width] [test ...]");
+                for (int i = 0; i < sizeof(bench_list) / sizeof(bench_list[0]); i++) {
+                    printf("    %s\n", bench_list[i].name);
+                }
+                optind = 1;        // getopt need to be reset
+                return 0;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case '?':
+                if (optarg) {
+                    fprintf(stderr, "Unknown option: -%s\n", optarg);
+                }
+                optind = 1;
+                return -1;
+        }
+    }
+
+    if ((count <= 0) || (width <= 0)) {
+        fprintf(stderr, "count and width must be positive\n");
+        optind = 1;
+        return -1;
+    }
+
+    // run all if none is given
+    int err = 0;
+    if (optind >= argc) {
+        for (int i = 0; i < sizeof(bench_list) / sizeof(bench_list[0]); i++) {
+            err |= run_bench(bench_list + i, count, width);
+        }
+        optind = 1;
+        return err ? -1 : 0;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        const bench_t * bench = (const bench_t *)0;
+        for (int j = 0; j < sizeof(bench_list) / sizeof(bench_list[0]); j++) {
+            if (strcmp(argv[i], bench_list[j].name) == 0) {
+                bench = bench_list + j;
+                break;
+            }
+        }
+
+        if (bench == (const bench_t *)0) {
+            fprintf(stderr, "unknown test: %s\n", argv[i]);
+            err = -1;
+            continue;
+        }
+        err |= run_bench(bench, count, width);
+    }
+
+    optind = 1;
+    return err ? -1 : 0;
+}
@@ -0,0 +1,15 @@
+/**
+ * Micro benchmarks of the kernel
+ */
+#ifndef MAIN_H
+#define MAIN_H
+
+#define BENCH_COUNT_DEFAULT     1000        // iterations of each test
+#define BENCH_WIDTH_DEFAULT     16          // children alive at the same time in bomb test, or requests in a batch
+#define URING_ENTRIES           64          // entries of the rings
+#define BENCH_PAGE_SIZE         4096        // bytes sent through pipe in one iteration
+#define BENCH_MSG_SIZE          64          // bytes of a message sent through the queue
+#define BENCH_MQ_MAXMSG         16          // messages in the queue
+#define BENCH_MQ_NAME           "bench"
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * Clock data shared by kernel and applications
+ * The kernel fills the time page once at boot, processes read it directly with rdtsc
+ * Only 32 bit division is used, there's no libgcc for the 64 bit one
+ */
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "types.h"
+#include "cpu_instr.h"
+
+#define TIME_PAGE_MAGIC         0x454D4954      // "TIME"
+#define CLOCK_SHIFT             20              // ns = cycles * mult >> shift
+#define NSEC_PER_SEC            1000000000
+#define NSEC_PER_USEC           1000
+
+/**
+ * Time page, mapped read only into every process
+ */
+typedef struct _time_page_t {
+    uint32_t magic;             // TIME_PAGE_MAGIC if it's valid
+    uint32_t mult;              // ns per cycle, scaled by 2^shift
+    uint32_t shift;
+    uint64_t tsc_base;          // TSC at monotonic clock 0
+    uint32_t boot_sec;          // wall clock at monotonic clock 0, seconds since 1970
+}time_page_t;
+
+/**
+ * @brief 64 bit divided by 32 bit, with divl
+ */
+static inline uint64_t clock_div64 (uint64_t n, uint32_t d, uint32_t * rem) {
+    uint32_t high = (uint32_t)(n >> 32);
+    uint32_t low = (uint32_t)n;
+    uint32_t q_high = 0, r;
+
+    // divl faults if the quotient doesn't fit in 32 bits
+    if (high >= d) {
+        q_high = high / d;
+        high %= d;
+    }
+    __asm__("divl %[d]":"=a"(low), "=d"(r):"a"(low), "d"(high), [d]"r"(d));
+
+    if (rem) {
+        *rem = r;
+    }
+    return ((uint64_t)q_high << 32) | low;
+}
+
+/**
+ * @brief Convert TSC cycles to ns, with two 32x32 multiplications
+ */
+static inline uint64_t clock_cyc2ns (uint64_t cycles, uint32_t mult, uint32_t shift) {
+    uint64_t low = (uint64_t)(uint32_t)cycles * mult;
+    uint64_t high = (uint64_t)(uint32_t)(cycles >> 32) * mult;
+    return (high << (32 - shift)) + (low >> shift);
+}
+
+/**
+ * @brief Monotonic time in ns from the time page
+ */
+static inline uint64_t clock_page_ns (const volatile time_page_t * page) {
+    return clock_cyc2ns(rdtsc() - page->tsc_base, page->mult, page->shift);
+}
+
+#endif // CLOCK_H
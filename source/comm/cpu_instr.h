@@ -112,6 +112,78 @@ static inline void write_tr (uint32_t tss_selector) {
     __asm__ __volatile__("ltr %%ax"::"a"(tss_selector));
 }
 
+static inline uint16_t read_tr (void) {
+    uint16_t tss_selector;
+    __asm__ __volatile__("str %[v]":[v]"=r"(tss_selector));
+    return tss_selector;
+}
+
+static inline uint32_t xchg (volatile uint32_t * addr, uint32_t new_value) {
+    uint32_t result;
+
+    // the lock prefix is implied by xchg when one operand is in memory
+    __asm__ __volatile__("xchgl %[v], %[m]"
+            :[m]"+m"(*addr), [v]"=a"(result)
+            :"1"(new_value)
+            :"memory");
+    return result;
+}
+
+static inline void cpu_pause (void) {
+    __asm__ __volatile__("pause");
+}
+
+static inline void cpu_barrier (void) {
+    __asm__ __volatile__("":::"memory");
+}
+
+static inline void clts (void) {
+    __asm__ __volatile__("clts");
+}
+
+static inline void cpuid (uint32_t leaf, uint32_t * eax, uint32_t * ebx, uint32_t * ecx, uint32_t * edx) {
+    __asm__ __volatile__("cpuid"
+            :"=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+            :"a"(leaf), "c"(0));
+}
+
+/**
+ * SYSENTER/SYSEXIT is supported, early Pentium Pro reports SEP without having it
+ */
+static inline int cpu_has_sysenter (void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1 << 11))) {
+        return 0;
+    }
+
+    uint32_t family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    return !((family == 6) && (model < 3) && (stepping < 3));
+}
+
+static inline uint64_t read_msr (uint32_t msr) {
+    uint64_t value;
+
+    __asm__ __volatile__("rdmsr":"=A"(value):"c"(msr));
+    return value;
+}
+
+static inline void write_msr (uint32_t msr, uint64_t value) {
+    __asm__ __volatile__("wrmsr"::"c"(msr), "A"(value));
+}
+
+static inline uint64_t rdtsc (void) {
+    uint64_t tsc;
+
+    __asm__ __volatile__("rdtsc":"=A"(tsc));
+    return tsc;
+}
+
+static inline void invlpg (uint32_t vaddr) {
+    __asm__ __volatile__("invlpg (%[v])"::[v]"r"(vaddr):"memory");
+}
+
 static inline uint32_t read_eflags (void) {
     uint32_t eflags;
 
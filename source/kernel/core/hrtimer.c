@@ -0,0 +1,154 @@
+/**
+ * High resolution timer
+ * The timers are sorted by expiry. The one-shot device is programmed at the earliest
+ * latest time, min(expires + slack), and all timers expired by then run in that interrupt.
+ * Without a one-shot device, the timers are checked in each tick.
+ */
+#include "core/hrtimer.h"
+#include "dev/time.h"
+#include "ipc/spinlock.h"
+#include "comm/cpu_instr.h"
+
+#define HRTIMER_NONE            ((uint64_t)-1)
+
+static list_t timer_list;                   // pending timers, the earliest first
+static spinlock_t timer_lock;
+static uint64_t next_event;                 // time the device is programmed at, HRTIMER_NONE if not
+static hrtimer_t * volatile timer_running;  // the timer whose function is running
+
+/**
+ * @brief Init timer
+ */
+void hrtimer_init (hrtimer_t * timer, hrtimer_func_t func, void * data) {
+    timer->expires = 0;
+    timer->slack = 0;
+    timer->func = func;
+    timer->data = data;
+    timer->pending = 0;
+    list_node_init(&timer->node);
+}
+
+/**
+ * @brief Find the latest time the first timers can wait to, the lock should be held
+ * the list is sorted by expiry, so the later ones can't be earlier than the result
+ */
+static uint64_t hrtimer_next_event (void) {
+    uint64_t next = HRTIMER_NONE;
+
+    for (list_node_t * node = list_first(&timer_list); node; node = list_node_next(node)) {
+        hrtimer_t * timer = list_node_parent(node, hrtimer_t, node);
+        if (timer->expires >= next) {
+            break;
+        }
+
+        uint64_t latest = timer->expires + timer->slack;
+        if (latest < next) {
+            next = latest;
+        }
+    }
+
+    return next;
+}
+
+/**
+ * @brief Program the device for the first timers, the lock should be held
+ */
+static void hrtimer_reprogram (uint64_t now) {
+    next_event = hrtimer_next_event();
+    if (next_event == HRTIMER_NONE) {
+        return;
+    }
+
+    // it may have passed, fire it as soon as possible
+    time_set_oneshot(next_event > now ? next_event - now : 0);
+}
+
+/**
+ * @brief Start the timer, it's restarted if pending
+ */
+void hrtimer_start (hrtimer_t * timer, uint64_t expires, uint32_t slack) {
+    irq_state_t state = spin_lock_protect(&timer_lock);
+    if (timer->pending) {
+        list_remove(&timer_list, &timer->node);
+    }
+
+    timer->expires = expires;
+    timer->slack = slack;
+    timer->pending = 1;
+
+    // after the timers with the same or earlier expiry
+    list_node_t * pos = list_first(&timer_list);
+    while (pos && (list_node_parent(pos, hrtimer_t, node)->expires <= expires)) {
+        pos = list_node_next(pos);
+    }
+    list_insert_before(&timer_list, pos, &timer->node);
+
+    // the device already fires before it's required
+    if (expires + slack < next_event) {
+        hrtimer_reprogram(time_ns());
+    }
+    spin_unlock_protect(&timer_lock, state);
+}
+
+/**
+ * @brief Stop the timer, and wait if its function is running on other CPU
+ * it can't be called in the function of the timer itself
+ */
+void hrtimer_cancel (hrtimer_t * timer) {
+    irq_state_t state = spin_lock_protect(&timer_lock);
+    if (timer->pending) {
+        list_remove(&timer_list, &timer->node);
+        timer->pending = 0;
+    }
+    spin_unlock_protect(&timer_lock, state);
+
+    // the device is left programmed, it only causes an interrupt with nothing to do
+    while (timer_running == timer) {
+        cpu_pause();
+    }
+}
+
+/**
+ * @brief Run the expired timers, called in the timer interrupt
+ */
+void hrtimer_interrupt (void) {
+    irq_state_t state = spin_lock_protect(&timer_lock);
+
+    uint64_t now = time_ns();
+    for (;;) {
+        list_node_t * node = list_first(&timer_list);
+        if (node == (list_node_t *)0) {
+            break;
+        }
+
+        hrtimer_t * timer = list_node_parent(node, hrtimer_t, node);
+        if (timer->expires > now) {
+            break;
+        }
+
+        // run without the lock, the timer may be started again in its function
+        list_remove_first(&timer_list);
+        timer->pending = 0;
+        timer_running = timer;
+        spin_unlock(&timer_lock);
+
+        timer->func(timer);
+
+        spin_lock(&timer_lock);
+        timer_running = (hrtimer_t *)0;
+        now = time_ns();
+    }
+
+    hrtimer_reprogram(now);
+    spin_unlock_protect(&timer_lock, state);
+}
+
+/**
+ * @brief Init the timer list
+ */
+void hrtimer_module_init (void) {
+    list_init(&timer_list);
+    spin_init(&timer_lock);
+    next_event = HRTIMER_NONE;
+    timer_running = (hrtimer_t *)0;
+}
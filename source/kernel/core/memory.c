@@ -7,9 +7,16 @@
 #include "tools/klib.h"
 #include "cpu/mmu.h"
 #include "dev/console.h"
+#include "ipc/spinlock.h"
 
 static addr_alloc_t paddr_alloc;        // physical address allocation structure
 static pde_t kernel_page_dir[PDE_CNT] __attribute__((aligned(MEM_PAGE_SIZE))); // kernel page dir
+static uint32_t mmio_next = MEM_MMIO_START;     // next free address in the MMIO window
+
+// page dirs of exited processes, the kernel half is kept and the user half is clear
+static uint32_t uvm_cache[MEM_UVM_CACHE_NR];
+static int uvm_cache_count;
+static spinlock_t uvm_cache_lock;
 
 /**
  * @brief Retrieve current page table address
@@ -152,6 +159,10 @@ void create_kernel_table (void) {
         {s_data,        (void *)(MEM_EBDA_START - 1),   s_data,        PTE_W},      // kernel data
         {(void *)CONSOLE_DISP_ADDR, (void *)(CONSOLE_DISP_END - 1), (void *)CONSOLE_VIDEO_BASE, PTE_W},
 
+        // EBDA and BIOS ROM, read only, where the MP configuration tables are searched for
+        {(void *)MEM_EBDA_START, (void *)(MEM_EBDA_END - 1), (void *)MEM_EBDA_START, 0},
+        {(void *)MEM_BIOS_START, (void *)(MEM_EXT_START - 1), (void *)MEM_BIOS_START, 0},
+
         // expanding the storage space with one-to-one mapping for easy direct manipulation
         {(void *)MEM_EXT_START, (void *)MEM_EXT_END,     (void *)MEM_EXT_START, PTE_W},
     };
@@ -171,6 +182,60 @@ void create_kernel_table (void) {
 
         memory_create_map(kernel_page_dir, vstart, (uint32_t)map->pstart, page_count, map->perm);
     }
+
+    // create the page table of MMIO window now, so that later mappings are shared by all processes
+    find_pte(kernel_page_dir, MEM_MMIO_START, 1);
+}
+
+/**
+ * @brief Map device registers into the kernel MMIO window, uncached
+ * must be called before any process is created
+ */
+uint32_t memory_map_mmio (uint32_t paddr, uint32_t size) {
+    uint32_t pstart = down2(paddr, MEM_PAGE_SIZE);
+    uint32_t pend = up2(paddr + size, MEM_PAGE_SIZE);
+    uint32_t vaddr = mmio_next;
+
+    if (vaddr + (pend - pstart) > MEM_MMIO_START + MEM_MMIO_SIZE) {
+        log_printf("mmio window is full. paddr = 0x%x", paddr);
+        return 0;
+    }
+
+    int err = memory_create_map(kernel_page_dir, vaddr, pstart, (pend - pstart) / MEM_PAGE_SIZE, PTE_W | PTE_PCD);
+    if (err < 0) {
+        return 0;
+    }
+
+    mmio_next += pend - pstart;
+    return vaddr + (paddr - pstart);
+}
+
+/**
+ * @brief Allocate a page mapped at vaddr in all processes, read only for user
+ * the kernel writes it through the returned physical address. It's in kernel space,
+ * so it's neither copied nor freed with the process. Must be called before any process is created
+ */
+uint32_t memory_alloc_shared_page (uint32_t vaddr) {
+    uint32_t page = addr_alloc_page(&paddr_alloc, 1);
+    if (page == 0) {
+        return 0;
+    }
+    kernel_memset((void *)page, 0, MEM_PAGE_SIZE);
+
+    int err = memory_create_map(kernel_page_dir, vaddr, page, 1, PTE_U);
+    if (err < 0) {
+        addr_free_page(&paddr_alloc, page, 1);
+        return 0;
+    }
+
+    return page;
+}
+
+/**
+ * @brief Page table of kernel, used by kernel threads which have no user space
+ */
+uint32_t memory_kernel_page_dir (void) {
+    return (uint32_t)kernel_page_dir;
 }
 
 /**
@@ -178,6 +243,17 @@ void create_kernel_table (void) {
  * The main task is to create a page directory table and then copy a portion from the kernel page table
  */
 uint32_t memory_create_uvm (void) {
+    // reuse a cached one, it's ready to use
+    uint32_t cached = 0;
+    irq_state_t state = spin_lock_protect(&uvm_cache_lock);
+    if (uvm_cache_count > 0) {
+        cached = uvm_cache[--uvm_cache_count];
+    }
+    spin_unlock_protect(&uvm_cache_lock, state);
+    if (cached) {
+        return cached;
+    }
+
     pde_t * page_dir = (pde_t *)addr_alloc_page(&paddr_alloc, 1);
     if (page_dir == 0) {
         return 0;
@@ -212,7 +288,7 @@ void memory_destroy_uvm (uint32_t page_dir) {
         // free the physical pages corresponding to the page table and the page table itself.
         pte_t * pte = (pte_t *)pde_paddr(pde);
         for (int j = 0; j < PTE_CNT; j++, pte++) {
-            if (!pte->present) {
+            if (!pte->present || (pte->v & PTE_SHARED)) {
                 continue;
             }
 
@@ -220,10 +296,21 @@ void memory_destroy_uvm (uint32_t page_dir) {
         }
 
         addr_free_page(&paddr_alloc, (uint32_t)pde_paddr(pde), 1);
+        pde->v = 0;
     }
 
+    // only the user half was changed, keep the page dir for the next process
+    irq_state_t state = spin_lock_protect(&uvm_cache_lock);
+    if (uvm_cache_count < MEM_UVM_CACHE_NR) {
+        uvm_cache[uvm_cache_count++] = page_dir;
+        page_dir = 0;
+    }
+    spin_unlock_protect(&uvm_cache_lock, state);
+
     // page dir table
-    addr_free_page(&paddr_alloc, page_dir, 1);
+    if (page_dir) {
+        addr_free_page(&paddr_alloc, page_dir, 1);
+    }
 }
 
 /**
@@ -253,6 +340,16 @@ uint32_t memory_copy_uvm (uint32_t page_dir) {
                 continue;
             }
 
+            // shared page, map the same one
+            uint32_t vaddr = (i << 22) | (j << 12);
+            if (pte->v & PTE_SHARED) {
+                int err = memory_create_map((pde_t *)to_page_dir, vaddr, pte_paddr(pte), 1, get_pte_perm(pte) | PTE_SHARED);
+                if (err < 0) {
+                    goto copy_uvm_failed;
+                }
+                continue;
+            }
+
             // allocate the physical memory
             uint32_t page = addr_alloc_page(&paddr_alloc, 1);
             if (page == 0) {
@@ -260,7 +357,6 @@ uint32_t memory_copy_uvm (uint32_t page_dir) {
             }
 
             // build mapping
-            uint32_t vaddr = (i << 22) | (j << 12);
             int err = memory_create_map((pde_t *)to_page_dir, vaddr, page, 1, get_pte_perm(pte));
             if (err < 0) {
                 goto copy_uvm_failed;
@@ -276,7 +372,7 @@ copy_uvm_failed:
     if (to_page_dir) {
         memory_destroy_uvm(to_page_dir);
     }
-    return -1;
+    return 0;
 }
 
 /**
@@ -387,6 +483,74 @@ void memory_free_page (uint32_t addr) {
     }
 }
 
+/**
+ * @brief Allocate count contiguous pages in the kernel space, e.g. a buffer of whole clusters
+ */
+uint32_t memory_alloc_pages (int count) {
+    return addr_alloc_page(&paddr_alloc, count);
+}
+
+/**
+ * @brief Release the pages of memory_alloc_pages
+ */
+void memory_free_pages (uint32_t addr, int count) {
+    addr_free_page(&paddr_alloc, addr, count);
+}
+
+/**
+ * @brief Map the kernel page at the page aligned user address vaddr of current task
+ * return the page mapped before, which is owned by the caller now, or 0 if vaddr is not a writable user page
+ * other CPUs may cache the old mapping, only for the processes with one thread
+ * the shared pages are not owned by the process, they're never swapped
+ */
+uint32_t memory_swap_page (uint32_t vaddr, uint32_t page) {
+    if ((vaddr < MEMORY_TASK_BASE) || (vaddr & (MEM_PAGE_SIZE - 1)) || (vaddr >= MEM_MQ_RING_START)) {
+        return 0;
+    }
+
+    pte_t * pte = find_pte(current_page_dir(), vaddr, 0);
+    if ((pte == (pte_t *)0) || !pte->present || !(pte->v & PTE_W) || !(pte->v & PTE_U) || (pte->v & PTE_SHARED)) {
+        return 0;
+    }
+
+    uint32_t old = pte_paddr(pte);
+    pte->v = page | get_pte_perm(pte);
+    invlpg(vaddr);
+    return old;
+}
+
+/**
+ * @brief Map the kernel page at the page aligned user address vaddr of current task, shared with others
+ * it's neither copied nor freed with the process, the owner frees it after all the users unmap it
+ */
+int memory_map_shared_page (uint32_t vaddr, uint32_t page, uint32_t perm) {
+    if ((vaddr < MEMORY_TASK_BASE) || (vaddr & (MEM_PAGE_SIZE - 1))) {
+        return -1;
+    }
+
+    // mapped already, e.g. opened twice
+    pte_t * pte = find_pte(current_page_dir(), vaddr, 0);
+    if (pte && pte->present) {
+        return ((pte->v & PTE_SHARED) && (pte_paddr(pte) == page)) ? 0 : -1;
+    }
+
+    return memory_create_map(current_page_dir(), vaddr, page, 1, perm | PTE_SHARED);
+}
+
+/**
+ * @brief Unmap the shared page at vaddr of current task, the page is kept
+ * other CPUs may cache the old mapping until their next switch
+ */
+void memory_unmap_shared_page (uint32_t vaddr) {
+    pte_t * pte = find_pte(current_page_dir(), vaddr, 0);
+    if ((pte == (pte_t *)0) || !pte->present || !(pte->v & PTE_SHARED)) {
+        return;
+    }
+
+    pte->v = 0;
+    invlpg(vaddr);
+}
+
 /**
  * @brief Initialize the memory management system
  * 
@@ -410,6 +574,7 @@ void memory_init (boot_info_t * boot_info) {
 
     // to manage 4GB of memory, a total of 4 * 1024 * 1024 * 1024 / 4096 / 8 = 128KB of bitmap is needed, which is accommodated in the lower 1MB of RAM space
     addr_alloc_init(&paddr_alloc, mem_free, MEM_EXT_START, mem_up1MB_free, MEM_PAGE_SIZE);
+    spin_init(&uvm_cache_lock);
     mem_free += bitmap_byte_count(paddr_alloc.size / MEM_PAGE_SIZE);
 
     ASSERT(mem_free < (uint8_t *)MEM_EBDA_START);
@@ -425,7 +590,7 @@ void memory_init (boot_info_t * boot_info) {
  * @brief Adjust memory allocation for the heap and return the pointer to the heap before the adjustment
  */
 char * sys_sbrk(int incr) {
-    task_t * task = task_current();
+    task_t * task = task_current()->leader;     // heap is shared by threads
     char * pre_heap_end = (char * )task->heap_end;
     int pre_incr = incr;
 
@@ -8,6 +8,16 @@
 #include "tools/log.h"
 #include "core/memory.h"
 #include "fs/fs.h"
+#include "dev/time.h"
+#include "core/uring.h"
+#include "ipc/futex.h"
+#include "fs/poll.h"
+#include "fs/epoll/epoll.h"
+#include "fs/mq/mq.h"
+#include "ipc/spinlock.h"
+#include "cpu/irq.h"
+#include "comm/cpu_instr.h"
+#include "applib/lib_syscall.h"
 
 // System call handling function type
 typedef int (*syscall_handler_t)(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3);
@@ -27,6 +37,26 @@ static const syscall_handler_t sys_table[] = {
     [SYS_yield] = (syscall_handler_t)sys_yield,
 	[SYS_wait] = (syscall_handler_t)sys_wait,
 	[SYS_exit] = (syscall_handler_t)sys_exit,
+	[SYS_thread_exit] = (syscall_handler_t)sys_thread_exit,
+	[SYS_getrusage] = (syscall_handler_t)sys_getrusage,
+	[SYS_task_list] = (syscall_handler_t)sys_task_list,
+	[SYS_sched_latency] = (syscall_handler_t)sys_sched_latency,
+	[SYS_sched_trace] = (syscall_handler_t)sys_sched_trace,
+	[SYS_clock_gettime] = (syscall_handler_t)sys_clock_gettime,
+	[SYS_gettimeofday] = (syscall_handler_t)sys_gettimeofday,
+	[SYS_time_page] = (syscall_handler_t)sys_time_page,
+	[SYS_nanosleep] = (syscall_handler_t)sys_nanosleep,
+	[SYS_timer_slack] = (syscall_handler_t)sys_timer_slack,
+	[SYS_spawn] = (syscall_handler_t)sys_spawn,
+	[SYS_vfork] = (syscall_handler_t)sys_vfork,
+	[SYS_clone] = (syscall_handler_t)sys_clone,
+	[SYS_join] = (syscall_handler_t)sys_join,
+	[SYS_sched_setattr] = (syscall_handler_t)sys_sched_setattr,
+	[SYS_sched_getattr] = (syscall_handler_t)sys_sched_getattr,
+	[SYS_syscall_stat] = (syscall_handler_t)sys_syscall_stat,
+	[SYS_strace] = (syscall_handler_t)sys_strace,
+	[SYS_strace_read] = (syscall_handler_t)sys_strace_read,
+	[SYS_futex] = (syscall_handler_t)sys_futex,
 
 	[SYS_open] = (syscall_handler_t)sys_open,
 	[SYS_read] = (syscall_handler_t)sys_read,
@@ -43,19 +73,200 @@ static const syscall_handler_t sys_table[] = {
 	[SYS_readdir] = (syscall_handler_t)sys_readdir,
 	[SYS_closedir] = (syscall_handler_t)sys_closedir,
 	[SYS_unlink] = (syscall_handler_t)sys_unlink,
+	[SYS_uring_setup] = (syscall_handler_t)sys_uring_setup,
+	[SYS_uring_enter] = (syscall_handler_t)sys_uring_enter,
+	[SYS_readv] = (syscall_handler_t)sys_readv,
+	[SYS_writev] = (syscall_handler_t)sys_writev,
+	[SYS_pread] = (syscall_handler_t)sys_pread,
+	[SYS_pwrite] = (syscall_handler_t)sys_pwrite,
+	[SYS_sendfile] = (syscall_handler_t)sys_sendfile,
+	[SYS_copy_file_range] = (syscall_handler_t)sys_copy_file_range,
+	[SYS_pipe] = (syscall_handler_t)sys_pipe,
+	[SYS_poll] = (syscall_handler_t)sys_poll,
+	[SYS_epoll_create] = (syscall_handler_t)sys_epoll_create,
+	[SYS_epoll_ctl] = (syscall_handler_t)sys_epoll_ctl,
+	[SYS_epoll_wait] = (syscall_handler_t)sys_epoll_wait,
+	[SYS_mq_open] = (syscall_handler_t)sys_mq_open,
+	[SYS_mq_unlink] = (syscall_handler_t)sys_mq_unlink,
+	[SYS_mq_send] = (syscall_handler_t)sys_mq_send,
+	[SYS_mq_receive] = (syscall_handler_t)sys_mq_receive,
+	[SYS_mq_getattr] = (syscall_handler_t)sys_mq_getattr,
 };
 
+#define SYSCALL_NR      (sizeof(sys_table) / sizeof(sys_table[0]))
+
+// non-zero when the stats are on or some task is traced, the only test on the fast path
+static volatile int syscall_probe;
+static int stat_enabled;
+static int trace_tasks;
+
+// counters of each CPU, no lock needed but irq off
+static syscall_stat_t stat_table[CPU_NR][SYSCALL_NR];
+
+static spinlock_t trace_lock;
+static syscall_event_t trace_buf[SYSCALL_TRACE_NR];
+static uint32_t trace_next;
+
+void syscall_init (void) {
+	spin_init(&trace_lock);
+	trace_next = 0;
+	syscall_probe = stat_enabled = trace_tasks = 0;
+	kernel_memset(stat_table, 0, sizeof(stat_table));
+}
+
+static void probe_update (void) {
+	syscall_probe = stat_enabled + trace_tasks;
+}
+
+/**
+ * @brief Start or stop tracing the syscalls of task, called with task_manager.lock held
+ */
+void syscall_trace_set (task_t * task, int on) {
+	irq_state_t state = spin_lock_protect(&trace_lock);
+	int traced = (task->flags & TASK_FLAG_TRACE) != 0;
+	if (on && !traced) {
+		__atomic_fetch_or(&task->flags, TASK_FLAG_TRACE, __ATOMIC_RELAXED);
+		trace_tasks++;
+	} else if (!on && traced) {
+		__atomic_fetch_and(&task->flags, ~TASK_FLAG_TRACE, __ATOMIC_RELAXED);
+		trace_tasks--;
+	}
+	probe_update();
+	spin_unlock_protect(&trace_lock, state);
+}
+
+static void trace_record (task_t * task, syscall_frame_t * frame, int ret, uint32_t cycles) {
+	irq_state_t state = spin_lock_protect(&trace_lock);
+	syscall_event_t * event = trace_buf + (trace_next % SYSCALL_TRACE_NR);
+	event->seq = trace_next++;
+	event->pid = task->pid;
+	event->id = frame->func_id;
+	event->args[0] = frame->arg0;
+	event->args[1] = frame->arg1;
+	event->args[2] = frame->arg2;
+	event->args[3] = frame->arg3;
+	event->ret = ret;
+	event->cycles = cycles;
+	spin_unlock_protect(&trace_lock, state);
+}
+
+/**
+ * @brief Syscall with the counters and the trace, only when syscall_probe is set
+ */
+static void do_probed_syscall (syscall_handler_t handler, syscall_frame_t * frame) {
+	task_t * task = task_current();
+
+	// exit never returns, record it before, and stop tracing the task
+	if ((frame->func_id == SYS_exit) && (task->flags & TASK_FLAG_TRACE)) {
+		trace_record(task, frame, 0, 0);
+	}
+
+	uint64_t start = rdtsc();
+	int ret = handler(frame->arg0, frame->arg1, frame->arg2, frame->arg3);
+	uint64_t cycles = rdtsc() - start;
+	frame->eax = ret;
+
+	if (stat_enabled) {
+		irq_state_t state = irq_enter_protection();
+		syscall_stat_t * stat = &stat_table[task_cpu_id()][frame->func_id];
+		stat->count++;
+		stat->cycles += cycles;
+		if (cycles > stat->max_cycles) {
+			stat->max_cycles = cycles;
+		}
+		irq_leave_protection(state);
+	}
+
+	// the task may be traced by others in the handler, use the flag now
+	if (task->flags & TASK_FLAG_TRACE) {
+		trace_record(task, frame, ret, (cycles >> 32) ? 0xFFFFFFFF : (uint32_t)cycles);
+	}
+}
+
+/**
+ * @brief Control and copy the syscall counters, the sum of all CPUs, return the number of syscall ids
+ */
+int sys_syscall_stat (syscall_stat_t * buf, int count, int flags) {
+	if (flags & SYSCALL_STAT_RESET) {
+		for (int cpu = 0; cpu < CPU_NR; cpu++) {
+			irq_state_t state = irq_enter_protection();
+			kernel_memset(stat_table[cpu], 0, sizeof(stat_table[cpu]));
+			irq_leave_protection(state);
+		}
+	}
+
+	if (flags & (SYSCALL_STAT_ENABLE | SYSCALL_STAT_DISABLE)) {
+		irq_state_t state = spin_lock_protect(&trace_lock);
+		stat_enabled = (flags & SYSCALL_STAT_ENABLE) ? 1 : 0;
+		probe_update();
+		spin_unlock_protect(&trace_lock, state);
+	}
+
+	if (buf && (count > 0)) {
+		if (count > SYSCALL_NR) {
+			count = SYSCALL_NR;
+		}
+
+		for (int id = 0; id < count; id++) {
+			syscall_stat_t * sum = buf + id;
+			sum->count = 0;
+			sum->cycles = sum->max_cycles = 0;
+
+			for (int cpu = 0; cpu < CPU_NR; cpu++) {
+				syscall_stat_t * stat = &stat_table[cpu][id];
+				sum->count += stat->count;
+				sum->cycles += stat->cycles;
+				if (stat->max_cycles > sum->max_cycles) {
+					sum->max_cycles = stat->max_cycles;
+				}
+			}
+		}
+	}
+
+	return SYSCALL_NR;
+}
+
+/**
+ * @brief Copy the trace events from seq, oldest first, return the number copied
+ * the first event copied has a larger seq if the older ones were overwritten
+ */
+int sys_strace_read (syscall_event_t * buf, int count, unsigned int seq) {
+	if ((buf == (syscall_event_t *)0) || (count <= 0)) {
+		return -1;
+	}
+
+	int n = 0;
+	irq_state_t state = spin_lock_protect(&trace_lock);
+	uint32_t start = (trace_next > SYSCALL_TRACE_NR) ? trace_next - SYSCALL_TRACE_NR : 0;
+	if (seq > start) {
+		start = seq;
+	}
+	for (uint32_t idx = start; (idx < trace_next) && (n < count); idx++) {
+		buf[n++] = trace_buf[idx % SYSCALL_TRACE_NR];
+	}
+	spin_unlock_protect(&trace_lock, state);
+
+	return n;
+}
+
 /**
  * Handle system calls. This function is called by system call functions.
  */
 void do_handler_syscall (syscall_frame_t * frame) {
 	// beyond the border, error
-    if (frame->func_id < sizeof(sys_table) / sizeof(sys_table[0])) {
+    if (frame->func_id < SYSCALL_NR) {
 		// look up the table to obtain the handling function, and then call it for processing
 		syscall_handler_t handler = sys_table[frame->func_id];
 		if (handler) {
-			int ret = handler(frame->arg0, frame->arg1, frame->arg2, frame->arg3);
-			frame->eax = ret;  // set the return value for the system call, passed through eax
+			if (syscall_probe) {
+				do_probed_syscall(handler, frame);
+			} else {
+				int ret = handler(frame->arg0, frame->arg1, frame->arg2, frame->arg3);
+				frame->eax = ret;  // set the return value for the system call, passed through eax
+			}
+
+			// the process may be exiting by another thread
+			task_check_kill();
             return;
 		}
 	}
@@ -13,18 +13,69 @@
 #include "core/syscall.h"
 #include "comm/elf.h"
 #include "fs/fs.h"
+#include "cpu/lapic.h"
+#include "cpu/smp.h"
+#include "dev/time.h"
+#include "comm/clock.h"
+#include "core/hrtimer.h"
+#include "core/uring.h"
+#include "ipc/futex.h"
 
 static task_manager_t task_manager;     // Task Manager
 static uint32_t idle_task_stack[IDLE_STACK_SIZE];	// idle Task Stack
 static task_t task_table[TASK_NR];      // User Process Table
-static mutex_t task_table_mutex;        // Process Table Mutex
+static task_t * tss_task_table[GDT_TABLE_SIZE];    // task of each TSS, to find current task by TR
 
-static int tss_init (task_t * task, int flag, uint32_t entry, uint32_t esp) {
-    // assign GDT for TSS
-    int tss_sel = gdt_alloc_desc();
-    if (tss_sel < 0) {
-        log_printf("alloc tss failed.\n");
-        return -1;
+static void dl_replenish (hrtimer_t * timer);
+
+/**
+ * @brief Get the bucket of pid hash
+ */
+static list_t * task_pid_bucket (int pid) {
+    return task_manager.pid_hash + (pid & (TASK_PID_HASH_NR - 1));
+}
+
+/**
+ * @brief Find the task by pid, the lock of task manager should be held
+ */
+static task_t * task_find_pid (int pid) {
+    for (list_node_t * node = list_first(task_pid_bucket(pid)); node; node = list_node_next(node)) {
+        task_t * task = list_node_parent(node, task_t, hash_node);
+        if (task->pid == pid) {
+            return task;
+        }
+    }
+
+    return (task_t *)0;
+}
+
+/**
+ * @brief Allocate a new pid, the lock of task manager should be held
+ * pids are not reused until the counter wraps around, then the ones still in use are skipped
+ */
+static int task_alloc_pid (void) {
+    for (;;) {
+        int pid = task_manager.next_pid++;
+        if (task_manager.next_pid <= 0) {
+            task_manager.next_pid = 1;
+        }
+
+        if (task_find_pid(pid) == (task_t *)0) {
+            return pid;
+        }
+    }
+}
+
+static int tss_init (task_t * task, int flag, uint32_t entry, uint32_t esp, uint32_t page_dir) {
+    // assign GDT for TSS, a recycled task struct still has its own one
+    int tss_sel = task->tss_sel;
+    if (tss_sel == 0) {
+        tss_sel = gdt_alloc_desc();
+        if (tss_sel < 0) {
+            log_printf("alloc tss failed.\n");
+            return -1;
+        }
+        task->tss_sel = tss_sel;
     }
 
     segment_desc_set(tss_sel, (uint32_t)&task->tss, sizeof(tss_t),
@@ -33,10 +84,14 @@ static int tss_init (task_t * task, int flag, uint32_t entry, uint32_t esp) {
     // init TSS segement
     kernel_memset(&task->tss, 0, sizeof(tss_t));
 
-    // allocate kernel stack (physical addr)
-    uint32_t kernel_stack = memory_alloc_page();
+    // allocate kernel stack (physical addr), also kept in a recycled task struct
+    uint32_t kernel_stack = task->kernel_stack;
     if (kernel_stack == 0) {
-        goto tss_init_failed;
+        kernel_stack = memory_alloc_page();
+        if (kernel_stack == 0) {
+            return -1;
+        }
+        task->kernel_stack = kernel_stack;
     }
     
     // select different access selectors based on different permissions
@@ -61,31 +116,27 @@ static int tss_init (task_t * task, int flag, uint32_t entry, uint32_t esp) {
     task->tss.cs = code_sel; 
     task->tss.iomap = 0;
 
-    // init page table
-    uint32_t page_dir = memory_create_uvm();
+    // init page table, kernel thread runs on the kernel one. the one given is shared or copied by the caller
     if (page_dir == 0) {
-        goto tss_init_failed;
+        page_dir = (flag & TASK_FLAG_KTHREAD) ? memory_kernel_page_dir() : memory_create_uvm();
+        if (page_dir == 0) {
+            return -1;
+        }
     }
     task->tss.cr3 = page_dir;
 
-    task->tss_sel = tss_sel;
+    tss_task_table[tss_sel >> 3] = task;
     return 0;
-tss_init_failed:
-    gdt_free_sel(tss_sel);
-
-    if (kernel_stack) {
-        memory_free_page(kernel_stack);
-    }
-    return -1;
 }
 
 /**
- * @brief Init Task
+ * @brief Init Task, it runs on page_dir, or a new page table if it's 0
+ * the one given is owned by the task unless flag has TASK_FLAG_VFORK or TASK_FLAG_THREAD
  */
-int task_init (task_t *task, const char * name, int flag, uint32_t entry, uint32_t esp) {
+int task_init (task_t *task, const char * name, int flag, uint32_t entry, uint32_t esp, uint32_t page_dir) {
     ASSERT(task != (task_t *)0);
 
-    int err = tss_init(task, flag, entry, esp);
+    int err = tss_init(task, flag, entry, esp, page_dir);
     if (err < 0) {
         log_printf("init task failed.\n");
         return err;
@@ -93,33 +144,89 @@ int task_init (task_t *task, const char * name, int flag, uint32_t entry, uint32
 
     // init Task seg
     kernel_strncpy(task->name, name, TASK_NAME_SIZE);
+    task->flags = flag;
     task->state = TASK_CREATED;
-    task->sleep_ticks = 0;
+    task->timer_slack = OS_TIMER_SLACK_NS;
     task->time_slice = TASK_TIME_SLICE_DEFAULT;
     task->slice_ticks = task->time_slice;
     task->parent = (task_t *)0;
+    task->leader = task;
+    task->threads = 1;
+    task->joiner = (task_t *)0;
+    task->tls = 0;
+    task->tls_sel = 0;
     task->heap_start = 0;
     task->heap_end = 0;
+    task->vfork_done = (sem_t *)0;
+    task->uring = (struct _uring_ctx_t *)0;
+    task->killer = (task_t *)0;
+    task->kill_left = 0;
+    task->cpu = 0;
+    task->on_cpu = 0;
+    task->on_rq = 0;
+    task->policy = SCHED_POLICY_NORMAL;
+    task->dl_runtime = task->dl_deadline = task->dl_period = task->dl_bw = 0;
+    task->dl_abs_deadline = task->dl_exec_start = 0;
+    task->dl_remaining = 0;
+    task->dl_throttled = task->dl_missed = 0;
+    task->dl_misses = task->dl_throttles = 0;
+    hrtimer_init(&task->dl_timer, dl_replenish, task);
+    task->pi_deadline = SCHED_NO_DEADLINE;
+    task->pi_blocked_on = (struct _mutex_t *)0;
+    list_init(&task->pi_list);
+    spin_init(&task->wait_lock);
+    task->wait_entry = (struct _waitq_entry_t *)0;
+    task->utime = task->stime = 0;
+    task->nvcsw = task->nivcsw = 0;
+    task->wait_ticks = task->ready_tick = 0;
+    task->page_faults = 0;
+    task->wakeup_tsc = 0;
+    task->fpu_used = 0;
+    kernel_memset(&task->latency, 0, sizeof(task->latency));
     list_node_init(&task->all_node);
     list_node_init(&task->run_node);
     list_node_init(&task->wait_node);
+    list_node_init(&task->child_node);
+    list_node_init(&task->hash_node);
+    list_init(&task->child_list);
+    list_init(&task->zombie_list);
+    list_init(&task->thread_list);
 
     // file related
     kernel_memset(task->file_table, 0, sizeof(task->file_table));
 
     // insert into the ready queue and all task queues
-    irq_state_t state = irq_enter_protection();
-    task->pid = (uint32_t)task;   // use addr
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    task->pid = task_alloc_pid();
     list_insert_last(&task_manager.task_list, &task->all_node);
-    irq_leave_protection(state);
+    list_insert_last(task_pid_bucket(task->pid), &task->hash_node);
+    spin_unlock_protect(&task_manager.lock, state);
     return 0;
 }
 
+/**
+ * @brief Find the online CPU with the fewest ready tasks
+ * the count is read without lock, it's only a hint
+ */
+static cpu_rq_t * rq_least_loaded (void) {
+    cpu_rq_t * best = task_manager.rq;
+
+    for (int i = 1; i < task_manager.cpu_count; i++) {
+        cpu_rq_t * rq = task_manager.rq + i;
+        if (rq->online && (list_count(&rq->ready_list) < list_count(&best->ready_list))) {
+            best = rq;
+        }
+    }
+
+    return best;
+}
+
 /**
  * @brief Start Task
  */
 void task_start(task_t * task) {
     irq_state_t state = irq_enter_protection();
+    task->cpu = rq_least_loaded()->id;
     task_set_ready(task);
     irq_leave_protection(state);
 }
@@ -128,19 +235,34 @@ void task_start(task_t * task) {
  * @brief Uninit
  */
 void task_uninit (task_t * task) {
+    // pid is set when it's inserted into the task list
+    if (task->pid) {
+        irq_state_t state = spin_lock_protect(&task_manager.lock);
+        list_remove(&task_manager.task_list, &task->all_node);
+        list_remove(task_pid_bucket(task->pid), &task->hash_node);
+        spin_unlock_protect(&task_manager.lock, state);
+    }
+
     if (task->tss_sel) {
-        gdt_free_sel(task->tss_sel);
+        tss_task_table[task->tss_sel >> 3] = (task_t *)0;
     }
 
-    if (task->tss.esp0) {
-        memory_free_page(task->tss.esp0 - MEM_PAGE_SIZE);
+    if (task->tls_sel) {
+        gdt_free_sel(task->tls_sel);
     }
 
-    if (task->tss.cr3) {
+    // the page table of kthread, vfork child and thread is not owned by it
+    if (task->tss.cr3 && !(task->flags & (TASK_FLAG_KTHREAD | TASK_FLAG_VFORK | TASK_FLAG_THREAD))) {
         memory_destroy_uvm(task->tss.cr3);
     }
 
+    // the TSS of a task struct is always at the same place, keep its selector and
+    // kernel stack so that the next fork using this struct needn't allocate them
+    uint16_t tss_sel = task->tss_sel;
+    uint32_t kernel_stack = task->kernel_stack;
     kernel_memset(task, 0, sizeof(task_t));
+    task->tss_sel = tss_sel;
+    task->kernel_stack = kernel_stack;
 }
 
 void simple_switch (uint32_t ** from, uint32_t * to);
@@ -149,6 +271,8 @@ void simple_switch (uint32_t ** from, uint32_t * to);
  * @brief Switch to specific Task
  */
 void task_switch_from_to (task_t * from, task_t * to) {
+    // SYSENTER doesn't take the stack from TSS
+    cpu_set_sysenter_stack(to->tss.esp0);
      switch_to_tss(to->tss_sel);
     //simple_switch(&from->stack, to->stack);
 }
@@ -172,10 +296,11 @@ void task_first_init (void) {
 
     uint32_t first_start = (uint32_t)first_task_entry;
 
-    task_init(&task_manager.first_task, "first task", 0, first_start, first_start + alloc_size);
+    task_init(&task_manager.first_task, "first task", 0, first_start, first_start + alloc_size, 0);
     task_manager.first_task.heap_start = (uint32_t)e_first_task;  
     task_manager.first_task.heap_end = task_manager.first_task.heap_start;
-    task_manager.curr_task = &task_manager.first_task;
+    task_manager.first_task.on_cpu = 1;
+    task_manager.rq[0].curr_task = &task_manager.first_task;
 
     // update page table addr
     mmu_set_page_dir(task_manager.first_task.tss.cr3);
@@ -189,6 +314,7 @@ void task_first_init (void) {
 
     // write to the TR register to indicate the first task currently running
     write_tr(task_manager.first_task.tss_sel);
+    cpu_set_sysenter_stack(task_manager.first_task.tss.esp0);
 }
 
 /**
@@ -198,6 +324,20 @@ task_t * task_first_task (void) {
     return &task_manager.first_task;
 }
 
+/**
+ * @brief Return the idle task of CPU
+ */
+task_t * task_idle_task (int cpu) {
+    return &task_manager.rq[cpu].idle_task;
+}
+
+/**
+ * @brief Check if the CPU has joined the scheduling
+ */
+int task_cpu_online (int cpu) {
+    return task_manager.rq[cpu].online;
+}
+
 /**
  * @brief Idle Task
  */
@@ -207,303 +347,981 @@ static void idle_task_entry (void) {
     }
 }
 
+/**
+ * @brief AP runs its idle task from here, and then takes part in scheduling
+ * it's already on the stack and page table of the idle task
+ */
+void task_ap_enter (int cpu) {
+    cpu_rq_t * rq = task_manager.rq + cpu;
+
+    rq->idle_task.on_cpu = 1;
+    rq->curr_task = &rq->idle_task;
+    write_tr(rq->idle_task.tss_sel);
+    rq->online = 1;
+
+    sti();
+    idle_task_entry();
+}
+
 /**
  * @brief Task Manager Init
  */
 void task_manager_init (void) {
     kernel_memset(task_table, 0, sizeof(task_table));
-    mutex_init(&task_table_mutex);
 
-    // data and code segments, using DPL3, shared by all applications
-    // for debugging convenience, temporarily using DPL0
-    int sel = gdt_alloc_desc();
-    segment_desc_set(sel, 0x00000000, 0xFFFFFFFF,
-                     SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL |
-                     SEG_TYPE_DATA | SEG_TYPE_RW | SEG_D);
-    task_manager.app_data_sel = sel;
+    // all task structures are free at first
+    list_init(&task_manager.free_list);
+    for (int i = 0; i < TASK_NR; i++) {
+        list_insert_last(&task_manager.free_list, &task_table[i].all_node);
+    }
 
-    sel = gdt_alloc_desc();
-    segment_desc_set(sel, 0x00000000, 0xFFFFFFFF,
-                     SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL |
-                     SEG_TYPE_CODE | SEG_TYPE_RW | SEG_D);
-    task_manager.app_code_sel = sel;
+    for (int i = 0; i < TASK_PID_HASH_NR; i++) {
+        list_init(task_manager.pid_hash + i);
+    }
+    task_manager.next_pid = 1;
+
+    // data and code segments, using DPL3, shared by all applications, set in init_gdt
+    task_manager.app_data_sel = APP_SELECTOR_DS;
+    task_manager.app_code_sel = APP_SELECTOR_CS;
 
     // list init
-    list_init(&task_manager.ready_list);
+    spin_init(&task_manager.lock);
     list_init(&task_manager.task_list);
-    list_init(&task_manager.sleep_list);
 
-    // idle Task init
-    task_init(&task_manager.idle_task,
-                "idle task",
-                TASK_FLAG_SYSTEM,
-                (uint32_t)idle_task_entry,
-                0);     // run in kernel mode, PL3 (lowest)
-    task_manager.curr_task = (task_t *)0;
-    task_start(&task_manager.idle_task);
+    // one run queue and idle task per CPU, only the BSP is online now
+    task_manager.cpu_count = smp_cpu_count();
+    for (int i = 0; i < task_manager.cpu_count; i++) {
+        cpu_rq_t * rq = task_manager.rq + i;
+
+        spin_init(&rq->lock);
+        rq->id = i;
+        rq->online = (i == 0);
+        rq->curr_task = (task_t *)0;
+        rq->prev_task = (task_t *)0;
+        list_init(&rq->ready_list);
+        list_init(&rq->dl_list);
+        rq->dl_bw = 0;
+        kernel_memset(&rq->latency, 0, sizeof(rq->latency));
+        rq->trace_next = 0;
+
+        // idle Task init
+        task_init(&rq->idle_task,
+                    "idle task",
+                    TASK_FLAG_SYSTEM,
+                    (uint32_t)idle_task_entry,
+                    0, 0);     // run in kernel mode, PL3 (lowest)
+        rq->idle_task.cpu = i;
+    }
 }
 
 /**
- * @brief Insert Task into ready list
+ * @brief Get run queue of current CPU
  */
-void task_set_ready(task_t *task) {
-    if (task != &task_manager.idle_task) {
-        list_insert_last(&task_manager.ready_list, &task->run_node);
-        task->state = TASK_READY;
-    }
+static cpu_rq_t * rq_this (void) {
+    task_t * curr = task_current();
+    return curr ? task_manager.rq + curr->cpu : task_manager.rq;
 }
 
 /**
- * @brief Remove Task from ready list
+ * @brief Get index of current CPU
  */
-void task_set_block (task_t *task) {
-    if (task != &task_manager.idle_task) {
-        list_remove(&task_manager.ready_list, &task->run_node);
-    }
+int task_cpu_id (void) {
+    return rq_this()->id;
 }
+
 /**
- * @brief Get next Task
+ * @brief Add one wakeup to run latency into the histogram
  */
-static task_t * task_next_run (void) {
-    // if there are no tasks, run the idle task
-    if (list_count(&task_manager.ready_list) == 0) {
-        return &task_manager.idle_task;
+static void latency_add (sched_latency_t * latency, uint32_t us) {
+    int bucket = us ? 31 - __builtin_clz(us) : 0;
+    if (bucket >= SCHED_LAT_HIST_SIZE) {
+        bucket = SCHED_LAT_HIST_SIZE - 1;
+    }
+
+    latency->hist[bucket]++;
+    latency->count++;
+    latency->total_us += us;
+    if (us > latency->max_us) {
+        latency->max_us = us;
     }
-    
-    // normal Task
-    list_node_t * task_node = list_first(&task_manager.ready_list);
-    return list_node_parent(task_node, task_t, run_node);
 }
 
 /**
- * @brief Add Task into sleep status
+ * @brief Record a scheduler event, the lock of rq should be held
  */
-void task_set_sleep(task_t *task, uint32_t ticks) {
-    if (ticks <= 0) {
-        return;
+static void sched_trace_event (cpu_rq_t * rq, int type, task_t * task, uint64_t tsc, uint32_t latency_us) {
+    sched_event_t * event = rq->trace + (rq->trace_next++ % SCHED_TRACE_NR);
+    event->tsc = tsc;
+    event->type = type;
+    event->pid = task->pid;
+    event->cpu = rq->id;
+    event->latency_us = latency_us;
+}
+
+/**
+ * @brief Check if the task should run before the current one of rq, the lock of rq should be held
+ */
+static int rq_should_preempt (cpu_rq_t * rq, task_t * task) {
+    task_t * curr = rq->curr_task;
+    if (curr == &rq->idle_task) {
+        return 1;
+    }
+
+    if (!task_is_dl(task)) {
+        return 0;
     }
 
-    task->sleep_ticks = ticks;
-    task->state = TASK_SLEEP;
-    list_insert_last(&task_manager.sleep_list, &task->run_node);
+    return task_sched_deadline(task) < task_sched_deadline(curr);
 }
 
 /**
- * @brief Remove Task from waitting list
- * 
- * @param task 
+ * @brief Insert the deadline task into dl list by its deadline, the lock of rq should be held
  */
-void task_set_wakeup (task_t *task) {
-    list_remove(&task_manager.sleep_list, &task->run_node);
+static void dl_enqueue (cpu_rq_t * rq, task_t * task) {
+    // after the ones with the same deadline
+    uint64_t deadline = task_sched_deadline(task);
+    list_node_t * pos = list_first(&rq->dl_list);
+    while (pos && (task_sched_deadline(list_node_parent(pos, task_t, run_node)) <= deadline)) {
+        pos = list_node_next(pos);
+    }
+    list_insert_before(&rq->dl_list, pos, &task->run_node);
 }
 
 /**
- * @brief Get current running Task
+ * @brief Check if the task is in a list of rq, the lock of rq should be held
+ * a deadline task throttled is out of the lists, unless it's boosted by a mutex
  */
-task_t * task_current (void) {
-    return task_manager.curr_task;
+static int task_in_rq (task_t * task) {
+    return task->on_rq && !((task->policy == SCHED_POLICY_DEADLINE) && task->dl_throttled
+                && (task->pi_deadline == SCHED_NO_DEADLINE));
+}
+
+static list_t * task_rq_list (cpu_rq_t * rq, task_t * task) {
+    return task_is_dl(task) ? &rq->dl_list : &rq->ready_list;
 }
 
 /**
- * @brief Retrieve file descriptor of current process
+ * @brief Insert the task into the list of its class, at the head of ready list if head is set
  */
-file_t * task_file (int fd) {
-    if ((fd >= 0) && (fd < TASK_OFILE_NR)) {
-        file_t * file = task_current()->file_table[fd];
-        return file;
+static void rq_enqueue (cpu_rq_t * rq, task_t * task, int head) {
+    if (task_is_dl(task)) {
+        dl_enqueue(rq, task);
+    } else if (head) {
+        list_insert_first(&rq->ready_list, &task->run_node);
+    } else {
+        list_insert_last(&rq->ready_list, &task->run_node);
     }
-
-    return (file_t *)0;
 }
 
 /**
- * @brief Allocate a new file ID for the specified file
+ * @brief Start a new period for the deadline task woken up, if it can't use the budget left
+ * before the deadline without exceeding its bandwidth, i.e. remaining / (deadline - now) > runtime / period
  */
-int task_alloc_fd (file_t * file) {
-    task_t * task = task_current();
+static void dl_wakeup (task_t * task, uint64_t now) {
+    if (task->dl_throttled) {
+        return;
+    }
 
-    for (int i = 0; i < TASK_OFILE_NR; i++) {
-        file_t * p = task->file_table[i];
-        if (p == (file_t *)0) {
-            task->file_table[i] = file;
-            return i;
+    // compared in units of 1024 ns, the products of values below 2^32 ns fit in 64 bits
+    if ((task->dl_abs_deadline > now) && (task->dl_remaining > 0)) {
+        uint64_t remaining = (uint64_t)task->dl_remaining >> 10;
+        uint64_t left = (task->dl_abs_deadline - now) >> 10;
+        if (remaining * (task->dl_period >> 10) <= left * (task->dl_runtime >> 10)) {
+            return;
         }
     }
 
-    return -1;
+    task->dl_abs_deadline = now + task->dl_deadline;
+    task->dl_remaining = task->dl_runtime;
+    task->dl_missed = 0;
 }
 
 /**
- * @brief Remove the opened file with file descriptor fd from the task
+ * @brief Take the deadline task out of the ready list until the next period, the lock of rq should be held
  */
-void task_remove_fd (int fd) {
-    if ((fd >= 0) && (fd < TASK_OFILE_NR)) {
-        task_current()->file_table[fd] = (file_t *)0;
+static void dl_throttle (cpu_rq_t * rq, task_t * task) {
+    // a boosted one keeps running to release the mutex soon
+    task->dl_throttled = 1;
+    if (task->on_rq && (task->pi_deadline == SCHED_NO_DEADLINE)) {
+        list_remove(&rq->dl_list, &task->run_node);
     }
+
+    hrtimer_start(&task->dl_timer, task->dl_abs_deadline - task->dl_deadline + task->dl_period, 0);
 }
 
 /**
- * @brief Let current Task yield CPU
+ * @brief Charge the time run since last update to the budget of deadline task, the lock of rq should be held
  */
-int sys_yield (void) {
-    irq_state_t state = irq_enter_protection();
+static void dl_update_curr (cpu_rq_t * rq, task_t * task, uint64_t now) {
+    task->dl_remaining -= (int64_t)(now - task->dl_exec_start);
+    task->dl_exec_start = now;
+
+    // still running after the deadline, counted once in a period
+    if ((now > task->dl_abs_deadline) && !task->dl_missed) {
+        task->dl_missed = 1;
+        task->dl_misses++;
+    }
 
-    if (list_count(&task_manager.ready_list) > 1) {
-        task_t * curr_task = task_current();
+    if ((task->dl_remaining <= 0) && !task->dl_throttled) {
+        task->dl_throttles++;
+        dl_throttle(rq, task);
+    }
+}
 
-        // if there are other tasks in the list, move the current task to the end of the list
-        task_set_block(curr_task);
-        task_set_ready(curr_task);
+/**
+ * @brief Give the budget of next period to the deadline task throttled, in timer interrupt
+ */
+static void dl_replenish (hrtimer_t * timer) {
+    task_t * task = (task_t *)timer->data;
+    cpu_rq_t * rq = task_manager.rq + task->cpu;
 
-        // switch to the next task. It's important to protect this section until the switch is complete;
-        // otherwise, issues may arise if the next task gets blocked or deleted for some reason after running, and we come back here to switch
-        task_dispatch();
+    spin_lock(&rq->lock);
+    if (!task->dl_throttled || (task->policy != SCHED_POLICY_DEADLINE)) {
+        spin_unlock(&rq->lock);
+        return;
     }
-    irq_leave_protection(state);
 
-    return 0;
+    // the overrun is paid from the new budget
+    do {
+        task->dl_abs_deadline += task->dl_period;
+        task->dl_remaining += task->dl_runtime;
+    } while (task->dl_remaining <= 0);
+
+    // too late, e.g. the timer is delayed, start from now
+    uint64_t now = time_ns();
+    if (task->dl_abs_deadline <= now) {
+        task->dl_abs_deadline = now + task->dl_deadline;
+        task->dl_remaining = task->dl_runtime;
+    }
+    task->dl_missed = 0;
+    task->dl_throttled = 0;
+
+    int kick = 0;
+    if (task->on_rq) {
+        // kept in the list when boosted, the deadline is changed
+        if (task->pi_deadline != SCHED_NO_DEADLINE) {
+            list_remove(&rq->dl_list, &task->run_node);
+        }
+        dl_enqueue(rq, task);
+        task->wakeup_tsc = time_tsc();
+        sched_trace_event(rq, SCHED_EVENT_WAKEUP, task, task->wakeup_tsc, 0);
+        kick = (rq != rq_this()) && rq_should_preempt(rq, task);
+    }
+    spin_unlock(&rq->lock);
+
+    if (kick) {
+        lapic_send_ipi(smp_apic_id(rq->id), IRQ_RESCHEDULE);
+    }
 }
 
 /**
- * @brief Execute a task scheduling
+ * @brief Update the state of task inserted into the ready list, the lock of rq should be held
  */
-void task_dispatch (void) {
-    task_t * to = task_next_run();
-    if (to != task_manager.curr_task) {
-        task_t * from = task_manager.curr_task;
-
-        task_manager.curr_task = to;
-        task_switch_from_to(from, to);
+static void rq_mark_ready (cpu_rq_t * rq, task_t * task) {
+    task->state = TASK_READY;
+    task->on_rq = 1;
+    task->ready_tick = time_get_tick();
+
+    // woken up, not moved to the tail while running, e.g. at the end of time slice
+    if (task != rq->curr_task) {
+        task->wakeup_tsc = time_tsc();
+        sched_trace_event(rq, SCHED_EVENT_WAKEUP, task, task->wakeup_tsc, 0);
     }
 }
 
 /**
- * @brief Time handling
- * being called in the interupt handler func
+ * @brief Insert Task into ready list
  */
-void task_time_tick (void) {
-    task_t * curr_task = task_current();
+void task_set_ready(task_t *task) {
+    cpu_rq_t * rq = task_manager.rq + task->cpu;
+    if (task == &rq->idle_task) {
+        return;
+    }
 
-    // handling of time slices
+    irq_state_t state = spin_lock_protect(&rq->lock);
+    if (task_is_dl(task)) {
+        // a throttled one is inserted when replenished, unless it's boosted
+        if ((task->policy == SCHED_POLICY_DEADLINE) && (task != rq->curr_task)) {
+            dl_wakeup(task, time_ns());
+        }
+        if (!task->dl_throttled || (task->pi_deadline != SCHED_NO_DEADLINE)) {
+            dl_enqueue(rq, task);
+        }
+    } else if (task->flags & TASK_FLAG_HIGH) {
+        // it will be chosen on next dispatch, the current task keeps its position after it
+        list_insert_first(&rq->ready_list, &task->run_node);
+    } else {
+        list_insert_last(&rq->ready_list, &task->run_node);
+    }
+    rq_mark_ready(rq, task);
+    int kick = (rq != rq_this()) && rq_should_preempt(rq, task);
+    spin_unlock_protect(&rq->lock, state);
+
+    // the CPU is idle or running a less urgent task, let it run the task now instead of on next tick
+    if (kick) {
+        lapic_send_ipi(smp_apic_id(rq->id), IRQ_RESCHEDULE);
+    }
+}
+
+/**
+ * @brief Wake up the task by current task which is going to block, e.g. waiting for the reply
+ * the task runs next on this CPU, with the rest of the time slice of current task, instead of
+ * waiting behind other ready tasks. it's the normal wakeup if the task can't be moved here
+ */
+void task_set_ready_sync (task_t * task) {
     irq_state_t state = irq_enter_protection();
-    if (--curr_task->slice_ticks == 0) {
-    // time slice is exhausted, reload the time slice
-    // for idle tasks, subtract unused time here
-        curr_task->slice_ticks = curr_task->time_slice;
+    cpu_rq_t * rq = rq_this();
+    task_t * curr = rq->curr_task;
 
-        // adjust the position of the list to the tail
-        task_set_block(curr_task);
-        task_set_ready(curr_task);
+    // the waker holds the lock of what task waits for, nobody else can wake it up and move it now
+    if (task_is_dl(task) || task_is_dl(curr)
+            || ((task->cpu != rq->id) && (task->on_cpu || !fpu_can_migrate(task, task->cpu)))) {
+        task_set_ready(task);
+        irq_leave_protection(state);
+        return;
     }
-    
-    // sleep handling
-    list_node_t * curr = list_first(&task_manager.sleep_list);
-    while (curr) {
-        list_node_t * next = list_node_next(curr);
-
-        task_t * task = list_node_parent(curr, task_t, run_node);
-        if (--task->sleep_ticks == 0) {
-            // when the delay time expires, remove it from the sleep list and move it to the ready list
-            task_set_wakeup(task);
-            task_set_ready(task);
-        }
-        curr = next;
+    task->cpu = rq->id;
+
+    spin_lock(&rq->lock);
+
+    // right after the current one, it's the head when current task blocks
+    list_node_t * pos = list_first(&rq->ready_list);
+    if (curr->on_rq && (curr != &rq->idle_task)) {
+        pos = list_node_next(&curr->run_node);
     }
+    list_insert_before(&rq->ready_list, pos, &task->run_node);
+    rq_mark_ready(rq, task);
+
+    // run as a part of the turn of current task
+    if (curr != &rq->idle_task) {
+        task->slice_ticks = curr->slice_ticks;
+    }
+    spin_unlock(&rq->lock);
 
-    task_dispatch();
     irq_leave_protection(state);
 }
 
 /**
- * @brief Assign with a Task structure
+ * @brief Set the deadline inherited from the waiters of the mutexes the task holds,
+ * or SCHED_NO_DEADLINE to drop it. The task is moved to the list of its class now
  */
-static task_t * alloc_task (void) {
-    task_t * task = (task_t *)0;
+void task_pi_set (task_t * task, uint64_t deadline) {
+    irq_state_t state = irq_enter_protection();
+    cpu_rq_t * rq = task_manager.rq + task->cpu;
+    spin_lock(&rq->lock);
 
-    mutex_lock(&task_table_mutex);
-    for (int i = 0; i < TASK_NR; i++) {
-        task_t * curr = task_table + i;
-        if (curr->name[0] == 0) {
-            task = curr;
-            break;
-        }
+    if (task_in_rq(task)) {
+        list_remove(task_rq_list(rq, task), &task->run_node);
     }
-    mutex_unlock(&task_table_mutex);
+    task->pi_deadline = deadline;
 
-    return task;
+    int kick = 0;
+    if (task_in_rq(task)) {
+        // the current task is at the head of ready list
+        rq_enqueue(rq, task, task == rq->curr_task);
+        kick = (rq != rq_this()) && rq_should_preempt(rq, task);
+    }
+    spin_unlock(&rq->lock);
+
+    if (kick) {
+        lapic_send_ipi(smp_apic_id(rq->id), IRQ_RESCHEDULE);
+    }
+    irq_leave_protection(state);
 }
 
 /**
- * @brief Release Task structure
+ * @brief Mark the task switched out before on this CPU as saved, the lock of rq should be held
+ * it can be run or reclaimed by other CPU from now on
  */
-static void free_task (task_t * task) {
-    mutex_lock(&task_table_mutex);
-    task->name[0] = 0;
-    mutex_unlock(&task_table_mutex);
+static void rq_finish_switch (cpu_rq_t * rq) {
+    if (rq->prev_task) {
+        rq->prev_task->on_cpu = 0;
+        rq->prev_task = (task_t *)0;
+    }
 }
 
 /**
- * @brief Task enters a sleep state
+ * @brief Remove Task from ready list
  */
-void sys_msleep (uint32_t ms) {
-    // at least delay 1 tick
-    if (ms < OS_TICK_MS) {
-        ms = OS_TICK_MS;
+void task_set_block (task_t *task) {
+    cpu_rq_t * rq = task_manager.rq + task->cpu;
+    if (task != &rq->idle_task) {
+        irq_state_t state = spin_lock_protect(&rq->lock);
+        if (task_in_rq(task)) {
+            list_remove(task_rq_list(rq, task), &task->run_node);
+        }
+        task->on_rq = 0;
+        spin_unlock_protect(&rq->lock, state);
     }
+}
 
-    irq_state_t state = irq_enter_protection();
+/**
+ * @brief Take a ready task from the busiest CPU
+ * only the task which is not running and has been saved can be moved,
+ * and the remote queue is only tried, so two CPUs stealing from each other won't deadlock
+ */
+static task_t * task_steal (cpu_rq_t * rq) {
+    cpu_rq_t * busiest = (cpu_rq_t *)0;
+    for (int i = 0; i < task_manager.cpu_count; i++) {
+        cpu_rq_t * other = task_manager.rq + i;
+        if ((other == rq) || !other->online) {
+            continue;
+        }
 
-    // remove from the ready list and add to the sleep list
-    task_set_block(task_manager.curr_task);
-    task_set_sleep(task_manager.curr_task, (ms + (OS_TICK_MS - 1))/ OS_TICK_MS);
-    
-    // execute a scheduling
-    task_dispatch();
+        if (!busiest || (list_count(&other->ready_list) > list_count(&busiest->ready_list))) {
+            busiest = other;
+        }
+    }
 
-    irq_leave_protection(state);
-}
+    if (!busiest || (list_count(&busiest->ready_list) == 0) || !spin_trylock(&busiest->lock)) {
+        return (task_t *)0;
+    }
+
+    // from the tail, which will run last there
+    task_t * task = (task_t *)0;
+    for (list_node_t * node = list_last(&busiest->ready_list); node; node = list_node_pre(node)) {
+        task_t * curr = list_node_parent(node, task_t, run_node);
+        if (!curr->on_cpu && fpu_can_migrate(curr, busiest->id)) {
+            list_remove(&busiest->ready_list, node);
+            curr->cpu = rq->id;
+            task = curr;
+            break;
+        }
+    }
+    spin_unlock(&busiest->lock);
 
+    return task;
+}
 
 /**
- * @brief Copy the list of open files from the current process
+ * @brief Get next Task, the lock of rq should be held
  */
-static void copy_opened_files(task_t * child_task) {
-    task_t * parent = task_current();
+static task_t * task_next_run (cpu_rq_t * rq) {
+    // deadline tasks first, they are not moved to other CPUs
+    if (list_count(&rq->dl_list)) {
+        return list_node_parent(list_first(&rq->dl_list), task_t, run_node);
+    }
 
-    for (int i = 0; i < TASK_OFILE_NR; i++) {
-        file_t * file = parent->file_table[i];
-        if (file) {
-            file_inc_ref(file);
-            child_task->file_table[i] = parent->file_table[i];
+    // if there are no tasks, try to get one from other CPU, or run the idle task
+    if (list_count(&rq->ready_list) == 0) {
+        task_t * task = task_steal(rq);
+        if (task == (task_t *)0) {
+            return &rq->idle_task;
         }
+
+        list_insert_last(&rq->ready_list, &task->run_node);
     }
+    
+    // normal Task
+    list_node_t * task_node = list_first(&rq->ready_list);
+    return list_node_parent(task_node, task_t, run_node);
 }
 
 /**
- * @brief Create a copy of the process
+ * @brief Get current running Task
  */
-int sys_fork (void) {
-    task_t * parent_task = task_current();
+task_t * task_current (void) {
+    // TR is per CPU, so there's no need to know which CPU it is
+    return tss_task_table[read_tr() >> 3];
+}
 
-    // assign Task structure
-    task_t * child_task = alloc_task();
-    if (child_task == (task_t *)0) {
-        goto fork_failed;
+/**
+ * @brief Retrieve file descriptor of current process
+ * the file table is in the leader, shared by all threads
+ */
+file_t * task_file (int fd) {
+    if ((fd >= 0) && (fd < TASK_OFILE_NR)) {
+        file_t * file = task_current()->leader->file_table[fd];
+        return file;
     }
 
-    syscall_frame_t * frame = (syscall_frame_t *)(parent_task->tss.esp0 - sizeof(syscall_frame_t));
+    return (file_t *)0;
+}
 
-    // initialize the child process and adjust necessary fields.
-    // the ESP needs to be reduced by the total number of argument bytes for system calls,
-    // as it returns through a normal 'ret' instruction without going through the system call handling 'ret' (which returns the number of arguments).
-    int err = task_init(child_task,  parent_task->name, 0, frame->eip,
-                        frame->esp + sizeof(uint32_t)*SYSCALL_PARAM_COUNT);
-    if (err < 0) {
-        goto fork_failed;
-    }
+/**
+ * @brief Allocate a new file ID for the specified file
+ */
+int task_alloc_fd (file_t * file) {
+    task_t * task = task_current()->leader;
+    int fd = -1;
+
+    // other threads may be allocating too
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    for (int i = 0; i < TASK_OFILE_NR; i++) {
+        file_t * p = task->file_table[i];
+        if (p == (file_t *)0) {
+            task->file_table[i] = file;
+            fd = i;
+            break;
+        }
+    }
+    spin_unlock_protect(&task_manager.lock, state);
+
+    return fd;
+}
+
+/**
+ * @brief Remove the opened file with file descriptor fd from the task
+ */
+void task_remove_fd (int fd) {
+    if ((fd >= 0) && (fd < TASK_OFILE_NR)) {
+        task_current()->leader->file_table[fd] = (file_t *)0;
+    }
+}
+
+/**
+ * @brief Load a TLS segment based at tls into gs of the task, or the normal data segment if tls is 0
+ */
+static int task_set_tls (task_t * task, uint32_t tls) {
+    if (task->tls_sel) {
+        gdt_free_sel(task->tls_sel);
+        task->tls_sel = 0;
+    }
+    task->tls = 0;
+    task->tss.gs = task_manager.app_data_sel | SEG_RPL3;
+
+    if (tls == 0) {
+        return 0;
+    }
+
+    int sel = gdt_alloc_desc();
+    if (sel < 0) {
+        log_printf("alloc tls failed.\n");
+        return -1;
+    }
+
+    segment_desc_set(sel, tls, 0xFFFFFFFF,
+                     SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL |
+                     SEG_TYPE_DATA | SEG_TYPE_RW | SEG_D);
+    task->tls = tls;
+    task->tls_sel = sel;
+    task->tss.gs = sel | SEG_RPL3;
+    return 0;
+}
+
+/**
+ * @brief Change the scheduling class of current task, the bandwidth of deadline task is checked with its CPU
+ */
+static int task_set_policy (task_t * task, int policy, uint32_t runtime, uint32_t deadline, uint32_t period) {
+    uint32_t bw = 0;
+    if (policy == SCHED_POLICY_DEADLINE) {
+        bw = (uint32_t)clock_div64((uint64_t)runtime << SCHED_DL_BW_SHIFT, period, (uint32_t *)0);
+    }
+
+    irq_state_t state = irq_enter_protection();
+    cpu_rq_t * rq = task_manager.rq + task->cpu;
+    spin_lock(&rq->lock);
+
+    // admission control, the deadlines can be met only if the total bandwidth doesn't exceed the CPU
+    uint32_t total = rq->dl_bw - task->dl_bw + bw;
+    if ((policy == SCHED_POLICY_DEADLINE) && (total > SCHED_DL_BW_MAX)) {
+        spin_unlock(&rq->lock);
+        irq_leave_protection(state);
+        return -1;
+    }
+    rq->dl_bw = total;
+
+    // it's running, so in the list of its class and not throttled
+    if (task_in_rq(task)) {
+        list_remove(task_rq_list(rq, task), &task->run_node);
+    }
+
+    task->policy = policy;
+    task->dl_runtime = runtime;
+    task->dl_deadline = deadline;
+    task->dl_period = period;
+    task->dl_bw = bw;
+    task->dl_throttled = 0;
+
+    if (policy == SCHED_POLICY_DEADLINE) {
+        uint64_t now = time_ns();
+        task->dl_abs_deadline = now + deadline;
+        task->dl_remaining = runtime;
+        task->dl_exec_start = now;
+        task->dl_missed = 0;
+    }
+    if (task_in_rq(task)) {
+        rq_enqueue(rq, task, 1);
+    }
+    spin_unlock(&rq->lock);
+
+    // other deadline task may be earlier
+    task_dispatch();
+    irq_leave_protection(state);
+
+    // replenishing is not needed any more
+    if (policy != SCHED_POLICY_DEADLINE) {
+        hrtimer_cancel(&task->dl_timer);
+    }
+    return 0;
+}
+
+/**
+ * @brief Let current Task yield CPU
+ */
+int sys_yield (void) {
+    irq_state_t state = irq_enter_protection();
+    cpu_rq_t * rq = rq_this();
+    task_t * curr = task_current();
+
+    if (curr->policy == SCHED_POLICY_DEADLINE) {
+        // done in this period, give up the budget left and wait for the next one
+        spin_lock(&rq->lock);
+        dl_update_curr(rq, curr, time_ns());
+        if (!curr->dl_throttled) {
+            curr->dl_remaining = 0;
+            dl_throttle(rq, curr);
+        }
+        spin_unlock(&rq->lock);
+
+        task_dispatch();
+    } else if (list_count(&rq->ready_list) > 1) {
+        task_t * curr_task = task_current();
+
+        // if there are other tasks in the list, move the current task to the end of the list
+        task_set_block(curr_task);
+        task_set_ready(curr_task);
+
+        // switch to the next task. It's important to protect this section until the switch is complete;
+        // otherwise, issues may arise if the next task gets blocked or deleted for some reason after running, and we come back here to switch
+        task_dispatch();
+    }
+    irq_leave_protection(state);
+
+    return 0;
+}
+
+/**
+ * @brief Execute a task scheduling
+ */
+void task_dispatch (void) {
+    cpu_rq_t * rq = rq_this();
+
+    spin_lock(&rq->lock);
+
+    // we are running, so the task switched out last time has been saved in its TSS
+    rq_finish_switch(rq);
+
+    // charge the deadline task running, it may be throttled and switched out below
+    uint64_t now_ns = 0;
+    if (rq->curr_task->policy == SCHED_POLICY_DEADLINE) {
+        now_ns = time_ns();
+        dl_update_curr(rq, rq->curr_task, now_ns);
+    }
+
+    task_t * to = task_next_run(rq);
+    if (to != rq->curr_task) {
+        task_t * from = rq->curr_task;
+        uint32_t now = time_get_tick();
+
+        // still ready when switched out, it's preempted and begins waiting from now
+        if (from != &rq->idle_task) {
+            if (from->on_rq) {
+                from->nivcsw++;
+                from->ready_tick = now;
+            } else {
+                from->nvcsw++;
+            }
+        }
+
+        if (to != &rq->idle_task) {
+            to->wait_ticks += now - to->ready_tick;
+        }
+
+        // the TSCs of CPUs may differ a little, if it's woken up on other CPU
+        uint32_t latency_us = 0;
+        uint64_t tsc = time_tsc();
+        if (to->wakeup_tsc) {
+            latency_us = (tsc > to->wakeup_tsc) ? time_tsc_to_us(tsc - to->wakeup_tsc) : 0;
+            to->wakeup_tsc = 0;
+            latency_add(&to->latency, latency_us);
+            latency_add(&rq->latency, latency_us);
+        }
+        sched_trace_event(rq, SCHED_EVENT_SWITCH, to, tsc, latency_us);
+
+        if (to->policy == SCHED_POLICY_DEADLINE) {
+            to->dl_exec_start = now_ns ? now_ns : time_ns();
+        }
+
+        to->on_cpu = 1;
+        rq->curr_task = to;
+        rq->prev_task = from;
+        spin_unlock(&rq->lock);
+
+        task_switch_from_to(from, to);
+
+        // resumed here, maybe on other CPU. finish the switch to us now, so the task switched out,
+        // e.g. a child exiting, can be reclaimed without waiting for the next dispatch
+        rq = rq_this();
+        spin_lock(&rq->lock);
+        rq_finish_switch(rq);
+        spin_unlock(&rq->lock);
+    } else {
+        spin_unlock(&rq->lock);
+    }
+}
+
+/**
+ * @brief Time handling
+ * being called in the interupt handler func, user is set if the tick interrupts user mode
+ */
+void task_time_tick (int user) {
+    // handling of time slices
+    irq_state_t state = irq_enter_protection();
+    cpu_rq_t * rq = rq_this();
+    task_t * curr_task = rq->curr_task;
+
+    // the whole tick is charged to the task interrupted
+    if (user) {
+        curr_task->utime++;
+    } else {
+        curr_task->stime++;
+    }
+
+    // deadline task has no time slice, it's charged in dispatch
+    if ((curr_task->policy != SCHED_POLICY_DEADLINE) && (--curr_task->slice_ticks == 0)) {
+    // time slice is exhausted, reload the time slice
+    // for idle tasks, subtract unused time here
+        curr_task->slice_ticks = curr_task->time_slice;
+
+        // adjust the position of the list to the tail
+        task_set_block(curr_task);
+        task_set_ready(curr_task);
+    }
+
+    task_dispatch();
+    irq_leave_protection(state);
+}
+
+/**
+ * @brief Assign with a Task structure
+ */
+static task_t * alloc_task (void) {
+    task_t * task = (task_t *)0;
+
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    list_node_t * node = list_remove_first(&task_manager.free_list);
+    if (node) {
+        task = list_node_parent(node, task_t, all_node);
+    }
+    spin_unlock_protect(&task_manager.lock, state);
+
+    return task;
+}
+
+/**
+ * @brief Release Task structure
+ */
+static void free_task (task_t * task) {
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    list_insert_first(&task_manager.free_list, &task->all_node);
+    spin_unlock_protect(&task_manager.lock, state);
+}
+
+/**
+ * @brief Create a kernel thread
+ * it runs in ring 0 on the kernel page table, nothing is loaded from disk
+ */
+task_t * kthread_create (const char * name, void (*entry)(void * arg), void * arg, int flag) {
+    task_t * task = alloc_task();
+    if (task == (task_t *)0) {
+        return (task_t *)0;
+    }
+
+    int err = task_init(task, name, flag | TASK_FLAG_SYSTEM | TASK_FLAG_KTHREAD, (uint32_t)entry, 0, 0);
+    if (err < 0) {
+        free_task(task);
+        return (task_t *)0;
+    }
+
+    // pass arg as a normal call, the entry should never return
+    uint32_t * esp = (uint32_t *)task->tss.esp;
+    *--esp = (uint32_t)arg;
+    *--esp = 0;
+    task->tss.esp = (uint32_t)esp;
+
+    task_start(task);
+    return task;
+}
+
+/**
+ * @brief Create a kernel thread in the process of leader
+ * it runs in ring 0 on the page table and files of the process, and is counted
+ * in its threads, so the process is gone after it exits
+ */
+task_t * kthread_create_in (task_t * leader, const char * name, void (*entry)(void * arg), void * arg) {
+    task_t * task = alloc_task();
+    if (task == (task_t *)0) {
+        return (task_t *)0;
+    }
+
+    // run on the page table of leader
+    int err = task_init(task, name, TASK_FLAG_SYSTEM | TASK_FLAG_THREAD, (uint32_t)entry, 0, leader->tss.cr3);
+    if (err < 0) {
+        task_uninit(task);
+        free_task(task);
+        return (task_t *)0;
+    }
+
+    uint32_t * esp = (uint32_t *)task->tss.esp;
+    *--esp = (uint32_t)arg;
+    *--esp = 0;
+    task->tss.esp = (uint32_t)esp;
+
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    task->leader = leader;
+    task->parent = leader;
+    leader->threads++;
+    list_insert_last(&leader->thread_list, &task->child_node);
+    spin_unlock_protect(&task_manager.lock, state);
+
+    task_start(task);
+    return task;
+}
+
+/**
+ * @brief Wake up the task when the sleep time expires, in timer interrupt
+ */
+static void task_sleep_timeout (hrtimer_t * timer) {
+    task_t * task = (task_t *)timer->data;
+
+    // it may have been woken up by the kill of its process
+    spin_lock(&task_manager.lock);
+    if (task->state == TASK_SLEEP) {
+        task_set_ready(task);
+    }
+    spin_unlock(&task_manager.lock);
+}
+
+/**
+ * @brief Task enters a sleep state for ns
+ */
+void task_sleep_ns (uint64_t ns) {
+    task_t * curr_task = task_current();
+
+    hrtimer_t timer;
+    hrtimer_init(&timer, task_sleep_timeout, curr_task);
+
+    // the timer may expire on other CPU before switching, then it's just put back to the ready list
+    irq_state_t state = irq_enter_protection();
+    spin_lock(&task_manager.lock);
+    if (curr_task->flags & TASK_FLAG_KILL) {
+        spin_unlock(&task_manager.lock);
+        irq_leave_protection(state);
+        return;
+    }
+    task_set_block(curr_task);
+    curr_task->state = TASK_SLEEP;
+    hrtimer_start(&timer, time_ns() + ns, curr_task->timer_slack);
+    spin_unlock(&task_manager.lock);
+
+    // execute a scheduling
+    task_dispatch();
+
+    irq_leave_protection(state);
+
+    // the timer is on the stack, make sure its function has returned
+    hrtimer_cancel(&timer);
+}
+
+/**
+ * @brief Task enters a sleep state
+ */
+void sys_msleep (uint32_t ms) {
+    task_sleep_ns((uint64_t)ms * 1000000);
+}
+
+/**
+ * @brief Sleep for the time in req, it's never interrupted so rem is always 0
+ */
+int sys_nanosleep (const struct timespec * req, struct timespec * rem) {
+    if ((req == (const struct timespec *)0) || (req->tv_sec < 0)
+            || (req->tv_nsec < 0) || (req->tv_nsec >= NSEC_PER_SEC)) {
+        return -1;
+    }
+
+    task_sleep_ns((uint64_t)req->tv_sec * NSEC_PER_SEC + req->tv_nsec);
+
+    if (rem) {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Set the timer slack of current task in ns, return the old one
+ * a negative value only returns the current setting
+ */
+int sys_timer_slack (int ns) {
+    task_t * curr_task = task_current();
+    int old = (int)curr_task->timer_slack;
+
+    if (ns >= 0) {
+        curr_task->timer_slack = ns;
+    }
+    return old;
+}
+
+
+/**
+ * @brief Copy the list of open files from the current process
+ */
+static void copy_opened_files(task_t * child_task) {
+    task_t * parent = task_current()->leader;
+
+    for (int i = 0; i < TASK_OFILE_NR; i++) {
+        file_t * file = parent->file_table[i];
+        if (file) {
+            file_inc_ref(file);
+            child_task->file_table[i] = parent->file_table[i];
+        }
+    }
+}
+
+/**
+ * @brief Create a copy of the current process, not started yet
+ * the child shares the page table of parent if share_vm is set, otherwise it gets a copy
+ */
+static task_t * fork_task (int share_vm) {
+    task_t * parent_task = task_current();
+
+    // assign Task structure
+    task_t * child_task = alloc_task();
+    if (child_task == (task_t *)0) {
+        goto fork_failed;
+    }
+
+    syscall_frame_t * frame = (syscall_frame_t *)(parent_task->tss.esp0 - sizeof(syscall_frame_t));
+
+    // the page table of parent, or a copy of its memory space
+    uint32_t page_dir = parent_task->tss.cr3;
+    if (!share_vm) {
+        page_dir = memory_copy_uvm(parent_task->tss.cr3);
+        if (page_dir == 0) {
+            goto fork_failed;
+        }
+    }
+
+    // initialize the child process and adjust necessary fields.
+    // the ESP needs to be reduced by the total number of argument bytes for system calls,
+    // as it returns through a normal 'ret' instruction without going through the system call handling 'ret' (which returns the number of arguments).
+    int err = task_init(child_task,  parent_task->name, share_vm ? TASK_FLAG_VFORK : 0, frame->eip,
+                        frame->esp + sizeof(uint32_t)*SYSCALL_PARAM_COUNT, page_dir);
+    if (err < 0) {
+        // not taken by the child yet
+        if (!share_vm) {
+            memory_destroy_uvm(page_dir);
+        }
+        goto fork_failed;
+    }
 
     // copy opened file
     copy_opened_files(child_task);
+    fpu_task_fork(child_task);
+    child_task->timer_slack = parent_task->timer_slack;
+    child_task->heap_start = parent_task->leader->heap_start;
+    child_task->heap_end = parent_task->leader->heap_end;
 
     // retrieve partial state from the parent process's stack and then write it to the TSS
     // check if ESP, EIP, and other values are within the user space range to avoid causing a page fault
@@ -523,22 +1341,70 @@ int sys_fork (void) {
     tss->gs = frame->gs;
     tss->eflags = frame->eflags;
 
-    child_task->parent = parent_task;
-
-    // copy the memory space of the parent process to the child process.
-    if ((child_task->tss.cr3 = memory_copy_uvm(parent_task->tss.cr3)) < 0) {
+    // a thread forking, the child has its own copy of the TLS
+    if (parent_task->tls && (task_set_tls(child_task, parent_task->tls) < 0)) {
         goto fork_failed;
     }
 
-    // after successfully created, return the child pid
-    task_start(child_task);
-    return child_task->pid;
+    // nothing can fail from now on, link it to the parent
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    child_task->parent = parent_task;
+    list_insert_last(&parent_task->child_list, &child_task->child_node);
+    spin_unlock_protect(&task_manager.lock, state);
+    return child_task;
+
 fork_failed:
     if (child_task) {
         task_uninit (child_task);
         free_task(child_task);
     }
-    return -1;
+    return (task_t *)0;
+}
+
+/**
+ * @brief Create a copy of the process
+ */
+int sys_fork (void) {
+    task_t * child_task = fork_task(0);
+    if (child_task == (task_t *)0) {
+        return -1;
+    }
+
+    // after successfully created, return the child pid
+    int pid = child_task->pid;
+    task_start(child_task);
+    return pid;
+}
+
+/**
+ * @brief Create a child running on the memory of parent, without copying it
+ * the parent is suspended until the child calls execve or exits
+ */
+int sys_vfork (void) {
+    task_t * child_task = fork_task(1);
+    if (child_task == (task_t *)0) {
+        return -1;
+    }
+
+    // not on the stack, sem_notify may still be unlocking it when the parent runs again
+    task_t * parent_task = task_current();
+    sem_init(&parent_task->vfork_sem, 0);
+    child_task->vfork_done = &parent_task->vfork_sem;
+
+    int pid = child_task->pid;
+    task_start(child_task);
+    sem_wait_nokill(&parent_task->vfork_sem);
+    return pid;
+}
+
+/**
+ * @brief Release the parent suspended in vfork, the page table of parent is not used from now on
+ */
+static void vfork_release (task_t * task) {
+    if (task->vfork_done) {
+        sem_notify(task->vfork_done);
+        task->vfork_done = (sem_t *)0;
+    }
 }
 
 /**
@@ -569,317 +1435,957 @@ static int load_phdr(int file, Elf32_Phdr * phdr, uint32_t page_dir) {
     while (size > 0) {
         int curr_size = (size > MEM_PAGE_SIZE) ? MEM_PAGE_SIZE : size;
 
-        uint32_t paddr = memory_get_paddr(page_dir, vaddr);
+        uint32_t paddr = memory_get_paddr(page_dir, vaddr);
+
+        // NOTE: the page used here is current, not other
+        if (sys_read(file, (char *)paddr, curr_size) <  curr_size) {
+            log_printf("read file failed");
+            return -1;
+        }
+
+        size -= curr_size;
+        vaddr += curr_size;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Load ELF file into memory
+ */
+static uint32_t load_elf_file (task_t * task, const char * name, uint32_t page_dir) {
+    Elf32_Ehdr elf_hdr;
+    Elf32_Phdr elf_phdr;
+
+    // open in only-read way
+    int file = sys_open(name, 0);   // TODO:  use 0 tempararily
+    if (file < 0) {
+        log_printf("open file failed.%s", name);
+        goto load_failed;
+    }
+
+    // read file header first
+    int cnt = sys_read(file, (char *)&elf_hdr, sizeof(Elf32_Ehdr));
+    if (cnt < sizeof(Elf32_Ehdr)) {
+        log_printf("elf hdr too small. size=%d", cnt);
+        goto load_failed;
+    }
+
+    // check
+    if ((elf_hdr.e_ident[0] != ELF_MAGIC) || (elf_hdr.e_ident[1] != 'E')
+        || (elf_hdr.e_ident[2] != 'L') || (elf_hdr.e_ident[3] != 'F')) {
+        log_printf("check elf indent failed.");
+        goto load_failed;
+    }
+
+    // it must be an executable file, of type for the 386 processor, and have an entry point
+    if ((elf_hdr.e_type != ET_EXEC) || (elf_hdr.e_machine != ET_386) || (elf_hdr.e_entry == 0)) {
+        log_printf("check elf type or entry failed.");
+        goto load_failed;
+    }
+
+    // it must have program header
+    if ((elf_hdr.e_phentsize == 0) || (elf_hdr.e_phoff == 0)) {
+        log_printf("none programe header");
+        goto load_failed;
+    }
+
+    // load the program headers and copy their contents to the corresponding locations
+    uint32_t e_phoff = elf_hdr.e_phoff;
+    for (int i = 0; i < elf_hdr.e_phnum; i++, e_phoff += elf_hdr.e_phentsize) {
+        if (sys_lseek(file, e_phoff, 0) < 0) {
+            log_printf("read file failed");
+            goto load_failed;
+        }
+
+        // parse program header after reading it
+        cnt = sys_read(file, (char *)&elf_phdr, sizeof(Elf32_Phdr));
+        if (cnt < sizeof(Elf32_Phdr)) {
+            log_printf("read file failed");
+            goto load_failed;
+        }
+
+        // checks
+        if ((elf_phdr.p_type != PT_LOAD) || (elf_phdr.p_vaddr < MEMORY_TASK_BASE)) {
+           continue;
+        }
+
+        // load current program header
+        int err = load_phdr(file, &elf_phdr, page_dir);
+        if (err < 0) {
+            log_printf("load program hdr failed");
+            goto load_failed;
+        }
+
+        // TODO: more checks here
+        task->heap_start = elf_phdr.p_vaddr + elf_phdr.p_memsz;
+        task->heap_end = task->heap_start;
+   }
+
+    sys_close(file);
+    return elf_hdr.e_entry;
+
+load_failed:
+    if (file >= 0) {
+        sys_close(file);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Copy process arguments to the stack
+ */
+static int copy_args (char * to, uint32_t page_dir, int argc, char **argv) {
+    // write argc, argv pointers, and parameter strings sequentially into stack top
+    task_args_t task_args;
+    task_args.argc = argc;
+    task_args.argv = (char **)(to + sizeof(task_args_t));
+
+    // copy various parameters, skipping task_args and the argument table, and write each argv parameter into memory space
+    char * dest_arg = to + sizeof(task_args_t) + sizeof(char *) * (argc + 1);   
+    
+    // argv table
+    char ** dest_argv_tb = (char **)memory_get_paddr(page_dir, (uint32_t)(to + sizeof(task_args_t)));
+    ASSERT(dest_argv_tb != 0);
+
+    for (int i = 0; i < argc; i++) {
+        char * from = argv[i];
+
+        int len = kernel_strlen(from) + 1;   
+        int err = memory_copy_uvm_data((uint32_t)dest_arg, page_dir, (uint32_t)from, len);
+        ASSERT(err >= 0);
+
+        // link with ar
+        dest_argv_tb[i] = dest_arg;
+
+        // record current location, move forward
+        dest_arg += len;
+    }
+
+    // maybe no parameter, no need to write
+    if (argc) {
+        dest_argv_tb[argc] = '\0';
+    }
+
+     // write task_args
+    return memory_copy_uvm_data((uint32_t)to, page_dir, (uint32_t)&task_args, sizeof(task_args_t));
+}
+
+/**
+ * @brief Load the program and its arguments into the page table, return the entry and the initial user stack
+ * the arguments are read from the current process, 0 is returned if failed
+ */
+static uint32_t load_program (task_t * task, const char * name, char * const * argv, uint32_t page_dir, uint32_t * esp) {
+    // load ELF file into memory
+    uint32_t entry = load_elf_file(task, name, page_dir);
+    if (entry == 0) {
+        return 0;
+    }
+
+    // prepare user stack space, reserving space for environment and parameters
+    uint32_t stack_top = MEM_TASK_STACK_TOP - MEM_TASK_ARG_SIZE;    // reserve a portion of parameter space
+    int err = memory_alloc_for_page_dir(page_dir,
+                            MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE,
+                            MEM_TASK_STACK_SIZE, PTE_P | PTE_U | PTE_W);
+    if (err < 0) {
+        return 0;
+    }
+
+    // copy parameters and write them to the top of the stack
+    int argc = strings_count((char **)argv);
+    err = copy_args((char *)stack_top, page_dir, argc, (char **)argv);
+    if (err < 0) {
+        return 0;
+    }
+
+    *esp = stack_top;
+    return entry;
+}
+
+/**
+ * @brief Load a process
+ */
+int sys_execve(char *name, char **argv, char **env) {
+    task_t * task = task_current();
+
+    // other threads are running on the page table to be replaced, the poller of uring is stopped
+    if ((task->leader != task) || (task->threads - uring_pollers(task) > 1)) {
+        return -1;
+    }
+    uring_shutdown(task);
+
+    // page tables will be switched later, so let's handle the cases where data needs to be fetched from the process space first
+    kernel_strncpy(task->name, get_file_name(name), TASK_NAME_SIZE);
+
+    // switch to new page table
+    uint32_t old_page_dir = task->tss.cr3;
+    uint32_t new_page_dir = memory_create_uvm();
+    if (!new_page_dir) {
+        goto exec_failed;
+    }
+
+    uint32_t stack_top;
+    uint32_t entry = load_program(task, name, argv, new_page_dir, &stack_top);
+    if (entry == 0) {
+        goto exec_failed;
+    }
+
+    // he purpose of 'exec' is to replace the current process, so it only requires changing the current process's execution flow
+    // when this process resumes execution, it's as if it's starting anew, 
+    // so the user stack should be set to its initial state, and the execution address should be set to the program's entry point
+    syscall_frame_t * frame = (syscall_frame_t *)(task->tss.esp0 - sizeof(syscall_frame_t));
+    frame->eip = entry;
+    frame->eax = frame->ebx = frame->ecx = frame->edx = 0;
+    frame->esi = frame->edi = frame->ebp = 0;
+    frame->eflags = EFLAGS_DEFAULT| EFLAGS_IF;  
+
+    // The kernel stack doesn't need to be modified; it remains unchanged. Subsequent calls to 'memory_destroy_uvm' won't destroy the mapping of the kernel stack
+    // However, the user stack needs to be altered. Additionally, the space for the parameters of the call gate should be pushed onto it.
+    frame->esp = stack_top - sizeof(uint32_t)*SYSCALL_PARAM_COUNT;
+
+    // no TLS for the new program
+    task_set_tls(task, 0);
+    frame->gs = frame->ds;
+
+    // switch to new page table
+    task->tss.cr3 = new_page_dir;
+    mmu_set_page_dir(new_page_dir); 
+
+    // release the original process's content space, or give it back to the parent in vfork
+    if (task->flags & TASK_FLAG_VFORK) {
+        task->flags &= ~TASK_FLAG_VFORK;
+        vfork_release(task);
+    } else {
+        memory_destroy_uvm(old_page_dir);
+    }
+
+    // new program starts with the initial FPU state, and without the rings in the old image
+    fpu_task_reset(task);
+    uring_release(task);
+
+    return  0;
+
+exec_failed:    //resource release
+    if (new_page_dir) {
+        // switch to the old page table and destroy the new page table
+        task->tss.cr3 = old_page_dir;
+        mmu_set_page_dir(old_page_dir);
+        memory_destroy_uvm(new_page_dir);
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Give the child the files of current process in fd_map, or all of them if fd_map is null
+ */
+static int spawn_files (task_t * child_task, const int * fd_map) {
+    if (fd_map == (const int *)0) {
+        copy_opened_files(child_task);
+        return 0;
+    }
+
+    // check all of them first, nothing to undo then
+    for (int i = 0; i < SPAWN_FD_NR; i++) {
+        if ((fd_map[i] >= 0) && (task_file(fd_map[i]) == (file_t *)0)) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < SPAWN_FD_NR; i++) {
+        if (fd_map[i] >= 0) {
+            file_t * file = task_file(fd_map[i]);
+            file_inc_ref(file);
+            child_task->file_table[i] = file;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Create a process running the program directly, without copying the current one
+ * fd i of the child is fd_map[i] of the current process, closed if it's negative
+ */
+int sys_spawn (const char * name, char * const * argv, char * const * env, const int * fd_map) {
+    task_t * parent_task = task_current();
+
+    task_t * child_task = alloc_task();
+    if (child_task == (task_t *)0) {
+        goto spawn_failed;
+    }
+
+    // the entry and stack are set after loading
+    int err = task_init(child_task, get_file_name((char *)name), 0, 0, 0, 0);
+    if (err < 0) {
+        goto spawn_failed;
+    }
+
+    // load into the page table created in task_init, it starts from the entry as after execve
+    uint32_t stack_top;
+    uint32_t entry = load_program(child_task, name, argv, child_task->tss.cr3, &stack_top);
+    if (entry == 0) {
+        goto spawn_failed;
+    }
+    child_task->tss.eip = entry;
+    child_task->tss.esp = stack_top;
+    child_task->timer_slack = parent_task->timer_slack;
+
+    if (spawn_files(child_task, fd_map) < 0) {
+        goto spawn_failed;
+    }
+
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    child_task->parent = parent_task;
+    list_insert_last(&parent_task->child_list, &child_task->child_node);
+    spin_unlock_protect(&task_manager.lock, state);
+
+    int pid = child_task->pid;
+    task_start(child_task);
+    return pid;
+
+spawn_failed:
+    if (child_task) {
+        task_uninit(child_task);
+        free_task(child_task);
+    }
+    return -1;
+}
+
+/**
+ * @brief Return Task pid
+ */
+int sys_getpid (void) {
+    task_t * curr_task = task_current();
+    return curr_task->leader->pid;
+}
+
+
+/**
+ * @brief Check if the task or any of its threads is still on its kernel stack in some CPU
+ */
+static int task_group_on_cpu (task_t * leader) {
+    if (leader->on_cpu) {
+        return 1;
+    }
+
+    for (list_node_t * node = list_first(&leader->thread_list); node; node = list_node_next(node)) {
+        task_t * thread = list_node_parent(node, task_t, child_node);
+        if (thread->on_cpu) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Waiting for the child process to exit
+ */
+int sys_wait(int* status) {
+    task_t * curr_task = task_current();
+
+    for (;;) {
+        // take an exited child, it's unlinked from the parent with the lock held
+        task_t * task = (task_t *)0;
+        int busy = 0;
+
+        irq_state_t state = irq_enter_protection();
+        spin_lock(&task_manager.lock);
+        for (list_node_t * node = list_first(&curr_task->zombie_list); node; node = list_node_next(node)) {
+            task_t * zombie = list_node_parent(node, task_t, child_node);
+
+            // it may be still on its kernel stack in other CPU, so may its last thread
+            if (task_group_on_cpu(zombie)) {
+                busy = 1;
+                continue;
+            }
+
+            list_remove(&curr_task->zombie_list, node);
+            task = zombie;
+            break;
+        }
+
+        // the process is exiting, don't wait any more
+        if ((task == (task_t *)0) && (curr_task->flags & TASK_FLAG_KILL)) {
+            spin_unlock(&task_manager.lock);
+            irq_leave_protection(state);
+            return -1;
+        }
+
+        if ((task == (task_t *)0) && !busy) {
+            // not found, wait. the child moves itself to the zombie list with the lock held, so it's not missed
+            task_set_block(curr_task);
+            curr_task->state = TASK_WAITING;
+            spin_unlock(&task_manager.lock);
+
+            task_dispatch();
+            irq_leave_protection(state);
+            continue;
+        }
+        spin_unlock(&task_manager.lock);
+        irq_leave_protection(state);
+
+        if (task == (task_t *)0) {
+            sys_msleep(OS_TICK_MS);
+            continue;
+        }
+
+        int pid = task->pid;
+        *status = task->status;
+
+        // threads not joined, all of them have exited
+        list_node_t * node;
+        while ((node = list_remove_first(&task->thread_list)) != (list_node_t *)0) {
+            task_t * thread = list_node_parent(node, task_t, child_node);
+            task_uninit(thread);
+            free_task(thread);
+        }
+
+        task_uninit(task);
+        free_task(task);
+        return pid;
+    }
+}
+
+/**
+ * @brief Move the exited process to the zombie list of parent, and wake up the parent in wait
+ * the lock of task manager should be held
+ */
+static void task_notify_parent (task_t * task) {
+    task_t * parent = task->parent;
+
+    list_remove(&parent->child_list, &task->child_node);
+    list_insert_last(&parent->zombie_list, &task->child_node);
+    // called by the exiting task, it never runs again. let the parent reclaim it right now
+    if (parent->state == TASK_WAITING) {
+        task_set_ready_sync(parent);
+    }
+}
+
+/**
+ * @brief Exit current task, the process is gone with its last thread
+ */
+void task_exit (int status) {
+    task_t * curr_task = task_current();
+    task_t * leader = curr_task->leader;
+
+    if (curr_task->flags & TASK_FLAG_TRACE) {
+        syscall_trace_set(curr_task, 0);
+    }
+
+    // the files are shared by the threads, closed by the last one
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    int left = --leader->threads;
+    spin_unlock_protect(&task_manager.lock, state);
+    int last = (left == 0);
+
+    // the poller of uring only serves other threads, it's the last one then
+    if (left == 1) {
+        uring_stop(leader);
+    } else if (last) {
+        uring_release(leader);
+    }
+
+    // Close all opened files. The standard input and output libraries will be closed by newlib, but we still handle them here
+    for (int fd = 0; last && (fd < TASK_OFILE_NR); fd++) {
+        file_t * file = leader->file_table[fd];
+        if (file) {
+            sys_close(fd);
+            leader->file_table[fd] = (file_t *)0;
+        }
+    }
+
+    // the task struct will be reused after it's reclaimed
+    fpu_task_reset(curr_task);
+
+    // release the bandwidth reserved and stop replenishing
+    if (curr_task->policy != SCHED_POLICY_NORMAL) {
+        task_set_policy(curr_task, SCHED_POLICY_NORMAL, 0, 0, 0);
+    }
+
+    // the page table is still owned by the parent in vfork, let it go on
+    vfork_release(curr_task);
+
+    state = irq_enter_protection();
+    spin_lock(&task_manager.lock);
+
+    // hand all child processes over to the init process
+    // zombies among them are not reclaimed by the current process because it is about to exit
+    task_t * init_task = &task_manager.first_task;
+    int move_zombie = list_count(&curr_task->zombie_list);
+    list_node_t * node;
+    while ((node = list_remove_first(&curr_task->child_list)) != (list_node_t *)0) {
+        task_t * task = list_node_parent(node, task_t, child_node);
+        task->parent = init_task;
+        list_insert_last(&init_task->child_list, node);
+    }
+    while ((node = list_remove_first(&curr_task->zombie_list)) != (list_node_t *)0) {
+        task_t * task = list_node_parent(node, task_t, child_node);
+        task->parent = init_task;
+        list_insert_last(&init_task->zombie_list, node);
+    }
+
+    // save the return value and enter the zombie state
+    curr_task->status = status;
+    curr_task->state = TASK_ZOMBIE;
+    task_set_block(curr_task);
+
+    // if there are orphaned zombies, wake up the init process
+    if (move_zombie && (init_task->state == TASK_WAITING)) {
+        task_set_ready(init_task);
+    }
+
+    // the thread exiting the process waits for the killed ones
+    if ((curr_task->flags & TASK_FLAG_KILL) && leader->killer && (--leader->kill_left == 0)
+            && (leader->killer->state == TASK_WAITING)) {
+        task_set_ready(leader->killer);
+    }
+
+    // a thread is reclaimed by join, or with the leader if nobody joins it
+    if ((curr_task != leader) && curr_task->joiner && (curr_task->joiner->state == TASK_WAITING)) {
+        task_set_ready_sync(curr_task->joiner);
+    }
+
+    // the process is gone when all of its threads exit, the leader is reclaimed by parent then
+    // if the parent process is not waiting, keep handling the zombie state
+    if (last) {
+        task_notify_parent(leader);
+    }
+    spin_unlock(&task_manager.lock);
+
+    // NOTE: the task is freed by parent only after other task runs on this CPU
+    task_dispatch();
+
+    irq_leave_protection(state);
+}
+
+/**
+ * @brief Kill the other threads of current process, they exit with status when going back
+ * to user mode, the ones sleeping in wait, join, sleep, futex or a wait queue are woken up for it.
+ * return -1 if the process has been killed by another thread
+ */
+static int task_kill_group (int status) {
+    task_t * curr_task = task_current();
+    task_t * leader = curr_task->leader;
+    int killed = 0;
+
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    if (curr_task->flags & TASK_FLAG_KILL) {
+        spin_unlock_protect(&task_manager.lock, state);
+        return -1;
+    }
+
+    leader->status = status;
+    for (list_node_t * node = &leader->child_node; node; ) {
+        task_t * task = (node == &leader->child_node) ? leader : list_node_parent(node, task_t, child_node);
+        node = (task == leader) ? list_first(&leader->thread_list) : list_node_next(node);
+
+        // the poller of uring is stopped by the last thread, see task_exit
+        if ((task == curr_task) || (task->state == TASK_ZOMBIE) || (task->flags & TASK_FLAG_SYSTEM)) {
+            continue;
+        }
+
+        __atomic_fetch_or(&task->flags, TASK_FLAG_KILL, __ATOMIC_RELAXED);
+        if ((task->state == TASK_WAITING) || (task->state == TASK_SLEEP)) {
+            task_set_ready(task);
+        } else {
+            waitq_wake_killed(task);
+        }
+        killed++;
+    }
+
+    // the last one killed wakes us up in task_exit
+    leader->killer = curr_task;
+    leader->kill_left = killed;
+    spin_unlock_protect(&task_manager.lock, state);
+
+    if (killed) {
+        futex_wake_killed(leader);
+    }
+    return 0;
+}
+
+/**
+ * @brief Exit current task if its process is exiting, called on the way back to user mode
+ */
+void task_check_kill (void) {
+    task_t * curr_task = task_current();
+    if (curr_task->flags & TASK_FLAG_KILL) {
+        task_exit(curr_task->leader->status);
+    }
+}
+
+/**
+ * @brief Exit the process with all its threads
+ * the others are killed and waited for, so current task is the last one to close the files
+ */
+void sys_exit(int status) {
+    task_t * curr_task = task_current();
+
+    if (task_kill_group(status) == 0) {
+        task_t * leader = curr_task->leader;
 
-        // NOTE: the page used here is current, not other
-        if (sys_read(file, (char *)paddr, curr_size) <  curr_size) {
-            log_printf("read file failed");
-            return -1;
+        irq_state_t state = irq_enter_protection();
+        spin_lock(&task_manager.lock);
+        while (leader->kill_left) {
+            task_set_block(curr_task);
+            curr_task->state = TASK_WAITING;
+            spin_unlock(&task_manager.lock);
+
+            task_dispatch();
+            spin_lock(&task_manager.lock);
         }
+        leader->killer = (task_t *)0;
+        spin_unlock(&task_manager.lock);
+        irq_leave_protection(state);
 
-        size -= curr_size;
-        vaddr += curr_size;
+        task_exit(status);
     }
 
-    return 0;
+    // killed by another thread, exit with its status
+    task_exit(curr_task->leader->status);
 }
 
 /**
- * @brief Load ELF file into memory
+ * @brief Exit current thread only, the process is gone if it's the last one
  */
-static uint32_t load_elf_file (task_t * task, const char * name, uint32_t page_dir) {
-    Elf32_Ehdr elf_hdr;
-    Elf32_Phdr elf_phdr;
+void sys_thread_exit (int status) {
+    task_exit(status);
+}
 
-    // open in only-read way
-    int file = sys_open(name, 0);   // TODO:  use 0 tempararily
-    if (file < 0) {
-        log_printf("open file failed.%s", name);
-        goto load_failed;
+/**
+ * @brief Create a thread running entry(arg) on the stack, sharing the page table and files of current process
+ * gs of the thread is based at tls if it's not 0, return the id of the thread
+ */
+int sys_clone (void (*entry)(void *), void * stack, void * arg, void * tls) {
+    task_t * curr_task = task_current();
+    task_t * leader = curr_task->leader;
+
+    if ((entry == 0) || (stack == 0)) {
+        return -1;
     }
 
-    // read file header first
-    int cnt = sys_read(file, (char *)&elf_hdr, sizeof(Elf32_Ehdr));
-    if (cnt < sizeof(Elf32_Ehdr)) {
-        log_printf("elf hdr too small. size=%d", cnt);
-        goto load_failed;
+    task_t * child_task = alloc_task();
+    if (child_task == (task_t *)0) {
+        goto clone_failed;
     }
 
-    // check
-    if ((elf_hdr.e_ident[0] != ELF_MAGIC) || (elf_hdr.e_ident[1] != 'E')
-        || (elf_hdr.e_ident[2] != 'L') || (elf_hdr.e_ident[3] != 'F')) {
-        log_printf("check elf indent failed.");
-        goto load_failed;
+    // it starts as entry is called with arg, entry never returns
+    uint32_t esp = (uint32_t)stack - sizeof(uint32_t) * 2;
+    // run on the page table of leader
+    int err = task_init(child_task, curr_task->name, TASK_FLAG_THREAD, (uint32_t)entry, esp, leader->tss.cr3);
+    if (err < 0) {
+        goto clone_failed;
     }
 
-    // it must be an executable file, of type for the 386 processor, and have an entry point
-    if ((elf_hdr.e_type != ET_EXEC) || (elf_hdr.e_machine != ET_386) || (elf_hdr.e_entry == 0)) {
-        log_printf("check elf type or entry failed.");
-        goto load_failed;
+    uint32_t call_frame[2] = {0, (uint32_t)arg};
+    err = memory_copy_uvm_data(esp, leader->tss.cr3, (uint32_t)call_frame, sizeof(call_frame));
+    if (err < 0) {
+        goto clone_failed;
     }
 
-    // it must have program header
-    if ((elf_hdr.e_phentsize == 0) || (elf_hdr.e_phoff == 0)) {
-        log_printf("none programe header");
-        goto load_failed;
+    child_task->timer_slack = curr_task->timer_slack;
+
+    if (task_set_tls(child_task, (uint32_t)tls) < 0) {
+        goto clone_failed;
     }
 
-    // load the program headers and copy their contents to the corresponding locations
-    uint32_t e_phoff = elf_hdr.e_phoff;
-    for (int i = 0; i < elf_hdr.e_phnum; i++, e_phoff += elf_hdr.e_phentsize) {
-        if (sys_lseek(file, e_phoff, 0) < 0) {
-            log_printf("read file failed");
-            goto load_failed;
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    child_task->leader = leader;
+    child_task->parent = leader;
+    leader->threads++;
+    list_insert_last(&leader->thread_list, &child_task->child_node);
+    spin_unlock_protect(&task_manager.lock, state);
+
+    int tid = child_task->pid;
+    task_start(child_task);
+    return tid;
+
+clone_failed:
+    if (child_task) {
+        task_uninit(child_task);
+        free_task(child_task);
+    }
+    return -1;
+}
+
+/**
+ * @brief Wait for the thread tid of current process to exit and reclaim it
+ */
+int sys_join (int tid, int * status) {
+    task_t * curr_task = task_current();
+    task_t * leader = curr_task->leader;
+
+    for (;;) {
+        task_t * task = (task_t *)0;
+
+        irq_state_t state = irq_enter_protection();
+        spin_lock(&task_manager.lock);
+        task_t * thread = task_find_pid(tid);
+        if ((thread == (task_t *)0) || (thread == curr_task)
+                || (thread->leader != leader) || !(thread->flags & TASK_FLAG_THREAD)) {
+            spin_unlock(&task_manager.lock);
+            irq_leave_protection(state);
+            return -1;
         }
 
-        // parse program header after reading it
-        cnt = sys_read(file, (char *)&elf_phdr, sizeof(Elf32_Phdr));
-        if (cnt < sizeof(Elf32_Phdr)) {
-            log_printf("read file failed");
-            goto load_failed;
+        if ((thread->state != TASK_ZOMBIE) && (curr_task->flags & TASK_FLAG_KILL)) {
+            spin_unlock(&task_manager.lock);
+            irq_leave_protection(state);
+            return -1;
         }
 
-        // checks
-        if ((elf_phdr.p_type != PT_LOAD) || (elf_phdr.p_vaddr < MEMORY_TASK_BASE)) {
-           continue;
+        if (thread->state != TASK_ZOMBIE) {
+            // woken up when it exits
+            thread->joiner = curr_task;
+            task_set_block(curr_task);
+            curr_task->state = TASK_WAITING;
+            spin_unlock(&task_manager.lock);
+
+            task_dispatch();
+            irq_leave_protection(state);
+            continue;
         }
 
-        // load current program header
-        int err = load_phdr(file, &elf_phdr, page_dir);
-        if (err < 0) {
-            log_printf("load program hdr failed");
-            goto load_failed;
+        // it may be still on its kernel stack in other CPU
+        if (!thread->on_cpu) {
+            list_remove(&leader->thread_list, &thread->child_node);
+            task = thread;
         }
+        spin_unlock(&task_manager.lock);
+        irq_leave_protection(state);
 
-        // TODO: more checks here
-        task->heap_start = elf_phdr.p_vaddr + elf_phdr.p_memsz;
-        task->heap_end = task->heap_start;
-   }
+        if (task == (task_t *)0) {
+            sys_msleep(OS_TICK_MS);
+            continue;
+        }
 
-    sys_close(file);
-    return elf_hdr.e_entry;
+        if (status) {
+            *status = task->status;
+        }
 
-load_failed:
-    if (file >= 0) {
-        sys_close(file);
+        task_uninit(task);
+        free_task(task);
+        return 0;
     }
-
-    return 0;
 }
 
 /**
- * @brief Copy process arguments to the stack
+ * @brief Fill the usage of task, the lock of task manager should be held
  */
-static int copy_args (char * to, uint32_t page_dir, int argc, char **argv) {
-    // write argc, argv pointers, and parameter strings sequentially into stack top
-    task_args_t task_args;
-    task_args.argc = argc;
-    task_args.argv = (char **)(to + sizeof(task_args_t));
-
-    // copy various parameters, skipping task_args and the argument table, and write each argv parameter into memory space
-    char * dest_arg = to + sizeof(task_args_t) + sizeof(char *) * (argc + 1);   
-    
-    // argv table
-    char ** dest_argv_tb = (char **)memory_get_paddr(page_dir, (uint32_t)(to + sizeof(task_args_t)));
-    ASSERT(dest_argv_tb != 0);
-
-    for (int i = 0; i < argc; i++) {
-        char * from = argv[i];
+static void task_fill_usage (task_t * task, task_usage_t * usage) {
+    usage->pid = task->pid;
+    usage->ppid = task->parent ? task->parent->pid : 0;
+    usage->cpu = task->cpu;
+    kernel_strncpy(usage->name, task->name, sizeof(usage->name));
+
+    switch (task->state) {
+    case TASK_SLEEP:
+        usage->state = 'S';
+        break;
+    case TASK_WAITING:
+        usage->state = 'W';
+        break;
+    case TASK_ZOMBIE:
+        usage->state = 'Z';
+        break;
+    default:
+        // blocked on semaphore or mutex, it's out of ready list but the state is not changed
+        usage->state = task->on_rq || task->on_cpu ? 'R' : 'B';
+        break;
+    }
 
-        int len = kernel_strlen(from) + 1;   
-        int err = memory_copy_uvm_data((uint32_t)dest_arg, page_dir, (uint32_t)from, len);
-        ASSERT(err >= 0);
+    usage->utime = task->utime;
+    usage->stime = task->stime;
+    usage->nvcsw = task->nvcsw;
+    usage->nivcsw = task->nivcsw;
+    usage->wait_ticks = task->wait_ticks;
+    usage->page_faults = task->page_faults;
+    usage->policy = task->policy;
+    usage->dl_misses = task->dl_misses;
+    usage->dl_throttles = task->dl_throttles;
+}
 
-        // link with ar
-        dest_argv_tb[i] = dest_arg;
+/**
+ * @brief Get usage of the task with pid, 0 for current task
+ */
+int sys_getrusage (int pid, task_usage_t * usage) {
+    if (usage == (task_usage_t *)0) {
+        return -1;
+    }
 
-        // record current location, move forward
-        dest_arg += len;
+    if (pid == 0) {
+        pid = task_current()->pid;
     }
 
-    // maybe no parameter, no need to write
-    if (argc) {
-        dest_argv_tb[argc] = '\0';
+    int err = -1;
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    task_t * task = task_find_pid(pid);
+    if (task) {
+        task_fill_usage(task, usage);
+        err = 0;
     }
+    spin_unlock_protect(&task_manager.lock, state);
 
-     // write task_args
-    return memory_copy_uvm_data((uint32_t)to, page_dir, (uint32_t)&task_args, sizeof(task_args_t));
+    return err;
 }
 
 /**
- * @brief Load a process
+ * @brief Get usage of all tasks, including idle tasks, return the number of items filled
  */
-int sys_execve(char *name, char **argv, char **env) {
-    task_t * task = task_current();
-
-    // page tables will be switched later, so let's handle the cases where data needs to be fetched from the process space first
-    kernel_strncpy(task->name, get_file_name(name), TASK_NAME_SIZE);
-
-    // switch to new page table
-    uint32_t old_page_dir = task->tss.cr3;
-    uint32_t new_page_dir = memory_create_uvm();
-    if (!new_page_dir) {
-        goto exec_failed;
+int sys_task_list (task_usage_t * buf, int count) {
+    if ((buf == (task_usage_t *)0) || (count <= 0)) {
+        return -1;
     }
 
-    // load ELF file into memory
-    uint32_t entry = load_elf_file(task, name, new_page_dir);    
-    if (entry == 0) {
-        goto exec_failed;
+    int n = 0;
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    for (list_node_t * node = list_first(&task_manager.task_list); node && (n < count); node = list_node_next(node)) {
+        task_t * task = list_node_parent(node, task_t, all_node);
+        task_fill_usage(task, buf + n++);
     }
+    spin_unlock_protect(&task_manager.lock, state);
 
-    // prepare user stack space, reserving space for environment and parameters
-    uint32_t stack_top = MEM_TASK_STACK_TOP - MEM_TASK_ARG_SIZE;    // reserve a portion of parameter space
-    int err = memory_alloc_for_page_dir(new_page_dir,
-                            MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE,
-                            MEM_TASK_STACK_SIZE, PTE_P | PTE_U | PTE_W);
-    if (err < 0) {
-        goto exec_failed;
-    }
+    return n;
+}
 
-    // copy parameters and write them to the top of the stack
-    int argc = strings_count(argv);
-    err = copy_args((char *)stack_top, new_page_dir, argc, argv);
-    if (err < 0) {
-        goto exec_failed;
+/**
+ * @brief Get wakeup to run latency of the task with pid, 0 for current task, -1 for all CPUs
+ */
+int sys_sched_latency (int pid, sched_latency_t * latency) {
+    if (latency == (sched_latency_t *)0) {
+        return -1;
     }
 
-    // he purpose of 'exec' is to replace the current process, so it only requires changing the current process's execution flow
-    // when this process resumes execution, it's as if it's starting anew, 
-    // so the user stack should be set to its initial state, and the execution address should be set to the program's entry point
-    syscall_frame_t * frame = (syscall_frame_t *)(task->tss.esp0 - sizeof(syscall_frame_t));
-    frame->eip = entry;
-    frame->eax = frame->ebx = frame->ecx = frame->edx = 0;
-    frame->esi = frame->edi = frame->ebp = 0;
-    frame->eflags = EFLAGS_DEFAULT| EFLAGS_IF;  
-
-    // The kernel stack doesn't need to be modified; it remains unchanged. Subsequent calls to 'memory_destroy_uvm' won't destroy the mapping of the kernel stack
-    // However, the user stack needs to be altered. Additionally, the space for the parameters of the call gate should be pushed onto it.
-    frame->esp = stack_top - sizeof(uint32_t)*SYSCALL_PARAM_COUNT;
-
-    // switch to new page table
-    task->tss.cr3 = new_page_dir;
-    mmu_set_page_dir(new_page_dir); 
+    kernel_memset(latency, 0, sizeof(sched_latency_t));
 
-    // release the original process's content space
-    memory_destroy_uvm(old_page_dir);            
+    // global, add up the histograms of all CPUs
+    if (pid < 0) {
+        for (int i = 0; i < task_manager.cpu_count; i++) {
+            cpu_rq_t * rq = task_manager.rq + i;
 
-    return  0;
+            irq_state_t state = spin_lock_protect(&rq->lock);
+            latency->count += rq->latency.count;
+            latency->total_us += rq->latency.total_us;
+            if (rq->latency.max_us > latency->max_us) {
+                latency->max_us = rq->latency.max_us;
+            }
+            for (int j = 0; j < SCHED_LAT_HIST_SIZE; j++) {
+                latency->hist[j] += rq->latency.hist[j];
+            }
+            spin_unlock_protect(&rq->lock, state);
+        }
+        return 0;
+    }
 
-exec_failed:    //resource release
-    if (new_page_dir) {
-        // switch to the old page table and destroy the new page table
-        task->tss.cr3 = old_page_dir;
-        mmu_set_page_dir(old_page_dir);
-        memory_destroy_uvm(new_page_dir);
+    if (pid == 0) {
+        pid = task_current()->pid;
     }
 
-    return -1;
-}
+    int err = -1;
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    task_t * task = task_find_pid(pid);
+    if (task) {
+        // updated when switched to, with the lock of its run queue
+        cpu_rq_t * rq = task_manager.rq + task->cpu;
+        spin_lock(&rq->lock);
+        kernel_memcpy(latency, &task->latency, sizeof(sched_latency_t));
+        spin_unlock(&rq->lock);
+        err = 0;
+    }
+    spin_unlock_protect(&task_manager.lock, state);
 
-/**
- * @brief Return Task pid
- */
-int sys_getpid (void) {
-    task_t * curr_task = task_current();
-    return curr_task->pid;
+    return err;
 }
 
-
 /**
- * @brief Waiting for the child process to exit
+ * @brief Copy the recent scheduler events, oldest first in each CPU, return the number copied
  */
-int sys_wait(int* status) {
-    task_t * curr_task = task_current();
-
-    for (;;) {
-        // traverse to find processes in a zombie state, then reclaim them. If none are found, enter a sleeping state
-        mutex_lock(&task_table_mutex);
-        for (int i = 0; i < TASK_NR; i++) {
-            task_t * task = task_table + i;
-            if (task->parent != curr_task) {
-                continue;
-            }
-
-            if (task->state == TASK_ZOMBIE) {
-                int pid = task->pid;
-
-                *status = task->status;
+int sys_sched_trace (sched_event_t * buf, int count) {
+    if ((buf == (sched_event_t *)0) || (count <= 0)) {
+        return -1;
+    }
 
-                memory_destroy_uvm(task->tss.cr3);
-                memory_free_page(task->tss.esp0 - MEM_PAGE_SIZE);
-                kernel_memset(task, 0, sizeof(task_t));
+    int n = 0;
+    for (int i = 0; (i < task_manager.cpu_count) && (n < count); i++) {
+        cpu_rq_t * rq = task_manager.rq + i;
 
-                mutex_unlock(&task_table_mutex);
-                return pid;
-            }
+        irq_state_t state = spin_lock_protect(&rq->lock);
+        uint32_t start = (rq->trace_next > SCHED_TRACE_NR) ? rq->trace_next - SCHED_TRACE_NR : 0;
+        for (uint32_t idx = start; (idx < rq->trace_next) && (n < count); idx++) {
+            buf[n++] = rq->trace[idx % SCHED_TRACE_NR];
         }
-        mutex_unlock(&task_table_mutex);
-
-        // not found, wait
-        irq_state_t state = irq_enter_protection();
-        task_set_block(curr_task);
-        curr_task->state = TASK_WAITING;
-        task_dispatch();
-        irq_leave_protection(state);
+        spin_unlock_protect(&rq->lock, state);
     }
+
+    return n;
 }
 
 /**
- * @brief Exit process
+ * @brief Start or stop recording the syscalls of task pid, 0 for current task
+ * it's kept after execve, the children are not traced
  */
-void sys_exit(int status) {
-    task_t * curr_task = task_current();
+int sys_strace (int pid, int on) {
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    task_t * task = pid ? task_find_pid(pid) : task_current();
+    if ((task == (task_t *)0) || (task->state == TASK_ZOMBIE)) {
+        spin_unlock_protect(&task_manager.lock, state);
+        return -1;
+    }
 
-    // Close all opened files. The standard input and output libraries will be closed by newlib, but we still handle them here
-    for (int fd = 0; fd < TASK_OFILE_NR; fd++) {
-        file_t * file = curr_task->file_table[fd];
-        if (file) {
-            sys_close(fd);
-            curr_task->file_table[fd] = (file_t *)0;
-        }
+    syscall_trace_set(task, on);
+    spin_unlock_protect(&task_manager.lock, state);
+    return 0;
+}
+
+/**
+ * @brief Set the scheduling class of current task, pid should be 0 or the pid of current task
+ */
+int sys_sched_setattr (int pid, const sched_attr_t * attr) {
+    task_t * task = task_current();
+    if ((attr == (const sched_attr_t *)0) || (pid && (pid != task->pid))) {
+        return -1;
     }
 
-    int move_child = 0;
+    if (attr->policy == SCHED_POLICY_NORMAL) {
+        return task_set_policy(task, SCHED_POLICY_NORMAL, 0, 0, 0);
+    } else if (attr->policy != SCHED_POLICY_DEADLINE) {
+        return -1;
+    }
 
-    // find all child processes and hand them over to the init process
-    mutex_lock(&task_table_mutex);
-    for (int i = 0; i < TASK_OFILE_NR; i++) {
-        task_t * task = task_table + i;
-        if (task->parent == curr_task) {
-            // if there are child processes, transfer them to the 'init_task'
-            task->parent = &task_manager.first_task;
-
-            // if there are zombie processes among the child processes, wake up to reclaim resources. 
-            // they are not reclaimed by the current process because it is about to exit
-            if (task->state == TASK_ZOMBIE) {
-                move_child = 1;
-            }
-        }
+    // runtime <= deadline <= period, and the budget can't be too small for charging
+    if ((attr->runtime_ns < NSEC_PER_USEC * 100) || (attr->runtime_ns > attr->deadline_ns)
+            || (attr->deadline_ns > attr->period_ns)) {
+        return -1;
     }
-    mutex_unlock(&task_table_mutex);
 
-    irq_state_t state = irq_enter_protection();
+    return task_set_policy(task, SCHED_POLICY_DEADLINE, attr->runtime_ns, attr->deadline_ns, attr->period_ns);
+}
 
-    // if there are orphaned child processes, wake up the init process
-    task_t * parent = curr_task->parent;
-    if (move_child && (parent != &task_manager.first_task)) {  // if the parent process is the init process, wake up below
-        if (task_manager.first_task.state == TASK_WAITING) {
-            task_set_ready(&task_manager.first_task);
-        }
+/**
+ * @brief Get the scheduling class of the task with pid, 0 for current task
+ */
+int sys_sched_getattr (int pid, sched_attr_t * attr) {
+    if (attr == (sched_attr_t *)0) {
+        return -1;
     }
 
-    // if a parent task is waiting in a 'wait' state, wake it up for reclamation
-    // if the parent process is not waiting, keep handling the zombie state
-    if (parent->state == TASK_WAITING) {
-        task_set_ready(curr_task->parent);
+    if (pid == 0) {
+        pid = task_current()->pid;
     }
 
-    // save the return value and enter the zombie state
-    curr_task->status = status;
-    curr_task->state = TASK_ZOMBIE;
-    task_set_block(curr_task);
-    task_dispatch();
+    int err = -1;
+    irq_state_t state = spin_lock_protect(&task_manager.lock);
+    task_t * task = task_find_pid(pid);
+    if (task) {
+        attr->policy = task->policy;
+        attr->runtime_ns = task->dl_runtime;
+        attr->deadline_ns = task->dl_deadline;
+        attr->period_ns = task->dl_period;
+        err = 0;
+    }
+    spin_unlock_protect(&task_manager.lock, state);
 
-    irq_leave_protection(state);
+    return err;
 }
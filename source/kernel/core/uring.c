@@ -0,0 +1,284 @@
+/**
+ * Submission and completion rings
+ */
+#include "core/uring.h"
+#include "core/task.h"
+#include "core/memory.h"
+#include "comm/cpu_instr.h"
+#include "fs/fs.h"
+#include "dev/time.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+static uring_ctx_t uring_table[URING_NR];
+static mutex_t table_mutex;
+
+/**
+ * @brief Init the table of rings
+ */
+void uring_table_init (void) {
+    kernel_memset(uring_table, 0, sizeof(uring_table));
+    mutex_init(&table_mutex);
+}
+
+static uring_ctx_t * alloc_ctx (void) {
+    uring_ctx_t * ctx = (uring_ctx_t *)0;
+
+    mutex_lock(&table_mutex);
+    for (int i = 0; i < URING_NR; i++) {
+        if (!uring_table[i].used) {
+            ctx = uring_table + i;
+            kernel_memset(ctx, 0, sizeof(uring_ctx_t));
+            ctx->used = 1;
+            break;
+        }
+    }
+    mutex_unlock(&table_mutex);
+    return ctx;
+}
+
+static void free_ctx (uring_ctx_t * ctx) {
+    mutex_lock(&table_mutex);
+    ctx->used = 0;
+    mutex_unlock(&table_mutex);
+}
+
+/**
+ * @brief Do one request with the syscall of it
+ */
+static int do_sqe (uring_sqe_t * sqe) {
+    switch (sqe->op) {
+        case URING_OP_NOP:
+            return 0;
+        case URING_OP_READ:
+            return sys_read(sqe->fd, (char *)sqe->addr, sqe->len);
+        case URING_OP_WRITE:
+            return sys_write(sqe->fd, (char *)sqe->addr, sqe->len);
+        case URING_OP_OPEN:
+            return sys_open((const char *)sqe->addr, sqe->arg);
+        case URING_OP_CLOSE:
+            return sys_close(sqe->fd);
+        case URING_OP_LSEEK:
+            return sys_lseek(sqe->fd, sqe->off, sqe->arg);
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Do at most count requests in the sq in order, return the number done
+ * it stops when the cq is full, the rest is done after the completions are taken
+ */
+static int ctx_submit (uring_ctx_t * ctx, int count) {
+    uring_t * ring = ctx->ring;
+    uint32_t mask = ctx->entries - 1;
+    int done = 0;
+
+    mutex_lock(&ctx->mutex);
+    while (done < count) {
+        uint32_t head = ring->sq.head;
+        if (head == ring->sq.tail) {
+            break;
+        }
+
+        uint32_t cq_tail = ring->cq.tail;
+        if (cq_tail - ring->cq.head >= ctx->entries) {
+            break;
+        }
+
+        // the process may change the entry after the head moves
+        uring_sqe_t sqe = ctx->sqes[head & mask];
+        cpu_barrier();
+        ring->sq.head = head + 1;
+
+        uring_cqe_t * cqe = ctx->cqes + (cq_tail & mask);
+        cqe->user_data = sqe.user_data;
+        cqe->res = do_sqe(&sqe);
+        cpu_barrier();
+        ring->cq.tail = cq_tail + 1;
+        done++;
+    }
+    mutex_unlock(&ctx->mutex);
+
+    // pairs with the check in sys_uring_enter
+    if (done && ctx->poller) {
+        __sync_synchronize();
+        if (ctx->cq_waiting) {
+            ctx->cq_waiting = 0;
+            sem_notify(&ctx->cq_sem);
+        }
+    }
+    return done;
+}
+
+/**
+ * @brief Entry of the poller, it runs in the process on its page table and files
+ * it keeps taking requests, and sleeps after being idle for a while
+ */
+static void poll_entry (void * arg) {
+    uring_ctx_t * ctx = (uring_ctx_t *)arg;
+    uring_t * ring = ctx->ring;
+    uint64_t idle_start = time_ns();
+
+    while (!ctx->stop) {
+        if (ctx_submit(ctx, ctx->entries) > 0) {
+            idle_start = time_ns();
+            continue;
+        }
+
+        if (time_ns() - idle_start < (uint64_t)URING_POLL_IDLE_MS * 1000000) {
+            sys_yield();
+            continue;
+        }
+
+        // recheck after the flag is seen, the process may submit just before it
+        ring->sq.flags |= URING_SQ_NEED_WAKEUP;
+        __sync_synchronize();
+        if ((ring->sq.head == ring->sq.tail) && !ctx->stop) {
+            sem_wait(&ctx->poll_sem);
+        }
+        ring->sq.flags &= ~URING_SQ_NEED_WAKEUP;
+        idle_start = time_ns();
+    }
+
+    // the process is gone with it, if it's the last one
+    task_exit(0);
+}
+
+/**
+ * @brief Let the poller exit, when the process has no other threads
+ */
+void uring_stop (task_t * leader) {
+    uring_ctx_t * ctx = leader->uring;
+    if (ctx && ctx->poller && (ctx->poller != task_current())) {
+        ctx->stop = 1;
+        sem_notify(&ctx->poll_sem);
+    }
+}
+
+/**
+ * @brief Number of the pollers running in the process, 0 or 1
+ */
+int uring_pollers (task_t * leader) {
+    uring_ctx_t * ctx = leader->uring;
+    return (ctx && ctx->poller && (ctx->poller->state != TASK_ZOMBIE)) ? 1 : 0;
+}
+
+/**
+ * @brief Stop the poller and wait for it to exit, then release the rings
+ * for exec, the rings are in the memory to be replaced
+ */
+void uring_shutdown (task_t * leader) {
+    uring_stop(leader);
+    while (uring_pollers(leader)) {
+        sys_msleep(OS_TICK_MS);
+    }
+    uring_release(leader);
+}
+
+/**
+ * @brief Release the rings of the process, after the poller exited
+ */
+void uring_release (task_t * leader) {
+    uring_ctx_t * ctx = leader->uring;
+    if (ctx) {
+        leader->uring = (uring_ctx_t *)0;
+        free_ctx(ctx);
+    }
+}
+
+/**
+ * @brief Register the rings of current process, entries is a power of 2
+ * with URING_SETUP_POLL, a kernel thread takes the requests without uring_enter
+ */
+int sys_uring_setup (uring_t * ring, int entries, int flags) {
+    task_t * leader = task_current()->leader;
+
+    if ((entries <= 0) || (entries > URING_ENTRIES_MAX) || (entries & (entries - 1))) {
+        return -1;
+    }
+
+    // the kernel keeps writing them, they must be in user space
+    if (((uint32_t)ring < MEMORY_TASK_BASE) || ((uint32_t)ring->sqes < MEMORY_TASK_BASE)
+            || ((uint32_t)ring->cqes < MEMORY_TASK_BASE)) {
+        return -1;
+    }
+
+    if (leader->uring) {
+        log_printf("uring: already set up");
+        return -1;
+    }
+
+    uring_ctx_t * ctx = alloc_ctx();
+    if (ctx == (uring_ctx_t *)0) {
+        log_printf("uring: no free context");
+        return -1;
+    }
+
+    ctx->ring = ring;
+    ctx->sqes = ring->sqes;
+    ctx->cqes = ring->cqes;
+    ctx->entries = entries;
+    mutex_init(&ctx->mutex);
+    sem_init(&ctx->poll_sem, 0);
+    sem_init(&ctx->cq_sem, 0);
+
+    ring->sq.head = ring->sq.tail = 0;
+    ring->cq.head = ring->cq.tail = 0;
+    ring->sq.mask = ring->cq.mask = entries - 1;
+    ring->sq.flags = ring->cq.flags = 0;
+    ring->flags = flags;
+
+    leader->uring = ctx;
+    if (flags & URING_SETUP_POLL) {
+        ctx->poller = kthread_create_in(leader, URING_POLL_NAME, poll_entry, ctx);
+        if (ctx->poller == (task_t *)0) {
+            log_printf("uring: create poller failed");
+            uring_release(leader);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Do at most to_submit requests, or wake up the poller
+ * then wait for min_complete completions in the cq, return the number submitted
+ */
+int sys_uring_enter (int to_submit, int min_complete, int flags) {
+    task_t * leader = task_current()->leader;
+    uring_ctx_t * ctx = leader->uring;
+    if (ctx == (uring_ctx_t *)0) {
+        return -1;
+    }
+
+    uring_t * ring = ctx->ring;
+    if (!ctx->poller) {
+        // done here, nothing to wait for
+        return (to_submit > 0) ? ctx_submit(ctx, to_submit) : 0;
+    }
+
+    if ((flags & URING_ENTER_WAKEUP) || (ring->sq.flags & URING_SQ_NEED_WAKEUP)) {
+        sem_notify(&ctx->poll_sem);
+    }
+
+    if (min_complete > (int)ctx->entries) {
+        min_complete = ctx->entries;
+    }
+
+    for (;;) {
+        ctx->cq_waiting = 1;
+        __sync_synchronize();
+        if ((int)(ring->cq.tail - ring->cq.head) >= min_complete) {
+            ctx->cq_waiting = 0;
+            break;
+        }
+
+        // the process is exiting, what is submitted is done by the poller or not at all
+        if (sem_wait(&ctx->cq_sem) < 0) {
+            ctx->cq_waiting = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
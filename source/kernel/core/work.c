@@ -0,0 +1,73 @@
+/**
+ * Deferred work
+ */
+#include "core/work.h"
+#include "core/task.h"
+#include "ipc/sem.h"
+#include "ipc/spinlock.h"
+#include "tools/log.h"
+
+static list_t work_list;            // queued work
+static spinlock_t work_lock;        // protect the list, queued from any CPU
+static sem_t work_sem;              // count of queued work
+
+/**
+ * @brief Init work item
+ */
+void work_init (work_t * work, work_func_t func) {
+    work->func = func;
+    work->pending = 0;
+    list_node_init(&work->node);
+}
+
+/**
+ * @brief Queue the work, can be called in interrupt handler
+ * a work already queued is not queued again, it will see the new data when running
+ */
+int work_schedule (work_t * work) {
+    irq_state_t state = spin_lock_protect(&work_lock);
+    if (work->pending) {
+        spin_unlock_protect(&work_lock, state);
+        return -1;
+    }
+
+    work->pending = 1;
+    list_insert_last(&work_list, &work->node);
+    spin_unlock_protect(&work_lock, state);
+
+    // kworker is queued in front, so it preempts the task interrupted
+    sem_notify(&work_sem);
+    return 0;
+}
+
+/**
+ * @brief Entry of kworker thread
+ */
+static void work_thread_entry (void * arg) {
+    for (;;) {
+        sem_wait(&work_sem);
+
+        irq_state_t state = spin_lock_protect(&work_lock);
+        list_node_t * node = list_remove_first(&work_list);
+        work_t * work = list_node_parent(node, work_t, node);
+        work->pending = 0;
+        spin_unlock_protect(&work_lock, state);
+
+        // run with interrupt enabled
+        work->func(work);
+    }
+}
+
+/**
+ * @brief Create the kworker thread
+ */
+void work_queue_init (void) {
+    list_init(&work_list);
+    spin_init(&work_lock);
+    sem_init(&work_sem, 0);
+
+    task_t * task = kthread_create(WORK_NAME, work_thread_entry, (void *)0, TASK_FLAG_HIGH);
+    if (task == (task_t *)0) {
+        log_printf("create %s failed.", WORK_NAME);
+    }
+}
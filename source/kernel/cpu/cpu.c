@@ -10,6 +10,7 @@
 
 static segment_desc_t gdt_table[GDT_TABLE_SIZE];
 static mutex_t mutex;
+static int sysenter_enabled;        // same on all CPUs
 
 /**
  * @brief Set segment descriptor
@@ -84,7 +85,16 @@ void init_gdt(void) {
                      SEG_P_PRESENT | SEG_DPL0 | SEG_S_NORMAL | SEG_TYPE_CODE
                      | SEG_TYPE_RW | SEG_D | SEG_G);
 
-    // call gate
+    // code and data segments shared by all applications, fixed as SYSEXIT loads them
+    // from MSR_SYSENTER_CS + 16 and + 24
+    segment_desc_set(APP_SELECTOR_CS, 0x00000000, 0xFFFFFFFF,
+                     SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL |
+                     SEG_TYPE_CODE | SEG_TYPE_RW | SEG_D);
+    segment_desc_set(APP_SELECTOR_DS, 0x00000000, 0xFFFFFFFF,
+                     SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL |
+                     SEG_TYPE_DATA | SEG_TYPE_RW | SEG_D);
+
+    // call gate, kept for the apps not using SYSENTER
     gate_desc_set((gate_desc_t *)(gdt_table + (SELECTOR_SYSCALL >> 3)),
             KERNEL_SELECTOR_CS,
             (uint32_t)exception_handler_syscall,
@@ -94,6 +104,14 @@ void init_gdt(void) {
     lgdt((uint32_t)gdt_table, sizeof(gdt_table));
 }
 
+/**
+ * @brief Get GDT base and limit, APs share the same GDT with the BSP
+ */
+void gdt_get_info (uint32_t * base, uint16_t * limit) {
+    *base = (uint32_t)gdt_table;
+    *limit = sizeof(gdt_table) - 1;
+}
+
 /**
  * @brief Switch to TSS, meaning jumping to achieve task switching
  */
@@ -101,6 +119,30 @@ void switch_to_tss (uint32_t tss_selector) {
     far_jump(tss_selector, 0);
 }
 
+/**
+ * @brief Enable SYSENTER on this CPU, called by each CPU
+ * the kernel stack is per task, it's set on each task switch
+ */
+void cpu_sysenter_init (void) {
+    if (!cpu_has_sysenter()) {
+        return;
+    }
+
+    write_msr(MSR_SYSENTER_CS, KERNEL_SELECTOR_CS);
+    write_msr(MSR_SYSENTER_ESP, 0);
+    write_msr(MSR_SYSENTER_EIP, (uint32_t)exception_handler_sysenter);
+    sysenter_enabled = 1;
+}
+
+/**
+ * @brief Set the kernel stack of SYSENTER on this CPU
+ */
+void cpu_set_sysenter_stack (uint32_t esp) {
+    if (sysenter_enabled) {
+        write_msr(MSR_SYSENTER_ESP, esp);
+    }
+}
+
 /**
  * @brief CPU init
  */
@@ -108,4 +150,5 @@ void cpu_init (void) {
     mutex_init(&mutex);
 
     init_gdt();
+    cpu_sysenter_init();
 }
@@ -0,0 +1,143 @@
+/**
+ * x87 FPU and SSE
+ * The state is switched lazily. Hardware task switch sets CR0.TS, so the first FPU or SSE
+ * instruction after switching raises #NM, only then the state of the last user on this CPU
+ * is saved and that of current task is loaded. A task which doesn't use FPU costs nothing.
+ */
+#include "comm/cpu_instr.h"
+#include "cpu/fpu.h"
+#include "core/task.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include "os_cfg.h"
+
+static int fpu_fxsr;                        // fxsave/fxrstor supported, or fnsave/frstor
+static int fpu_sse;
+static task_t * fpu_owner[CPU_NR];          // task whose state is in FPU of each CPU
+
+static void fpu_save (task_t * task) {
+    if (fpu_fxsr) {
+        __asm__ __volatile__("fxsave %0":"=m"(task->fpu_state));
+    } else {
+        __asm__ __volatile__("fnsave %0":"=m"(task->fpu_state));
+    }
+}
+
+static void fpu_restore (task_t * task) {
+    if (fpu_fxsr) {
+        __asm__ __volatile__("fxrstor %0"::"m"(task->fpu_state));
+    } else {
+        __asm__ __volatile__("frstor %0"::"m"(task->fpu_state));
+    }
+}
+
+/**
+ * @brief Init the FPU of current CPU, called on each CPU
+ */
+void fpu_init (void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    fpu_fxsr = (edx & CPUID_EDX_FXSR) != 0;
+    fpu_sse = fpu_fxsr && (edx & CPUID_EDX_SSE);
+
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE);
+    if (fpu_fxsr) {
+        uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+        if (fpu_sse) {
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+        write_cr4(cr4);
+    }
+    __asm__ __volatile__("fninit");
+
+    // no one owns it, trap on first use
+    write_cr0(read_cr0() | CR0_TS);
+
+    log_printf("fpu: fxsr %d, sse %d", fpu_fxsr, fpu_sse);
+}
+
+/**
+ * @brief Give the FPU to current task, called in #NM handler with interrupts disabled
+ */
+void fpu_switch (void) {
+    task_t * curr = task_current();
+    int cpu = task_cpu_id();
+
+    clts();
+
+    // switched back to the owner, nothing changed in FPU
+    task_t * owner = fpu_owner[cpu];
+    if (owner == curr) {
+        return;
+    }
+
+    if (owner) {
+        fpu_save(owner);
+    }
+
+    if (curr->fpu_used) {
+        fpu_restore(curr);
+    } else {
+        __asm__ __volatile__("fninit");
+        if (fpu_sse) {
+            uint32_t mxcsr = MXCSR_DEFAULT;
+            __asm__ __volatile__("ldmxcsr %0"::"m"(mxcsr));
+        }
+        curr->fpu_used = 1;
+    }
+
+    // the old owner may be moved to other CPU once it's not the owner, so save it first
+    cpu_barrier();
+    fpu_owner[cpu] = curr;
+}
+
+/**
+ * @brief Check if the task can run on other CPU
+ * its state may be still in FPU of this CPU, which can't be saved from other CPU
+ */
+int fpu_can_migrate (task_t * task, int cpu) {
+    return fpu_owner[cpu] != task;
+}
+
+/**
+ * @brief Copy the FPU state of current task to the child
+ */
+void fpu_task_fork (task_t * child) {
+    task_t * curr = task_current();
+
+    child->fpu_used = curr->fpu_used;
+    if (!curr->fpu_used) {
+        return;
+    }
+
+    irq_state_t state = irq_enter_protection();
+    if (fpu_owner[task_cpu_id()] == curr) {
+        // it's in the FPU, save without changing the owner
+        uint32_t cr0 = read_cr0();
+        clts();
+        fpu_save(child);
+        if (!fpu_fxsr) {
+            // fnsave reinitializes the FPU
+            fpu_restore(child);
+        }
+        write_cr0(cr0);
+    } else {
+        kernel_memcpy(child->fpu_state, curr->fpu_state, FPU_STATE_SIZE);
+    }
+    irq_leave_protection(state);
+}
+
+/**
+ * @brief Drop the FPU state of current task, on exec or exit
+ * the task struct may be reused after exit, so it must not be left as the owner
+ */
+void fpu_task_reset (task_t * task) {
+    irq_state_t state = irq_enter_protection();
+    int cpu = task_cpu_id();
+    if (fpu_owner[cpu] == task) {
+        fpu_owner[cpu] = (task_t *)0;
+        write_cr0(read_cr0() | CR0_TS);
+    }
+    task->fpu_used = 0;
+    irq_leave_protection(state);
+}
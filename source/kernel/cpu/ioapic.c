@@ -0,0 +1,110 @@
+/**
+ * I/O APIC
+ * ISA interrupts are routed to the local APIC of one CPU, with the same vector as the PIC uses,
+ * so the handlers don't need to know which controller is in use
+ */
+#include "cpu/ioapic.h"
+#include "cpu/lapic.h"
+#include "core/memory.h"
+#include "tools/log.h"
+
+static volatile uint32_t * ioapic_base;     // register window
+static int ioapic_pin_count;
+static int ioapic_dest;                     // local APIC id of the CPU receives the interrupts
+
+// ISA irq to pin, identity mapped if no override in MP table
+static struct {
+    uint8_t pin;
+    uint8_t active_low;
+    uint8_t level;
+}isa_route[IRQ_ISA_NR] = {
+    {0}, {1}, {2}, {3}, {4}, {5}, {6}, {7},
+    {8}, {9}, {10}, {11}, {12}, {13}, {14}, {15},
+};
+
+static uint32_t ioapic_read (int reg) {
+    ioapic_base[IOAPIC_REGSEL >> 2] = reg;
+    return ioapic_base[IOAPIC_WIN >> 2];
+}
+
+static void ioapic_write (int reg, uint32_t value) {
+    ioapic_base[IOAPIC_REGSEL >> 2] = reg;
+    ioapic_base[IOAPIC_WIN >> 2] = value;
+}
+
+/**
+ * @brief Set the redirection entry of ISA irq
+ */
+static void ioapic_set_entry (int irq, int masked) {
+    int pin = isa_route[irq].pin;
+    if (pin >= ioapic_pin_count) {
+        return;
+    }
+
+    uint32_t low = (IRQ_PIC_START + irq) | (masked ? IOAPIC_INT_MASKED : 0);
+    if (isa_route[irq].active_low) {
+        low |= IOAPIC_INT_LOW;
+    }
+    if (isa_route[irq].level) {
+        low |= IOAPIC_INT_LEVEL;
+    }
+
+    // fixed delivery, physical destination
+    ioapic_write(IOAPIC_REG_REDTBL + pin * 2 + 1, ioapic_dest << 24);
+    ioapic_write(IOAPIC_REG_REDTBL + pin * 2, low);
+}
+
+/**
+ * @brief Record the pin of ISA irq, from the interrupt entries of MP table
+ */
+void ioapic_set_isa_route (int irq, int pin, int active_low, int level) {
+    if ((irq < 0) || (irq >= IRQ_ISA_NR)) {
+        return;
+    }
+
+    isa_route[irq].pin = pin;
+    isa_route[irq].active_low = active_low;
+    isa_route[irq].level = level;
+}
+
+/**
+ * @brief Map the registers and mask all pins
+ */
+int ioapic_init (uint32_t paddr, int dest_apic_id) {
+    ioapic_base = (volatile uint32_t *)memory_map_mmio(paddr, MEM_PAGE_SIZE);
+    if (ioapic_base == 0) {
+        log_printf("map io apic failed.");
+        return -1;
+    }
+
+    ioapic_dest = dest_apic_id;
+    ioapic_pin_count = ((ioapic_read(IOAPIC_REG_VER) >> 16) & 0xFF) + 1;
+    for (int pin = 0; pin < ioapic_pin_count; pin++) {
+        ioapic_write(IOAPIC_REG_REDTBL + pin * 2, IOAPIC_INT_MASKED);
+    }
+
+    log_printf("io apic: 0x%x, %d pins", paddr, ioapic_pin_count);
+    return 0;
+}
+
+static void ioapic_enable (int irq_num) {
+    ioapic_set_entry(irq_num - IRQ_PIC_START, 0);
+}
+
+static void ioapic_disable (int irq_num) {
+    ioapic_set_entry(irq_num - IRQ_PIC_START, 1);
+}
+
+/**
+ * @brief EOI goes to the local APIC, one memory write
+ */
+static void ioapic_eoi (int irq_num) {
+    lapic_eoi();
+}
+
+irq_chip_t ioapic_chip = {
+    .name = "io apic",
+    .enable = ioapic_enable,
+    .disable = ioapic_disable,
+    .eoi = ioapic_eoi,
+};
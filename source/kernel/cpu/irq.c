@@ -7,10 +7,14 @@
 #include "tools/log.h"
 #include "os_cfg.h"
 #include "core/task.h"
+#include "cpu/fpu.h"
 
 #define IDT_TABLE_NR			128				// IDT table entry number
 
 static gate_desc_t idt_table[IDT_TABLE_NR];	// IDT
+static irq_chip_t pic_chip;						// legacy 8259 PIC, the default one
+static irq_chip_t * irq_chip;					// current interrupt controller
+static uint16_t irq_enabled_mask;				// enabled ISA irqs, moved to the new controller when switching
 
 static void dump_core_regs (exception_frame_t * frame) {
     // print CPU register related content
@@ -86,7 +90,8 @@ void do_handler_invalid_opcode(exception_frame_t * frame) {
 }
 
 void do_handler_device_unavailable(exception_frame_t * frame) {
-	do_default_handler(frame, "Device Not Available.");
+	// CR0.TS is set after task switching, load the FPU state of current task
+	fpu_switch();
 }
 
 void do_handler_double_fault(exception_frame_t * frame) {
@@ -137,6 +142,11 @@ void do_handler_general_protection(exception_frame_t * frame) {
 }
 
 void do_handler_page_fault(exception_frame_t * frame) {
+    task_t * task = task_current();
+    if (task) {
+        task->page_faults++;
+    }
+
     log_printf("--------------------------------");
     log_printf("IRQ/Exception happend: Page fault.");
     if (frame->error_code & ERR_PAGE_P) {
@@ -188,6 +198,23 @@ void do_handler_virtual_exception(exception_frame_t * frame) {
 	do_default_handler(frame, "Virtualization Exception.");
 }
 
+/**
+ * @brief Called after every interrupt and exception is handled, on the way back
+ * the task killed while running in user mode exits here with interrupts enabled, like after a syscall
+ */
+void do_irq_return (exception_frame_t * frame) {
+    if ((frame->cs & 0x3) && (task_current()->flags & TASK_FLAG_KILL)) {
+        irq_enable_global();
+        task_check_kill();
+    }
+}
+
+/**
+ * @brief Spurious interrupt of local APIC, no EOI is required
+ */
+void do_handler_spurious(exception_frame_t * frame) {
+}
+
 static void init_pic(void) {
     // Edge-triggered, cascaded, configure ICW4, 8086 mode
     outb(PIC0_ICW1, PIC_ICW1_ALWAYS_1 | PIC_ICW1_ICW4);
@@ -260,10 +287,20 @@ void irq_init(void) {
 	irq_install(IRQ20_VE, exception_handler_virtual_exception);
 
 
-	lidt((uint32_t)idt_table, sizeof(idt_table));
+	irq_install(IRQ_SPURIOUS, exception_handler_spurious);
+
+	irq_load_idt();
 
 	// Initialize the PIC 
 	init_pic();
+	irq_chip = &pic_chip;
+}
+
+/**
+ * @brief Load the IDT into current CPU, the table is shared by all CPUs
+ */
+void irq_load_idt (void) {
+	lidt((uint32_t)idt_table, sizeof(idt_table));
 }
 
 /**
@@ -279,11 +316,7 @@ int irq_install(int irq_num, irq_handler_t handler) {
 	return 0;
 }
 
-void irq_enable(int irq_num) {
-    if (irq_num < IRQ_PIC_START) {
-        return;
-    }
-
+static void pic_enable(int irq_num) {
     irq_num -= IRQ_PIC_START;
     if (irq_num < 8) {
         uint8_t mask = inb(PIC0_IMR) & ~(1 << irq_num);
@@ -295,11 +328,7 @@ void irq_enable(int irq_num) {
     }
 }
 
-void irq_disable(int irq_num) {
-    if (irq_num < IRQ_PIC_START) {
-        return;
-    }
-
+static void pic_disable(int irq_num) {
     irq_num -= IRQ_PIC_START;
     if (irq_num < 8) {
         uint8_t mask = inb(PIC0_IMR) | (1 << irq_num);
@@ -311,6 +340,66 @@ void irq_disable(int irq_num) {
     }
 }
 
+static irq_chip_t pic_chip = {
+    .name = "8259 pic",
+    .enable = pic_enable,
+    .disable = pic_disable,
+    .eoi = pic_send_eoi,
+};
+
+/**
+ * @brief Switch to other interrupt controller, the PIC is used by default
+ */
+void irq_set_chip (irq_chip_t * chip) {
+    irq_state_t state = irq_enter_protection();
+
+    // the PIC is left unused, mask all including the cascade
+    if (irq_chip == &pic_chip) {
+        outb(PIC0_IMR, 0xFF);
+        outb(PIC1_IMR, 0xFF);
+    }
+
+    for (int i = 0; i < IRQ_ISA_NR; i++) {
+        if (irq_enabled_mask & (1 << i)) {
+            irq_chip->disable(IRQ_PIC_START + i);
+            chip->enable(IRQ_PIC_START + i);
+        }
+    }
+    irq_chip = chip;
+    irq_leave_protection(state);
+
+    log_printf("interrupt controller: %s", chip->name);
+}
+
+void irq_enable(int irq_num) {
+    if ((irq_num < IRQ_PIC_START) || (irq_num >= IRQ_PIC_START + IRQ_ISA_NR)) {
+        return;
+    }
+
+    irq_state_t state = irq_enter_protection();
+    irq_enabled_mask |= 1 << (irq_num - IRQ_PIC_START);
+    irq_chip->enable(irq_num);
+    irq_leave_protection(state);
+}
+
+void irq_disable(int irq_num) {
+    if ((irq_num < IRQ_PIC_START) || (irq_num >= IRQ_PIC_START + IRQ_ISA_NR)) {
+        return;
+    }
+
+    irq_state_t state = irq_enter_protection();
+    irq_enabled_mask &= ~(1 << (irq_num - IRQ_PIC_START));
+    irq_chip->disable(irq_num);
+    irq_leave_protection(state);
+}
+
+/**
+ * @brief End of interrupt, to the controller in use
+ */
+void irq_send_eoi (int irq_num) {
+    irq_chip->eoi(irq_num);
+}
+
 void irq_disable_global(void) {
     cli();
 }
@@ -0,0 +1,144 @@
+/**
+ * Local APIC
+ * Every CPU owns one, it's used for the inter-processor interrupts and the per-CPU timer
+ */
+#include "cpu/lapic.h"
+#include "cpu/irq.h"
+#include "core/memory.h"
+#include "dev/time.h"
+#include "tools/log.h"
+
+static volatile uint32_t * lapic_base;      // register window, same addr on all CPUs
+static uint32_t timer_ticks_per_ms;         // timer count per ms, divide by 16
+
+static inline uint32_t lapic_read (int reg) {
+    return lapic_base[reg >> 2];
+}
+
+static inline void lapic_write (int reg, uint32_t value) {
+    lapic_base[reg >> 2] = value;
+    lapic_base[LAPIC_ID >> 2];        // read back to wait for the write to finish
+}
+
+/**
+ * @brief Map the local APIC registers
+ */
+void lapic_init (uint32_t paddr) {
+    lapic_base = (volatile uint32_t *)memory_map_mmio(paddr, MEM_PAGE_SIZE);
+    if (lapic_base == 0) {
+        log_printf("map local apic failed.");
+    }
+}
+
+/**
+ * @brief Check if the local APIC is usable
+ */
+int lapic_present (void) {
+    return lapic_base != 0;
+}
+
+/**
+ * @brief Enable the local APIC of current CPU
+ */
+void lapic_enable (int is_bsp) {
+    // enable, and set the spurious interrupt vector
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | IRQ_SPURIOUS);
+
+    // only the BSP receives the legacy PIC interrupts through LINT0
+    if (!is_bsp) {
+        lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+        lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+    }
+
+    // clear error, accept all interrupts
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_EOI, 0);
+    lapic_write(LAPIC_TPR, 0);
+}
+
+/**
+ * @brief Return the APIC id of current CPU
+ */
+int lapic_id (void) {
+    if (lapic_base == 0) {
+        return 0;
+    }
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/**
+ * @brief Acknowledge the interrupt
+ */
+void lapic_eoi (void) {
+    lapic_base[LAPIC_EOI >> 2] = 0;
+}
+
+/**
+ * @brief Wait for the last interrupt command to be sent
+ */
+static void lapic_wait_icr (void) {
+    while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING) {}
+}
+
+/**
+ * @brief Send a fixed interrupt to other CPU
+ */
+void lapic_send_ipi (int apic_id, int vector) {
+    irq_state_t state = irq_enter_protection();
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, vector);
+    lapic_wait_icr();
+    irq_leave_protection(state);
+}
+
+/**
+ * @brief Start application processor with INIT-SIPI-SIPI sequence
+ * addr is the real mode entry, must be 4KB aligned and below 1MB
+ * Ref: Intel MultiProcessor Specification, B.4
+ */
+void lapic_start_ap (int apic_id, uint32_t addr) {
+    // INIT, assert then deassert
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+    lapic_wait_icr();
+    pit_delay_us(200);
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+    lapic_wait_icr();
+    pit_delay_us(10000);
+
+    // STARTUP twice, the vector is the page number of the entry
+    for (int i = 0; i < 2; i++) {
+        lapic_write(LAPIC_ICR_HI, apic_id << 24);
+        lapic_write(LAPIC_ICR_LO, LAPIC_ICR_STARTUP | (addr >> 12));
+        lapic_wait_icr();
+        pit_delay_us(200);
+    }
+}
+
+/**
+ * @brief Measure the timer frequency against the PIT, all CPUs share the result
+ * the bus clock is the same for every local APIC
+ */
+void lapic_timer_calibrate (void) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    pit_delay_us(10000);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    timer_ticks_per_ms = elapsed / 10;
+    log_printf("local apic timer: %d ticks per ms", timer_ticks_per_ms);
+}
+
+/**
+ * @brief Start the periodic timer of current CPU
+ */
+void lapic_timer_start (int vector, int ms) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | vector);
+    lapic_write(LAPIC_TIMER_INIT, timer_ticks_per_ms * ms);
+}
@@ -0,0 +1,273 @@
+/**
+ * Multi-processor support
+ * CPUs are found in the MP configuration table, the application processors (AP)
+ * are then woken up by the BSP with INIT-SIPI-SIPI and run the scheduler too
+ */
+#include "comm/cpu_instr.h"
+#include "cpu/smp.h"
+#include "cpu/cpu.h"
+#include "cpu/irq.h"
+#include "cpu/lapic.h"
+#include "cpu/ioapic.h"
+#include "cpu/fpu.h"
+#include "core/memory.h"
+#include "core/task.h"
+#include "dev/time.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include "os_cfg.h"
+
+#define BDA_EBDA_SEG            0x40E       // segment of EBDA in BIOS data area
+#define AP_START_TIMEOUT_MS     100         // max waiting time of AP start
+
+static int cpu_count = 1;                   // CPU number, at least the BSP
+static int cpu_apic_id[CPU_NR];             // local APIC id of each CPU, 0 is the BSP
+static uint32_t ioapic_addr;                // physical address of the first I/O APIC, 0 if none
+static int imcr_present;                    // the interrupts go through IMCR to PIC by default
+
+/**
+ * @brief Checksum, the bytes of all MP structures add up to 0
+ */
+static uint8_t mp_sum (uint8_t * data, int size) {
+    uint8_t sum = 0;
+    for (int i = 0; i < size; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+/**
+ * @brief Search the floating pointer in specific area, it's 16 bytes aligned
+ */
+static mp_float_t * mp_search (uint32_t start, int size) {
+    for (uint32_t addr = start; addr < start + size; addr += sizeof(mp_float_t)) {
+        mp_float_t * mp = (mp_float_t *)addr;
+        if ((kernel_memcmp(mp->signature, "_MP_", 4) == 0)
+                && (mp_sum((uint8_t *)mp, sizeof(mp_float_t)) == 0)) {
+            return mp;
+        }
+    }
+
+    return (mp_float_t *)0;
+}
+
+/**
+ * @brief Find the floating pointer, it's in
+ * 1. the first 1KB of EBDA, 2. the last 1KB of base memory, 3. BIOS ROM
+ */
+static mp_float_t * mp_find (void) {
+    mp_float_t * mp = (mp_float_t *)0;
+
+    uint32_t ebda = *(uint16_t *)BDA_EBDA_SEG << 4;
+    if ((ebda >= MEM_EBDA_START) && (ebda < MEM_EBDA_END)) {
+        mp = mp_search(ebda, 1024);
+    }
+
+    if (mp == (mp_float_t *)0) {
+        mp = mp_search(MEM_EBDA_END - 1024, 1024);
+    }
+
+    if (mp == (mp_float_t *)0) {
+        mp = mp_search(0xF0000, 0x10000);
+    }
+
+    return mp;
+}
+
+/**
+ * @brief Parse the configuration table, record all enabled processors
+ */
+static uint32_t mp_parse (mp_float_t * mp) {
+    // the table should be in BIOS area, which is mapped
+    mp_conf_t * conf = (mp_conf_t *)mp->conf_addr;
+    if (((uint32_t)conf < MEM_EBDA_START) || ((uint32_t)conf >= MEM_EXT_START)) {
+        log_printf("mp config table not supported: 0x%x", (uint32_t)conf);
+        return LAPIC_DEFAULT_BASE;
+    }
+
+    if (kernel_memcmp(conf->signature, "PCMP", 4) || mp_sum((uint8_t *)conf, conf->length)) {
+        log_printf("mp config table is broken.");
+        return LAPIC_DEFAULT_BASE;
+    }
+
+    int isa_bus = -1;
+    uint8_t * entry = (uint8_t *)(conf + 1);
+    for (int i = 0; i < conf->entry_count; i++) {
+        switch (*entry) {
+        case MP_ENTRY_PROC: {
+            mp_proc_t * proc = (mp_proc_t *)entry;
+            if (proc->flags & MP_PROC_ENABLED) {
+                if (proc->flags & MP_PROC_BSP) {
+                    cpu_apic_id[0] = proc->apic_id;
+                } else if (cpu_count < CPU_NR) {
+                    cpu_apic_id[cpu_count++] = proc->apic_id;
+                }
+            }
+            entry += sizeof(mp_proc_t);
+            continue;
+        }
+        case MP_ENTRY_BUS: {
+            mp_bus_t * bus = (mp_bus_t *)entry;
+            if (kernel_memcmp(bus->bus_type, "ISA", 3) == 0) {
+                isa_bus = bus->bus_id;
+            }
+            break;
+        }
+        case MP_ENTRY_IOAPIC: {
+            // only the first one is used, which handles the ISA irqs
+            mp_ioapic_t * ioapic = (mp_ioapic_t *)entry;
+            if ((ioapic->flags & MP_IOAPIC_ENABLED) && (ioapic_addr == 0)) {
+                ioapic_addr = ioapic->addr;
+            }
+            break;
+        }
+        case MP_ENTRY_IOINTR: {
+            // the bus entries are always before, e.g. the timer is on pin 2 in qemu
+            mp_iointr_t * intr = (mp_iointr_t *)entry;
+            if ((intr->intr_type == MP_INTR_TYPE_INT) && (intr->src_bus == isa_bus)) {
+                ioapic_set_isa_route(intr->src_irq, intr->dst_pin,
+                        (intr->flags & MP_INTR_POL_MASK) == MP_INTR_POL_LOW,
+                        (intr->flags & MP_INTR_TRIG_MASK) == MP_INTR_TRIG_LEVEL);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        entry += 8;
+    }
+
+    return conf->lapic_addr;
+}
+
+/**
+ * @brief Find all CPUs and interrupt controllers, then enable the local APIC of BSP
+ * must be called before task manager init, which creates one idle task per CPU
+ */
+void smp_init (void) {
+    uint32_t lapic_addr = LAPIC_DEFAULT_BASE;
+
+    mp_float_t * mp = mp_find();
+    if (mp && mp->conf_addr) {
+        lapic_addr = mp_parse(mp);
+        imcr_present = mp->features[1] & MP_FEATURE2_IMCRP;
+    } else {
+        log_printf("no mp table found, run with one cpu.");
+    }
+
+    lapic_init(lapic_addr);
+    if (!lapic_present()) {
+        cpu_count = 1;
+        return;
+    }
+
+    lapic_enable(1);
+    cpu_apic_id[0] = lapic_id();
+    lapic_timer_calibrate();
+
+    // device interrupts go to the BSP through the I/O APIC, or keep using the PIC
+    if (ioapic_addr && (ioapic_init(ioapic_addr, cpu_apic_id[0]) == 0)) {
+        if (imcr_present) {
+            outb(IMCR_ADDR_PORT, IMCR_SELECT);
+            outb(IMCR_DATA_PORT, IMCR_APIC);
+        }
+        irq_set_chip(&ioapic_chip);
+    }
+
+#if OS_TICK_LAPIC
+    time_use_lapic();
+#endif
+
+    if (cpu_count > 1) {
+        irq_install(IRQ_RESCHEDULE, (irq_handler_t)exception_handler_resched);
+    }
+    log_printf("cpu count: %d", cpu_count);
+}
+
+/**
+ * @brief Start all APs one by one
+ * the loader is no longer used, so its memory is reused for the start up code
+ */
+void smp_start_ap (void) {
+    extern uint8_t ap_trampoline_start[], ap_trampoline_end[], ap_trampoline_param[];
+
+    if (cpu_count <= 1) {
+        return;
+    }
+
+    kernel_memcpy((void *)AP_TRAMPOLINE_ADDR, ap_trampoline_start,
+                (int)(ap_trampoline_end - ap_trampoline_start));
+    ap_param_t * param = (ap_param_t *)(AP_TRAMPOLINE_ADDR + (ap_trampoline_param - ap_trampoline_start));
+
+    uint32_t gdt_base;
+    uint16_t gdt_limit;
+    gdt_get_info(&gdt_base, &gdt_limit);
+
+    int online = 1;
+    for (int cpu = 1; cpu < cpu_count; cpu++) {
+        // run on the stack and page table of its idle task
+        task_t * idle = task_idle_task(cpu);
+        param->gdt_base = gdt_base;
+        param->gdt_limit = gdt_limit;
+        param->cr3 = idle->tss.cr3;
+        param->esp = idle->tss.esp0;
+        param->entry = (uint32_t)ap_main;
+        param->cpu = cpu;
+
+        lapic_start_ap(cpu_apic_id[cpu], AP_TRAMPOLINE_ADDR);
+
+        // wait until it's ready, or the param will be overwritten by next one
+        for (int ms = 0; (ms < AP_START_TIMEOUT_MS) && !task_cpu_online(cpu); ms++) {
+            pit_delay_us(1000);
+        }
+
+        if (task_cpu_online(cpu)) {
+            online++;
+        } else {
+            log_printf("start cpu %d failed, apic id: %d", cpu, cpu_apic_id[cpu]);
+        }
+    }
+
+    log_printf("%d cpus online", online);
+}
+
+/**
+ * @brief Return the number of CPUs found
+ */
+int smp_cpu_count (void) {
+    return cpu_count;
+}
+
+/**
+ * @brief Return the local APIC id of CPU
+ */
+int smp_apic_id (int cpu) {
+    return cpu_apic_id[cpu];
+}
+
+/**
+ * @brief C entry of AP, jump from ap_start.S with paging enabled
+ */
+void ap_main (int cpu) {
+    irq_load_idt();
+    fpu_init();
+    cpu_sysenter_init();
+
+    lapic_enable(0);
+    lapic_timer_start(IRQ_LAPIC_TIMER, OS_TICK_MS);
+
+    // run the idle task, never return
+    task_ap_enter(cpu);
+}
+
+/**
+ * @brief Reschedule request from other CPU, new task is ready here
+ */
+void do_handler_resched (exception_frame_t * frame) {
+    lapic_eoi();
+
+    irq_state_t state = irq_enter_protection();
+    task_dispatch();
+    irq_leave_protection(state);
+}
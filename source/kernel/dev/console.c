@@ -6,10 +6,12 @@
 #include "comm/cpu_instr.h"
 #include "dev/tty.h"
 #include "cpu/irq.h"
+#include "ipc/spinlock.h"
 
 #define CONSOLE_NR          8           // number of console
 
 static console_t console_buf[CONSOLE_NR];
+static spinlock_t crtc_lock;            // the index/data port pair of CRTC is shared by all CPUs
 
 /**
  * @brief Read the current cursor position
@@ -17,12 +19,12 @@ static console_t console_buf[CONSOLE_NR];
 static int read_cursor_pos (void) {
     int pos;
 
-    irq_state_t state = irq_enter_protection();
+    irq_state_t state = spin_lock_protect(&crtc_lock);
  	outb(0x3D4, 0x0F);		// write low addr
 	pos = inb(0x3D5);
 	outb(0x3D4, 0x0E);		// write high addr
 	pos |= inb(0x3D5) << 8;   
-    irq_leave_protection(state);
+    spin_unlock_protect(&crtc_lock, state);
     return pos;
 }
 
@@ -33,18 +35,18 @@ static void update_cursor_pos (console_t * console) {
 	uint16_t pos = (console - console_buf) * (console->display_cols * console->display_rows);
     pos += console->cursor_row *  console->display_cols + console->cursor_col;
 
-    irq_state_t state = irq_enter_protection();
+    irq_state_t state = spin_lock_protect(&crtc_lock);
 	outb(0x3D4, 0x0F);		// write low addr
 	outb(0x3D5, (uint8_t) (pos & 0xFF));
 	outb(0x3D4, 0x0E);		// write high addr
 	outb(0x3D5, (uint8_t) ((pos >> 8) & 0xFF));
-    irq_leave_protection(state);
+    spin_unlock_protect(&crtc_lock, state);
 }
 
 void console_set_cursor(int idx, int visiable) {
     console_t *console = console_buf + idx;
 
-    irq_state_t state = irq_enter_protection();
+    irq_state_t state = spin_lock_protect(&crtc_lock);
     if (visiable) {
         outb(0x3D4, 0x0A);
         outb(0x3D5, (inb(0x3D5) & 0xC0) | 0);
@@ -54,7 +56,7 @@ void console_set_cursor(int idx, int visiable) {
         outb(0x3D4, 0x0A);
         outb(0x3D5, 0x20);
     }
-    irq_leave_protection(state);
+    spin_unlock_protect(&crtc_lock, state);
 }
 
 
@@ -2,10 +2,12 @@
  * Dev ops
 */
 #include "cpu/irq.h"
+#include "ipc/spinlock.h"
 #include "dev/dev.h"
 #include "dev/tty.h"
 #include "tools/klib.h"
 #include "dev/disk.h"
+#include "applib/lib_syscall.h"
 
 #define DEV_TABLE_SIZE          128     // supported device number
 
@@ -20,6 +22,7 @@ static dev_desc_t * dev_desc_tbl[] = {
 
 // Device table
 static device_t dev_tbl[DEV_TABLE_SIZE];
+static spinlock_t dev_tbl_lock;         // protect device table, zero means unlocked
 
 static int is_devid_bad (int dev_id) {
     if ((dev_id < 0) || (dev_id >=  sizeof(dev_tbl) / sizeof(dev_tbl[0]))) {
@@ -37,7 +40,7 @@ static int is_devid_bad (int dev_id) {
  * @brief Open specific device
  */
 int dev_open (int major, int minor, void * data) {
-    irq_state_t state = irq_enter_protection();
+    irq_state_t state = spin_lock_protect(&dev_tbl_lock);
 
     // iterate until finding a opened device, otherwise find a empty device
     device_t * free_dev = (device_t *)0;
@@ -49,7 +52,7 @@ int dev_open (int major, int minor, void * data) {
         } else if ((dev->desc->major == major) && (dev->minor == minor)) {
             // find opened device, return
             dev->open_count++;
-            irq_leave_protection(state);
+            spin_unlock_protect(&dev_tbl_lock, state);
             return i;
         }
     }
@@ -73,12 +76,12 @@ int dev_open (int major, int minor, void * data) {
         int err = desc->open(free_dev);
         if (err == 0) {
             free_dev->open_count = 1;
-            irq_leave_protection(state);
+            spin_unlock_protect(&dev_tbl_lock, state);
             return free_dev - dev_tbl;
         }
     }
 
-    irq_leave_protection(state);
+    spin_unlock_protect(&dev_tbl_lock, state);
     return -1;
 }
 
@@ -119,6 +122,18 @@ int dev_control (int dev_id, int cmd, int arg0, int arg1) {
     return dev->desc->control(dev, cmd, arg0, arg1);
 }
 
+/**
+ * @brief Events ready of the device, it's always ready without poll
+ */
+int dev_poll (int dev_id, struct _poll_table_t * pt) {
+    if (is_devid_bad(dev_id)) {
+        return POLLNVAL;
+    }
+
+    device_t * dev = dev_tbl + dev_id;
+    return dev->desc->poll ? dev->desc->poll(dev, pt) : (POLLIN | POLLOUT);
+}
+
 /**
  * @brief Close device
  */
@@ -129,10 +144,10 @@ void dev_close (int dev_id) {
 
     device_t * dev = dev_tbl + dev_id;
 
-    irq_state_t state = irq_enter_protection();
+    irq_state_t state = spin_lock_protect(&dev_tbl_lock);
     if (--dev->open_count == 0) {
         dev->desc->close(dev);
         kernel_memset(dev, 0, sizeof(device_t));
     }
-    irq_leave_protection(state);
-}
\ No newline at end of file
+    spin_unlock_protect(&dev_tbl_lock, state);
+}
\ No newline at end of file
@@ -262,7 +262,7 @@ int disk_read (device_t * dev, int start_sector, char * buf, int count) {
     for (cnt = 0; cnt < count; cnt++, buf += disk->sector_size) {
         // use sem to wait for interupt, wait writing to finish
         if (task_current()) {
-            sem_wait(disk->op_sem);
+            sem_wait_nokill(disk->op_sem);
         }
 
         // although there is a call to wait here, it won't actually wait because the operation has already completed
@@ -308,7 +308,7 @@ int disk_write (device_t * dev, int start_sector, char * buf, int count) {
 
         // use sem to wait for interupt, wait writing to finish
         if (task_current()) {
-            sem_wait(disk->op_sem);
+            sem_wait_nokill(disk->op_sem);
         }
 
         int err = ata_wait_data(disk);
@@ -341,7 +341,7 @@ void disk_close (device_t * dev) {
  * @brief Disk primary channel interrupt handling
  */
 void do_handler_ide_primary (exception_frame_t *frame)  {
-    pic_send_eoi(IRQ14_HARDDISK_PRIMARY);
+    irq_send_eoi(IRQ14_HARDDISK_PRIMARY);
     if (task_on_op && task_current()) {
         sem_notify(&op_sem);
     }
@@ -7,8 +7,12 @@
 #include "tools/log.h"
 #include "tools/klib.h"
 #include "dev/tty.h"
+#include "core/work.h"
 
 static kbd_state_t kbd_state;	// keyboard status
+static tty_fifo_t kbd_fifo;		// raw code received in interrupt
+static char kbd_buf[KBD_BUF_SIZE];
+static work_t kbd_work;			// decode raw code in kworker
 
 /**
  * Keyboard mapping table, divided into three categories
@@ -227,18 +231,13 @@ static void do_e0_key (uint8_t raw_code) {
 
 /**
  * @brief Key interrupt handling program
+ * only read the raw code here, it's decoded and sent to tty later in kworker
  */
 void do_handler_kbd(exception_frame_t *frame) {
-    static enum {
-    	NORMAL,				// normal, no e0 or e1
-		BEGIN_E0,			// e0
-		BEGIN_E1,			// e1
-    }recv_state = NORMAL;
-
 	// check for data; exit if there is none
 	uint8_t status = inb(KBD_PORT_STAT);
 	if (!(status & KBD_STAT_RECV_READY)) {
-        pic_send_eoi(IRQ1_KEYBOARD);
+        irq_send_eoi(IRQ1_KEYBOARD);
 		return;
 	}
 
@@ -246,26 +245,46 @@ void do_handler_kbd(exception_frame_t *frame) {
     uint8_t raw_code = inb(KBD_PORT_DATA);
 
 	// after reading is completed, you can send an EOI (End of Interrupt) to facilitate the continued response to keyboard interrupts
-    pic_send_eoi(IRQ1_KEYBOARD);
+    irq_send_eoi(IRQ1_KEYBOARD);
+
+	// dropped if kworker is too slow
+	tty_fifo_put(&kbd_fifo, raw_code);
+	work_schedule(&kbd_work);
+}
+
+/**
+ * @brief Decode all the received raw codes
+ */
+static void kbd_work_func (work_t * work) {
+    static enum {
+    	NORMAL,				// normal, no e0 or e1
+		BEGIN_E0,			// e0
+		BEGIN_E1,			// e1
+    }recv_state = NORMAL;
 
-	if (raw_code == KEY_E0) {
-		// E0 char
-		recv_state = BEGIN_E0;
-	} else if (raw_code == KEY_E1) {
-		// E1 char
-		recv_state = BEGIN_E1;
-	} else {
-		switch (recv_state) {
-		case NORMAL:
-			do_normal_key(raw_code);
-			break;
-		case BEGIN_E0:
-			do_e0_key(raw_code);
-			recv_state = NORMAL;
-			break;
-		case BEGIN_E1: 
-			recv_state = NORMAL;
-			break;
+	char code;
+	while (tty_fifo_get(&kbd_fifo, &code) == 0) {
+		uint8_t raw_code = (uint8_t)code;
+
+		if (raw_code == KEY_E0) {
+			// E0 char
+			recv_state = BEGIN_E0;
+		} else if (raw_code == KEY_E1) {
+			// E1 char
+			recv_state = BEGIN_E1;
+		} else {
+			switch (recv_state) {
+			case NORMAL:
+				do_normal_key(raw_code);
+				break;
+			case BEGIN_E0:
+				do_e0_key(raw_code);
+				recv_state = NORMAL;
+				break;
+			case BEGIN_E1: 
+				recv_state = NORMAL;
+				break;
+			}
 		}
 	}
 }
@@ -279,6 +298,9 @@ void kbd_init(void) {
     if (!inited) {
         update_led_status();
 
+        tty_fifo_init(&kbd_fifo, kbd_buf, sizeof(kbd_buf));
+        work_init(&kbd_work, kbd_work_func);
+
         irq_install(IRQ1_KEYBOARD, (irq_handler_t)exception_handler_kbd);
         irq_enable(IRQ1_KEYBOARD);
 
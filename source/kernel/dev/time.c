@@ -8,20 +8,298 @@
 #include "comm/cpu_instr.h"
 #include "os_cfg.h"
 #include "core/task.h"
+#include "cpu/lapic.h"
+#include "tools/log.h"
+#include "tools/klib.h"
+#include "core/memory.h"
+#include "comm/clock.h"
+#include "applib/lib_syscall.h"
+#include "core/hrtimer.h"
 
 static uint32_t sys_tick;						// number of tick after system start
+static int lapic_tick;							// local APIC timer is the tick source of BSP
+static uint32_t tsc_khz;						// TSC frequency, 0 if not calibrated
+static time_page_t * time_page;					// kernel address of the time page, 0 if no TSC
+static int pit_oneshot;							// PIT is free for one-shot events, or it's the tick
 
 /**
  * @brief Interrupt handling function
  */
 void do_handler_timer (exception_frame_t *frame) {
+    // one-shot event of hrtimers, the tick is from local APIC
+    if (pit_oneshot) {
+        irq_send_eoi(IRQ0_TIMER);
+        hrtimer_interrupt();
+
+        // run the task woken up at once if this CPU is idle, or it waits for next tick
+        irq_state_t state = irq_enter_protection();
+        task_dispatch();
+        irq_leave_protection(state);
+        return;
+    }
+
     sys_tick++;
 
     //send EOI first, instead of placing it at the end. 
     //placing it at the end would require the task to switch back to continue, after being switched out.
-    pic_send_eoi(IRQ0_TIMER);
+    irq_send_eoi(IRQ0_TIMER);
+
+    // no one-shot device, the hrtimers are checked in each tick
+    hrtimer_interrupt();
+    task_time_tick(frame->cs & 0x3);
+}
+
+/**
+ * @brief Local APIC timer interrupt, the tick source of application processors
+ * the system tick is counted on the BSP only
+ */
+void do_handler_lapic_timer (exception_frame_t *frame) {
+    if (lapic_tick && (task_cpu_id() == 0)) {
+        sys_tick++;
+    }
+
+    lapic_eoi();
+
+    task_time_tick(frame->cs & 0x3);
+}
+
+/**
+ * @brief Return number of ticks after system start
+ */
+uint32_t time_get_tick (void) {
+    return sys_tick;
+}
+
+/**
+ * @brief Tick from the local APIC timer instead of PIT on the BSP
+ * no port access in each tick, and EOI is one memory write
+ */
+void time_use_lapic (void) {
+    lapic_tick = 1;
+    lapic_timer_start(IRQ_LAPIC_TIMER, OS_TICK_MS);
+
+    // stop the periodic counting, PIT is programmed later for each hrtimer event
+    outb(PIT_COMMAND_MODE_PORT, PIT_CHANNLE0 | PIT_LOAD_LOHI | PIT_MODE0);
+    pit_oneshot = 1;
+}
+
+/**
+ * @brief Raise the timer interrupt after delta_ns, with PIT channel 0 in one-shot mode
+ * the max delay is about 54ms, the caller reprograms it when it comes too early
+ * return -1 if it's the tick source, then the hrtimers are checked in each tick
+ */
+int time_set_oneshot (uint64_t delta_ns) {
+    if (!pit_oneshot) {
+        return -1;
+    }
+
+    uint32_t us = (delta_ns >= (uint64_t)PIT_ONESHOT_MAX_US * NSEC_PER_USEC)
+                ? PIT_ONESHOT_MAX_US : (uint32_t)delta_ns / NSEC_PER_USEC;
+    uint32_t count = us * (PIT_OSC_FREQ / 1000) / 1000;
+    if (count < PIT_ONESHOT_MIN_COUNT) {
+        count = PIT_ONESHOT_MIN_COUNT;
+    } else if (count > 0xFFFF) {
+        count = 0xFFFF;
+    }
 
-    task_time_tick();
+    outb(PIT_COMMAND_MODE_PORT, PIT_CHANNLE0 | PIT_LOAD_LOHI | PIT_MODE0);
+    outb(PIT_CHANNEL0_DATA_PORT, count & 0xFF);
+    outb(PIT_CHANNEL0_DATA_PORT, (count >> 8) & 0xFF);
+    return 0;
+}
+
+/**
+ * @brief Busy wait with PIT channel 2, usable before the interrupts are enabled
+ * Ref: https://wiki.osdev.org/APIC_timer
+ */
+void pit_delay_us (uint32_t us) {
+    while (us > 0) {
+        // channel 2 is 16 bits, less than 54ms once
+        uint32_t curr_us = us > 50000 ? 50000 : us;
+        uint32_t count = PIT_OSC_FREQ / 1000 * curr_us / 1000;
+
+        // stop counting and disable the speaker, then load the count in one-shot mode
+        uint8_t gate = inb(PIT_CHANNEL2_GATE_PORT) & ~(PIT_GATE2_SPEAKER | PIT_GATE2_ENABLE);
+        outb(PIT_CHANNEL2_GATE_PORT, gate);
+        outb(PIT_COMMAND_MODE_PORT, PIT_CHANNLE2 | PIT_LOAD_LOHI | PIT_MODE0);
+        outb(PIT_CHANNEL2_DATA_PORT, count & 0xFF);
+        outb(PIT_CHANNEL2_DATA_PORT, (count >> 8) & 0xFF);
+
+        // start, out turns high when reach 0
+        outb(PIT_CHANNEL2_GATE_PORT, gate | PIT_GATE2_ENABLE);
+        while ((inb(PIT_CHANNEL2_GATE_PORT) & PIT_GATE2_OUT) == 0) {}
+
+        us -= curr_us;
+    }
+}
+
+/**
+ * @brief Read time stamp counter
+ */
+uint64_t time_tsc (void) {
+    return rdtsc();
+}
+
+/**
+ * @brief Convert TSC cycles to us, saturated at 0xFFFFFFFF
+ */
+uint32_t time_tsc_to_us (uint64_t cycles) {
+    if (time_page == (time_page_t *)0) {
+        return 0;
+    }
+
+    uint64_t us = clock_div64(clock_cyc2ns(cycles, time_page->mult, time_page->shift), NSEC_PER_USEC, 0);
+    return (us >> 32) ? 0xFFFFFFFF : (uint32_t)us;
+}
+
+/**
+ * @brief Monotonic time in ns since boot, in ticks if there's no TSC
+ */
+uint64_t time_ns (void) {
+    if (time_page == (time_page_t *)0) {
+        return (uint64_t)sys_tick * OS_TICK_MS * 1000000;
+    }
+
+    return clock_page_ns(time_page);
+}
+
+/**
+ * @brief Measure frequency of TSC with PIT channel 2
+ */
+static void tsc_calibrate (void) {
+    uint64_t start = rdtsc();
+    pit_delay_us(TSC_CALIBRATE_US);
+    uint64_t end = rdtsc();
+
+    tsc_khz = (uint32_t)(end - start) / (TSC_CALIBRATE_US / 1000);
+    log_printf("tsc: %d kHz", tsc_khz);
+}
+
+static uint8_t cmos_read (uint8_t reg) {
+    outb(CMOS_ADDR_PORT, reg | CMOS_NMI_DISABLE);
+    return inb(CMOS_DATA_PORT);
+}
+
+static int bcd_to_bin (uint8_t bcd) {
+    return (bcd & 0xF) + (bcd >> 4) * 10;
+}
+
+/**
+ * @brief Days from 1970-01-01
+ * Ref: http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+ */
+static int days_from_civil (int year, int month, int day) {
+    year -= month <= 2;
+    int era = year / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/**
+ * @brief Read wall clock from RTC, in seconds since 1970
+ * the registers are read again if an update happens in the middle
+ */
+static uint32_t rtc_read_sec (void) {
+    uint8_t regs[6], last[6];
+    static const uint8_t addr[6] = {RTC_SECOND, RTC_MINUTE, RTC_HOUR, RTC_DAY, RTC_MONTH, RTC_YEAR};
+
+    for (int i = 0; i < 6; i++) {
+        last[i] = 0xFF;
+    }
+    for (;;) {
+        while (cmos_read(RTC_STATUS_A) & RTC_A_UPDATING) {}
+        for (int i = 0; i < 6; i++) {
+            regs[i] = cmos_read(addr[i]);
+        }
+
+        if (kernel_memcmp(regs, last, sizeof(regs)) == 0) {
+            break;
+        }
+        kernel_memcpy(last, regs, sizeof(regs));
+    }
+
+    uint8_t status = cmos_read(RTC_STATUS_B);
+    int pm = regs[2] & RTC_HOUR_PM;
+    regs[2] &= ~RTC_HOUR_PM;
+
+    int value[6];
+    for (int i = 0; i < 6; i++) {
+        value[i] = (status & RTC_B_BINARY) ? regs[i] : bcd_to_bin(regs[i]);
+    }
+
+    // 12 hour mode, 12AM is 0 and 12PM is 12
+    int hour = value[2];
+    if (!(status & RTC_B_24HOUR)) {
+        hour = (hour % 12) + (pm ? 12 : 0);
+    }
+
+    int days = days_from_civil(2000 + value[5], value[4], value[3]);
+    return (uint32_t)days * 86400 + hour * 3600 + value[1] * 60 + value[0];
+}
+
+/**
+ * @brief Create the time page shared with all processes
+ */
+static void time_page_init (void) {
+    if (tsc_khz == 0) {
+        log_printf("no tsc, clock is in ticks.");
+        return;
+    }
+
+    time_page_t * page = (time_page_t *)memory_alloc_shared_page(MEM_TIME_PAGE);
+    if (page == (time_page_t *)0) {
+        log_printf("alloc time page failed.");
+        return;
+    }
+
+    page->mult = (uint32_t)clock_div64((uint64_t)1000000 << CLOCK_SHIFT, tsc_khz, 0);
+    page->shift = CLOCK_SHIFT;
+    page->boot_sec = rtc_read_sec();
+    page->tsc_base = rdtsc();
+    page->magic = TIME_PAGE_MAGIC;
+    time_page = page;
+}
+
+/**
+ * @brief Get time of the clock, CLOCK_MONOTONIC is since boot
+ */
+int sys_clock_gettime (int clock_id, struct timespec * ts) {
+    if ((ts == (struct timespec *)0) || ((clock_id != CLOCK_MONOTONIC) && (clock_id != CLOCK_REALTIME))) {
+        return -1;
+    }
+
+    uint32_t nsec;
+    uint64_t sec = clock_div64(time_ns(), NSEC_PER_SEC, &nsec);
+    if ((clock_id == CLOCK_REALTIME) && time_page) {
+        sec += time_page->boot_sec;
+    }
+
+    ts->tv_sec = sec;
+    ts->tv_nsec = nsec;
+    return 0;
+}
+
+/**
+ * @brief Get wall clock, the timezone is not supported
+ */
+int sys_gettimeofday (struct timeval * tv, void * tz) {
+    struct timespec ts;
+    if ((tv == (struct timeval *)0) || (sys_clock_gettime(CLOCK_REALTIME, &ts) < 0)) {
+        return -1;
+    }
+
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / NSEC_PER_USEC;
+    return 0;
+}
+
+/**
+ * @brief User address of the time page, 0 if there's none
+ */
+uint32_t sys_time_page (void) {
+    return time_page ? MEM_TIME_PAGE : 0;
 }
 
 /**
@@ -45,7 +323,13 @@ static void init_pit (void) {
 void time_init (void) {
     sys_tick = 0;
 
+    hrtimer_module_init();
     init_pit();
+    tsc_calibrate();
+    time_page_init();
+
+    // tick source of application processors, started by each of them
+    irq_install(IRQ_LAPIC_TIMER, (irq_handler_t)exception_handler_lapic_timer);
 }
 
 
@@ -8,6 +8,8 @@
 #include "dev/dev.h"
 #include "tools/log.h"
 #include "cpu/irq.h"
+#include "fs/poll.h"
+#include "applib/lib_syscall.h"
 
 static tty_t tty_devs[TTY_NR];
 static int curr_tty = 0;
@@ -20,23 +22,25 @@ void tty_fifo_init (tty_fifo_t * fifo, char * buf, int size) {
 	fifo->count = 0;
 	fifo->size = size;
 	fifo->read = fifo->write = 0;
+	spin_init(&fifo->lock);
 }
 
 /**
  * @brief Get one byte
  */
 int tty_fifo_get (tty_fifo_t * fifo, char * c) {
+	irq_state_t state = spin_lock_protect(&fifo->lock);
 	if (fifo->count <= 0) {
+		spin_unlock_protect(&fifo->lock, state);
 		return -1;
 	}
 
-	irq_state_t state = irq_enter_protection();
 	*c = fifo->buf[fifo->read++];
 	if (fifo->read >= fifo->size) {
 		fifo->read = 0;
 	}
 	fifo->count--;
-	irq_leave_protection(state);
+	spin_unlock_protect(&fifo->lock, state);
 	return 0;
 }
 
@@ -44,17 +48,18 @@ int tty_fifo_get (tty_fifo_t * fifo, char * c) {
  * @brief Write one byte
  */
 int tty_fifo_put (tty_fifo_t * fifo, char c) {
+	irq_state_t state = spin_lock_protect(&fifo->lock);
 	if (fifo->count >= fifo->size) {
+		spin_unlock_protect(&fifo->lock, state);
 		return -1;
 	}
 
-	irq_state_t state = irq_enter_protection();
 	fifo->buf[fifo->write++] = c;
 	if (fifo->write >= fifo->size) {
 		fifo->write = 0;
 	}
 	fifo->count++;
-	irq_leave_protection(state);
+	spin_unlock_protect(&fifo->lock, state);
 
 	return 0;
 }
@@ -87,6 +92,7 @@ int tty_open (device_t * dev)  {
 	sem_init(&tty->osem, TTY_OBUF_SIZE);
 	tty_fifo_init(&tty->ififo, tty->ibuf, TTY_IBUF_SIZE);
 	sem_init(&tty->isem, 0);
+	waitq_init(&tty->poll_wq);
 
 	tty->iflags = TTY_INLCR | TTY_IECHO;
 	tty->oflags = TTY_OCRLF;
@@ -116,15 +122,19 @@ int tty_write (device_t * dev, int addr, char * buf, int size) {
 
 		// If '\n' is encountered, decide whether to convert it to '\r\n' based on the config
 		if (c == '\n' && (tty->oflags & TTY_OCRLF)) {
-			sem_wait(&tty->osem);
+			if (sem_wait(&tty->osem) < 0) {
+				break;
+			}
 			int err = tty_fifo_put(&tty->ofifo, '\r');
 			if (err < 0) {
 				break;
 			}
 		}
 
-		// write current char
-		sem_wait(&tty->osem);
+		// write current char, given up if the process is killed
+		if (sem_wait(&tty->osem) < 0) {
+			break;
+		}
 		int err = tty_fifo_put(&tty->ofifo, c);
 		if (err < 0) {
 			break;
@@ -154,8 +164,10 @@ int tty_read (device_t * dev, int addr, char * buf, int size) {
 
 	// keep reading until encountering the end of file or the end of a line
 	while (len < size) {
-		// wait available data
-		sem_wait(&tty->isem);
+		// wait available data, what is read is returned if the process is killed
+		if (sem_wait(&tty->isem) < 0) {
+			break;
+		}
 
 		// retrieve data
 		char ch;
@@ -221,6 +233,17 @@ int tty_control (device_t * dev, int cmd, int arg0, int arg1) {
 	return 0;
 }
 
+/**
+ * @brief Input is ready if any char is in the buffer. Output is always ready,
+ * it waits only for the console to take the chars
+ */
+int tty_poll (device_t * dev, poll_table_t * pt) {
+	tty_t * tty = get_tty(dev);
+
+	poll_wait(pt, &tty->poll_wq);
+	return (sem_count(&tty->isem) ? POLLIN : 0) | POLLOUT;
+}
+
 /**
  * @brief Close tty device
  */
@@ -240,6 +263,7 @@ void tty_in (char ch) {
 
 	tty_fifo_put(&tty->ififo, ch);
 	sem_notify(&tty->isem);
+	poll_wakeup(&tty->poll_wq);
 }
 
 /**
@@ -260,5 +284,6 @@ dev_desc_t dev_tty_desc = {
 	.read = tty_read,
 	.write = tty_write,
 	.control = tty_control,
+	.poll = tty_poll,
 	.close = tty_close,
-};
\ No newline at end of file
+};
\ No newline at end of file
@@ -114,6 +114,13 @@ int devfs_ioctl(file_t * file, int cmd, int arg0, int arg1) {
     return dev_control(file->dev_id, cmd, arg0, arg1);
 }
 
+/**
+ * @brief Events ready of the device
+ */
+int devfs_poll (file_t * file, struct _poll_table_t * pt) {
+    return dev_poll(file->dev_id, pt);
+}
+
 // file system operations
 fs_op_t devfs_op = {
     .mount = devfs_mount,
@@ -125,4 +132,5 @@ fs_op_t devfs_op = {
     .stat = devfs_stat,
     .close = devfs_close,
     .ioctl = devfs_ioctl,
+    .poll = devfs_poll,
 };
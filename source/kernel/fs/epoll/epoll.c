@@ -0,0 +1,396 @@
+/**
+ * Epoll
+ */
+#include "fs/epoll/epoll.h"
+#include "fs/fs.h"
+#include "core/task.h"
+#include "cpu/irq.h"
+#include "dev/time.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include <sys/file.h>
+
+static epoll_t epoll_table[EPOLL_NR];
+static mutex_t table_mutex;
+static int epoll_count;                 // sets opened, closing a file looks for it in them
+static fs_t epoll_fs;
+
+/**
+ * @brief Watcher of epoll_ctl, the poll op of the file adds the item to its queue
+ */
+typedef struct _epoll_queue_t {
+    poll_table_t pt;                    // the first member
+    epoll_item_t * item;
+}epoll_queue_t;
+
+static epoll_t * file_epoll (file_t * file) {
+    return epoll_table + file->dev_id;
+}
+
+/**
+ * @brief Put the item into the ready list if it's not there, ep->wq.lock should be held
+ */
+static void epoll_item_mark (epoll_item_t * item) {
+    if (!item->ready) {
+        item->ready = 1;
+        list_insert_last(&item->ep->ready_list, &item->ready_node);
+    }
+}
+
+/**
+ * @brief The queue of the file is woken up, called by the waker with the lock of the queue held
+ */
+static void epoll_item_wake (waitq_entry_t * entry) {
+    epoll_item_t * item = (epoll_item_t *)entry->arg;
+    epoll_t * ep = item->ep;
+
+    spin_lock(&ep->wq.lock);
+    epoll_item_mark(item);
+    waitq_wake_all(&ep->wq);
+    spin_unlock(&ep->wq.lock);
+}
+
+static void epoll_queue (poll_table_t * pt, waitq_t * wq) {
+    epoll_item_t * item = ((epoll_queue_t *)pt)->item;
+    if (item->wq == (waitq_t *)0) {
+        item->wq = wq;
+        waitq_add(wq, &item->entry, epoll_item_wake, item);
+    }
+}
+
+/**
+ * @brief Start watching the file if it's not, it's checked on next wait
+ */
+static void epoll_item_watch (epoll_item_t * item) {
+    epoll_queue_t queue;
+    queue.pt.queue = epoll_queue;
+    queue.item = item;
+    file_poll(item->file, &queue.pt);
+
+    epoll_t * ep = item->ep;
+    irq_state_t irq_state = spin_lock_protect(&ep->wq.lock);
+    epoll_item_mark(item);
+    waitq_wake_all(&ep->wq);
+    spin_unlock_protect(&ep->wq.lock, irq_state);
+}
+
+/**
+ * @brief Stop watching and remove the item from the set, ep->mutex should be held
+ */
+static void epoll_item_free (epoll_item_t * item) {
+    epoll_t * ep = item->ep;
+
+    if (item->wq) {
+        waitq_remove(item->wq, &item->entry);
+        item->wq = (waitq_t *)0;
+    }
+
+    irq_state_t irq_state = spin_lock_protect(&ep->wq.lock);
+    if (item->ready) {
+        list_remove(&ep->ready_list, &item->ready_node);
+        item->ready = 0;
+    }
+    spin_unlock_protect(&ep->wq.lock, irq_state);
+    item->used = 0;
+}
+
+/**
+ * @brief Check the items ready, and fill at most maxevents of them into events
+ * level triggered, the one reported is checked again on next wait. ep->mutex should be held
+ */
+static int epoll_collect (epoll_t * ep, struct epoll_event * events, int maxevents) {
+    // take the ready list, the items woken up from now on go to the new one
+    irq_state_t irq_state = spin_lock_protect(&ep->wq.lock);
+    list_t list = ep->ready_list;
+    list_init(&ep->ready_list);
+    spin_unlock_protect(&ep->wq.lock, irq_state);
+
+    int count = 0;
+    while (list_count(&list) && (count < maxevents)) {
+        epoll_item_t * item = list_node_parent(list_remove_first(&list), epoll_item_t, ready_node);
+
+        // a wake up from now on puts it back
+        irq_state = spin_lock_protect(&ep->wq.lock);
+        item->ready = 0;
+        spin_unlock_protect(&ep->wq.lock, irq_state);
+
+        unsigned int revents = file_poll(item->file, (poll_table_t *)0) & (item->events | POLLERR | POLLHUP);
+        if (revents) {
+            events[count].events = revents;
+            events[count++].data = item->data;
+
+            irq_state = spin_lock_protect(&ep->wq.lock);
+            epoll_item_mark(item);
+            spin_unlock_protect(&ep->wq.lock, irq_state);
+        }
+    }
+
+    // the rest are left to next wait, still marked as ready
+    irq_state = spin_lock_protect(&ep->wq.lock);
+    while (list_count(&list)) {
+        list_insert_last(&ep->ready_list, list_remove_first(&list));
+    }
+    spin_unlock_protect(&ep->wq.lock, irq_state);
+    return count;
+}
+
+/**
+ * @brief Get the interest set of the fd
+ */
+static epoll_t * epoll_get (int epfd) {
+    file_t * file = task_file(epfd);
+    if (!file || (file->type != FILE_EPOLL)) {
+        return (epoll_t *)0;
+    }
+    return file_epoll(file);
+}
+
+/**
+ * @brief Add, change or delete fd in the interest set, the epoll files can't be added
+ */
+int sys_epoll_ctl (int epfd, int op, int fd, struct epoll_event * event) {
+    epoll_t * ep = epoll_get(epfd);
+    file_t * file = task_file(fd);
+    if (!ep || !file || (file->type == FILE_EPOLL) || ((op != EPOLL_CTL_DEL) && !event)) {
+        return -1;
+    }
+
+    mutex_lock(&ep->mutex);
+
+    epoll_item_t * item = (epoll_item_t *)0;
+    epoll_item_t * free_item = (epoll_item_t *)0;
+    for (int i = 0; i < EPOLL_ITEM_NR; i++) {
+        epoll_item_t * curr = ep->items + i;
+        if (!curr->used) {
+            free_item = free_item ? free_item : curr;
+        } else if ((curr->fd == fd) && (curr->file == file)) {
+            item = curr;
+            break;
+        }
+    }
+
+    int err = 0;
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        if (item || !free_item) {
+            err = -1;
+            break;
+        }
+
+        item = free_item;
+        item->used = 1;
+        item->fd = fd;
+        item->file = file;
+        item->ep = ep;
+        item->events = event->events;
+        item->data = event->data;
+        item->wq = (waitq_t *)0;
+        item->ready = 0;
+        list_node_init(&item->ready_node);
+        epoll_item_watch(item);
+        break;
+    case EPOLL_CTL_MOD:
+        if (item) {
+            item->events = event->events;
+            item->data = event->data;
+            epoll_item_watch(item);
+        } else {
+            err = -1;
+        }
+        break;
+    case EPOLL_CTL_DEL:
+        if (item) {
+            epoll_item_free(item);
+        } else {
+            err = -1;
+        }
+        break;
+    default:
+        err = -1;
+        break;
+    }
+
+    mutex_unlock(&ep->mutex);
+    return err;
+}
+
+/**
+ * @brief Wait until some files in the set are ready, or timeout ms passed, forever if timeout < 0
+ * return the number of events filled, 0 if time is out
+ */
+int sys_epoll_wait (int epfd, struct epoll_event * events, int maxevents, int timeout) {
+    epoll_t * ep = epoll_get(epfd);
+    if (!ep || !events || (maxevents <= 0)) {
+        return -1;
+    }
+
+    uint64_t deadline = (timeout > 0) ? time_ns() + (uint64_t)timeout * 1000000 : 0;
+    int count;
+    for (;;) {
+        mutex_lock(&ep->mutex);
+        count = epoll_collect(ep, events, maxevents);
+        mutex_unlock(&ep->mutex);
+        if (count || (timeout == 0)) {
+            break;
+        }
+
+        // sleep with the ready list checked empty, the item woken up after it wakes us up
+        int err = 0;
+        irq_state_t irq_state = spin_lock_protect(&ep->wq.lock);
+        if (list_count(&ep->ready_list) == 0) {
+            uint64_t now = time_ns();
+            if (deadline && (now >= deadline)) {
+                err = -1;
+            } else {
+                err = waitq_wait(&ep->wq, 0, deadline ? deadline - now : 0);
+            }
+        }
+        spin_unlock_protect(&ep->wq.lock, irq_state);
+
+        if (err < 0) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief The file is closed at last, remove it from all the sets
+ */
+void epoll_file_close (file_t * file) {
+    if (epoll_count == 0) {
+        return;
+    }
+
+    for (int i = 0; i < EPOLL_NR; i++) {
+        epoll_t * ep = epoll_table + i;
+        if (!ep->used) {
+            continue;
+        }
+
+        mutex_lock(&ep->mutex);
+        for (int j = 0; j < EPOLL_ITEM_NR; j++) {
+            epoll_item_t * item = ep->items + j;
+            if (item->used && (item->file == file)) {
+                epoll_item_free(item);
+            }
+        }
+        mutex_unlock(&ep->mutex);
+    }
+}
+
+static int epoll_read (char * buf, int size, file_t * file) {
+    return -1;
+}
+
+static int epoll_write (char * buf, int size, file_t * file) {
+    return -1;
+}
+
+/**
+ * @brief Release the set with all its items
+ */
+static void epoll_close (file_t * file) {
+    epoll_t * ep = file_epoll(file);
+
+    mutex_lock(&ep->mutex);
+    for (int i = 0; i < EPOLL_ITEM_NR; i++) {
+        epoll_item_t * item = ep->items + i;
+        if (item->used) {
+            epoll_item_free(item);
+        }
+    }
+    mutex_unlock(&ep->mutex);
+
+    mutex_lock(&table_mutex);
+    ep->used = 0;
+    epoll_count--;
+    mutex_unlock(&table_mutex);
+}
+
+static int epoll_seek (file_t * file, uint32_t offset, int dir) {
+    return -1;
+}
+
+static int epoll_stat (file_t * file, struct stat * st) {
+    return -1;
+}
+
+static int epoll_ioctl (file_t * file, int cmd, int arg0, int arg1) {
+    return -1;
+}
+
+/**
+ * @brief Readable if some items may be ready, for poll on the set
+ */
+static int epoll_poll (file_t * file, poll_table_t * pt) {
+    epoll_t * ep = file_epoll(file);
+    poll_wait(pt, &ep->wq);
+
+    irq_state_t irq_state = spin_lock_protect(&ep->wq.lock);
+    int events = list_count(&ep->ready_list) ? POLLIN : 0;
+    spin_unlock_protect(&ep->wq.lock, irq_state);
+    return events;
+}
+
+static fs_op_t epoll_op = {
+    .read = epoll_read,
+    .write = epoll_write,
+    .close = epoll_close,
+    .seek = epoll_seek,
+    .stat = epoll_stat,
+    .ioctl = epoll_ioctl,
+    .poll = epoll_poll,
+};
+
+/**
+ * @brief Init the table of interest sets
+ */
+void epoll_init (void) {
+    kernel_memset(epoll_table, 0, sizeof(epoll_table));
+    mutex_init(&table_mutex);
+    epoll_count = 0;
+
+    // not mounted like the pipes, the sets lock themselves
+    kernel_memset(&epoll_fs, 0, sizeof(epoll_fs));
+    epoll_fs.type = FS_EPOLL;
+    epoll_fs.op = &epoll_op;
+    epoll_fs.rwlock = (rwlock_t *)0;
+}
+
+/**
+ * @brief Create an empty interest set for file
+ */
+int epoll_open (file_t * file) {
+    epoll_t * ep = (epoll_t *)0;
+
+    mutex_lock(&table_mutex);
+    for (int i = 0; i < EPOLL_NR; i++) {
+        if (!epoll_table[i].used) {
+            ep = epoll_table + i;
+            ep->used = 1;
+            epoll_count++;
+            break;
+        }
+    }
+    mutex_unlock(&table_mutex);
+
+    if (ep == (epoll_t *)0) {
+        log_printf("no free epoll");
+        return -1;
+    }
+
+    mutex_init(&ep->mutex);
+    waitq_init(&ep->wq);
+    list_init(&ep->ready_list);
+    kernel_memset(ep->items, 0, sizeof(ep->items));
+
+    kernel_strncpy(file->file_name, "epoll", FILE_NAME_SIZE);
+    file->type = FILE_EPOLL;
+    file->fs = &epoll_fs;
+    file->dev_id = ep - epoll_table;
+    file->pos = file->size = 0;
+    file->mode = O_RDONLY;
+    return 0;
+}
@@ -58,12 +58,11 @@ int cluster_get_next (fat_t * fat, cluster_t curr) {
     }
 
     // read sector and get cluster data
+    mutex_lock(&fat->buf_mutex);
     int err = bread_sector(fat, fat->tbl_start + sector);
-    if (err < 0) {
-        return FAT_CLUSTER_INVALID;
-    }
-
-    return *(cluster_t*)(fat->fat_buffer + off_sector);
+    cluster_t next = (err < 0) ? FAT_CLUSTER_INVALID : *(cluster_t*)(fat->fat_buffer + off_sector);
+    mutex_unlock(&fat->buf_mutex);
+    return next;
 }
 
 /**
@@ -298,10 +297,9 @@ static int expand_file(file_t * file, int inc_bytes) {
         // empty file or end of the cluster
         cluster_cnt = up2(inc_bytes, fat->cluster_byte_size) / fat->cluster_byte_size; 
     } else {
-        // not empty file, if space is enough just quit
+        // not empty file, if space is enough just quit, the size is updated by the write
         int cfree = fat->cluster_byte_size - (file->size % fat->cluster_byte_size);
         if (cfree >= inc_bytes) {
-            file->size += inc_bytes;
             return 0;
         }
 
@@ -319,11 +317,21 @@ static int expand_file(file_t * file, int inc_bytes) {
     if (!cluster_is_valid(file->sblk)) {
         file->cblk = file->sblk = start;
     } else {
-        // build link
-        int err = cluster_set_next(fat, file->cblk, start);
+        // build link after the last cluster, the position may be in the middle after pwrite
+        cluster_t last = cluster_is_valid(file->cblk) ? file->cblk : file->sblk;
+        for (cluster_t next = cluster_get_next(fat, last); cluster_is_valid(next); next = cluster_get_next(fat, next)) {
+            last = next;
+        }
+
+        int err = cluster_set_next(fat, last, start);
         if (err < 0) {
             return -1;
         }
+
+        // the position is right after the last cluster, e.g. seek to the end, it's in the new one
+        if (!cluster_is_valid(file->cblk)) {
+            file->cblk = start;
+        }
     }
 
     return 0;
@@ -354,6 +362,40 @@ static int move_file_pos(file_t* file, fat_t * fat, uint32_t move_bytes, int exp
 	return 0;
 }
 
+/**
+ * @brief Move file pointer to offset
+ * walk the chain from the current cluster if offset is not before it, otherwise from the start
+ * the end of the last cluster is allowed, the cluster there is allocated by the next write
+ */
+static int seek_file_pos (file_t * file, fat_t * fat, uint32_t offset) {
+    uint32_t cluster_start = 0;
+    cluster_t cluster = file->sblk;
+
+    uint32_t curr_start = file->pos - file->pos % fat->cluster_byte_size;
+    if ((offset >= curr_start) && cluster_is_valid(file->cblk)) {
+        cluster_start = curr_start;
+        cluster = file->cblk;
+    }
+
+    while (offset - cluster_start >= fat->cluster_byte_size) {
+        if (!cluster_is_valid(cluster)) {
+            return -1;
+        }
+
+        cluster_t next = cluster_get_next(fat, cluster);
+        if (!cluster_is_valid(next) && (offset - cluster_start > fat->cluster_byte_size)) {
+            return -1;
+        }
+
+        cluster = next;
+        cluster_start += fat->cluster_byte_size;
+    }
+
+    file->pos = offset;
+    file->cblk = cluster;
+    return 0;
+}
+
 /**
  * @brief Mount FAT File System
  */
@@ -392,8 +434,9 @@ int fatfs_mount (struct _fs_t * fs, int dev_major, int dev_minor) {
     fat->data_start = fat->root_start + fat->root_ent_cnt * 32 / SECTOR_SIZE;
     fat->curr_sector = -1;
     fat->fs = fs;
-    mutex_init(&fat->mutex);
-    fs->mutex = &fat->mutex;
+    mutex_init(&fat->buf_mutex);
+    rwlock_init(&fat->rwlock);
+    fs->rwlock = &fat->rwlock;
 
     // check if it's fat 16 file system
 	if (fat->tbl_cnt != 2) {
@@ -449,12 +492,16 @@ int fatfs_open (struct _fs_t * fs, const char * path, file_t * file) {
     fat_t * fat = (fat_t *)fs->data;
     diritem_t * file_item = (diritem_t *)0;
     int p_index = -1;
+    int err = -1;
+
+    // the entries are in the buffer shared by the readers
+    mutex_lock(&fat->buf_mutex);
 
     // iterate root dir data, find exised matching entry
     for (int i = 0; i < fat->root_ent_cnt; i++) {
         diritem_t * item = read_dir_entry(fat, i);
         if (item == (diritem_t *)0) {
-            return -1;
+            goto open_done;
         }
 
          // end entry.
@@ -485,22 +532,23 @@ int fatfs_open (struct _fs_t * fs, const char * path, file_t * file) {
             file->cblk = file->sblk = FAT_CLUSTER_INVALID;
             file->size = 0;
         }
-        return 0;
+        err = 0;
     } else if ((file->mode & O_CREAT) && (p_index >= 0)) {
         // create a idle diritem entry
         diritem_t item;
         diritem_init(&item, 0, path);
-        int err = write_dir_entry(fat, &item, p_index);
+        err = write_dir_entry(fat, &item, p_index);
         if (err < 0) {
             log_printf("create file failed.");
-            return -1;
+            goto open_done;
         }
 
         read_from_diritem(fat, file, &item, p_index);
-        return 0;
     }
 
-    return -1;
+open_done:
+    mutex_unlock(&fat->buf_mutex);
+    return err;
 }
 
 /**
@@ -521,8 +569,8 @@ int fatfs_read (char * buf, int size, file_t * file) {
 		uint32_t cluster_offset = file->pos % fat->cluster_byte_size;
         uint32_t start_sector = fat->data_start + (file->cblk - 2)* fat->sec_per_cluster;  
 
-        // if it's cluster, read only one cluster
-        if ((cluster_offset == 0) && (nbytes == fat->cluster_byte_size)) {
+        // a whole cluster is read into the buffer directly
+        if ((cluster_offset == 0) && (nbytes >= fat->cluster_byte_size)) {
             int err = dev_read(fat->fs->dev_id, start_sector, buf, fat->sec_per_cluster);
             if (err < 0) {
                 return total_read;
@@ -536,12 +584,16 @@ int fatfs_read (char * buf, int size, file_t * file) {
             }
 
             // Read the entire cluster and then copy from it
+            mutex_lock(&fat->buf_mutex);
             fat->curr_sector = -1;
             int err = dev_read(fat->fs->dev_id, start_sector, fat->fat_buffer, fat->sec_per_cluster);
+            if (err >= 0) {
+                kernel_memcpy(buf, fat->fat_buffer + cluster_offset, curr_read);
+            }
+            mutex_unlock(&fat->buf_mutex);
             if (err < 0) {
                 return total_read;
             }
-            kernel_memcpy(buf, fat->fat_buffer + cluster_offset, curr_read);
         }
 
         buf += curr_read;
@@ -581,8 +633,8 @@ int fatfs_write (char * buf, int size, file_t * file) {
 		uint32_t cluster_offset = file->pos % fat->cluster_byte_size;
         uint32_t start_sector = fat->data_start + (file->cblk - 2)* fat->sec_per_cluster;  // 从2开始
 
-        // If it's a whole cluster, write the entire cluster
-        if ((cluster_offset == 0) && (nbytes == fat->cluster_byte_size)) {
+        // a whole cluster is written from the buffer directly, without reading it first
+        if ((cluster_offset == 0) && (nbytes >= fat->cluster_byte_size)) {
             int err = dev_write(fat->fs->dev_id, start_sector, buf, fat->sec_per_cluster);
             if (err < 0) {
                 return total_write;
@@ -612,7 +664,11 @@ int fatfs_write (char * buf, int size, file_t * file) {
         buf += curr_write;
         nbytes -= curr_write;
         total_write += curr_write;
-        file->size += curr_write;
+
+        // it may overwrite the data inside the file
+        if (file->pos + curr_write > file->size) {
+            file->size = file->pos + curr_write;
+        }
 
         // Move the file pointer forward
 		int err = move_file_pos(file, fat, curr_write, 1);
@@ -655,36 +711,73 @@ int fatfs_seek (file_t * file, uint32_t offset, int dir) {
     }
 
     fat_t * fat = (fat_t *)file->fs->data;
-    cluster_t curr_cluster = file->sblk;
-    uint32_t curr_pos = 0;
-    uint32_t offset_to_move = offset;
+    return seek_file_pos(file, fat, offset);
+}
 
-    while (offset_to_move > 0) {
-        uint32_t c_off = curr_pos % fat->cluster_byte_size;
-        uint32_t curr_move = offset_to_move;
+/**
+ * @brief Read to the segments at offset, or at the current position if offset < 0
+ * the position is not changed with offset
+ */
+int fatfs_preadv (file_t * file, const struct iovec * iov, int iovcnt, int offset) {
+    fat_t * fat = (fat_t *)file->fs->data;
+    int pos = file->pos;
+    cluster_t cblk = file->cblk;
 
-        // If it doesn't exceed one cluster, adjust the position directly, no need to move to the next cluster
-        if (c_off + curr_move < fat->cluster_byte_size) {
-            curr_pos += curr_move;
+    if (offset >= 0) {
+        if (offset >= file->size) {
+            return 0;
+        }
+
+        if (seek_file_pos(file, fat, offset) < 0) {
+            return -1;
+        }
+    }
+
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        int size = fatfs_read((char *)iov[i].iov_base, iov[i].iov_len, file);
+        total += size;
+        if (size < iov[i].iov_len) {
             break;
         }
+    }
 
-        // If it exceeds one cluster, move only within the current cluster
-        curr_move = fat->cluster_byte_size - c_off;
-        curr_pos += curr_move;
-        offset_to_move -= curr_move;
+    if (offset >= 0) {
+        file->pos = pos;
+        file->cblk = cblk;
+    }
+    return total;
+}
+
+/**
+ * @brief Write the segments at offset, or at the current position if offset < 0
+ * the file can be extended, but not with a hole after its end
+ */
+int fatfs_pwritev (file_t * file, const struct iovec * iov, int iovcnt, int offset) {
+    fat_t * fat = (fat_t *)file->fs->data;
+    int pos = file->pos;
+    cluster_t cblk = file->cblk;
 
-        // Get next cluster
-        curr_cluster = cluster_get_next(fat, curr_cluster);
-        if (!cluster_is_valid(curr_cluster)) {
+    if (offset >= 0) {
+        if ((offset > file->size) || (seek_file_pos(file, fat, offset) < 0)) {
             return -1;
         }
     }
 
-    // Record the final position
-    file->pos = curr_pos;
-    file->cblk = curr_cluster;
-    return 0;
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        int size = fatfs_write((char *)iov[i].iov_base, iov[i].iov_len, file);
+        total += size;
+        if (size < iov[i].iov_len) {
+            break;
+        }
+    }
+
+    if (offset >= 0) {
+        file->pos = pos;
+        file->cblk = cblk;
+    }
+    return total;
 }
 
 int fatfs_stat (file_t * file, struct stat *st) {
@@ -704,12 +797,14 @@ int fatfs_opendir (struct _fs_t * fs,const char * name, DIR * dir) {
  */
 int fatfs_readdir (struct _fs_t * fs,DIR* dir, struct dirent * dirent) {
     fat_t * fat = (fat_t *)fs->data;
+    int err = -1;
 
     // Simple checks
+    mutex_lock(&fat->buf_mutex);
     while (dir->index < fat->root_ent_cnt) {
         diritem_t * item = read_dir_entry(fat, dir->index);
         if (item == (diritem_t *)0) {
-            return -1;
+            break;
         }
 
         // The end entry; no need for further scanning, and the index should not advance
@@ -725,14 +820,16 @@ int fatfs_readdir (struct _fs_t * fs,DIR* dir, struct dirent * dirent) {
                 dirent->type = diritem_get_type(item);
                 dirent->size = item->DIR_FileSize;
                 diritem_get_name(item, dirent->name);
-                return 0;
+                err = 0;
+                break;
             }
         }
 
         dir->index++;
     }
+    mutex_unlock(&fat->buf_mutex);
 
-    return -1;
+    return err;
 }
 
 /**
@@ -790,9 +887,11 @@ fs_op_t fatfs_op = {
     .seek = fatfs_seek,
     .stat = fatfs_stat,
     .close = fatfs_close,
+    .preadv = fatfs_preadv,
+    .pwritev = fatfs_pwritev,
 
     .opendir = fatfs_opendir,
     .readdir = fatfs_readdir,
     .closedir = fatfs_closedir,
     .unlink = fatfs_unlink,
-};
\ No newline at end of file
+};
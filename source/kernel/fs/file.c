@@ -4,9 +4,12 @@
 #include "fs/file.h"
 #include "tools/klib.h"
 #include "ipc/mutex.h"
+#include "ipc/waitq.h"
+#include "cpu/irq.h"
 
 static file_t file_table[FILE_TABLE_SIZE];      // available file table
 static mutex_t file_alloc_mutex;                // mutex of file_table
+static waitq_t file_lock_wq;                    // tasks waiting in file_lock, data is the file index
 
 /**
  * @brief Allocate a file descriptor 
@@ -48,6 +51,37 @@ void file_inc_ref (file_t * file) {
     mutex_unlock(&file_alloc_mutex);
 }
 
+/**
+ * @brief Lock the position of file, for the readers sharing the file system
+ */
+void file_lock (file_t * file) {
+    irq_state_t irq_state = spin_lock_protect(&file_lock_wq.lock);
+    while (file->locked) {
+        waitq_wait_nokill(&file_lock_wq, file - file_table);
+    }
+    file->locked = 1;
+    spin_unlock_protect(&file_lock_wq.lock, irq_state);
+}
+
+/**
+ * @brief Choose the waiters of the file, arg is the file index
+ */
+static int file_lock_waiter (waitq_entry_t * entry, void * arg) {
+    return (entry->data == (int)arg) ? WAITQ_WAKE : WAITQ_SKIP;
+}
+
+void file_unlock (file_t * file) {
+    irq_state_t irq_state = spin_lock_protect(&file_lock_wq.lock);
+    file->locked = 0;
+    int count = waitq_wake_if(&file_lock_wq, file_lock_waiter, (void *)(file - file_table));
+    spin_unlock(&file_lock_wq.lock);
+
+    if (count) {
+        task_dispatch();
+    }
+    irq_leave_protection(irq_state);
+}
+
 /**
  * @brief Init file table
  */
@@ -55,4 +89,5 @@ void file_table_init (void) {
     // init file descriptor table
 	kernel_memset(&file_table, 0, sizeof(file_table));
 	mutex_init(&file_alloc_mutex);
+    waitq_init(&file_lock_wq);
 }
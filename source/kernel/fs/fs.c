@@ -14,6 +14,10 @@
 #include <sys/file.h>
 #include "dev/disk.h"
 #include "os_cfg.h"
+#include "core/memory.h"
+#include "fs/pipe/pipe.h"
+#include "fs/epoll/epoll.h"
+#include "fs/mq/mq.h"
 
 #define FS_TABLE_SIZE		10		// file system tables number
 
@@ -88,7 +92,7 @@ static fs_t * mount (fs_type_t type, char * mount_point, int dev_major, int dev_
 	kernel_memset(fs, 0, sizeof(fs_t));
 	kernel_strncpy(fs->mount_point, mount_point, FS_MOUNTP_SIZE);
 	fs->op = op;
-	fs->mutex = (mutex_t *)0;
+	fs->rwlock = (rwlock_t *)0;
 
 	// mount file system
 	if (op->mount(fs, dev_major, dev_minor) < 0) {
@@ -122,6 +126,9 @@ static void mount_list_init (void) {
 void fs_init (void) {
 	mount_list_init();
     file_table_init();
+	pipe_init();
+	epoll_init();
+	mq_init();
 
 	// check disk
 	disk_init();
@@ -175,14 +182,36 @@ const char * path_next_child (const char * path) {
 }
 
 static void fs_protect (fs_t * fs) {
-	if (fs->mutex) {
-		mutex_lock(fs->mutex);
+	if (fs->rwlock) {
+		rwlock_write_lock(fs->rwlock);
 	}
 }
 
 static void fs_unprotect (fs_t * fs) {
-	if (fs->mutex) {
-		mutex_unlock(fs->mutex);
+	if (fs->rwlock) {
+		rwlock_write_unlock(fs->rwlock);
+	}
+}
+
+/**
+ * @brief Lock the file system for the operations not changing it, they run in parallel
+ * the position of file is changed by reading, so the readers of one file are serialized
+ */
+static void fs_protect_read (fs_t * fs, file_t * file) {
+	if (fs->rwlock) {
+		rwlock_read_lock(fs->rwlock);
+		if (file) {
+			file_lock(file);
+		}
+	}
+}
+
+static void fs_unprotect_read (fs_t * fs, file_t * file) {
+	if (fs->rwlock) {
+		if (file) {
+			file_unlock(file);
+		}
+		rwlock_read_unlock(fs->rwlock);
 	}
 }
 
@@ -223,15 +252,15 @@ int sys_open(const char *name, int flags, ...) {
 	file->fs = fs;
 	kernel_strncpy(file->file_name, name, FILE_NAME_SIZE);
 
-	fs_protect(fs);
+	// looking up the directory only, unless the file is created or truncated
+	int lookup = !(flags & (O_CREAT | O_TRUNC));
+	lookup ? fs_protect_read(fs, (file_t *)0) : fs_protect(fs);
 	int err = fs->op->open(fs, name, file);
+	lookup ? fs_unprotect_read(fs, (file_t *)0) : fs_unprotect(fs);
 	if (err < 0) {
-		fs_unprotect(fs);
-
 		log_printf("open %s failed.", name);
 		return -1;
 	}
-	fs_unprotect(fs);
 
 	return fd;
 
@@ -309,11 +338,12 @@ int sys_read(int file, char *ptr, int len) {
 		return -1;
 	}
 
-	// read file
+	// read file, the readers of read only files share the file system
 	fs_t * fs = p_file->fs;
-	fs_protect(fs);
+	int shared = (p_file->mode == O_RDONLY);
+	shared ? fs_protect_read(fs, p_file) : fs_protect(fs);
 	int err = fs->op->read(ptr, len, p_file);
-	fs_unprotect(fs);
+	shared ? fs_unprotect_read(fs, p_file) : fs_unprotect(fs);
 	return err;
 }
 
@@ -344,6 +374,201 @@ int sys_write(int file, char *ptr, int len) {
 	return err;
 }
 
+/**
+ * @brief Read or write the segments at offset, or at the current position if offset < 0
+ * all of them are done with the file system locked once
+ */
+static int file_io (file_t * p_file, const struct iovec * iov, int iovcnt, int offset, int write) {
+	if (p_file->mode == (write ? O_RDONLY : O_WRONLY)) {
+		log_printf("file mode not allowed");
+		return -1;
+	}
+
+	fs_t * fs = p_file->fs;
+	int shared = !write && (p_file->mode == O_RDONLY);
+	shared ? fs_protect_read(fs, p_file) : fs_protect(fs);
+	int total;
+	if (write ? fs->op->pwritev : fs->op->preadv) {
+		total = write ? fs->op->pwritev(p_file, iov, iovcnt, offset) : fs->op->preadv(p_file, iov, iovcnt, offset);
+	} else if (offset >= 0) {
+		// device has no position
+		total = -1;
+	} else {
+		total = 0;
+		for (int i = 0; i < iovcnt; i++) {
+			int size = write ? fs->op->write((char *)iov[i].iov_base, iov[i].iov_len, p_file)
+						: fs->op->read((char *)iov[i].iov_base, iov[i].iov_len, p_file);
+			if (size < 0) {
+				total = total ? total : size;
+				break;
+			}
+
+			total += size;
+			if (size < iov[i].iov_len) {
+				break;
+			}
+		}
+	}
+	shared ? fs_unprotect_read(fs, p_file) : fs_unprotect(fs);
+	return total;
+}
+
+static int file_rw_vec (int fd, const struct iovec * iov, int iovcnt, int offset, int write) {
+	if (is_fd_bad(fd) || !iov || (iovcnt <= 0) || (iovcnt > UIO_MAXIOV)) {
+		return -1;
+	}
+
+	file_t * p_file = task_file(fd);
+	if (!p_file) {
+		log_printf("file not opened");
+		return -1;
+	}
+
+	return file_io(p_file, iov, iovcnt, offset, write);
+}
+
+/**
+ * @brief Copy at most count bytes from in to out through a kernel buffer, until the end of in
+ * in_off/out_off < 0 means the current position. The buffer holds whole clusters of out in FAT,
+ * and the chunks after the first one are aligned to them, so they're written without read-modify-write
+ */
+static int file_copy (file_t * in, int in_off, file_t * out, int out_off, int count) {
+	int unit = (out->fs->type == FS_FAT16) ? out->fs->fat_data.cluster_byte_size : MEM_PAGE_SIZE;
+	int chunk = up2(unit, MEM_PAGE_SIZE);
+	char * buf = (char *)memory_alloc_pages(chunk / MEM_PAGE_SIZE);
+	if (buf == (char *)0) {
+		return -1;
+	}
+
+	// the first one reaches the boundary of the cluster
+	int out_pos = (out_off < 0) ? out->pos : out_off;
+	int size = chunk - out_pos % unit;
+
+	int total = 0;
+	while (total < count) {
+		if (size > count - total) {
+			size = count - total;
+		}
+
+		struct iovec iov = {buf, size};
+		int rd = file_io(in, &iov, 1, (in_off < 0) ? -1 : in_off + total, 0);
+		if (rd <= 0) {
+			total = total ? total : rd;
+			break;
+		}
+
+		iov.iov_len = rd;
+		int wr = file_io(out, &iov, 1, (out_off < 0) ? -1 : out_off + total, 1);
+		if (wr <= 0) {
+			total = total ? total : wr;
+			break;
+		}
+
+		total += wr;
+		if ((wr < rd) || (rd < size)) {
+			break;
+		}
+		size = chunk;
+	}
+
+	memory_free_pages((uint32_t)buf, chunk / MEM_PAGE_SIZE);
+	return total;
+}
+
+/**
+ * @brief Copy count bytes from in_fd to out_fd in the kernel
+ * from *offset of in_fd if it's not NULL, which is updated and the position is kept
+ */
+int sys_sendfile (int out_fd, int in_fd, int * offset, int count) {
+	if (is_fd_bad(out_fd) || is_fd_bad(in_fd) || (count < 0) || (offset && (*offset < 0))) {
+		return -1;
+	}
+
+	file_t * in = task_file(in_fd);
+	file_t * out = task_file(out_fd);
+	if (!in || !out) {
+		log_printf("file not opened");
+		return -1;
+	}
+
+	int copied = file_copy(in, offset ? *offset : -1, out, -1, count);
+	if (offset && (copied > 0)) {
+		*offset += copied;
+	}
+	return copied;
+}
+
+/**
+ * @brief Copy a range between two files in the kernel, see copy_range_t
+ */
+int sys_copy_file_range (copy_range_t * range) {
+	if (!range || range->flags || is_fd_bad(range->fd_in) || is_fd_bad(range->fd_out) || (range->len < 0)) {
+		return -1;
+	}
+
+	int off_in = range->off_in ? *range->off_in : -1;
+	int off_out = range->off_out ? *range->off_out : -1;
+	if ((range->off_in && (off_in < 0)) || (range->off_out && (off_out < 0))) {
+		return -1;
+	}
+
+	file_t * in = task_file(range->fd_in);
+	file_t * out = task_file(range->fd_out);
+	if (!in || !out) {
+		log_printf("file not opened");
+		return -1;
+	}
+
+	int copied = file_copy(in, off_in, out, off_out, range->len);
+	if (copied > 0) {
+		if (range->off_in) {
+			*range->off_in += copied;
+		}
+		if (range->off_out) {
+			*range->off_out += copied;
+		}
+	}
+	return copied;
+}
+
+/**
+ * @brief Read file to the segments in order
+ */
+int sys_readv (int file, const struct iovec * iov, int iovcnt) {
+	return file_rw_vec(file, iov, iovcnt, -1, 0);
+}
+
+/**
+ * @brief Write the segments in order to file
+ */
+int sys_writev (int file, const struct iovec * iov, int iovcnt) {
+	return file_rw_vec(file, iov, iovcnt, -1, 1);
+}
+
+/**
+ * @brief Read file at offset, the position is not changed
+ */
+int sys_pread (int file, char * ptr, int len, int offset) {
+	if (offset < 0) {
+		return -1;
+	}
+
+	struct iovec iov = {ptr, len};
+	return file_rw_vec(file, &iov, 1, offset, 0);
+}
+
+/**
+ * @brief Write file at offset, the position is not changed
+ */
+int sys_pwrite (int file, char * ptr, int len, int offset) {
+	if (offset < 0) {
+		return -1;
+	}
+
+	struct iovec iov = {ptr, len};
+	return file_rw_vec(file, &iov, 1, offset, 1);
+}
+
 /**
  * @brief File location
  */
@@ -384,9 +609,16 @@ int sys_close(int file) {
 
 	ASSERT(p_file->ref > 0);
 
+	// the ring is unmapped from the process closing it, even the file is still opened by others
+	if (p_file->type == FILE_MQ) {
+		mq_file_unmap(p_file, file);
+	}
+
 	if (p_file->ref-- == 1) {
 		fs_t * fs = p_file->fs;
 
+		epoll_file_close(p_file);
+
 		fs_protect(fs);
 		fs->op->close(p_file);
 		fs_unprotect(fs);
@@ -398,6 +630,90 @@ int sys_close(int file) {
 }
 
 
+/**
+ * @brief Create a pipe, fds[0] is the end to read and fds[1] is the end to write
+ * flags may have O_NONBLOCK
+ */
+int sys_pipe (int * fds, int flags) {
+	if (fds == (int *)0) {
+		return -1;
+	}
+
+	int fd[2] = {-1, -1};
+	file_t * files[2] = {file_alloc(), file_alloc()};
+	if (!files[0] || !files[1]) {
+		goto sys_pipe_failed;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		fd[i] = task_alloc_fd(files[i]);
+		if (fd[i] < 0) {
+			goto sys_pipe_failed;
+		}
+	}
+
+	if (pipe_open(files[0], files[1]) < 0) {
+		goto sys_pipe_failed;
+	}
+	files[0]->mode = O_RDONLY | (flags & O_NONBLOCK);
+	files[1]->mode = O_WRONLY | (flags & O_NONBLOCK);
+
+	fds[0] = fd[0];
+	fds[1] = fd[1];
+	return 0;
+
+sys_pipe_failed:
+	for (int i = 0; i < 2; i++) {
+		if (files[i]) {
+			file_free(files[i]);
+		}
+		if (fd[i] >= 0) {
+			task_remove_fd(fd[i]);
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Create an interest set of epoll, size is ignored
+ */
+int sys_epoll_create (int size) {
+	file_t * file = file_alloc();
+	if (!file) {
+		return -1;
+	}
+
+	int fd = task_alloc_fd(file);
+	if ((fd < 0) || (epoll_open(file) < 0)) {
+		file_free(file);
+		if (fd >= 0) {
+			task_remove_fd(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief Open the message queue by name, see mq_file_open
+ */
+int sys_mq_open (const char * name, int flags, mq_attr_t * attr) {
+	file_t * file = file_alloc();
+	if (!file) {
+		return -1;
+	}
+
+	int fd = task_alloc_fd(file);
+	if ((fd < 0) || (mq_file_open(file, name, flags, attr) < 0)) {
+		file_free(file);
+		if (fd >= 0) {
+			task_remove_fd(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
 /**
  * @brief Check if the file descriptor is related to tty device
  */
@@ -431,30 +747,30 @@ int sys_fstat(int file, struct stat *st) {
 
     kernel_memset(st, 0, sizeof(struct stat));
 
-	fs_protect(fs);
+	fs_protect_read(fs, (file_t *)0);
 	int err = fs->op->stat(p_file, st);
-	fs_unprotect(fs);
+	fs_unprotect_read(fs, (file_t *)0);
 	return err;
 }
 
 int sys_opendir(const char * name, DIR * dir) {
-	fs_protect(root_fs);
+	fs_protect_read(root_fs, (file_t *)0);
 	int err = root_fs->op->opendir(root_fs, name, dir);
-	fs_unprotect(root_fs);
+	fs_unprotect_read(root_fs, (file_t *)0);
 	return err;
 }
 
 int sys_readdir(DIR* dir, struct dirent * dirent) {
-	fs_protect(root_fs);
+	fs_protect_read(root_fs, (file_t *)0);
 	int err = root_fs->op->readdir(root_fs, dir, dirent);
-	fs_unprotect(root_fs);
+	fs_unprotect_read(root_fs, (file_t *)0);
 	return err;
 }
 
 int sys_closedir(DIR *dir) {
-	fs_protect(root_fs);
+	fs_protect_read(root_fs, (file_t *)0);
 	int err = root_fs->op->closedir(root_fs, dir);
-	fs_unprotect(root_fs);
+	fs_unprotect_read(root_fs, (file_t *)0);
 	return err;
 }
 
@@ -463,4 +779,4 @@ int sys_unlink (const char * path) {
 	int err = root_fs->op->unlink(root_fs, path);
 	fs_unprotect(root_fs);
 	return err;
-}
\ No newline at end of file
+}
\ No newline at end of file
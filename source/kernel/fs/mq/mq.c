@@ -0,0 +1,505 @@
+/**
+ * Message queue
+ */
+#include "fs/mq/mq.h"
+#include "fs/fs.h"
+#include "fs/poll.h"
+#include "core/task.h"
+#include "cpu/mmu.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include <sys/file.h>
+
+static mq_t mq_table[MQ_NR];
+static mutex_t table_mutex;             // protect the names and the opens of the queues
+static fs_t mq_fs;
+
+static int mq_nonblock (file_t * file) {
+    return (file->mode & O_NONBLOCK) != 0;
+}
+
+static mq_t * file_mq (file_t * file) {
+    return mq_table + file->dev_id;
+}
+
+/**
+ * @brief Get the file of the queue opened at mqd
+ */
+static file_t * mq_fd_file (int mqd) {
+    file_t * file = task_file(mqd);
+    if (!file || (file->type != FILE_MQ)) {
+        return (file_t *)0;
+    }
+    return file;
+}
+
+/**
+ * @brief Find the queue not unlinked by name, table_mutex should be held
+ */
+static mq_t * mq_find (const char * name) {
+    for (int i = 0; i < MQ_NR; i++) {
+        mq_t * mq = mq_table + i;
+        if (mq->used && !mq->unlinked && (kernel_strncmp(mq->name, name, MQ_NAME_SIZE) == 0)) {
+            return mq;
+        }
+    }
+    return (mq_t *)0;
+}
+
+/**
+ * @brief Messages in the queue, mq->mutex should be held for the queue without MQ_RING
+ */
+static int mq_curmsgs (mq_t * mq) {
+    if (mq->flags & MQ_RING) {
+        // moved by the processes, may be anything
+        int count = (int)(mq->ring->tail - mq->ring->head);
+        return (count < 0) ? 0 : (count > mq->maxmsg) ? mq->maxmsg : count;
+    }
+    return list_count(&mq->msg_list);
+}
+
+/**
+ * @brief Fill the attributes of the queue
+ */
+static void mq_get_attr (mq_t * mq, mq_attr_t * attr) {
+    mutex_lock(&mq->mutex);
+    attr->flags = mq->flags;
+    attr->maxmsg = mq->maxmsg;
+    attr->msgsize = mq->msgsize;
+    attr->curmsgs = mq_curmsgs(mq);
+    attr->ring = (mq->flags & MQ_RING) ? (void *)mq->ring_vaddr : (void *)0;
+    mutex_unlock(&mq->mutex);
+}
+
+/**
+ * @brief Set up the ring with the slots of power of 2 as many as possible, at most maxmsg
+ * only the indexes are in the ring page, the geometry is given to user space with the attributes
+ */
+static int mq_ring_setup (mq_t * mq) {
+    int slot_size = MQ_RING_SLOT_SIZE(mq->msgsize);
+    int max = (MEM_PAGE_SIZE - sizeof(mq_ring_t)) / slot_size;
+    if (max > mq->maxmsg) {
+        max = mq->maxmsg;
+    }
+
+    if (max <= 0) {
+        return -1;
+    }
+
+    mq->ring = (mq_ring_t *)memory_alloc_page();
+    if (mq->ring == (mq_ring_t *)0) {
+        return -1;
+    }
+    kernel_memset(mq->ring, 0, MEM_PAGE_SIZE);
+
+    int slots = 1;
+    while (slots * 2 <= max) {
+        slots *= 2;
+    }
+    mq->maxmsg = slots;
+    return 0;
+}
+
+/**
+ * @brief Carve the kernel page into messages as many as possible, at most maxmsg
+ */
+static int mq_page_setup (mq_t * mq) {
+    int slot_size = up2(sizeof(mq_msg_t) + mq->msgsize, sizeof(int));
+    int max = MEM_PAGE_SIZE / slot_size;
+    if (max > mq->maxmsg) {
+        max = mq->maxmsg;
+    }
+    if (max <= 0) {
+        return -1;
+    }
+
+    mq->page = memory_alloc_page();
+    if (mq->page == 0) {
+        return -1;
+    }
+
+    list_init(&mq->msg_list);
+    list_init(&mq->free_list);
+    for (int i = 0; i < max; i++) {
+        mq_msg_t * msg = (mq_msg_t *)(mq->page + i * slot_size);
+        list_node_init(&msg->node);
+        list_insert_last(&mq->free_list, &msg->node);
+    }
+    mq->maxmsg = max;
+    return 0;
+}
+
+/**
+ * @brief Create the queue with attr, the defaults are used without it. table_mutex should be held
+ */
+static mq_t * mq_create (const char * name, mq_attr_t * attr) {
+    mq_t * mq = (mq_t *)0;
+    for (int i = 0; i < MQ_NR; i++) {
+        if (!mq_table[i].used) {
+            mq = mq_table + i;
+            break;
+        }
+    }
+    if (mq == (mq_t *)0) {
+        log_printf("no free message queue");
+        return (mq_t *)0;
+    }
+
+    mq->flags = attr ? attr->flags & MQ_RING : 0;
+    mq->maxmsg = attr ? attr->maxmsg : MQ_MAXMSG_DEFAULT;
+    mq->msgsize = attr ? attr->msgsize : MQ_MSGSIZE_DEFAULT;
+    if ((mq->maxmsg <= 0) || (mq->msgsize <= 0) || (mq->msgsize > MEM_PAGE_SIZE)) {
+        return (mq_t *)0;
+    }
+
+    mq->page = 0;
+    mq->ring = (mq_ring_t *)0;
+    int err = (mq->flags & MQ_RING) ? mq_ring_setup(mq) : mq_page_setup(mq);
+    if (err < 0) {
+        log_printf("message queue too large: %d", mq->msgsize);
+        return (mq_t *)0;
+    }
+
+    kernel_strncpy(mq->name, name, MQ_NAME_SIZE);
+    mq->used = 1;
+    mq->unlinked = 0;
+    mq->opens = 0;
+    mutex_init(&mq->mutex);
+    cond_init(&mq->not_empty);
+    cond_init(&mq->not_full);
+    waitq_init(&mq->poll_wq);
+    return mq;
+}
+
+/**
+ * @brief Release the queue, table_mutex should be held
+ */
+static void mq_free (mq_t * mq) {
+    if (mq->page) {
+        memory_free_page(mq->page);
+        mq->page = 0;
+    }
+    if (mq->ring) {
+        memory_free_page((uint32_t)mq->ring);
+        mq->ring = (mq_ring_t *)0;
+    }
+    mq->used = 0;
+}
+
+/**
+ * @brief Map the ring of the queue into current process, table_mutex should be held
+ * it's seen only by the processes opening the queue
+ */
+static int mq_ring_map (mq_t * mq) {
+    if (!(mq->flags & MQ_RING)) {
+        return 0;
+    }
+    return memory_map_shared_page(mq->ring_vaddr, (uint32_t)mq->ring, PTE_U | PTE_W);
+}
+
+/**
+ * @brief Send the message, block until there is free space in the queue
+ */
+static int mq_file_send (file_t * file, const char * msg, int len, unsigned int prio) {
+    mq_t * mq = file_mq(file);
+    if ((mq->flags & MQ_RING) || ((file->mode & O_ACCMODE) == O_RDONLY)) {
+        return -1;
+    }
+    if ((len < 0) || (len > mq->msgsize) || (prio >= MQ_PRIO_MAX)) {
+        return -1;
+    }
+
+    mutex_lock(&mq->mutex);
+    while (list_count(&mq->free_list) == 0) {
+        if (mq_nonblock(file)) {
+            mutex_unlock(&mq->mutex);
+            return -1;
+        }
+        if (cond_wait(&mq->not_full, &mq->mutex) < 0) {
+            mutex_unlock(&mq->mutex);
+            return -1;
+        }
+    }
+
+    mq_msg_t * mq_msg = list_node_parent(list_remove_first(&mq->free_list), mq_msg_t, node);
+    mq_msg->prio = prio;
+    mq_msg->len = len;
+    kernel_memcpy(mq_msg + 1, (void *)msg, len);
+
+    // before the first one of lower priority
+    list_node_t * node = list_first(&mq->msg_list);
+    while (node && (list_node_parent(node, mq_msg_t, node)->prio >= prio)) {
+        node = list_node_next(node);
+    }
+    if (node) {
+        list_insert_before(&mq->msg_list, node, &mq_msg->node);
+    } else {
+        list_insert_last(&mq->msg_list, &mq_msg->node);
+    }
+
+    cond_signal(&mq->not_empty);
+    poll_wakeup(&mq->poll_wq);
+    mutex_unlock(&mq->mutex);
+    return 0;
+}
+
+/**
+ * @brief Receive the oldest message of the highest priority, block until there is one
+ * buf should be able to hold msgsize bytes, return the length of the message
+ */
+static int mq_file_receive (file_t * file, char * buf, int len, unsigned int * prio) {
+    mq_t * mq = file_mq(file);
+    if ((mq->flags & MQ_RING) || ((file->mode & O_ACCMODE) == O_WRONLY)) {
+        return -1;
+    }
+    if (len < mq->msgsize) {
+        return -1;
+    }
+
+    mutex_lock(&mq->mutex);
+    while (list_count(&mq->msg_list) == 0) {
+        if (mq_nonblock(file)) {
+            mutex_unlock(&mq->mutex);
+            return -1;
+        }
+        if (cond_wait(&mq->not_empty, &mq->mutex) < 0) {
+            mutex_unlock(&mq->mutex);
+            return -1;
+        }
+    }
+
+    mq_msg_t * mq_msg = list_node_parent(list_remove_first(&mq->msg_list), mq_msg_t, node);
+    len = mq_msg->len;
+    kernel_memcpy(buf, mq_msg + 1, len);
+    if (prio) {
+        *prio = mq_msg->prio;
+    }
+    list_insert_last(&mq->free_list, &mq_msg->node);
+
+    cond_signal(&mq->not_full);
+    poll_wakeup(&mq->poll_wq);
+    mutex_unlock(&mq->mutex);
+    return len;
+}
+
+/**
+ * @brief Open the queue by name for file, create it with attr if O_CREAT is given
+ * attr is filled with the attributes of the queue if it's given
+ */
+int mq_file_open (file_t * file, const char * name, int flags, mq_attr_t * attr) {
+    if (!name || !name[0]) {
+        return -1;
+    }
+
+    int created = 0;
+    mutex_lock(&table_mutex);
+    mq_t * mq = mq_find(name);
+    if (mq) {
+        if ((flags & O_CREAT) && (flags & O_EXCL)) {
+            goto open_failed;
+        }
+    } else {
+        if (!(flags & O_CREAT)) {
+            goto open_failed;
+        }
+
+        mq = mq_create(name, attr);
+        if (mq == (mq_t *)0) {
+            goto open_failed;
+        }
+        created = 1;
+    }
+
+    // mapped with the file set up, not unmapped by closing another fd of the queue, see mq_file_unmap
+    kernel_strncpy(file->file_name, name, FILE_NAME_SIZE);
+    file->type = FILE_MQ;
+    file->fs = &mq_fs;
+    file->dev_id = mq - mq_table;
+    file->pos = file->size = 0;
+    file->mode = flags & (O_ACCMODE | O_NONBLOCK);
+    if (mq_ring_map(mq) < 0) {
+        if (created) {
+            mq_free(mq);
+        }
+        goto open_failed;
+    }
+    mq->opens++;
+    mutex_unlock(&table_mutex);
+
+    if (attr) {
+        mq_get_attr(mq, attr);
+    }
+    return 0;
+open_failed:
+    mutex_unlock(&table_mutex);
+    return -1;
+}
+
+/**
+ * @brief Remove the name of the queue, it's released after all its files are closed
+ */
+int sys_mq_unlink (const char * name) {
+    if (!name) {
+        return -1;
+    }
+
+    mutex_lock(&table_mutex);
+    mq_t * mq = mq_find(name);
+    if (mq) {
+        mq->unlinked = 1;
+        if (mq->opens == 0) {
+            mq_free(mq);
+        }
+    }
+    mutex_unlock(&table_mutex);
+    return mq ? 0 : -1;
+}
+
+int sys_mq_send (int mqd, const char * msg, int len, unsigned int prio) {
+    file_t * file = mq_fd_file(mqd);
+    if (!file || (!msg && len)) {
+        return -1;
+    }
+    return mq_file_send(file, msg, len, prio);
+}
+
+int sys_mq_receive (int mqd, char * buf, int len, unsigned int * prio) {
+    file_t * file = mq_fd_file(mqd);
+    if (!file || !buf) {
+        return -1;
+    }
+    return mq_file_receive(file, buf, len, prio);
+}
+
+/**
+ * @brief Get the attributes of the queue, with the messages in it now
+ */
+int sys_mq_getattr (int mqd, mq_attr_t * attr) {
+    file_t * file = mq_fd_file(mqd);
+    if (!file || !attr) {
+        return -1;
+    }
+
+    // mapped again, e.g. after exec
+    mq_t * mq = file_mq(file);
+    mutex_lock(&table_mutex);
+    int err = mq_ring_map(mq);
+    mutex_unlock(&table_mutex);
+    if (err < 0) {
+        return -1;
+    }
+
+    mq_get_attr(mq, attr);
+    return 0;
+}
+
+/**
+ * @brief Unmap the ring from current process when fd is closed, if no other fd of it opens the queue
+ * the process borrowing the page table of its parent leaves it to the parent
+ */
+void mq_file_unmap (file_t * file, int fd) {
+    mq_t * mq = file_mq(file);
+    if (!(mq->flags & MQ_RING) || (task_current()->flags & TASK_FLAG_VFORK)) {
+        return;
+    }
+
+    mutex_lock(&table_mutex);
+    for (int i = 0; i < TASK_OFILE_NR; i++) {
+        file_t * other = task_file(i);
+        if ((i != fd) && other && (other->type == FILE_MQ) && (other->dev_id == file->dev_id)) {
+            mutex_unlock(&table_mutex);
+            return;
+        }
+    }
+    memory_unmap_shared_page(mq->ring_vaddr);
+    mutex_unlock(&table_mutex);
+}
+
+static int mq_read (char * buf, int size, file_t * file) {
+    return mq_file_receive(file, buf, size, (unsigned int *)0);
+}
+
+static int mq_write (char * buf, int size, file_t * file) {
+    return mq_file_send(file, buf, size, 0);
+}
+
+/**
+ * @brief Release the queue if it's unlinked and this is its last file
+ */
+static void mq_file_close (file_t * file) {
+    mq_t * mq = file_mq(file);
+
+    mutex_lock(&table_mutex);
+    if ((--mq->opens == 0) && mq->unlinked) {
+        mq_free(mq);
+    }
+    mutex_unlock(&table_mutex);
+}
+
+static int mq_seek (file_t * file, uint32_t offset, int dir) {
+    return -1;
+}
+
+static int mq_stat (file_t * file, struct stat * st) {
+    return -1;
+}
+
+static int mq_ioctl (file_t * file, int cmd, int arg0, int arg1) {
+    return -1;
+}
+
+/**
+ * @brief Readable with messages, writable with free space
+ * the ring is moved in user space without the kernel, so it's checked but not watched
+ */
+static int mq_poll (file_t * file, poll_table_t * pt) {
+    mq_t * mq = file_mq(file);
+
+    int count;
+    if (mq->flags & MQ_RING) {
+        count = mq_curmsgs(mq);
+    } else {
+        poll_wait(pt, &mq->poll_wq);
+
+        mutex_lock(&mq->mutex);
+        count = mq_curmsgs(mq);
+        mutex_unlock(&mq->mutex);
+    }
+
+    int events = 0;
+    if (count > 0) {
+        events |= POLLIN;
+    }
+    if (count < mq->maxmsg) {
+        events |= POLLOUT;
+    }
+    return events;
+}
+
+static fs_op_t mq_op = {
+    .read = mq_read,
+    .write = mq_write,
+    .close = mq_file_close,
+    .seek = mq_seek,
+    .stat = mq_stat,
+    .ioctl = mq_ioctl,
+    .poll = mq_poll,
+};
+
+/**
+ * @brief Init the queue table, each queue has its own address for the ring
+ */
+void mq_init (void) {
+    kernel_memset(mq_table, 0, sizeof(mq_table));
+    mutex_init(&table_mutex);
+
+    for (int i = 0; i < MQ_NR; i++) {
+        mq_table[i].ring_vaddr = MEM_MQ_RING_START + i * MEM_PAGE_SIZE;
+    }
+
+    // not mounted like the pipes, the queues lock themselves
+    kernel_memset(&mq_fs, 0, sizeof(mq_fs));
+    mq_fs.type = FS_MQ;
+    mq_fs.op = &mq_op;
+    mq_fs.rwlock = (rwlock_t *)0;
+}
@@ -0,0 +1,351 @@
+/**
+ * Pipe
+ */
+#include "fs/pipe/pipe.h"
+#include "fs/fs.h"
+#include "fs/poll.h"
+#include "core/task.h"
+#include "core/memory.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include <sys/file.h>
+
+static pipe_t pipe_table[PIPE_NR];
+static mutex_t table_mutex;
+static fs_t pipe_fs;
+
+static int pipe_nonblock (file_t * file) {
+    return (file->mode & O_NONBLOCK) != 0;
+}
+
+static int pipe_is_reader (file_t * file) {
+    return (file->mode & O_ACCMODE) == O_RDONLY;
+}
+
+static pipe_t * file_pipe (file_t * file) {
+    return pipe_table + file->dev_id;
+}
+
+/**
+ * @brief Get an empty page for the ring, from the spare pages first
+ */
+static uint32_t pipe_get_page (pipe_t * pipe) {
+    if (pipe->spare_count) {
+        return pipe->spare[--pipe->spare_count];
+    }
+    return memory_alloc_page();
+}
+
+static void pipe_put_page (pipe_t * pipe, uint32_t page) {
+    if (pipe->spare_count < PIPE_SPARE_NR) {
+        pipe->spare[pipe->spare_count++] = page;
+    } else {
+        memory_free_page(page);
+    }
+}
+
+/**
+ * @brief Wake up one waiter, or all of them, called with the pipe locked
+ */
+static void pipe_wakeup (int * waiters, sem_t * sem, int all) {
+    while (*waiters) {
+        (*waiters)--;
+        sem_notify(sem);
+        if (!all) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Unlock the pipe and wait, it's locked again after return
+ * return -1 if the process is killed, the notify for it may be left in sem, the callers check again
+ */
+static int pipe_wait (pipe_t * pipe, int * waiters, sem_t * sem) {
+    (*waiters)++;
+    mutex_unlock(&pipe->mutex);
+    int err = sem_wait(sem);
+    mutex_lock(&pipe->mutex);
+    return err;
+}
+
+/**
+ * @brief Read from the ring, block until some data arrives, 0 when all writers are closed
+ */
+static int pipe_read (char * buf, int size, file_t * file) {
+    if (!pipe_is_reader(file)) {
+        return -1;
+    }
+
+    pipe_t * pipe = file_pipe(file);
+    mutex_lock(&pipe->mutex);
+    while (pipe->count == 0) {
+        if ((pipe->writers == 0) || pipe_nonblock(file)) {
+            int err = pipe->writers ? -1 : 0;
+            mutex_unlock(&pipe->mutex);
+            return err;
+        }
+        if (pipe_wait(pipe, &pipe->read_waiters, &pipe->read_sem) < 0) {
+            mutex_unlock(&pipe->mutex);
+            return -1;
+        }
+    }
+
+    // other threads may access the old page through their TLB after swapping, so only one thread
+    int swap = task_current()->leader->threads == 1;
+
+    int total = 0;
+    while ((total < size) && pipe->count) {
+        pipe_buf_t * pbuf = pipe->bufs + pipe->head;
+        int len = size - total;
+        if (len > pbuf->len) {
+            len = pbuf->len;
+        }
+
+        // a whole page is moved to the reader, and the page of the reader comes to the ring
+        uint32_t old = 0;
+        if (swap && (len == MEM_PAGE_SIZE)) {
+            old = memory_swap_page((uint32_t)buf + total, pbuf->page);
+        }
+        if (old) {
+            pbuf->page = old;
+        } else {
+            kernel_memcpy(buf + total, (char *)pbuf->page + pbuf->offset, len);
+        }
+
+        total += len;
+        pbuf->offset += len;
+        pbuf->len -= len;
+        if (pbuf->len == 0) {
+            pipe_put_page(pipe, pbuf->page);
+            pipe->head = (pipe->head + 1) % PIPE_PAGE_NR;
+            pipe->count--;
+        }
+    }
+
+    pipe_wakeup(&pipe->write_waiters, &pipe->write_sem, 0);
+    poll_wakeup(&pipe->poll_wq);
+    mutex_unlock(&pipe->mutex);
+    return total;
+}
+
+/**
+ * @brief Write into the ring, block until all are written
+ * return -1 if there is no reader, or nothing written without blocking
+ * the data is always copied, the buffer of the writer must stay as it is after the write
+ * and there is no copy on write to share the page with it
+ */
+static int pipe_write (char * buf, int size, file_t * file) {
+    if (pipe_is_reader(file)) {
+        return -1;
+    }
+
+    if (size == 0) {
+        return 0;
+    }
+
+    pipe_t * pipe = file_pipe(file);
+    mutex_lock(&pipe->mutex);
+
+    int total = 0;
+    while ((total < size) && pipe->readers) {
+        // fill the last page first
+        pipe_buf_t * pbuf = (pipe_buf_t *)0;
+        if (pipe->count) {
+            pbuf = pipe->bufs + (pipe->head + pipe->count - 1) % PIPE_PAGE_NR;
+            if (pbuf->offset + pbuf->len == MEM_PAGE_SIZE) {
+                pbuf = (pipe_buf_t *)0;
+            }
+        }
+
+        if ((pbuf == (pipe_buf_t *)0) && (pipe->count < PIPE_PAGE_NR)) {
+            uint32_t page = pipe_get_page(pipe);
+            if (page == 0) {
+                log_printf("pipe: no memory");
+                break;
+            }
+
+            pbuf = pipe->bufs + (pipe->head + pipe->count) % PIPE_PAGE_NR;
+            pbuf->page = page;
+            pbuf->offset = pbuf->len = 0;
+            pipe->count++;
+        }
+
+        if (pbuf == (pipe_buf_t *)0) {
+            // the ring is full, let readers take what is written
+            pipe_wakeup(&pipe->read_waiters, &pipe->read_sem, 0);
+            poll_wakeup(&pipe->poll_wq);
+            if (pipe_nonblock(file) || (pipe_wait(pipe, &pipe->write_waiters, &pipe->write_sem) < 0)) {
+                break;
+            }
+            continue;
+        }
+
+        int len = MEM_PAGE_SIZE - pbuf->offset - pbuf->len;
+        if (len > size - total) {
+            len = size - total;
+        }
+        kernel_memcpy((char *)pbuf->page + pbuf->offset + pbuf->len, buf + total, len);
+        pbuf->len += len;
+        total += len;
+    }
+
+    pipe_wakeup(&pipe->read_waiters, &pipe->read_sem, 0);
+    poll_wakeup(&pipe->poll_wq);
+    mutex_unlock(&pipe->mutex);
+    return total ? total : -1;
+}
+
+/**
+ * @brief Close one end, wake up the tasks waiting for the other end
+ */
+static void pipe_close (file_t * file) {
+    pipe_t * pipe = file_pipe(file);
+    mutex_lock(&pipe->mutex);
+    if (pipe_is_reader(file)) {
+        pipe->readers--;
+        pipe_wakeup(&pipe->write_waiters, &pipe->write_sem, 1);
+    } else {
+        pipe->writers--;
+        pipe_wakeup(&pipe->read_waiters, &pipe->read_sem, 1);
+    }
+    poll_wakeup(&pipe->poll_wq);
+    int last = (pipe->readers == 0) && (pipe->writers == 0);
+    mutex_unlock(&pipe->mutex);
+
+    if (!last) {
+        return;
+    }
+
+    // nobody can reach the pipe now
+    for (; pipe->count; pipe->count--) {
+        memory_free_page(pipe->bufs[pipe->head].page);
+        pipe->head = (pipe->head + 1) % PIPE_PAGE_NR;
+    }
+    while (pipe->spare_count) {
+        memory_free_page(pipe->spare[--pipe->spare_count]);
+    }
+
+    mutex_lock(&table_mutex);
+    pipe->used = 0;
+    mutex_unlock(&table_mutex);
+}
+
+static int pipe_seek (file_t * file, uint32_t offset, int dir) {
+    return -1;
+}
+
+/**
+ * @brief The size is the bytes not read yet
+ */
+static int pipe_stat (file_t * file, struct stat * st) {
+    pipe_t * pipe = file_pipe(file);
+
+    mutex_lock(&pipe->mutex);
+    int size = 0;
+    for (int i = 0; i < pipe->count; i++) {
+        size += pipe->bufs[(pipe->head + i) % PIPE_PAGE_NR].len;
+    }
+    mutex_unlock(&pipe->mutex);
+
+    st->st_mode = S_IFIFO;
+    st->st_size = size;
+    st->st_blksize = MEM_PAGE_SIZE;
+    return 0;
+}
+
+static int pipe_ioctl (file_t * file, int cmd, int arg0, int arg1) {
+    return -1;
+}
+
+/**
+ * @brief The reader is ready with data or without writers, the writer with free space or without readers
+ */
+static int pipe_poll (file_t * file, poll_table_t * pt) {
+    pipe_t * pipe = file_pipe(file);
+
+    mutex_lock(&pipe->mutex);
+    poll_wait(pt, &pipe->poll_wq);
+
+    int events = 0;
+    if (pipe_is_reader(file)) {
+        events |= pipe->count ? POLLIN : 0;
+        events |= pipe->writers ? 0 : POLLHUP;
+    } else {
+        // all pages are in the ring, and the last one is filled
+        int full = 0;
+        if (pipe->count == PIPE_PAGE_NR) {
+            pipe_buf_t * last = pipe->bufs + (pipe->head + pipe->count - 1) % PIPE_PAGE_NR;
+            full = (last->offset + last->len == MEM_PAGE_SIZE);
+        }
+        events |= full ? 0 : POLLOUT;
+        events |= pipe->readers ? 0 : POLLERR;
+    }
+    mutex_unlock(&pipe->mutex);
+    return events;
+}
+
+static fs_op_t pipe_op = {
+    .read = pipe_read,
+    .write = pipe_write,
+    .close = pipe_close,
+    .seek = pipe_seek,
+    .stat = pipe_stat,
+    .ioctl = pipe_ioctl,
+    .poll = pipe_poll,
+};
+
+/**
+ * @brief Init the table of pipes
+ */
+void pipe_init (void) {
+    kernel_memset(pipe_table, 0, sizeof(pipe_table));
+    mutex_init(&table_mutex);
+
+    // not mounted, no path leads to a pipe. The pipes lock themselves, without the fs mutex
+    kernel_memset(&pipe_fs, 0, sizeof(pipe_fs));
+    pipe_fs.type = FS_PIPE;
+    pipe_fs.op = &pipe_op;
+    pipe_fs.rwlock = (rwlock_t *)0;
+}
+
+/**
+ * @brief Create a pipe read by rfile and written by wfile, the modes of them are set by the caller
+ */
+int pipe_open (file_t * rfile, file_t * wfile) {
+    pipe_t * pipe = (pipe_t *)0;
+
+    mutex_lock(&table_mutex);
+    for (int i = 0; i < PIPE_NR; i++) {
+        if (!pipe_table[i].used) {
+            pipe = pipe_table + i;
+            pipe->used = 1;
+            break;
+        }
+    }
+    mutex_unlock(&table_mutex);
+
+    if (pipe == (pipe_t *)0) {
+        log_printf("no free pipe");
+        return -1;
+    }
+
+    mutex_init(&pipe->mutex);
+    sem_init(&pipe->read_sem, 0);
+    sem_init(&pipe->write_sem, 0);
+    waitq_init(&pipe->poll_wq);
+    pipe->head = pipe->count = pipe->spare_count = 0;
+    pipe->read_waiters = pipe->write_waiters = 0;
+    pipe->readers = pipe->writers = 1;
+
+    file_t * files[] = {rfile, wfile};
+    for (int i = 0; i < 2; i++) {
+        file_t * file = files[i];
+        kernel_strncpy(file->file_name, "pipe", FILE_NAME_SIZE);
+        file->type = FILE_PIPE;
+        file->fs = &pipe_fs;
+        file->dev_id = pipe - pipe_table;
+        file->pos = file->size = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * Poll
+ */
+#include "fs/poll.h"
+#include "fs/fs.h"
+#include "core/task.h"
+#include "cpu/irq.h"
+#include "dev/time.h"
+#include "applib/lib_syscall.h"
+
+/**
+ * @brief Task sleeping in sys_poll, on its stack
+ */
+typedef struct _poll_waiter_t {
+    poll_table_t pt;                    // the first member, poll_queue gets the waiter from it
+    waitq_t wq;                         // the task sleeps here, its lock protects triggered
+    int triggered;                      // some queue watched is woken up
+
+    int count;
+    waitq_entry_t entries[POLL_FD_MAX]; // one queue for each file, the others are not watched
+}poll_waiter_t;
+
+/**
+ * @brief Called by the waker of the queue watched, with the lock of the queue held
+ */
+static void poll_entry_wake (waitq_entry_t * entry) {
+    poll_waiter_t * waiter = (poll_waiter_t *)entry->arg;
+    spin_lock(&waiter->wq.lock);
+    waiter->triggered = 1;
+    waitq_wake(&waiter->wq, 1);
+    spin_unlock(&waiter->wq.lock);
+}
+
+static void poll_queue (poll_table_t * pt, waitq_t * wq) {
+    poll_waiter_t * waiter = (poll_waiter_t *)pt;
+    if (waiter->count < POLL_FD_MAX) {
+        waitq_add(wq, waiter->entries + waiter->count++, poll_entry_wake, waiter);
+    }
+}
+
+/**
+ * @brief Sleep until a queue watched is woken up, or the deadline if it's not 0
+ * the wake up after the last scan is not lost, it's recorded by triggered
+ * return -1 if time is out or the process is killed
+ */
+static int poll_sleep (poll_waiter_t * waiter, uint64_t deadline) {
+    int err = 0;
+    irq_state_t irq_state = spin_lock_protect(&waiter->wq.lock);
+    if (!waiter->triggered) {
+        uint64_t now = time_ns();
+        if (deadline && (now >= deadline)) {
+            err = -1;
+        } else {
+            err = waitq_wait(&waiter->wq, 0, deadline ? deadline - now : 0);
+        }
+    }
+    waiter->triggered = 0;
+    spin_unlock_protect(&waiter->wq.lock, irq_state);
+    return err;
+}
+
+/**
+ * @brief Wake up the tasks watching wq, called when the events of the file change
+ */
+void poll_wakeup (waitq_t * wq) {
+    irq_state_t irq_state = spin_lock_protect(&wq->lock);
+    int count = waitq_count(wq);
+    waitq_wake_all(wq);
+    spin_unlock(&wq->lock);
+
+    if (count) {
+        task_dispatch();
+    }
+    irq_leave_protection(irq_state);
+}
+
+/**
+ * @brief Events ready of the file, the file without poll op is always ready
+ */
+int file_poll (file_t * file, poll_table_t * pt) {
+    fs_op_t * op = file->fs->op;
+    return op->poll ? op->poll(file, pt) : (POLLIN | POLLOUT);
+}
+
+/**
+ * @brief Wait until some of fds are ready, or timeout ms passed, forever if timeout < 0
+ * return the number of fds ready, 0 if time is out
+ */
+int sys_poll (struct pollfd * fds, int nfds, int timeout) {
+    if ((nfds < 0) || (nfds > POLL_FD_MAX) || (!fds && nfds)) {
+        return -1;
+    }
+
+    poll_waiter_t waiter;
+    waiter.pt.queue = poll_queue;
+    waitq_init(&waiter.wq);
+    waiter.triggered = 0;
+    waiter.count = 0;
+
+    uint64_t deadline = (timeout > 0) ? time_ns() + (uint64_t)timeout * 1000000 : 0;
+    poll_table_t * pt = timeout ? &waiter.pt : (poll_table_t *)0;
+    int ready;
+    int stop = 0;
+    for (;;) {
+        ready = 0;
+        for (int i = 0; i < nfds; i++) {
+            struct pollfd * pfd = fds + i;
+            pfd->revents = 0;
+            if (pfd->fd < 0) {
+                continue;
+            }
+
+            file_t * file = task_file(pfd->fd);
+            int revents = file ? file_poll(file, pt) : POLLNVAL;
+            pfd->revents = revents & (pfd->events | POLLERR | POLLHUP | POLLNVAL);
+            ready += (pfd->revents != 0);
+        }
+
+        // the queues are watched since the first scan, not added again
+        pt = (poll_table_t *)0;
+        if (ready || (timeout == 0) || stop) {
+            break;
+        }
+
+        // scanned once more after time is out
+        stop = poll_sleep(&waiter, deadline) < 0;
+    }
+
+    for (int i = 0; i < waiter.count; i++) {
+        waitq_remove(waiter.entries[i].wq, waiter.entries + i);
+    }
+    return ready;
+}
@@ -0,0 +1,33 @@
+/**
+ * High resolution timer
+ * One-shot expiries in ns of the monotonic clock, the timers close to each other
+ * are handled in one interrupt if their slack allows
+ */
+#ifndef HRTIMER_H
+#define HRTIMER_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+
+struct _hrtimer_t;
+typedef void (*hrtimer_func_t)(struct _hrtimer_t * timer);
+
+/**
+ * @brief Timer, it can be on the stack if it's canceled before return
+ */
+typedef struct _hrtimer_t {
+    uint64_t expires;           // monotonic time in ns, it never runs before
+    uint32_t slack;             // ns it may be delayed, to run with other timers
+    hrtimer_func_t func;        // called in interrupt, with interrupts disabled
+    void * data;
+    int pending;                // in the timer list
+    list_node_t node;
+}hrtimer_t;
+
+void hrtimer_init (hrtimer_t * timer, hrtimer_func_t func, void * data);
+void hrtimer_start (hrtimer_t * timer, uint64_t expires, uint32_t slack);
+void hrtimer_cancel (hrtimer_t * timer);
+void hrtimer_interrupt (void);
+void hrtimer_module_init (void);
+
+#endif // HRTIMER_H
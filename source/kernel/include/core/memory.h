@@ -9,15 +9,24 @@
 #include "ipc/mutex.h"
 
 #define MEM_EBDA_START              0x00080000
+#define MEM_EBDA_END                0x000A0000
+#define MEM_BIOS_START              0x000E0000
 #define MEM_EXT_START               (1024*1024)
 #define MEM_EXT_END                 (128*1024*1024 - 1)
 #define MEM_PAGE_SIZE               4096        // same with the page table size
 
+#define MEM_MMIO_START              (0x7FC00000u)       // kernel window for device registers (APIC...)
+#define MEM_MMIO_SIZE               (4*1024*1024u)
+#define MEM_TIME_PAGE               (MEM_MMIO_START - MEM_PAGE_SIZE)  // clock data, read only for user
+
 #define MEMORY_TASK_BASE            (0x80000000)        // start address of process
 #define MEM_TASK_STACK_TOP          (0xE0000000)        // start address of stack
+#define MEM_MQ_RING_START           (MEM_TASK_STACK_TOP)  // rings of the opened message queues, one page each
 #define MEM_TASK_STACK_SIZE         (MEM_PAGE_SIZE * 500)   // 500KB stack
 #define MEM_TASK_ARG_SIZE           (MEM_PAGE_SIZE * 4)     // parameter size
 
+#define MEM_UVM_CACHE_NR            16          // page dirs kept after exit for the next fork/exec
+
 /**
  * @brief Address allocation structure
  */
@@ -46,10 +55,18 @@ uint32_t memory_alloc_for_page_dir (uint32_t page_dir, uint32_t vaddr, uint32_t
 int memory_alloc_page_for (uint32_t addr, uint32_t size, int perm);
 uint32_t memory_alloc_page (void);
 void memory_free_page (uint32_t addr);
+uint32_t memory_alloc_pages (int count);
+void memory_free_pages (uint32_t addr, int count);
 void memory_destroy_uvm (uint32_t page_dir);
 uint32_t memory_copy_uvm (uint32_t page_dir);
 uint32_t memory_get_paddr (uint32_t page_dir, uint32_t vaddr);
 int memory_copy_uvm_data(uint32_t to, uint32_t page_dir, uint32_t from, uint32_t size);
+uint32_t memory_map_mmio (uint32_t paddr, uint32_t size);
+uint32_t memory_alloc_shared_page (uint32_t vaddr);
+uint32_t memory_swap_page (uint32_t vaddr, uint32_t page);
+int memory_map_shared_page (uint32_t vaddr, uint32_t page, uint32_t perm);
+void memory_unmap_shared_page (uint32_t vaddr);
+uint32_t memory_kernel_page_dir (void);
 char * sys_sbrk(int incr);
 
-#endif // MEMORY_H
\ No newline at end of file
+#endif // MEMORY_H
\ No newline at end of file
@@ -13,6 +13,26 @@
 #define SYS_yield               4
 #define SYS_exit                5
 #define SYS_wait                6
+#define SYS_getrusage           7
+#define SYS_task_list           8
+#define SYS_sched_latency       9
+#define SYS_sched_trace         10
+#define SYS_clock_gettime       11
+#define SYS_gettimeofday        12
+#define SYS_time_page           13
+#define SYS_nanosleep           14
+#define SYS_timer_slack         15
+#define SYS_spawn               16
+#define SYS_vfork               17
+#define SYS_clone               18
+#define SYS_join                19
+#define SYS_sched_setattr       20
+#define SYS_sched_getattr       21
+#define SYS_syscall_stat        22
+#define SYS_strace              23
+#define SYS_strace_read         24
+#define SYS_futex               25
+#define SYS_thread_exit         26
 
 #define SYS_open                50
 #define SYS_read                51
@@ -29,10 +49,36 @@
 #define SYS_readdir				61
 #define SYS_closedir			62
 #define SYS_unlink				63
+#define SYS_uring_setup			64
+#define SYS_uring_enter			65
+#define SYS_readv				66
+#define SYS_writev				67
+#define SYS_pread				68
+#define SYS_pwrite				69
+#define SYS_sendfile			70
+#define SYS_copy_file_range		71
+#define SYS_pipe				72
+#define SYS_poll				73
+#define SYS_epoll_create		74
+#define SYS_epoll_ctl			75
+#define SYS_epoll_wait			76
+#define SYS_mq_open				77
+#define SYS_mq_unlink			78
+#define SYS_mq_send				79
+#define SYS_mq_receive			80
+#define SYS_mq_getattr			81
 
 
 #define SYS_printmsg            100
 
+#ifndef __ASSEMBLER__
+
+#define SYSCALL_TRACE_NR        256     // events of traced tasks kept
+
+struct _task_t;
+struct _syscall_stat_t;
+struct _syscall_event_t;
+
 /**
  * Stack info of system call
  */
@@ -45,6 +91,14 @@ typedef struct _syscall_frame_t {
 	int esp, ss;
 }syscall_frame_t;
 
-void exception_handler_syscall (void);		// syscall handler
+void exception_handler_syscall (void);		// syscall handler of call gate
+void exception_handler_sysenter (void);		// syscall handler of SYSENTER
+
+void syscall_init (void);
+void syscall_trace_set (struct _task_t * task, int on);
+int sys_syscall_stat (struct _syscall_stat_t * buf, int count, int flags);
+int sys_strace_read (struct _syscall_event_t * buf, int count, unsigned int seq);
+
+#endif
 
 #endif //OS_SYSCALL_H
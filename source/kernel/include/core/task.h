@@ -6,14 +6,33 @@
 
 #include "comm/types.h"
 #include "cpu/cpu.h"
+#include "cpu/fpu.h"
 #include "tools/list.h"
 #include "fs/file.h"
+#include "ipc/spinlock.h"
+#include "ipc/sem.h"
+#include "core/hrtimer.h"
+#include "os_cfg.h"
+#include "applib/lib_syscall.h"
 
 #define TASK_NAME_SIZE				32			// length of task name
 #define TASK_TIME_SLICE_DEFAULT		10			// timestamp counts
 #define TASK_OFILE_NR				128			// Max supported file number
+#define SCHED_TRACE_NR				128			// trace events kept per CPU
+#define TASK_PID_HASH_NR			64			// buckets of pid hash, power of 2
+#define SCHED_DL_BW_SHIFT			20			// fixed point of bandwidth, runtime / period
+#define SCHED_DL_BW_MAX				((95 << SCHED_DL_BW_SHIFT) / 100)	// deadline tasks can reserve 95% of a CPU
+#define SCHED_NO_DEADLINE			((uint64_t)-1)		// normal task, after all deadline tasks
 
 #define TASK_FLAG_SYSTEM       	(1 << 0)		// system task
+#define TASK_FLAG_KTHREAD       (1 << 1)		// kernel thread, no user space
+#define TASK_FLAG_HIGH          (1 << 2)		// run before other ready tasks when woken up
+#define TASK_FLAG_VFORK         (1 << 3)		// borrowing the page table of parent, until exec or exit
+#define TASK_FLAG_THREAD        (1 << 4)		// thread created by clone, the page table is owned by leader
+#define TASK_FLAG_TRACE         (1 << 5)		// syscalls are recorded, see strace
+#define TASK_FLAG_KILL          (1 << 6)		// its process is exiting, it exits on the way back to user mode
+
+struct _mutex_t;
 
 typedef struct _task_args_t {
 	uint32_t ret_addr;		// return addr
@@ -35,64 +54,185 @@ typedef struct _task_t {
 	}state;
 
     char name[TASK_NAME_SIZE];		// task name
+	int flags;				// TASK_FLAG_xxx
 
     int pid;				// pid
     struct _task_t * parent;		// parent process
+	struct _task_t * leader;		// thread group leader owning files, heap and page table, itself for a process
+	int threads;			// tasks not exited in the group, valid in leader
+	list_t thread_list;		// threads created by clone, valid in leader
+	struct _task_t * joiner;	// task waiting in join for this thread
+	uint32_t tls;			// base of TLS segment loaded into gs, 0 if none
+	int tls_sel;			// selector of TLS segment
 	uint32_t heap_start;		// start addr of heap
 	uint32_t heap_end;			// end addr of heap
     int status;				// result of process
+	sem_t vfork_sem;		// waiting for the child in vfork
+	sem_t * vfork_done;		// sem of parent waiting in vfork, notified on exec or exit
+	struct _uring_ctx_t * uring;	// rings registered by uring_setup, valid in leader
+	struct _task_t * killer;	// thread exiting the process, woken up when the killed ones exit, valid in leader
+	int kill_left;			// threads killed but not exited yet, valid in leader
 
-    int sleep_ticks;		// sleep time
+    uint32_t timer_slack;	// ns the wakeup of sleep may be delayed
     int time_slice;			
 	int slice_ticks;		// decreasing time slice counter
 
+	int cpu;				// CPU whose ready list the task is in
+	volatile int on_cpu;	// running, or TSS not saved yet after switching away
+	int on_rq;				// in the ready list of its CPU
+
+	// deadline class, the task gets runtime in every period, before the deadline in the period
+	int policy;				// SCHED_POLICY_xxx
+	uint32_t dl_runtime;	// ns
+	uint32_t dl_deadline;	// ns, relative to the start of period
+	uint32_t dl_period;		// ns
+	uint32_t dl_bw;			// runtime / period, reserved in its CPU
+	uint64_t dl_abs_deadline;	// deadline of current period
+	int64_t dl_remaining;	// budget left in current period, negative if overrun
+	uint64_t dl_exec_start;	// time the budget is charged to
+	int dl_throttled;		// out of the ready list until replenished in the next period
+	int dl_missed;			// the miss in current period has been counted
+	uint32_t dl_misses;		// periods in which it was still running after the deadline
+	uint32_t dl_throttles;	// times the budget is used up
+	hrtimer_t dl_timer;		// replenish at the start of next period
+
+	// priority inheritance, the owner of a mutex runs by the earliest deadline of its waiters
+	uint64_t pi_deadline;	// inherited deadline, SCHED_NO_DEADLINE if not boosted
+	list_t pi_list;			// mutexes held with waiters
+	struct _mutex_t * pi_blocked_on;	// mutex waiting for
+
+	// wait queue slept on, the kill of the process wakes the task up from it
+	spinlock_t wait_lock;	// protect wait_entry
+	struct _waitq_entry_t * wait_entry;	// on the stack of the task, 0 if it's not in a queue
+
+	// accounting, in ticks or counts
+	uint32_t utime;			// ticks running in user mode
+	uint32_t stime;			// ticks running in kernel mode
+	uint32_t nvcsw;			// voluntary switches, e.g. sleep or wait
+	uint32_t nivcsw;		// involuntary switches, preempted while ready
+	uint32_t wait_ticks;	// ticks waiting in the ready list
+	uint32_t ready_tick;	// tick when inserted into the ready list
+	uint32_t page_faults;
+
+	uint64_t wakeup_tsc;	// TSC when woken up, 0 if it's not waiting to run after wakeup
+	sched_latency_t latency;	// wakeup to run latency
+
     file_t * file_table[TASK_OFILE_NR];	// Max number of file a task can open
 
+	int fpu_used;			// FPU state is valid, it's initialized on first use
+	uint8_t fpu_state[FPU_STATE_SIZE] __attribute__((aligned(16)));	// saved when other task uses FPU
+
 	tss_t tss;				// TSS segement of task
 	uint16_t tss_sel;		// TSS selector
+	uint32_t kernel_stack;	// page of kernel stack, kept with tss_sel when the struct is recycled
 	
+	list_t child_list;		// running children
+	list_t zombie_list;		// exited children, not reclaimed by wait yet
+
 	list_node_t run_node;		
 	list_node_t wait_node;		
-	list_node_t all_node;		
+	list_node_t all_node;		// in the task list, or the free list if not used
+	list_node_t child_node;		// in child list or zombie list of parent, or thread list of leader
+	list_node_t hash_node;		// in pid hash
 }task_t;
 
-int task_init (task_t *task, const char * name, int flag, uint32_t entry, uint32_t esp);
+int task_init (task_t *task, const char * name, int flag, uint32_t entry, uint32_t esp, uint32_t page_dir);
+task_t * kthread_create (const char * name, void (*entry)(void * arg), void * arg, int flag);
+task_t * kthread_create_in (task_t * leader, const char * name, void (*entry)(void * arg), void * arg);
 void task_switch_from_to (task_t * from, task_t * to);
 void task_set_ready(task_t *task);
+void task_set_ready_sync (task_t * task);
 void task_set_block (task_t *task);
-void task_set_sleep(task_t *task, uint32_t ticks);
-void task_set_wakeup (task_t *task);
+void task_pi_set (task_t * task, uint64_t deadline);
 int sys_yield (void);
 void task_dispatch (void);
 task_t * task_current (void);
-void task_time_tick (void);
+void task_time_tick (int user);
+void task_sleep_ns (uint64_t ns);
 void sys_msleep (uint32_t ms);
+int sys_nanosleep (const struct timespec * req, struct timespec * rem);
+int sys_timer_slack (int ns);
 file_t * task_file (int fd);
 int task_alloc_fd (file_t * file);
 void task_remove_fd (int fd);
 
+/**
+ * @brief Run queue, one per CPU
+ */
+typedef struct _cpu_rq_t {
+	spinlock_t lock;			// protect the ready list and the fields below
+	int id;						// cpu index
+	volatile int online;
+
+	task_t * curr_task;
+	task_t * prev_task;			// task switched out, its TSS is saved when running again on this CPU
+	list_t ready_list;			// current task is at the head when running
+	list_t dl_list;				// deadline tasks not throttled, the earliest deadline first, run before ready list
+	uint32_t dl_bw;				// bandwidth reserved by deadline tasks
+	task_t idle_task;
+
+	sched_latency_t latency;	// of tasks run on this CPU, added up for the global one
+	sched_event_t trace[SCHED_TRACE_NR];	// ring of recent scheduler events
+	uint32_t trace_next;		// total events recorded, the next one is at trace_next % SCHED_TRACE_NR
+}cpu_rq_t;
+
 typedef struct _task_manager_t {
-    task_t * curr_task;       
+	spinlock_t lock;			// protect the task list, free list, pid hash and the relation of tasks
+	cpu_rq_t rq[CPU_NR];
+	int cpu_count;
 
-	list_t ready_list;			
 	list_t task_list;			// created task list
-	list_t sleep_list;        
+	list_t free_list;			// unused task structures
+	list_t pid_hash[TASK_PID_HASH_NR];
+	int next_pid;				// pid is increased and not reused, until it wraps around after 2^31
 
 	task_t first_task;			
-	task_t idle_task;			
 	int app_code_sel;			// selector of task code
 	int app_data_sel;			// elector of task data
 }task_manager_t;
 
+/**
+ * @brief Deadline the task is scheduled by, the inherited one if it's earlier
+ */
+static inline uint64_t task_sched_deadline (task_t * task) {
+	uint64_t deadline = (task->policy == SCHED_POLICY_DEADLINE) ? task->dl_abs_deadline : SCHED_NO_DEADLINE;
+	return (task->pi_deadline < deadline) ? task->pi_deadline : deadline;
+}
+
+/**
+ * @brief Check if the task runs in the deadline class, by its policy or boosted by a mutex
+ */
+static inline int task_is_dl (task_t * task) {
+	return task_sched_deadline(task) != SCHED_NO_DEADLINE;
+}
+
 void task_manager_init (void);
 void task_first_init (void);
 task_t * task_first_task (void);
+task_t * task_idle_task (int cpu);
+int task_cpu_online (int cpu);
+int task_cpu_id (void);
+void task_ap_enter (int cpu);
 
 int sys_getpid (void);
 int sys_fork (void);
+int sys_vfork (void);
+int sys_spawn (const char * name, char * const * argv, char * const * env, const int * fd_map);
+int sys_clone (void (*entry)(void *), void * stack, void * arg, void * tls);
+int sys_join (int tid, int * status);
+int sys_sched_setattr (int pid, const sched_attr_t * attr);
+int sys_sched_getattr (int pid, sched_attr_t * attr);
 int sys_execve(char *name, char **argv, char **env);
+void task_exit (int status);
+void task_check_kill (void);
 void sys_exit(int status);
+void sys_thread_exit (int status);
 int sys_wait(int* status);
+int sys_getrusage (int pid, task_usage_t * usage);
+int sys_task_list (task_usage_t * buf, int count);
+int sys_sched_latency (int pid, sched_latency_t * latency);
+int sys_sched_trace (sched_event_t * buf, int count);
+int sys_strace (int pid, int on);
 
 #endif
 
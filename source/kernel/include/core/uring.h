@@ -0,0 +1,47 @@
+/**
+ * Submission and completion rings
+ * A process queues file requests in the rings in its memory, they're done in a batch
+ * by one uring_enter, or by a kernel thread polling the rings without any syscall
+ */
+#ifndef URING_H
+#define URING_H
+
+#include "ipc/mutex.h"
+#include "ipc/sem.h"
+#include "applib/lib_syscall.h"
+
+#define URING_NR                8           // processes using rings at the same time
+#define URING_ENTRIES_MAX       256         // max entries of each ring
+#define URING_POLL_IDLE_MS      20          // the poller sleeps after idle for so long
+#define URING_POLL_NAME         "uring-poll"
+
+struct _task_t;
+
+/**
+ * @brief Rings registered by a process
+ */
+typedef struct _uring_ctx_t {
+    int used;
+    uring_t * ring;             // in user space
+    uring_sqe_t * sqes;         // copied at setup, the process can't redirect them
+    uring_cqe_t * cqes;
+    uint32_t entries;
+    mutex_t mutex;              // consumer of sq and producer of cq
+
+    struct _task_t * poller;    // kernel thread in the process polling the sq
+    sem_t poll_sem;             // wake up the poller
+    volatile int stop;          // the poller should exit
+    volatile int cq_waiting;    // someone waits for completions from the poller
+    sem_t cq_sem;
+}uring_ctx_t;
+
+void uring_table_init (void);
+void uring_stop (struct _task_t * leader);
+void uring_release (struct _task_t * leader);
+int uring_pollers (struct _task_t * leader);
+void uring_shutdown (struct _task_t * leader);
+
+int sys_uring_setup (uring_t * ring, int entries, int flags);
+int sys_uring_enter (int to_submit, int min_complete, int flags);
+
+#endif // URING_H
@@ -0,0 +1,29 @@
+/**
+ * Deferred work
+ * Interrupt handlers do only the part which must be done at once, and queue the rest,
+ * which runs later in the kworker kernel thread with interrupts enabled
+ */
+#ifndef WORK_H
+#define WORK_H
+
+#include "tools/list.h"
+
+#define WORK_NAME               "kworker"
+
+struct _work_t;
+typedef void (*work_func_t)(struct _work_t * work);
+
+/**
+ * @brief Work item, embedded in the structure of the driver
+ */
+typedef struct _work_t {
+    work_func_t func;
+    volatile int pending;       // queued and not run yet
+    list_node_t node;
+}work_t;
+
+void work_init (work_t * work, work_func_t func);
+int work_schedule (work_t * work);
+void work_queue_init (void);
+
+#endif // WORK_H
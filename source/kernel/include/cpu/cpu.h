@@ -35,6 +35,10 @@
 #define EFLAGS_IF           (1 << 9)
 #define EFLAGS_DEFAULT      (1 << 1)
 
+#define MSR_SYSENTER_CS     0x174       // kernel CS, SS is the next one, app CS and SS follow
+#define MSR_SYSENTER_ESP    0x175       // kernel stack
+#define MSR_SYSENTER_EIP    0x176       // kernel entry
+
 #pragma pack(1)
 
 /**
@@ -76,9 +80,12 @@ void cpu_init (void);
 void segment_desc_set(int selector, uint32_t base, uint32_t limit, uint16_t attr);
 void gate_desc_set(gate_desc_t * desc, uint16_t selector, uint32_t offset, uint16_t attr);
 int gdt_alloc_desc (void);
+void gdt_get_info (uint32_t * base, uint16_t * limit);
 void gdt_free_sel (int sel);
 
 void switch_to_tss (uint32_t tss_selector);
+void cpu_sysenter_init (void);
+void cpu_set_sysenter_stack (uint32_t esp);
 
 #endif
 
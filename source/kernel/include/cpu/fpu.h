@@ -0,0 +1,32 @@
+/**
+ * x87 FPU and SSE
+ * Ref: Intel SDM Vol 3, 13.4 Designing OS facilities for saving x87 FPU, SSE and extended states
+ */
+#ifndef FPU_H
+#define FPU_H
+
+#include "comm/types.h"
+
+#define FPU_STATE_SIZE          512         // fxsave area, 16 bytes aligned
+
+#define CR0_MP                  (1 << 1)    // monitor coprocessor, wait/fwait also checks TS
+#define CR0_EM                  (1 << 2)    // no FPU, emulated
+#define CR0_TS                  (1 << 3)    // task switched, set by hardware task switch
+#define CR0_NE                  (1 << 5)    // report FPU error with #MF
+#define CR4_OSFXSR              (1 << 9)    // fxsave/fxrstor and SSE enabled
+#define CR4_OSXMMEXCPT          (1 << 10)   // unmasked SSE exception with #XM
+
+#define CPUID_EDX_FXSR          (1 << 24)
+#define CPUID_EDX_SSE           (1 << 25)
+
+#define MXCSR_DEFAULT           0x1F80      // all SSE exceptions masked
+
+struct _task_t;
+
+void fpu_init (void);
+void fpu_switch (void);
+int fpu_can_migrate (struct _task_t * task, int cpu);
+void fpu_task_fork (struct _task_t * child);
+void fpu_task_reset (struct _task_t * task);
+
+#endif // FPU_H
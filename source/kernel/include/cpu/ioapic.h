@@ -0,0 +1,29 @@
+/**
+ * I/O APIC
+ * Ref: Intel 82093AA I/O Advanced Programmable Interrupt Controller
+ */
+#ifndef IOAPIC_H
+#define IOAPIC_H
+
+#include "comm/types.h"
+#include "cpu/irq.h"
+
+// register select and data window
+#define IOAPIC_REGSEL               0x00
+#define IOAPIC_WIN                  0x10
+
+// indirect register
+#define IOAPIC_REG_ID               0x00
+#define IOAPIC_REG_VER              0x01
+#define IOAPIC_REG_REDTBL           0x10        // 2 registers per pin
+
+#define IOAPIC_INT_LOW              (1 << 13)   // active low
+#define IOAPIC_INT_LEVEL            (1 << 15)   // level triggered
+#define IOAPIC_INT_MASKED           (1 << 16)
+
+int ioapic_init (uint32_t paddr, int dest_apic_id);
+void ioapic_set_isa_route (int irq, int pin, int active_low, int level);
+
+extern irq_chip_t ioapic_chip;
+
+#endif // IOAPIC_H
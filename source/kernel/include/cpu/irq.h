@@ -31,6 +31,10 @@
 #define IRQ1_KEYBOARD		0x21				// keyboard interupt
 #define IRQ14_HARDDISK_PRIMARY		0x2E		// ATA disk interupt in bus
 
+#define IRQ_LAPIC_TIMER     0x30                // local apic timer
+#define IRQ_RESCHEDULE      0x31                // IPI, ask other CPU to reschedule
+#define IRQ_SPURIOUS        0x3F                // local apic spurious interrupt
+
 #define ERR_PAGE_P          (1 << 0)
 #define ERR_PAGE_WR          (1 << 1)
 #define ERR_PAGE_US          (1 << 1)
@@ -52,7 +56,21 @@ typedef struct _exception_frame_t {
 
 typedef void(*irq_handler_t)(void);
 
+#define IRQ_ISA_NR          16                  // ISA irq number, mapped to IRQ_PIC_START...
+
+/**
+ * Interrupt controller, the 8259 PIC or the I/O APIC
+ * irq is the vector number of the device
+ */
+typedef struct _irq_chip_t {
+    const char * name;
+    void (*enable)(int irq);
+    void (*disable)(int irq);
+    void (*eoi)(int irq);
+}irq_chip_t;
+
 void irq_init (void);
+void irq_load_idt (void);
 int irq_install(int irq_num, irq_handler_t handler);
 
 void exception_handler_unknown (void);
@@ -75,6 +93,8 @@ void exception_handler_alignment_check (void);
 void exception_handler_machine_check (void);
 void exception_handler_smd_exception (void);
 void exception_handler_virtual_exception (void);
+void exception_handler_resched (void);
+void exception_handler_spurious (void);
 
 // PIC regs
 #define PIC0_ICW1			0x20
@@ -108,6 +128,8 @@ irq_state_t irq_enter_protection (void);
 void irq_leave_protection (irq_state_t state);
 
 void pic_send_eoi(int irq);
+void irq_send_eoi (int irq_num);
+void irq_set_chip (irq_chip_t * chip);
 
 
 #endif
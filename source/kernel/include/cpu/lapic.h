@@ -0,0 +1,50 @@
+/**
+ * Local APIC
+ * Ref: https://wiki.osdev.org/APIC
+ */
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include "comm/types.h"
+
+#define LAPIC_DEFAULT_BASE          0xFEE00000      // default physical address
+
+// register offset
+#define LAPIC_ID                    0x020
+#define LAPIC_VER                   0x030
+#define LAPIC_TPR                   0x080           // task priority
+#define LAPIC_EOI                   0x0B0
+#define LAPIC_SVR                   0x0F0           // spurious interrupt vector
+#define LAPIC_ESR                   0x280           // error status
+#define LAPIC_ICR_LO                0x300           // interrupt command
+#define LAPIC_ICR_HI                0x310
+#define LAPIC_LVT_TIMER             0x320
+#define LAPIC_LVT_LINT0             0x350
+#define LAPIC_LVT_LINT1             0x360
+#define LAPIC_LVT_ERROR             0x370
+#define LAPIC_TIMER_INIT            0x380           // timer initial count
+#define LAPIC_TIMER_CURR            0x390           // timer current count
+#define LAPIC_TIMER_DIV             0x3E0           // timer divide config
+
+#define LAPIC_SVR_ENABLE            (1 << 8)
+#define LAPIC_LVT_MASKED            (1 << 16)
+#define LAPIC_TIMER_PERIODIC        (1 << 17)
+#define LAPIC_TIMER_DIV_16          0x3
+
+#define LAPIC_ICR_INIT              (5 << 8)
+#define LAPIC_ICR_STARTUP           (6 << 8)
+#define LAPIC_ICR_PENDING           (1 << 12)       // delivery status
+#define LAPIC_ICR_ASSERT            (1 << 14)
+#define LAPIC_ICR_LEVEL             (1 << 15)
+
+void lapic_init (uint32_t paddr);
+int lapic_present (void);
+void lapic_enable (int is_bsp);
+int lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (int apic_id, int vector);
+void lapic_start_ap (int apic_id, uint32_t addr);
+void lapic_timer_calibrate (void);
+void lapic_timer_start (int vector, int ms);
+
+#endif // LAPIC_H
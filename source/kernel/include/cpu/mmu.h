@@ -13,7 +13,9 @@
 #define PTE_W           (1 << 1)
 #define PDE_P       (1 << 0)
 #define PTE_U           (1 << 2)
+#define PTE_PCD         (1 << 4)
 #define PDE_U           (1 << 2)
+#define PTE_SHARED      (1 << 9)        // ignored by cpu, the page is owned by the kernel, not copied or freed with the process
 
 #pragma pack(1)
 /**
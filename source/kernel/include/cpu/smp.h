@@ -0,0 +1,131 @@
+/**
+ * Multi-processor support
+ * Ref: Intel MultiProcessor Specification v1.4
+ */
+#ifndef SMP_H
+#define SMP_H
+
+#include "comm/types.h"
+
+#define MP_ENTRY_PROC           0           // processor entry
+#define MP_ENTRY_BUS            1
+#define MP_ENTRY_IOAPIC         2
+#define MP_ENTRY_IOINTR         3
+#define MP_ENTRY_LINTR          4
+
+#define MP_PROC_ENABLED         (1 << 0)
+#define MP_PROC_BSP             (1 << 1)
+#define MP_IOAPIC_ENABLED       (1 << 0)
+#define MP_FEATURE2_IMCRP       (1 << 7)    // IMCR present, PIC mode
+
+#define MP_INTR_TYPE_INT        0           // vectored interrupt
+#define MP_INTR_POL_MASK        0x3
+#define MP_INTR_POL_LOW         0x3
+#define MP_INTR_TRIG_MASK       (0x3 << 2)
+#define MP_INTR_TRIG_LEVEL      (0x3 << 2)
+
+#define IMCR_ADDR_PORT          0x22
+#define IMCR_DATA_PORT          0x23
+#define IMCR_SELECT             0x70
+#define IMCR_APIC               0x01        // route the interrupts to the APIC
+
+#pragma pack(1)
+
+/**
+ * MP floating pointer structure
+ */
+typedef struct _mp_float_t {
+    char signature[4];          // "_MP_"
+    uint32_t conf_addr;         // physical address of configuration table
+    uint8_t length;             // in 16 bytes
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t features[5];
+}mp_float_t;
+
+/**
+ * MP configuration table header
+ */
+typedef struct _mp_conf_t {
+    char signature[4];          // "PCMP"
+    uint16_t length;            // base table length
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_addr;        // physical address of local APIC
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+}mp_conf_t;
+
+/**
+ * Processor entry, the other entries are all 8 bytes
+ */
+typedef struct _mp_proc_t {
+    uint8_t type;
+    uint8_t apic_id;
+    uint8_t apic_ver;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+}mp_proc_t;
+
+/**
+ * Bus entry
+ */
+typedef struct _mp_bus_t {
+    uint8_t type;
+    uint8_t bus_id;
+    char bus_type[6];           // "ISA   ", "PCI   "...
+}mp_bus_t;
+
+/**
+ * I/O APIC entry
+ */
+typedef struct _mp_ioapic_t {
+    uint8_t type;
+    uint8_t apic_id;
+    uint8_t apic_ver;
+    uint8_t flags;
+    uint32_t addr;
+}mp_ioapic_t;
+
+/**
+ * I/O interrupt assignment entry
+ */
+typedef struct _mp_iointr_t {
+    uint8_t type;
+    uint8_t intr_type;
+    uint16_t flags;             // polarity and trigger mode
+    uint8_t src_bus;
+    uint8_t src_irq;
+    uint8_t dst_apic_id;
+    uint8_t dst_pin;
+}mp_iointr_t;
+
+/**
+ * Parameters passed to the AP start up code
+ */
+typedef struct _ap_param_t {
+    uint16_t gdt_limit;
+    uint32_t gdt_base;
+    uint32_t cr3;               // page dir, the same as the idle task
+    uint32_t esp;               // stack, the kernel stack of idle task
+    uint32_t entry;             // ap_main
+    uint32_t cpu;               // cpu index
+}ap_param_t;
+
+#pragma pack()
+
+void smp_init (void);
+void smp_start_ap (void);
+int smp_cpu_count (void);
+int smp_apic_id (int cpu);
+void ap_main (int cpu);
+
+#endif // SMP_H
@@ -16,6 +16,7 @@ enum {
 };
 
 struct _dev_desc_t;
+struct _poll_table_t;
 
 /**
  * @brief Device driver interface
@@ -40,6 +41,7 @@ typedef struct _dev_desc_t {
     int (*read) (device_t * dev, int addr, char * buf, int size);
     int (*write) (device_t * dev, int addr, char * buf, int size);
     int (*control) (device_t * dev, int cmd, int arg0, int arg1);
+    int (*poll) (device_t * dev, struct _poll_table_t * pt);     // optional, see fs/poll.h
     void (*close) (device_t * dev);
 }dev_desc_t;
 
@@ -47,6 +49,7 @@ int dev_open (int major, int minor, void * data);
 int dev_read (int dev_id, int addr, char * buf, int size);
 int dev_write (int dev_id, int addr, char * buf, int size);
 int dev_control (int dev_id, int cmd, int arg0, int arg1);
+int dev_poll (int dev_id, struct _poll_table_t * pt);
 void dev_close (int dev_id);
 
 #endif // DEV_H
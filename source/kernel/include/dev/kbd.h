@@ -11,6 +11,8 @@
 #define KBD_PORT_STAT			0x64
 #define KBD_PORT_CMD			0x64
 
+#define KBD_BUF_SIZE			64		// raw code buffer
+
 #define KBD_STAT_RECV_READY		(1 << 0)
 #define KBD_STAT_SEND_FULL		(1 << 1)
 
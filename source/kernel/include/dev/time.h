@@ -7,16 +7,61 @@
 #include "comm/types.h"
 
 #define PIT_OSC_FREQ                1193182				// Timer clock
+#define TSC_CALIBRATE_US            50000               // PIT time for measuring TSC frequency
+#define PIT_ONESHOT_MAX_US          54000               // 16 bits count, less than 54.9ms
+#define PIT_ONESHOT_MIN_COUNT       2
 
 // Timer regs config
 #define PIT_CHANNEL0_DATA_PORT       0x40
+#define PIT_CHANNEL2_DATA_PORT       0x42
 #define PIT_COMMAND_MODE_PORT        0x43
+#define PIT_CHANNEL2_GATE_PORT       0x61
 
 #define PIT_CHANNLE0                (0 << 6)
+#define PIT_CHANNLE2                (2 << 6)
 #define PIT_LOAD_LOHI               (3 << 4)
+#define PIT_MODE0                   (0 << 1)
 #define PIT_MODE3                   (3 << 1)
 
+#define PIT_GATE2_ENABLE            (1 << 0)        // gate of channel 2
+#define PIT_GATE2_SPEAKER           (1 << 1)        // speaker data enable
+#define PIT_GATE2_OUT               (1 << 5)        // output of channel 2
+
+// CMOS real time clock
+// Ref: https://wiki.osdev.org/CMOS
+#define CMOS_ADDR_PORT              0x70
+#define CMOS_DATA_PORT              0x71
+#define CMOS_NMI_DISABLE            (1 << 7)
+
+#define RTC_SECOND                  0x00
+#define RTC_MINUTE                  0x02
+#define RTC_HOUR                    0x04
+#define RTC_DAY                     0x07
+#define RTC_MONTH                   0x08
+#define RTC_YEAR                    0x09
+#define RTC_STATUS_A                0x0A
+#define RTC_STATUS_B                0x0B
+
+#define RTC_A_UPDATING              (1 << 7)        // update in progress
+#define RTC_B_24HOUR                (1 << 1)
+#define RTC_B_BINARY                (1 << 2)        // BCD if not set
+#define RTC_HOUR_PM                 (1 << 7)
+
 void time_init (void);
+void pit_delay_us (uint32_t us);
+void time_use_lapic (void);
+uint32_t time_get_tick (void);
+uint64_t time_tsc (void);
+uint32_t time_tsc_to_us (uint64_t cycles);
+uint64_t time_ns (void);
+int time_set_oneshot (uint64_t delta_ns);
+
+struct timespec;
+struct timeval;
+int sys_clock_gettime (int clock_id, struct timespec * ts);
+int sys_gettimeofday (struct timeval * tv, void * tz);
+uint32_t sys_time_page (void);
 void exception_handler_timer (void);
+void exception_handler_lapic_timer (void);
 
 #endif //OS_TIMER_H
@@ -5,6 +5,7 @@
 #define TTY_H
 
 #include "ipc/sem.h"
+#include "ipc/spinlock.h"
 
 #define TTY_NR						8		// max tty device number
 #define TTY_IBUF_SIZE				512		// tty input buffer
@@ -17,8 +18,10 @@ typedef struct _tty_fifo_t {
 	int size;				// max byte number
 	int read, write;		// current writing/reading position
 	int count;				// current data counter
+	spinlock_t lock;		// written by kbd interrupt and read by task on other CPU
 }tty_fifo_t;
 
+void tty_fifo_init (tty_fifo_t * fifo, char * buf, int size);
 int tty_fifo_get (tty_fifo_t * fifo, char * c);
 int tty_fifo_put (tty_fifo_t * fifo, char c);
 
@@ -37,6 +40,7 @@ typedef struct _tty_t {
 	char ibuf[TTY_IBUF_SIZE];
 	tty_fifo_t ififo;				// output list(fifo)
 	sem_t isem;
+	waitq_t poll_wq;				// woken up on input
 
 	int iflags;						// input flag
     int oflags;						// output flag
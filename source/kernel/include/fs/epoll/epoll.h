@@ -0,0 +1,55 @@
+/**
+ * Epoll
+ * The interest set is kept in the kernel between the waits. Each file in it is watched
+ * all the time, its wake up puts it into the ready list, so a wait checks the files
+ * ready only instead of scanning all of them
+ */
+#ifndef EPOLL_H
+#define EPOLL_H
+
+#include "fs/file.h"
+#include "fs/poll.h"
+#include "ipc/mutex.h"
+#include "ipc/waitq.h"
+
+#define EPOLL_NR                8           // interest sets opened at the same time
+#define EPOLL_ITEM_NR           32          // files in one set
+
+struct _epoll_t;
+struct epoll_event;
+
+/**
+ * @brief File in the interest set
+ */
+typedef struct _epoll_item_t {
+    int used;
+    int fd;
+    file_t * file;
+    struct _epoll_t * ep;
+    unsigned int events;        // interested
+    unsigned int data;          // returned with the events
+
+    waitq_entry_t entry;        // watcher on the queue of the file
+    waitq_t * wq;               // 0 if the file is always ready
+    int ready;                  // in the ready list, it's checked on next wait
+    list_node_t ready_node;
+}epoll_item_t;
+
+/**
+ * @brief Interest set, released when its file is closed
+ */
+typedef struct _epoll_t {
+    int used;
+    mutex_t mutex;              // protect the items, held by epoll_ctl and epoll_wait
+    waitq_t wq;                 // tasks in epoll_wait, its lock protects the ready list
+    list_t ready_list;
+    epoll_item_t items[EPOLL_ITEM_NR];
+}epoll_t;
+
+void epoll_init (void);
+int epoll_open (file_t * file);
+void epoll_file_close (file_t * file);
+int sys_epoll_ctl (int epfd, int op, int fd, struct epoll_event * event);
+int sys_epoll_wait (int epfd, struct epoll_event * events, int maxevents, int timeout);
+
+#endif // EPOLL_H
@@ -5,6 +5,7 @@
 #define FAT_H
 
 #include "ipc/mutex.h"
+#include "ipc/rwlock.h"
 
 #pragma pack(1)    
 
@@ -88,9 +89,10 @@ typedef struct _fat_t {
     // write/read in file system
     uint8_t * fat_buffer;             		// FAT table entry buffer
     int curr_sector;                        // current buffer sector
+    mutex_t buf_mutex;                      // buffer shared by the readers
 
     struct _fs_t * fs;                      // current file system
-    mutex_t mutex;                         
+    rwlock_t rwlock;                         
 } fat_t;
 
 typedef uint16_t cluster_t;
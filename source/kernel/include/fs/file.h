@@ -17,6 +17,9 @@ typedef enum _file_type_t {
     FILE_TTY = 1,
     FILE_NORMAL,
     FILE_DIR,
+    FILE_PIPE,
+    FILE_EPOLL,
+    FILE_MQ,
 } file_type_t;
 
 struct _fs_t;
@@ -37,11 +40,14 @@ typedef struct _file_t {
     int cblk;                   // current block
     int p_index;                // index in parent dir
     int mode;					// write/read mode
+    int locked;                 // read with the file system shared, see file_lock
 
     struct _fs_t * fs;          // current file system
 } file_t;
 
 file_t * file_alloc (void) ;
+void file_lock (file_t * file);
+void file_unlock (file_t * file);
 void file_free (file_t * file);
 void file_table_init (void);
 void file_inc_ref (file_t * file);
@@ -12,6 +12,7 @@
 #include "ipc/mutex.h"
 
 struct _fs_t;
+struct _poll_table_t;
 
 /**
  * @brief File System operation interface
@@ -27,6 +28,13 @@ typedef struct _fs_op_t {
     int (*stat)(file_t * file, struct stat *st);
     int (*ioctl) (file_t * file, int cmd, int arg0, int arg1);
 
+    // optional, events ready and watch the changes, see fs/poll.h. always ready without it
+    int (*poll) (file_t * file, struct _poll_table_t * pt);
+
+    // optional, read/write at offset, or at the position if offset < 0
+    int (*preadv) (file_t * file, const struct iovec * iov, int iovcnt, int offset);
+    int (*pwritev) (file_t * file, const struct iovec * iov, int iovcnt, int offset);
+
     int (*opendir)(struct _fs_t * fs,const char * name, DIR * dir);
     int (*readdir)(struct _fs_t * fs, DIR* dir, struct dirent * dirent);
     int (*closedir)(struct _fs_t * fs,DIR *dir);
@@ -39,6 +47,9 @@ typedef struct _fs_op_t {
 typedef enum _fs_type_t {
     FS_FAT16,
     FS_DEVFS,
+    FS_PIPE,
+    FS_EPOLL,
+    FS_MQ,
 }fs_type_t;
 
 typedef struct _fs_t {
@@ -56,7 +67,7 @@ typedef struct _fs_t {
     union {
         fat_t fat_data;         // file system related data
     };
-    mutex_t * mutex;              // mutex
+    rwlock_t * rwlock;          // shared by the readers, held by one writer
 }fs_t;
 
 void fs_init (void);
@@ -67,7 +78,16 @@ int sys_open(const char *name, int flags, ...);
 int sys_read(int file, char *ptr, int len);
 int sys_write(int file, char *ptr, int len);
 int sys_lseek(int file, int ptr, int dir);
+int sys_readv (int file, const struct iovec * iov, int iovcnt);
+int sys_writev (int file, const struct iovec * iov, int iovcnt);
+int sys_pread (int file, char * ptr, int len, int offset);
+int sys_pwrite (int file, char * ptr, int len, int offset);
+int sys_sendfile (int out_fd, int in_fd, int * offset, int count);
+int sys_copy_file_range (copy_range_t * range);
 int sys_close(int file);
+int sys_pipe (int * fds, int flags);
+int sys_epoll_create (int size);
+int sys_mq_open (const char * name, int flags, mq_attr_t * attr);
 
 int sys_isatty(int file);
 int sys_fstat(int file, struct stat *st);
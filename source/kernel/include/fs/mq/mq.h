@@ -0,0 +1,59 @@
+/**
+ * Message queue
+ * Opened by name as a file. Messages are kept in one kernel page in the order of priorities,
+ * or in a ring page shared with user space if the queue is created with MQ_RING
+ */
+#ifndef MQ_H
+#define MQ_H
+
+#include "fs/file.h"
+#include "core/memory.h"
+#include "ipc/mutex.h"
+#include "ipc/cond.h"
+#include "ipc/waitq.h"
+#include "tools/list.h"
+#include "applib/lib_syscall.h"
+
+#define MQ_NR                   8           // queues at the same time, the rings are mapped from MEM_MQ_RING_START
+
+/**
+ * @brief Message in the page of the queue, the data follows
+ */
+typedef struct _mq_msg_t {
+    list_node_t node;
+    unsigned int prio;
+    int len;
+}mq_msg_t;
+
+/**
+ * @brief Message queue, released when it's unlinked and all its files are closed
+ */
+typedef struct _mq_t {
+    int used;
+    char name[MQ_NAME_SIZE];
+    int unlinked;               // can't be opened by name any more
+    int opens;                  // files opened
+    int flags;                  // MQ_RING
+    int maxmsg;
+    int msgsize;
+
+    mutex_t mutex;              // protect the messages
+    cond_t not_empty, not_full;
+    waitq_t poll_wq;            // woken up on every send and receive
+    uint32_t page;              // messages of the queue without MQ_RING
+    list_t msg_list;            // by priority from high to low, FIFO in the same one
+    list_t free_list;
+
+    mq_ring_t * ring;           // ring page of the queue with MQ_RING
+    uint32_t ring_vaddr;        // where the processes opening the queue see it
+}mq_t;
+
+void mq_init (void);
+int mq_file_open (file_t * file, const char * name, int flags, mq_attr_t * attr);
+void mq_file_unmap (file_t * file, int fd);
+int sys_mq_unlink (const char * name);
+int sys_mq_send (int mqd, const char * msg, int len, unsigned int prio);
+int sys_mq_receive (int mqd, char * buf, int len, unsigned int * prio);
+int sys_mq_getattr (int mqd, mq_attr_t * attr);
+
+#endif // MQ_H
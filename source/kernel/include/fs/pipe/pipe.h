@@ -0,0 +1,51 @@
+/**
+ * Pipe
+ * Data is kept in a ring of kernel pages. A whole page read into a page aligned
+ * buffer is mapped to the reader instead of being copied. Writes are always copied
+ */
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "fs/file.h"
+#include "ipc/mutex.h"
+#include "ipc/sem.h"
+
+#define PIPE_NR                 32          // pipes opened at the same time
+#define PIPE_PAGE_NR            16          // pages in the ring of one pipe
+#define PIPE_SPARE_NR           2           // free pages kept by a pipe for the next writes
+
+/**
+ * @brief One page in the ring
+ */
+typedef struct _pipe_buf_t {
+    uint32_t page;
+    int offset;                 // the first byte not read
+    int len;                    // bytes not read
+}pipe_buf_t;
+
+/**
+ * @brief Pipe, released when both ends are closed
+ */
+typedef struct _pipe_t {
+    int used;
+    mutex_t mutex;
+
+    pipe_buf_t bufs[PIPE_PAGE_NR];
+    int head;                   // the first buffer to read
+    int count;                  // buffers in the ring
+
+    uint32_t spare[PIPE_SPARE_NR];
+    int spare_count;
+
+    int readers, writers;       // opened files of each end
+
+    // tasks waiting for data or for free space
+    int read_waiters, write_waiters;
+    sem_t read_sem, write_sem;
+    waitq_t poll_wq;            // woken up on every read, write and close
+}pipe_t;
+
+void pipe_init (void);
+int pipe_open (file_t * rfile, file_t * wfile);
+
+#endif // PIPE_H
@@ -0,0 +1,37 @@
+/**
+ * Poll
+ * A task waits for many files at once. The poll op of a file returns the events ready
+ * and watches the wait queue woken up when they change, the first change wakes up the task
+ */
+#ifndef POLL_H
+#define POLL_H
+
+#include "fs/file.h"
+#include "ipc/waitq.h"
+
+struct _poll_table_t;
+struct pollfd;
+
+typedef void (*poll_queue_t)(struct _poll_table_t * pt, waitq_t * wq);
+
+/**
+ * @brief Given to the poll op, queue adds a watcher to the wait queue of the file
+ */
+typedef struct _poll_table_t {
+    poll_queue_t queue;
+}poll_table_t;
+
+/**
+ * @brief Watch the queue woken up when the events of the file change, pt may be NULL
+ */
+static inline void poll_wait (poll_table_t * pt, waitq_t * wq) {
+    if (pt && pt->queue) {
+        pt->queue(pt, wq);
+    }
+}
+
+void poll_wakeup (waitq_t * wq);
+int file_poll (file_t * file, poll_table_t * pt);
+int sys_poll (struct pollfd * fds, int nfds, int timeout);
+
+#endif // POLL_H
@@ -0,0 +1,24 @@
+/**
+ * Condition variable
+ */
+#ifndef COND_H
+#define COND_H
+
+#include "ipc/waitq.h"
+#include "ipc/mutex.h"
+
+/**
+ * @brief Tasks wait for a condition protected by a mutex, they check it again after woken up
+ */
+typedef struct _cond_t {
+    waitq_t wq;
+    uint32_t seq;           // increased by every signal, a waiter sleeps only if it's not changed
+}cond_t;
+
+void cond_init (cond_t * cond);
+int cond_wait (cond_t * cond, mutex_t * mutex);
+int cond_timedwait (cond_t * cond, mutex_t * mutex, uint64_t timeout_ns);
+void cond_signal (cond_t * cond);
+void cond_broadcast (cond_t * cond);
+
+#endif // COND_H
@@ -0,0 +1,32 @@
+/**
+ * Futex
+ * The lock word is in user memory, the kernel is entered only to sleep on it
+ * or to wake up the sleepers. Waiters are hashed by the physical address of the word,
+ * so the threads of a process and the processes sharing the page meet in the same queue
+ */
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+#include "ipc/spinlock.h"
+
+#define FUTEX_HASH_NR           64          // wait queues, must be power of 2
+
+/**
+ * @brief Waiters of the words hashed to the same bucket
+ */
+typedef struct _futex_bucket_t {
+    spinlock_t lock;
+    list_t wait_list;
+}futex_bucket_t;
+
+struct timespec;
+
+struct _task_t;
+
+void futex_init (void);
+void futex_wake_killed (struct _task_t * leader);
+int sys_futex (uint32_t * uaddr, int op, uint32_t val, const struct timespec * timeout);
+
+#endif // FUTEX_H
@@ -6,18 +6,25 @@
 
 #include "core/task.h"
 #include "tools/list.h"
+#include "ipc/spinlock.h"
+
+#define MUTEX_PI_DEPTH          8       // owners boosted along a chain of mutexes, stops a deadlock cycle
 
 /**
- * Counting semaphore used for process synchronization
+ * Mutex with priority inheritance, the owner runs by the earliest deadline of the waiters
  */
 typedef struct _mutex_t {
+    spinlock_t lock;        // protect the fields below between CPUs
     task_t * owner;
     int locked_count;
-    list_t wait_list;
+    list_t wait_list;       // by deadline, the normal tasks after the deadline ones in FIFO order
+    list_node_t pi_node;    // in pi_list of owner while there are waiters
 }mutex_t;
 
 void mutex_init (mutex_t * mutex);
 void mutex_lock (mutex_t * mutex);
+int mutex_trylock (mutex_t * mutex);
 void mutex_unlock (mutex_t * mutex);
+void mutex_unlock_sync (mutex_t * mutex);
  
 #endif //MUTEX_H
@@ -0,0 +1,32 @@
+/**
+ * Reader-writer lock
+ */
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include "core/task.h"
+#include "ipc/waitq.h"
+
+#define RWLOCK_READ             0           // data of the waiters
+#define RWLOCK_WRITE            1
+
+/**
+ * @brief Many readers or one writer. Writers are preferred, new readers wait while a writer
+ * is waiting, so a stream of readers can't starve it. The writer can accquire it again,
+ * readers can't, they would wait for the writer waiting for them
+ */
+typedef struct _rwlock_t {
+    waitq_t wq;                 // its lock protects the fields below
+    int readers;                // holding it for reading
+    task_t * writer;            // holding it for writing
+    int write_count;            // times accquired by the writer
+    int writers_waiting;
+}rwlock_t;
+
+void rwlock_init (rwlock_t * rwlock);
+void rwlock_read_lock (rwlock_t * rwlock);
+void rwlock_read_unlock (rwlock_t * rwlock);
+void rwlock_write_lock (rwlock_t * rwlock);
+void rwlock_write_unlock (rwlock_t * rwlock);
+
+#endif // RWLOCK_H
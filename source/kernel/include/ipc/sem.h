@@ -4,19 +4,23 @@
 #ifndef OS_SEM_H
 #define OS_SEM_H
 
-#include "tools/list.h"
+#include "ipc/waitq.h"
+#include "comm/types.h"
 
 /**
  * Semaphore
  */
 typedef struct _sem_t {
+    waitq_t wq;             // its lock protects count too
     int count;				
-    list_t wait_list;
 }sem_t;
 
 void sem_init (sem_t * sem, int init_count);
-void sem_wait (sem_t * sem);
+int sem_wait (sem_t * sem);
+void sem_wait_nokill (sem_t * sem);
+int sem_timedwait (sem_t * sem, uint64_t timeout_ns);
 void sem_notify (sem_t * sem);
+void sem_notify_sync (sem_t * sem);
 int sem_count (sem_t * sem);
 
 #endif //OS_SEM_H
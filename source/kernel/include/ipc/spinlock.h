@@ -0,0 +1,26 @@
+/**
+ * Spinlock
+ */
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "comm/types.h"
+#include "cpu/irq.h"
+
+/**
+ * Busy-waiting lock, used where disabling interrupts on the local CPU
+ * is not enough because another CPU may touch the same data
+ */
+typedef struct _spinlock_t {
+    volatile uint32_t locked;
+}spinlock_t;
+
+void spin_init (spinlock_t * lock);
+void spin_lock (spinlock_t * lock);
+int spin_trylock (spinlock_t * lock);
+void spin_unlock (spinlock_t * lock);
+
+irq_state_t spin_lock_protect (spinlock_t * lock);
+void spin_unlock_protect (spinlock_t * lock, irq_state_t state);
+
+#endif // SPINLOCK_H
@@ -0,0 +1,64 @@
+/**
+ * Wait queue
+ * The common part of the sleeping primitives: tasks sleep on the queue until they
+ * are woken up or their timeout is over. The owner of the queue keeps its condition
+ * under the lock of the queue, so no wake up is lost between the check and the sleep.
+ * The kill of the process wakes its tasks up from waitq_wait, but not from waitq_wait_nokill
+ */
+#ifndef WAITQ_H
+#define WAITQ_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+#include "ipc/spinlock.h"
+#include "core/hrtimer.h"
+
+#define WAITQ_SKIP              0           // return of waitq_pred_t, leave the waiter sleeping
+#define WAITQ_WAKE              1           // wake it up
+#define WAITQ_STOP              -1          // leave it and the waiters after it sleeping
+
+struct _task_t;
+struct _waitq_entry_t;
+
+// called by the waker instead of making the task ready, the entry is left in the queue
+typedef void (*waitq_func_t)(struct _waitq_entry_t * entry);
+
+/**
+ * @brief Queue of the sleeping tasks, in FIFO order
+ */
+typedef struct _waitq_t {
+    spinlock_t lock;            // protect the list and the condition of the owner
+    list_t list;
+}waitq_t;
+
+/**
+ * @brief Waiter on the stack of the sleeping task
+ */
+typedef struct _waitq_entry_t {
+    list_node_t node;
+    struct _task_t * task;
+    int data;                   // given by the waiter for the predicate, e.g. reader or writer
+    int done;                   // 0 sleeping, 1 woken up, -1 time is out
+    waitq_t * wq;
+    hrtimer_t timer;
+
+    // watcher added by waitq_add, e.g. poll on many queues, removed by its owner
+    waitq_func_t func;
+    void * arg;
+}waitq_entry_t;
+
+typedef int (*waitq_pred_t)(waitq_entry_t * entry, void * arg);
+
+void waitq_init (waitq_t * wq);
+int waitq_wait (waitq_t * wq, int data, uint64_t timeout_ns);
+void waitq_wait_nokill (waitq_t * wq, int data);
+void waitq_wake_killed (struct _task_t * task);
+void waitq_add (waitq_t * wq, waitq_entry_t * entry, waitq_func_t func, void * arg);
+void waitq_remove (waitq_t * wq, waitq_entry_t * entry);
+int waitq_wake (waitq_t * wq, int nr);
+int waitq_wake_sync (waitq_t * wq);
+int waitq_wake_all (waitq_t * wq);
+int waitq_wake_if (waitq_t * wq, waitq_pred_t pred, void * arg);
+int waitq_count (waitq_t * wq);
+
+#endif // WAITQ_H
@@ -7,10 +7,14 @@
 #define GDT_TABLE_SIZE      	256		// GDT number
 #define KERNEL_SELECTOR_CS		(1 * 8)		// kernel code descriptor
 #define KERNEL_SELECTOR_DS		(2 * 8)		// kernel data descriptor
+#define APP_SELECTOR_CS			(3 * 8)		// app code descriptor, SYSEXIT needs it right after the kernel ones
+#define APP_SELECTOR_DS			(4 * 8)		// app data descriptor
 #define KERNEL_STACK_SIZE       (8*1024)    // kernel stack
-#define SELECTOR_SYSCALL     	(3 * 8)	// call gate selector
+#define SELECTOR_SYSCALL     	(5 * 8)	// call gate selector
 
 #define OS_TICK_MS              10       	// number of clock cycles per millisecond
+#define OS_TICK_LAPIC           1           // tick from local APIC timer if present, otherwise PIT
+#define OS_TIMER_SLACK_NS       50000       // default time a sleep may be delayed, to share the timer interrupt
 
 #define OS_VERSION              "0.0.1"     // OS version
 
@@ -18,6 +22,9 @@
 
 #define TASK_NR             128            // process number
 
+#define CPU_NR              8               // max supported CPU number
+#define AP_TRAMPOLINE_ADDR  0x8000          // AP start up code, reuse loader memory, 4KB aligned
+
 #define ROOT_DEV            DEV_DISK, 0xb1  // device root dir located in
 
 #endif //OS_OS_CFG_H
@@ -32,20 +32,15 @@ int first_task_main (void) {
 #endif
 
     for (int i = 0; i < TTY_NR; i++) {
-        int pid = fork();
+        char tty_num[] = "/dev/tty?";
+        tty_num[sizeof(tty_num) - 2] = i + '0';
+        char * argv[] = {tty_num, (char *)0};
+
+        // the shell opens its tty itself, no file to pass
+        int pid = spawn("shell.elf", argv, (char **)0, (const int *)0);
         if (pid < 0) {
             print_msg("create shell proc failed", 0);
             break;
-        } else if (pid == 0) {
-            // child process
-            char tty_num[] = "/dev/tty?";
-            tty_num[sizeof(tty_num) - 2] = i + '0';
-            char * argv[] = {tty_num, (char *)0};
-            execve("shell.elf", argv, (char **)0);
-            print_msg("create shell proc failed", 0);
-            while (1) {
-                msleep(10000);
-            }
         }
     }
 
@@ -57,4 +52,4 @@ int first_task_main (void) {
     }
 
     return 0;
-} 
\ No newline at end of file
+} 
\ No newline at end of file
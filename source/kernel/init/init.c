@@ -5,6 +5,8 @@
 #include "comm/cpu_instr.h"
 #include "cpu/cpu.h"
 #include "cpu/irq.h"
+#include "cpu/smp.h"
+#include "cpu/fpu.h"
 #include "dev/time.h"
 #include "tools/log.h"
 #include "core/task.h"
@@ -12,10 +14,14 @@
 #include "tools/klib.h"
 #include "tools/list.h"
 #include "ipc/sem.h"
+#include "ipc/futex.h"
 #include "core/memory.h"
 #include "dev/console.h"
 #include "dev/kbd.h"
 #include "fs/fs.h"
+#include "core/work.h"
+#include "core/uring.h"
+#include "core/syscall.h"
 
 static boot_info_t * init_boot_info;        // boot info
 
@@ -29,14 +35,24 @@ void kernel_init (boot_info_t * boot_info) {
     cpu_init();
     irq_init();
     log_init();
+    fpu_init();
 
     // memory init should put in front of file system(tty device)
     memory_init(boot_info);
     fs_init();
+    uring_table_init();
+    syscall_init();
+    futex_init();
 
     time_init();
 
+    // find all CPUs before creating their idle tasks
+    smp_init();
+
     task_manager_init();
+
+    // bottom halves of interrupts
+    work_queue_init();
 }
 
 
@@ -69,5 +85,9 @@ void init_main(void) {
 
     // init task
     task_first_init();
+
+    // other CPUs join after the first task is on the BSP, and take tasks from it later
+    smp_start_ap();
+
     move_to_first_task();
 }
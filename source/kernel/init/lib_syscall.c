@@ -59,6 +59,16 @@ int fork() {
     return sys_call(&args);
 }
 
+int spawn(const char *name, char * const *argv, char * const *env, const int * fd_map) {
+    syscall_args_t args;
+    args.id = SYS_spawn;
+    args.arg0 = (int)name;
+    args.arg1 = (int)argv;
+    args.arg2 = (int)env;
+    args.arg3 = (int)fd_map;
+    return sys_call(&args);
+}
+
 int execve(const char *name, char * const *argv, char * const *env) {
     syscall_args_t args;
     args.id = SYS_execve;
@@ -0,0 +1,72 @@
+/**
+ * Condition variable
+ */
+#include "cpu/irq.h"
+#include "ipc/cond.h"
+
+void cond_init (cond_t * cond) {
+    waitq_init(&cond->wq);
+    cond->seq = 0;
+}
+
+/**
+ * @brief Release the mutex and sleep, then accquire the mutex again
+ * the signal between them is seen by the changed seq, so it's not lost
+ * return 0 if signaled, -1 if time is out or the process is killed
+ */
+int cond_timedwait (cond_t * cond, mutex_t * mutex, uint64_t timeout_ns) {
+    irq_state_t irq_state = spin_lock_protect(&cond->wq.lock);
+    uint32_t seq = cond->seq;
+    spin_unlock_protect(&cond->wq.lock, irq_state);
+
+    // the mutex may wake up its waiter, it can't be released with the spinlock held
+    mutex_unlock(mutex);
+
+    int err = 0;
+    irq_state = spin_lock_protect(&cond->wq.lock);
+    if (seq == cond->seq) {
+        err = waitq_wait(&cond->wq, 0, timeout_ns);
+    }
+    spin_unlock_protect(&cond->wq.lock, irq_state);
+
+    mutex_lock(mutex);
+    return err;
+}
+
+/**
+ * @brief Wait until signaled, the caller should check its condition again
+ * return -1 if the process is killed, the caller should give up
+ */
+int cond_wait (cond_t * cond, mutex_t * mutex) {
+    return cond_timedwait(cond, mutex, 0);
+}
+
+/**
+ * @brief Wake up one waiter, or all of them
+ */
+static void cond_wake (cond_t * cond, int all) {
+    irq_state_t irq_state = spin_lock_protect(&cond->wq.lock);
+
+    cond->seq++;
+    int count = all ? waitq_wake_all(&cond->wq) : waitq_wake(&cond->wq, 1);
+    spin_unlock(&cond->wq.lock);
+
+    if (count) {
+        task_dispatch();
+    }
+    irq_leave_protection(irq_state);
+}
+
+/**
+ * @brief Wake up one waiter
+ */
+void cond_signal (cond_t * cond) {
+    cond_wake(cond, 0);
+}
+
+/**
+ * @brief Wake up all the waiters
+ */
+void cond_broadcast (cond_t * cond) {
+    cond_wake(cond, 1);
+}
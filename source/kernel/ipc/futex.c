@@ -0,0 +1,198 @@
+/**
+ * Futex
+ */
+#include "ipc/futex.h"
+#include "core/task.h"
+#include "core/memory.h"
+#include "core/hrtimer.h"
+#include "cpu/irq.h"
+#include "dev/time.h"
+#include "comm/clock.h"
+#include "applib/lib_syscall.h"
+
+static futex_bucket_t futex_table[FUTEX_HASH_NR];
+
+/**
+ * @brief Waiter on the stack of the waiting task
+ */
+typedef struct _futex_waiter_t {
+    list_node_t node;
+    uint32_t key;               // physical address of the word
+    task_t * task;
+    futex_bucket_t * bucket;
+    hrtimer_t timer;
+    int timeout;                // woken up by timer, not by futex wake
+}futex_waiter_t;
+
+void futex_init (void) {
+    for (int i = 0; i < FUTEX_HASH_NR; i++) {
+        spin_init(&futex_table[i].lock);
+        list_init(&futex_table[i].wait_list);
+    }
+}
+
+/**
+ * @brief Get the physical address of the word in current process, 0 if it's invalid
+ */
+static uint32_t futex_key (uint32_t * uaddr) {
+    uint32_t vaddr = (uint32_t)uaddr;
+    if ((vaddr < MEMORY_TASK_BASE) || (vaddr & 0x3)) {
+        return 0;
+    }
+    return memory_get_paddr(task_current()->tss.cr3, vaddr);
+}
+
+static futex_bucket_t * futex_bucket (uint32_t key) {
+    // the words are 4 bytes aligned, and often in different cache lines
+    return futex_table + (((key >> 2) ^ (key >> 12)) & (FUTEX_HASH_NR - 1));
+}
+
+/**
+ * @brief Wake up the task if it's still waiting when time is out, in timer interrupt
+ */
+static void futex_timeout (hrtimer_t * timer) {
+    futex_waiter_t * waiter = (futex_waiter_t *)timer->data;
+    futex_bucket_t * bucket = waiter->bucket;
+
+    spin_lock(&bucket->lock);
+
+    // futex wake may have removed it just now
+    for (list_node_t * node = list_first(&bucket->wait_list); node; node = list_node_next(node)) {
+        if (node == &waiter->node) {
+            list_remove(&bucket->wait_list, node);
+            waiter->timeout = 1;
+            task_set_ready(waiter->task);
+            break;
+        }
+    }
+
+    spin_unlock(&bucket->lock);
+}
+
+/**
+ * @brief Sleep if the word is still val, until woken up or timeout_ns passed, 0 for no timeout
+ * return 0 if woken up, -1 if the word has changed or time is out
+ */
+static int futex_wait (uint32_t * uaddr, uint32_t key, uint32_t val, uint64_t timeout_ns) {
+    futex_bucket_t * bucket = futex_bucket(key);
+    irq_state_t irq_state = spin_lock_protect(&bucket->lock);
+
+    // checked with the bucket locked, no wake can be lost between the check and sleep
+    // nor the kill of the process, see futex_wake_killed
+    task_t * curr = task_current();
+    if ((*(volatile uint32_t *)uaddr != val) || (curr->flags & TASK_FLAG_KILL)) {
+        spin_unlock_protect(&bucket->lock, irq_state);
+        return -1;
+    }
+
+    futex_waiter_t waiter;
+    waiter.key = key;
+    waiter.task = curr;
+    waiter.bucket = bucket;
+    waiter.timeout = 0;
+    hrtimer_init(&waiter.timer, futex_timeout, &waiter);
+
+    task_set_block(curr);
+    list_insert_last(&bucket->wait_list, &waiter.node);
+    if (timeout_ns) {
+        hrtimer_start(&waiter.timer, time_ns() + timeout_ns, curr->timer_slack);
+    }
+    spin_unlock(&bucket->lock);
+    task_dispatch();
+
+    irq_leave_protection(irq_state);
+
+    // the waiter is on the stack, make sure the timer function has returned
+    if (timeout_ns) {
+        hrtimer_cancel(&waiter.timer);
+    }
+    return waiter.timeout ? -1 : 0;
+}
+
+/**
+ * @brief Wake up at most count tasks waiting on the word, return the number woken up
+ */
+static int futex_wake (uint32_t key, int count) {
+    futex_bucket_t * bucket = futex_bucket(key);
+    int woken = 0;
+
+    irq_state_t irq_state = spin_lock_protect(&bucket->lock);
+    list_node_t * node = list_first(&bucket->wait_list);
+    while (node && (woken < count)) {
+        list_node_t * next = list_node_next(node);
+
+        futex_waiter_t * waiter = list_node_parent(node, futex_waiter_t, node);
+        if (waiter->key == key) {
+            list_remove(&bucket->wait_list, node);
+            task_set_ready(waiter->task);
+            woken++;
+        }
+        node = next;
+    }
+    spin_unlock(&bucket->lock);
+
+    if (woken) {
+        task_dispatch();
+    }
+    irq_leave_protection(irq_state);
+    return woken;
+}
+
+/**
+ * @brief Wake up the threads of leader killed by the exit of the process, they return -1
+ * the kill flag is set before, the ones not found here see it before sleeping
+ */
+void futex_wake_killed (task_t * leader) {
+    for (int i = 0; i < FUTEX_HASH_NR; i++) {
+        futex_bucket_t * bucket = futex_table + i;
+
+        irq_state_t irq_state = spin_lock_protect(&bucket->lock);
+        list_node_t * node = list_first(&bucket->wait_list);
+        while (node) {
+            list_node_t * next = list_node_next(node);
+
+            futex_waiter_t * waiter = list_node_parent(node, futex_waiter_t, node);
+            if ((waiter->task->leader == leader) && (waiter->task->flags & TASK_FLAG_KILL)) {
+                list_remove(&bucket->wait_list, node);
+                waiter->timeout = 1;
+                task_set_ready(waiter->task);
+            }
+            node = next;
+        }
+        spin_unlock_protect(&bucket->lock, irq_state);
+    }
+}
+
+/**
+ * @brief Wait on or wake the waiters of the word at uaddr
+ * FUTEX_WAIT: sleep if *uaddr == val, with the relative timeout if it's not null
+ * FUTEX_WAKE: wake up at most val waiters, return the number woken up
+ */
+int sys_futex (uint32_t * uaddr, int op, uint32_t val, const struct timespec * timeout) {
+    uint32_t key = futex_key(uaddr);
+    if (key == 0) {
+        return -1;
+    }
+
+    switch (op) {
+        case FUTEX_WAIT: {
+            uint64_t timeout_ns = 0;
+            if (timeout) {
+                if ((timeout->tv_sec < 0) || (timeout->tv_nsec < 0) || (timeout->tv_nsec >= NSEC_PER_SEC)) {
+                    return -1;
+                }
+
+                // 0 means forever below, the shortest wait instead
+                timeout_ns = (uint64_t)timeout->tv_sec * NSEC_PER_SEC + timeout->tv_nsec;
+                if (timeout_ns == 0) {
+                    timeout_ns = 1;
+                }
+            }
+            return futex_wait(uaddr, key, val, timeout_ns);
+        }
+        case FUTEX_WAKE:
+            return futex_wake(key, (int)val);
+        default:
+            return -1;
+    }
+}
@@ -4,34 +4,106 @@
 #include "cpu/irq.h"
 #include "ipc/mutex.h"
 
+// protect the wait lists of all mutexes and the inheritance of their owners, zero means unlocked
+static spinlock_t pi_lock;
+
 /**
  * Mutex initization
  */
 void mutex_init (mutex_t * mutex) {
+    spin_init(&mutex->lock);
     mutex->locked_count = 0;
     mutex->owner = (task_t *)0;
     list_init(&mutex->wait_list);
+    list_node_init(&mutex->pi_node);
+}
+
+/**
+ * @brief Insert the task into the wait list by its deadline, the normal ones are in FIFO order
+ * pi_lock should be held
+ */
+static void pi_enqueue (mutex_t * mutex, task_t * task) {
+    uint64_t deadline = task_sched_deadline(task);
+    list_node_t * pos = list_first(&mutex->wait_list);
+    while (pos && (task_sched_deadline(list_node_parent(pos, task_t, wait_node)) <= deadline)) {
+        pos = list_node_next(pos);
+    }
+    list_insert_before(&mutex->wait_list, pos, &task->wait_node);
+}
+
+/**
+ * @brief The earliest deadline of the waiters of the mutexes held by task, pi_lock should be held
+ */
+static uint64_t pi_top_deadline (task_t * task) {
+    uint64_t deadline = SCHED_NO_DEADLINE;
+    for (list_node_t * node = list_first(&task->pi_list); node; node = list_node_next(node)) {
+        mutex_t * mutex = list_node_parent(node, mutex_t, pi_node);
+        task_t * waiter = list_node_parent(list_first(&mutex->wait_list), task_t, wait_node);
+        uint64_t curr = task_sched_deadline(waiter);
+        if (curr < deadline) {
+            deadline = curr;
+        }
+    }
+    return deadline;
+}
+
+/**
+ * @brief The waiters of mutex have changed, update the owner, then the owner of the mutex
+ * the owner is waiting for, and so on. pi_lock should be held
+ */
+static void pi_propagate (mutex_t * mutex) {
+    for (int depth = 0; mutex && (depth < MUTEX_PI_DEPTH); depth++) {
+        task_t * owner = mutex->owner;
+        if (owner == (task_t *)0) {
+            break;
+        }
+
+        uint64_t deadline = pi_top_deadline(owner);
+        if (deadline == owner->pi_deadline) {
+            break;
+        }
+        task_pi_set(owner, deadline);
+
+        // the owner is a waiter too, move it to the new position
+        mutex = owner->pi_blocked_on;
+        if (mutex) {
+            list_remove(&mutex->wait_list, &owner->wait_node);
+            pi_enqueue(mutex, owner);
+        }
+    }
 }
 
 /**
  * Accquire Mutex
  */
 void mutex_lock (mutex_t * mutex) {
-    irq_state_t  irq_state = irq_enter_protection();
+    irq_state_t  irq_state = spin_lock_protect(&mutex->lock);
 
     task_t * curr = task_current();
     if (mutex->locked_count == 0) {
         // no task
         mutex->locked_count = 1;
         mutex->owner = curr;
+        spin_unlock(&mutex->lock);
     } else if (mutex->owner == curr) {
         // owned by current task, add count
         mutex->locked_count++;
+        spin_unlock(&mutex->lock);
     } else {
-        // owned by other task, add waiting queue
-        task_t * curr = task_current();
+        // owned by other task, add waiting queue by priority, and lend it to the owner
+        // unlock before switching, the owner may wake us up on other CPU before that, it's fine
         task_set_block(curr);
-        list_insert_last(&mutex->wait_list, &curr->wait_node);
+
+        spin_lock(&pi_lock);
+        pi_enqueue(mutex, curr);
+        curr->pi_blocked_on = mutex;
+        if (list_count(&mutex->wait_list) == 1) {
+            list_insert_last(&mutex->owner->pi_list, &mutex->pi_node);
+        }
+        pi_propagate(mutex);
+        spin_unlock(&pi_lock);
+
+        spin_unlock(&mutex->lock);
         task_dispatch();
     }
 
@@ -39,10 +111,32 @@ void mutex_lock (mutex_t * mutex) {
 }
 
 /**
- * Release Mutex
+ * Accquire Mutex without waiting
+ * return 0 if it's accquired or already owned by current task, -1 if owned by other task
  */
-void mutex_unlock (mutex_t * mutex) {
-    irq_state_t  irq_state = irq_enter_protection();
+int mutex_trylock (mutex_t * mutex) {
+    irq_state_t  irq_state = spin_lock_protect(&mutex->lock);
+
+    int err = 0;
+    task_t * curr = task_current();
+    if (mutex->locked_count == 0) {
+        mutex->locked_count = 1;
+        mutex->owner = curr;
+    } else if (mutex->owner == curr) {
+        mutex->locked_count++;
+    } else {
+        err = -1;
+    }
+
+    spin_unlock_protect(&mutex->lock, irq_state);
+    return err;
+}
+
+/**
+ * Release Mutex, hand the CPU over to the waiter if sync is set
+ */
+static void mutex_release (mutex_t * mutex, int sync) {
+    irq_state_t  irq_state = spin_lock_protect(&mutex->lock);
 
     // the ownner of the mutex can release
     task_t * curr = task_current();
@@ -51,20 +145,59 @@ void mutex_unlock (mutex_t * mutex) {
             // decrease to 0, release the mutex
             mutex->owner = (task_t *)0;
 
-            // if there is task waiting in the queue, wake up and accquire the mutex
+            // if there is task waiting in the queue, wake up the first one and give the mutex to it
+            spin_lock(&pi_lock);
             if (list_count(&mutex->wait_list)) {
                 list_node_t * task_node = list_remove_first(&mutex->wait_list);
                 task_t * task = list_node_parent(task_node, task_t, wait_node);
-                task_set_ready(task);
+                task->pi_blocked_on = (mutex_t *)0;
 
                 mutex->locked_count = 1;
                 mutex->owner = task;
 
-                task_dispatch();
+                // the rest waiters lend their priority to the new owner, not us
+                list_remove(&curr->pi_list, &mutex->pi_node);
+                if (list_count(&mutex->wait_list)) {
+                    list_insert_last(&task->pi_list, &mutex->pi_node);
+                    pi_propagate(mutex);
+                }
+                uint64_t deadline = pi_top_deadline(curr);
+                if (deadline != curr->pi_deadline) {
+                    task_pi_set(curr, deadline);
+                }
+                spin_unlock(&pi_lock);
+
+                if (sync) {
+                    task_set_ready_sync(task);
+                } else {
+                    task_set_ready(task);
+                }
+                spin_unlock(&mutex->lock);
+
+                // with sync, it runs when current task blocks
+                if (!sync) {
+                    task_dispatch();
+                }
+                irq_leave_protection(irq_state);
+                return;
             }
+            spin_unlock(&pi_lock);
         }
     }
 
-    irq_leave_protection(irq_state);
+    spin_unlock_protect(&mutex->lock, irq_state);
 }
 
+/**
+ * Release Mutex
+ */
+void mutex_unlock (mutex_t * mutex) {
+    mutex_release(mutex, 0);
+}
+
+/**
+ * Release Mutex when current task is going to block, the waiter runs next on this CPU
+ */
+void mutex_unlock_sync (mutex_t * mutex) {
+    mutex_release(mutex, 1);
+}
@@ -0,0 +1,113 @@
+/**
+ * Reader-writer lock
+ */
+#include "cpu/irq.h"
+#include "ipc/rwlock.h"
+
+void rwlock_init (rwlock_t * rwlock) {
+    waitq_init(&rwlock->wq);
+    rwlock->readers = 0;
+    rwlock->writer = (task_t *)0;
+    rwlock->write_count = 0;
+    rwlock->writers_waiting = 0;
+}
+
+/**
+ * @brief Choose the first writer, arg points to the number chosen
+ */
+static int rwlock_first_writer (waitq_entry_t * entry, void * arg) {
+    int * count = (int *)arg;
+    if (*count) {
+        return WAITQ_STOP;
+    } else if (entry->data == RWLOCK_WRITE) {
+        (*count)++;
+        return WAITQ_WAKE;
+    }
+    return WAITQ_SKIP;
+}
+
+/**
+ * @brief Wake up the first writer, or all the readers if no writer is waiting
+ * rwlock->wq.lock should be held
+ */
+static int rwlock_wake (rwlock_t * rwlock) {
+    if (rwlock->writers_waiting) {
+        int count = 0;
+        return waitq_wake_if(&rwlock->wq, rwlock_first_writer, &count);
+    }
+    return waitq_wake_all(&rwlock->wq);
+}
+
+/**
+ * @brief Accquire for reading, wait while it's written or a writer is waiting
+ */
+void rwlock_read_lock (rwlock_t * rwlock) {
+    irq_state_t irq_state = spin_lock_protect(&rwlock->wq.lock);
+
+    // woken up by the release, check again, another writer may come first
+    while (rwlock->writer || rwlock->writers_waiting) {
+        waitq_wait_nokill(&rwlock->wq, RWLOCK_READ);
+    }
+    rwlock->readers++;
+
+    spin_unlock_protect(&rwlock->wq.lock, irq_state);
+}
+
+/**
+ * @brief Release for reading, the last reader lets the writer go
+ */
+void rwlock_read_unlock (rwlock_t * rwlock) {
+    irq_state_t irq_state = spin_lock_protect(&rwlock->wq.lock);
+
+    int count = 0;
+    if ((--rwlock->readers == 0) && rwlock->writers_waiting) {
+        count = rwlock_wake(rwlock);
+    }
+    spin_unlock(&rwlock->wq.lock);
+
+    if (count) {
+        task_dispatch();
+    }
+    irq_leave_protection(irq_state);
+}
+
+/**
+ * @brief Accquire for writing, wait until no reader or other writer holds it
+ */
+void rwlock_write_lock (rwlock_t * rwlock) {
+    irq_state_t irq_state = spin_lock_protect(&rwlock->wq.lock);
+
+    task_t * curr = task_current();
+    if (rwlock->writer == curr) {
+        rwlock->write_count++;
+    } else {
+        rwlock->writers_waiting++;
+        while (rwlock->writer || rwlock->readers) {
+            waitq_wait_nokill(&rwlock->wq, RWLOCK_WRITE);
+        }
+        rwlock->writers_waiting--;
+        rwlock->writer = curr;
+        rwlock->write_count = 1;
+    }
+
+    spin_unlock_protect(&rwlock->wq.lock, irq_state);
+}
+
+/**
+ * @brief Release for writing, the waiting writer goes first, then the readers
+ */
+void rwlock_write_unlock (rwlock_t * rwlock) {
+    irq_state_t irq_state = spin_lock_protect(&rwlock->wq.lock);
+
+    int count = 0;
+    if ((rwlock->writer == task_current()) && (--rwlock->write_count == 0)) {
+        rwlock->writer = (task_t *)0;
+        count = rwlock_wake(rwlock);
+    }
+    spin_unlock(&rwlock->wq.lock);
+
+    if (count) {
+        task_dispatch();
+    }
+    irq_leave_protection(irq_state);
+}
@@ -9,56 +9,107 @@
  * Semaphore initization
  */
 void sem_init (sem_t * sem, int init_count) {
+    waitq_init(&sem->wq);
     sem->count = init_count;
-    list_init(&sem->wait_list);
 }
 
 /**
  * Acquire Semaphore
+ * return 0 if acquired, -1 if the process is killed while waiting
  */
-void sem_wait (sem_t * sem) {
-    irq_state_t  irq_state = irq_enter_protection();
+int sem_wait (sem_t * sem) {
+    irq_state_t  irq_state = spin_lock_protect(&sem->wq.lock);
 
+    int err = 0;
     if (sem->count > 0) {
         sem->count--;
     } else {
-        // remove from the ready queue, then add waiting queue
-        task_t * curr = task_current();
-        task_set_block(curr);
-        list_insert_last(&sem->wait_list, &curr->wait_node);
-        task_dispatch();
+        // the count is handed over to us by sem_notify, no need to check again
+        err = waitq_wait(&sem->wq, 0, 0);
     }
 
-    irq_leave_protection(irq_state);
+    spin_unlock_protect(&sem->wq.lock, irq_state);
+    return err;
 }
 
 /**
- * Release Semaphore
+ * Acquire Semaphore, not given up by the kill, e.g. waiting for the disk
  */
-void sem_notify (sem_t * sem) {
-    irq_state_t  irq_state = irq_enter_protection();
+void sem_wait_nokill (sem_t * sem) {
+    irq_state_t  irq_state = spin_lock_protect(&sem->wq.lock);
+
+    if (sem->count > 0) {
+        sem->count--;
+    } else {
+        waitq_wait_nokill(&sem->wq, 0);
+    }
+
+    spin_unlock_protect(&sem->wq.lock, irq_state);
+}
 
-    if (list_count(&sem->wait_list)) {
-        // if there is process waiting, wake it up and add it to the ready queue
-        list_node_t * node = list_remove_first(&sem->wait_list);
-        task_t * task = list_node_parent(node, task_t, wait_node);
-        task_set_ready(task);
+/**
+ * Acquire Semaphore, give up after timeout_ns
+ * return 0 if acquired, -1 if time is out or the process is killed
+ */
+int sem_timedwait (sem_t * sem, uint64_t timeout_ns) {
+    irq_state_t  irq_state = spin_lock_protect(&sem->wq.lock);
 
-        task_dispatch();
+    int err = 0;
+    if (sem->count > 0) {
+        sem->count--;
+    } else if (timeout_ns == 0) {
+        err = -1;
+    } else {
+        err = waitq_wait(&sem->wq, 0, timeout_ns);
+    }
+
+    spin_unlock_protect(&sem->wq.lock, irq_state);
+    return err;
+}
+
+/**
+ * Release Semaphore, hand the CPU over to the waiter if sync is set
+ */
+static void sem_release (sem_t * sem, int sync) {
+    irq_state_t  irq_state = spin_lock_protect(&sem->wq.lock);
+
+    // if there is process waiting, wake it up and add it to the ready queue
+    if (sync ? waitq_wake_sync(&sem->wq) : waitq_wake(&sem->wq, 1)) {
+        spin_unlock(&sem->wq.lock);
+
+        // with sync, it runs when current task blocks
+        if (!sync) {
+            task_dispatch();
+        }
     } else {
         sem->count++;
+        spin_unlock(&sem->wq.lock);
     }
 
     irq_leave_protection(irq_state);
 }
 
+/**
+ * Release Semaphore
+ */
+void sem_notify (sem_t * sem) {
+    sem_release(sem, 0);
+}
+
+/**
+ * Release Semaphore when current task is going to block, e.g. waiting for the reply
+ * the waiter runs next on this CPU instead of queuing behind other tasks
+ */
+void sem_notify_sync (sem_t * sem) {
+    sem_release(sem, 1);
+}
+
 /**
  * Get current value of Semaphore
  */
 int sem_count (sem_t * sem) {
-    irq_state_t  irq_state = irq_enter_protection();
+    irq_state_t  irq_state = spin_lock_protect(&sem->wq.lock);
     int count = sem->count;
-    irq_leave_protection(irq_state);
+    spin_unlock_protect(&sem->wq.lock, irq_state);
     return count;
 }
-
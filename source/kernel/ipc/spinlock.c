@@ -0,0 +1,58 @@
+/**
+ * Spinlock
+ */
+#include "comm/cpu_instr.h"
+#include "ipc/spinlock.h"
+
+/**
+ * Spinlock initization
+ */
+void spin_init (spinlock_t * lock) {
+    lock->locked = 0;
+}
+
+/**
+ * Accquire the lock, spin until it is released by the other CPU
+ * interrupts should be disabled by the caller, otherwise an interrupt handler may deadlock on it
+ */
+void spin_lock (spinlock_t * lock) {
+    while (xchg(&lock->locked, 1) != 0) {
+        // only read while waiting, to keep the cache line shared
+        while (lock->locked) {
+            cpu_pause();
+        }
+    }
+}
+
+/**
+ * Try to accquire the lock once
+ * return 1 if locked, 0 if it's held by others
+ */
+int spin_trylock (spinlock_t * lock) {
+    return xchg(&lock->locked, 1) == 0;
+}
+
+/**
+ * Release the lock
+ */
+void spin_unlock (spinlock_t * lock) {
+    cpu_barrier();
+    lock->locked = 0;
+}
+
+/**
+ * Disable local interrupts, then accquire the lock
+ */
+irq_state_t spin_lock_protect (spinlock_t * lock) {
+    irq_state_t state = irq_enter_protection();
+    spin_lock(lock);
+    return state;
+}
+
+/**
+ * Release the lock, then restore local interrupts
+ */
+void spin_unlock_protect (spinlock_t * lock, irq_state_t state) {
+    spin_unlock(lock);
+    irq_leave_protection(state);
+}
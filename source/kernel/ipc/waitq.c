@@ -0,0 +1,242 @@
+/**
+ * Wait queue
+ */
+#include "ipc/waitq.h"
+#include "core/task.h"
+#include "dev/time.h"
+#include "cpu/irq.h"
+
+void waitq_init (waitq_t * wq) {
+    spin_init(&wq->lock);
+    list_init(&wq->list);
+}
+
+/**
+ * @brief Wake up the task if it's still waiting when time is out, in timer interrupt
+ */
+static void waitq_timeout (hrtimer_t * timer) {
+    waitq_entry_t * entry = (waitq_entry_t *)timer->data;
+    waitq_t * wq = entry->wq;
+
+    spin_lock(&wq->lock);
+
+    // a waker may have removed it just now
+    if (entry->done == 0) {
+        list_remove(&wq->list, &entry->node);
+        entry->done = -1;
+        task_set_ready(entry->task);
+    }
+
+    spin_unlock(&wq->lock);
+}
+
+/**
+ * @brief Sleep on the queue, the killable one is woken up by the kill of its process
+ */
+static int waitq_sleep (waitq_t * wq, int data, uint64_t timeout_ns, int killable) {
+    task_t * curr = task_current();
+
+    waitq_entry_t entry;
+    entry.task = curr;
+    entry.data = data;
+    entry.done = 0;
+    entry.wq = wq;
+    entry.func = (waitq_func_t)0;
+    list_node_init(&entry.node);
+
+    // the flag is checked with the entry published, the kill sees the entry or it's seen here
+    if (killable) {
+        spin_lock(&curr->wait_lock);
+        if (curr->flags & TASK_FLAG_KILL) {
+            spin_unlock(&curr->wait_lock);
+            return -1;
+        }
+        curr->wait_entry = &entry;
+        spin_unlock(&curr->wait_lock);
+    }
+
+    // remove from the ready queue, then add the waiting queue and start the timer
+    task_set_block(curr);
+    list_insert_last(&wq->list, &entry.node);
+    if (timeout_ns) {
+        hrtimer_init(&entry.timer, waitq_timeout, &entry);
+        hrtimer_start(&entry.timer, time_ns() + timeout_ns, curr->timer_slack);
+    }
+    spin_unlock(&wq->lock);
+    task_dispatch();
+
+    // the entry is on the stack, make sure the timer function has returned
+    if (timeout_ns) {
+        hrtimer_cancel(&entry.timer);
+    }
+
+    spin_lock(&wq->lock);
+    if (killable) {
+        spin_lock(&curr->wait_lock);
+        curr->wait_entry = (waitq_entry_t *)0;
+        spin_unlock(&curr->wait_lock);
+    }
+    return (entry.done > 0) ? 0 : -1;
+}
+
+/**
+ * @brief Sleep on the queue until woken up, or timeout_ns passed if it's not 0, or the process is killed
+ * wq->lock should be held with interrupts disabled, it's released while sleeping
+ * and held again on return. return 0 if woken up, -1 if time is out or killed
+ */
+int waitq_wait (waitq_t * wq, int data, uint64_t timeout_ns) {
+    return waitq_sleep(wq, data, timeout_ns, 1);
+}
+
+/**
+ * @brief Sleep on the queue until woken up, not by the kill. For the locks, which are released
+ * by their holders soon, and the waits which can't be given up, e.g. disk I/O
+ */
+void waitq_wait_nokill (waitq_t * wq, int data) {
+    waitq_sleep(wq, data, 0, 0);
+}
+
+/**
+ * @brief Wake up the killed task from the queue it sleeps on, its waitq_wait returns -1
+ * the kill flag should be set before. The queue is locked before wait_lock by the waiter,
+ * so it's only tried here, again and again until the waiter leaves it
+ */
+void waitq_wake_killed (task_t * task) {
+    for (;;) {
+        irq_state_t irq_state = spin_lock_protect(&task->wait_lock);
+        waitq_entry_t * entry = task->wait_entry;
+        if (entry == (waitq_entry_t *)0) {
+            spin_unlock_protect(&task->wait_lock, irq_state);
+            return;
+        }
+
+        // the entry stays there until wait_lock is released, the waiter clears it first
+        if (spin_trylock(&entry->wq->lock)) {
+            if (entry->done == 0) {
+                list_remove(&entry->wq->list, &entry->node);
+                entry->done = -1;
+                task_set_ready(task);
+            }
+            spin_unlock(&entry->wq->lock);
+            spin_unlock_protect(&task->wait_lock, irq_state);
+            return;
+        }
+        spin_unlock_protect(&task->wait_lock, irq_state);
+    }
+}
+
+/**
+ * @brief Add a watcher without sleeping, func is called on every wake up until it's removed
+ * it doesn't take the place of the waiters, e.g. the count handed over by a semaphore
+ */
+void waitq_add (waitq_t * wq, waitq_entry_t * entry, waitq_func_t func, void * arg) {
+    entry->task = task_current();
+    entry->data = 0;
+    entry->done = 0;
+    entry->wq = wq;
+    entry->func = func;
+    entry->arg = arg;
+    list_node_init(&entry->node);
+
+    irq_state_t irq_state = spin_lock_protect(&wq->lock);
+    list_insert_last(&wq->list, &entry->node);
+    spin_unlock_protect(&wq->lock, irq_state);
+}
+
+/**
+ * @brief Remove the watcher, func is not called after return
+ */
+void waitq_remove (waitq_t * wq, waitq_entry_t * entry) {
+    irq_state_t irq_state = spin_lock_protect(&wq->lock);
+    list_remove(&wq->list, &entry->node);
+    spin_unlock_protect(&wq->lock, irq_state);
+}
+
+/**
+ * @brief Remove the waiter and make it ready, or call the func of the watcher
+ * wq->lock should be held. return 1 if it's a waiter
+ */
+static int waitq_wake_entry (waitq_t * wq, waitq_entry_t * entry, int sync) {
+    if (entry->func) {
+        entry->func(entry);
+        return 0;
+    }
+
+    list_remove(&wq->list, &entry->node);
+    entry->done = 1;
+    if (sync) {
+        task_set_ready_sync(entry->task);
+    } else {
+        task_set_ready(entry->task);
+    }
+    return 1;
+}
+
+/**
+ * @brief Wake up at most nr waiters from the head, and the watchers before the last of them
+ * wq->lock should be held. return the number woken up, the caller dispatches after releasing the lock
+ */
+static int waitq_wake_nr (waitq_t * wq, int nr, int sync) {
+    int count = 0;
+
+    list_node_t * node = list_first(&wq->list);
+    while (node && (count < nr)) {
+        list_node_t * next = list_node_next(node);
+        count += waitq_wake_entry(wq, list_node_parent(node, waitq_entry_t, node), sync);
+        node = next;
+    }
+    return count;
+}
+
+/**
+ * @brief Wake up at most nr waiters from the head, wq->lock should be held
+ */
+int waitq_wake (waitq_t * wq, int nr) {
+    return waitq_wake_nr(wq, nr, 0);
+}
+
+/**
+ * @brief Wake up the first waiter, it runs next on this CPU when current task blocks
+ * wq->lock should be held
+ */
+int waitq_wake_sync (waitq_t * wq) {
+    return waitq_wake_nr(wq, 1, 1);
+}
+
+/**
+ * @brief Wake up all the waiters and watchers, wq->lock should be held
+ */
+int waitq_wake_all (waitq_t * wq) {
+    return waitq_wake_nr(wq, list_count(&wq->list), 0);
+}
+
+/**
+ * @brief Wake up the waiters pred chooses, from the head until it returns WAITQ_STOP
+ * wq->lock should be held
+ */
+int waitq_wake_if (waitq_t * wq, waitq_pred_t pred, void * arg) {
+    int count = 0;
+
+    list_node_t * node = list_first(&wq->list);
+    while (node) {
+        list_node_t * next = list_node_next(node);
+        waitq_entry_t * entry = list_node_parent(node, waitq_entry_t, node);
+
+        int action = pred(entry, arg);
+        if (action == WAITQ_STOP) {
+            break;
+        } else if (action == WAITQ_WAKE) {
+            waitq_wake_entry(wq, entry, 0);
+            count++;
+        }
+        node = next;
+    }
+    return count;
+}
+
+/**
+ * @brief Number of the waiters, wq->lock should be held
+ */
+int waitq_count (waitq_t * wq) {
+    return list_count(&wq->list);
+}
@@ -56,6 +56,28 @@ void list_insert_last(list_t *list, list_node_t *node) {
     list->count++;
 }
 
+/**
+ * Insert the node in front of pos, or at the tail if pos is 0
+ */
+void list_insert_before(list_t *list, list_node_t *pos, list_node_t *node) {
+    if ((pos == (list_node_t *)0) || (pos == list->first)) {
+        if (pos) {
+            list_insert_first(list, node);
+        } else {
+            list_insert_last(list, node);
+        }
+        return;
+    }
+
+    // pos has a predecessor, link the node between them
+    node->pre = pos->pre;
+    node->next = pos;
+    pos->pre->next = node;
+    pos->pre = node;
+
+    list->count++;
+}
+
 /**
  * Remove  head of specific list
  */
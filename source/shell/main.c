@@ -212,27 +212,28 @@ static int do_cp (int argc, char ** argv) {
         return -1;
     }
 
-    FILE * from, * to;
-    from = fopen(argv[1], "rb");
-    to = fopen(argv[2], "wb");
-    if (!from || !to) {
+    int from = open(argv[1], O_RDONLY);
+    int to = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC);
+    if ((from < 0) || (to < 0)) {
         puts("open file failed.");
-        goto ls_failed;
+        goto cp_failed;
     }
 
-    char * buf = (char *)malloc(255);
-    int size = 0;
-    while ((size = fread(buf, 1, 255, from)) > 0) {
-        fwrite(buf, 1, size, to);
+    // copied in the kernel, usually done by the first call
+    int size;
+    while ((size = copy_file_range(from, (off_t *)0, to, (off_t *)0, CP_SIZE_MAX, 0)) > 0) {
+    }
+
+    if (size < 0) {
+        puts("copy file failed.");
     }
-    free(buf);
 
-ls_failed:
-    if (from) {
-        fclose(from);
+cp_failed:
+    if (from >= 0) {
+        close(from);
     }
-    if (to) {
-        fclose(to);
+    if (to >= 0) {
+        close(to);
     }
     return 0;
 }
@@ -361,16 +362,11 @@ static const char * find_exec_path (const char * file_name) {
  * @brief  Run current file
  */
 static void run_exec_file (const char * path, int argc, char ** argv) {
-    int pid = fork();
+    // the child is loaded from the file directly, only with the standard input and outputs
+    const int fd_map[SPAWN_FD_NR] = {0, 1, 2};
+    int pid = spawn(path, argv, (char * const *)0, fd_map);
     if (pid < 0) {
-        fprintf(stderr, "fork failed: %s", path);
-    } else if (pid == 0) {
-        // child process
-        int err = execve(path, argv, (char * const *)0);
-        if (err < 0) {
-            fprintf(stderr, "exec failed: %s", path);
-        }
-        exit(-1);
+        fprintf(stderr, "exec failed: %s", path);
     } else {
         // wait until child process finish
         int status;
@@ -379,6 +375,82 @@ static void run_exec_file (const char * path, int argc, char ** argv) {
     }
 }
 
+/**
+ * @brief Run the commands split by "|", the output of each one goes to the input of the next
+ * through a pipe, they run at the same time
+ */
+static void run_pipeline (int argc, char ** argv) {
+    char ** cmds[CLI_PIPE_MAX];
+    int count = 0;
+
+    // split argv in place, each command ends with null
+    cmds[count++] = argv;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "|") != 0) {
+            continue;
+        }
+
+        argv[i] = (char *)0;
+        if ((count >= CLI_PIPE_MAX) || (i + 1 >= argc)) {
+            fprintf(stderr, ESC_COLOR_ERROR"bad pipeline\n"ESC_COLOR_DEFAULT);
+            return;
+        }
+        cmds[count++] = argv + i + 1;
+    }
+
+    int started = 0;
+    int in = 0;
+    for (int i = 0; i < count; i++) {
+        char ** cmd = cmds[i];
+        if (cmd[0] == (char *)0) {
+            fprintf(stderr, ESC_COLOR_ERROR"bad pipeline\n"ESC_COLOR_DEFAULT);
+            break;
+        }
+
+        const char * path = find_exec_path(cmd[0]);
+        if (path == (const char *)0) {
+            fprintf(stderr, ESC_COLOR_ERROR"Unknown command: %s\n"ESC_COLOR_DEFAULT, cmd[0]);
+            break;
+        }
+
+        // the last one writes to the terminal
+        int fds[2] = {-1, 1};
+        if ((i < count - 1) && (pipe(fds) < 0)) {
+            fprintf(stderr, ESC_COLOR_ERROR"create pipe failed\n"ESC_COLOR_DEFAULT);
+            break;
+        }
+
+        const int fd_map[SPAWN_FD_NR] = {in, fds[1], 2};
+        int pid = spawn(path, cmd, (char * const *)0, fd_map);
+
+        // the shell keeps only the read end for the next command
+        if (in != 0) {
+            close(in);
+        }
+        if (fds[1] != 1) {
+            close(fds[1]);
+        }
+        in = (fds[0] >= 0) ? fds[0] : 0;
+
+        if (pid < 0) {
+            fprintf(stderr, "exec failed: %s", path);
+            break;
+        }
+        started++;
+    }
+
+    // the next command has not started, nobody reads it
+    if (in != 0) {
+        close(in);
+    }
+
+    for (int i = 0; i < started; i++) {
+        int status;
+        int pid = wait(&status);
+        fprintf(stderr, "cmd result: %d, pid = %d\n", status, pid);
+    }
+}
+
 int main (int argc, char **argv) {
 	open(argv[0], O_RDWR);
     dup(0);     // std output
@@ -427,6 +499,15 @@ int main (int argc, char **argv) {
             continue;
         }
 
+        int piped = 0;
+        for (int i = 0; i < argc; i++) {
+            piped |= (strcmp(argv[i], "|") == 0);
+        }
+        if (piped) {
+            run_pipeline(argc, argv);
+            continue;
+        }
+
         const cli_cmd_t * cmd = find_builtin(argv[0]);
         if (cmd) {
             run_builtin(cmd, argc, argv);
@@ -444,4 +525,4 @@ int main (int argc, char **argv) {
     }
 
     return 0;
-}   
\ No newline at end of file
+}   
\ No newline at end of file
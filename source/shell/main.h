@@ -6,6 +6,8 @@
 
 #define CLI_INPUT_SIZE              1024            // input buffer
 #define	CLI_MAX_ARG_COUNT		    10			    // max received arguments number
+#define CLI_PIPE_MAX                4               // commands in a pipeline
+#define CP_SIZE_MAX                 0x7FFFFFFF      // bytes copied by one copy_file_range, till the end of file
 
 #define ESC_CMD2(Pn, cmd)		    "\x1b["#Pn#cmd
 #define	ESC_COLOR_ERROR			    ESC_CMD2(31, m)	// red error message
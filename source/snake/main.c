@@ -259,16 +259,13 @@ int main (int argc, char ** argv) {
 	show_welcome();
     begin_game();
 
-    int count;
-	int cnt = 0;
 	do {
-		// check if any input on keyboard
-		ioctl(0, TTY_CMD_IN_COUNT, (int)&count, 0);
-		if (count) {
+		// sleep until a key is pressed, or move the snake in fixed pace automaticlly
+		struct pollfd pfd = {0, POLLIN, 0};
+		if (poll(&pfd, 1, SNAKE_STEP_MS) > 0) {
 			int ch = getchar();
 			move_forward(ch);
-		} else if (++cnt % 50 == 0) {
-			// move the snake in fixed pace automaticlly
+		} else {
 			move_forward(snake.dir);
 		}
 
@@ -280,8 +277,6 @@ int main (int argc, char ** argv) {
 			getchar();
 			break;
 		}
-
-		msleep(10);
 	}while (1);
 
 	// TODO: dangerous quitting here
@@ -15,6 +15,8 @@
 #define PLAYER1_KEY_RIGHT		'd'
 #define PLAYER1_KEY_QUITE		'q'
 
+#define SNAKE_STEP_MS			500		// moves by itself after no key is pressed for it
+
 /**
  * snake body node
  */
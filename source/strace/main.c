@@ -0,0 +1,264 @@
+/**
+ * Syscall tracer, print the syscalls of a program or the counters of all syscalls
+ * Usage: strace [-c] cmd [args ...]
+ *        strace -s [-r]
+ * without option, print each syscall of cmd with the arguments, the return value and the cycles
+ * with -c, count the syscalls of all tasks while cmd runs and print a summary instead
+ * with -s, print the counters collected so far, -r also clears them
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "lib_syscall.h"
+#include "comm/clock.h"
+#include "main.h"
+
+static const char * const syscall_names[] = {
+    [SYS_msleep] = "msleep",
+    [SYS_getpid] = "getpid",
+    [SYS_fork] = "fork",
+    [SYS_execve] = "execve",
+    [SYS_yield] = "yield",
+    [SYS_exit] = "exit",
+    [SYS_wait] = "wait",
+    [SYS_getrusage] = "getrusage",
+    [SYS_task_list] = "task_list",
+    [SYS_sched_latency] = "sched_latency",
+    [SYS_sched_trace] = "sched_trace",
+    [SYS_clock_gettime] = "clock_gettime",
+    [SYS_gettimeofday] = "gettimeofday",
+    [SYS_time_page] = "time_page",
+    [SYS_nanosleep] = "nanosleep",
+    [SYS_timer_slack] = "timer_slack",
+    [SYS_spawn] = "spawn",
+    [SYS_vfork] = "vfork",
+    [SYS_clone] = "clone",
+    [SYS_join] = "join",
+    [SYS_sched_setattr] = "sched_setattr",
+    [SYS_sched_getattr] = "sched_getattr",
+    [SYS_syscall_stat] = "syscall_stat",
+    [SYS_strace] = "strace",
+    [SYS_strace_read] = "strace_read",
+    [SYS_futex] = "futex",
+    [SYS_thread_exit] = "thread_exit",
+    [SYS_open] = "open",
+    [SYS_read] = "read",
+    [SYS_write] = "write",
+    [SYS_close] = "close",
+    [SYS_lseek] = "lseek",
+    [SYS_isatty] = "isatty",
+    [SYS_sbrk] = "sbrk",
+    [SYS_fstat] = "fstat",
+    [SYS_dup] = "dup",
+    [SYS_ioctl] = "ioctl",
+    [SYS_opendir] = "opendir",
+    [SYS_readdir] = "readdir",
+    [SYS_closedir] = "closedir",
+    [SYS_unlink] = "unlink",
+    [SYS_uring_setup] = "uring_setup",
+    [SYS_uring_enter] = "uring_enter",
+    [SYS_readv] = "readv",
+    [SYS_writev] = "writev",
+    [SYS_pread] = "pread",
+    [SYS_pwrite] = "pwrite",
+    [SYS_sendfile] = "sendfile",
+    [SYS_copy_file_range] = "copy_file_range",
+    [SYS_pipe] = "pipe",
+    [SYS_poll] = "poll",
+    [SYS_epoll_create] = "epoll_create",
+    [SYS_epoll_ctl] = "epoll_ctl",
+    [SYS_epoll_wait] = "epoll_wait",
+    [SYS_mq_open] = "mq_open",
+    [SYS_mq_unlink] = "mq_unlink",
+    [SYS_mq_send] = "mq_send",
+    [SYS_mq_receive] = "mq_receive",
+    [SYS_mq_getattr] = "mq_getattr",
+    [SYS_printmsg] = "printmsg",
+};
+
+#define SYSCALL_NAME_NR     (sizeof(syscall_names) / sizeof(syscall_names[0]))
+
+static syscall_stat_t stat_list[SYSCALL_NAME_NR];
+static syscall_event_t event_list[STRACE_EVENT_BUF];
+
+static const char * syscall_name (int id) {
+    if ((id >= 0) && (id < SYSCALL_NAME_NR) && syscall_names[id]) {
+        return syscall_names[id];
+    }
+    return "unknown";
+}
+
+/**
+ * Print the counters of the syscalls called at least once
+ */
+static void show_stat (void) {
+    int count = syscall_stat(stat_list, SYSCALL_NAME_NR, 0);
+    if (count > SYSCALL_NAME_NR) {
+        count = SYSCALL_NAME_NR;
+    }
+
+    printf("%-16s %10s %12s %10s %10s\n", "SYSCALL", "CALLS", "TOTAL(K)", "AVG", "MAX");
+    for (int id = 0; id < count; id++) {
+        syscall_stat_t * stat = stat_list + id;
+        if (stat->count == 0) {
+            continue;
+        }
+
+        // no 64 bits division in libc, the cycles are in 32 bits after the division
+        uint32_t rem;
+        uint32_t total_k = (uint32_t)clock_div64(stat->cycles, 1000, &rem);
+        uint32_t avg = (uint32_t)clock_div64(stat->cycles, stat->count, &rem);
+        uint32_t max = (stat->max_cycles >> 32) ? 0xFFFFFFFF : (uint32_t)stat->max_cycles;
+        printf("%-16s %10u %12u %10u %10u\n", syscall_name(id), stat->count, total_k, avg, max);
+    }
+}
+
+/**
+ * Find the program, with or without .elf
+ */
+static const char * find_path (const char * name) {
+    static char path[STRACE_PATH_MAX];
+
+    int fd = open(name, 0);
+    if (fd >= 0) {
+        close(fd);
+        return name;
+    }
+
+    snprintf(path, sizeof(path), "%s.elf", name);
+    fd = open(path, 0);
+    if (fd < 0) {
+        return (const char *)0;
+    }
+    close(fd);
+    return path;
+}
+
+/**
+ * Get the seq of next event, to skip the events of others before
+ */
+static unsigned int trace_seq (void) {
+    unsigned int seq = 0;
+    int count;
+    while ((count = strace_read(event_list, STRACE_EVENT_BUF, seq)) > 0) {
+        seq = event_list[count - 1].seq + 1;
+    }
+    return seq;
+}
+
+/**
+ * Print the events of the traced child from seq until it exits
+ */
+static void trace_child (int pid, unsigned int seq) {
+    int done = 0;
+    while (!done) {
+        int count = strace_read(event_list, STRACE_EVENT_BUF, seq);
+        if (count <= 0) {
+            msleep(STRACE_POLL_MS);
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            syscall_event_t * event = event_list + i;
+            if (event->seq != seq) {
+                printf("... %u events lost\n", event->seq - seq);
+            }
+            seq = event->seq + 1;
+
+            printf("[%d] %s(0x%x, 0x%x, 0x%x, 0x%x) = %d <%u>\n", event->pid, syscall_name(event->id),
+                event->args[0], event->args[1], event->args[2], event->args[3], event->ret, event->cycles);
+
+            if ((event->id == SYS_exit) && (event->pid == pid)) {
+                done = 1;
+            }
+        }
+    }
+}
+
+int main (int argc, char ** argv) {
+    int count_only = 0, show_only = 0, reset = 0;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "+csrh")) != -1) {
+        switch (ch) {
+            case 'h':
+                puts("trace the syscalls of a program");
+                puts("Usage: strace [-c] cmd [args ...]");
+                puts("       strace -s [-r]");
+                optind = 1;        // getopt need to be reset
+                return 0;
+            case 'c':
+                count_only = 1;
+                break;
+            case 's':
+                show_only = 1;
+                break;
+            case 'r':
+                reset = 1;
+                break;
+            case '?':
+                if (optarg) {
+                    fprintf(stderr, "Unknown option: -%s\n", optarg);
+                }
+                optind = 1;
+                return -1;
+        }
+    }
+
+    if (show_only) {
+        show_stat();
+        if (reset) {
+            syscall_stat((syscall_stat_t *)0, 0, SYSCALL_STAT_RESET);
+        }
+        optind = 1;
+        return 0;
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "no command\n");
+        optind = 1;
+        return -1;
+    }
+
+    const char * path = find_path(argv[optind]);
+    if (path == (const char *)0) {
+        fprintf(stderr, "%s not found\n", argv[optind]);
+        optind = 1;
+        return -1;
+    }
+
+    if (count_only) {
+        syscall_stat((syscall_stat_t *)0, 0, SYSCALL_STAT_RESET | SYSCALL_STAT_ENABLE);
+    }
+
+    unsigned int seq = trace_seq();
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "fork failed\n");
+        optind = 1;
+        return -1;
+    } else if (pid == 0) {
+        if (!count_only) {
+            strace(0, 1);
+        }
+        execve(path, argv + optind, (char * const *)0);
+        exit(-1);
+    }
+
+    if (!count_only) {
+        trace_child(pid, seq);
+    }
+
+    int status;
+    wait(&status);
+
+    if (count_only) {
+        syscall_stat((syscall_stat_t *)0, 0, SYSCALL_STAT_DISABLE);
+        show_stat();
+    }
+
+    printf("exit status: %d\n", status);
+    optind = 1;
+    return 0;
+}
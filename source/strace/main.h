@@ -0,0 +1,11 @@
+/**
+ * Syscall tracer
+ */
+#ifndef MAIN_H
+#define MAIN_H
+
+#define STRACE_EVENT_BUF        32          // events read in one call
+#define STRACE_POLL_MS          10          // sleep when no new event
+#define STRACE_PATH_MAX         64
+
+#endif
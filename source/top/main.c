@@ -0,0 +1,181 @@
+/**
+ * Task monitor, list the tasks and their CPU usage
+ * Usage: top [-n iterations] [-d delay_ms] [-l]
+ * with -n 0, only print once like ps, without the usage in the interval
+ * with -l, print the wakeup to run latency of the scheduler instead
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "lib_syscall.h"
+#include "main.h"
+
+static task_usage_t old_list[TOP_TASK_MAX];
+static task_usage_t new_list[TOP_TASK_MAX];
+
+/**
+ * Find the task in last sample
+ */
+static task_usage_t * find_old (int pid, int count) {
+    for (int i = 0; i < count; i++) {
+        if (old_list[i].pid == pid) {
+            return old_list + i;
+        }
+    }
+    return (task_usage_t *)0;
+}
+
+/**
+ * Print all tasks, usage is computed with the ticks in the interval
+ */
+static void show_tasks (int new_count, int old_count, int interval) {
+    printf("%10s %10s %2s %3s %6s %8s %8s %7s %7s %7s %4s %5s %s\n",
+            "PID", "PPID", "S", "CPU", "%CPU", "UTIME", "STIME", "VCSW", "IVCSW", "WAIT", "PF", "MISS", "NAME");
+
+    for (int i = 0; i < new_count; i++) {
+        task_usage_t * usage = new_list + i;
+
+        // ticks running in the interval, of one CPU
+        int percent = 0;
+        task_usage_t * old = find_old(usage->pid, old_count);
+        if (old && (interval > 0)) {
+            int ticks = (usage->utime + usage->stime) - (old->utime + old->stime);
+            percent = ticks * 100 / interval;
+        }
+
+        // deadline misses only make sense for deadline tasks
+        char miss[12] = "-";
+        if (usage->policy == SCHED_POLICY_DEADLINE) {
+            sprintf(miss, "%u", usage->dl_misses);
+        }
+
+        printf("%10d %10d %2c %3d %5d%% %8u %8u %7u %7u %7u %4u %5s %s\n",
+                usage->pid, usage->ppid, usage->state, usage->cpu, percent,
+                usage->utime, usage->stime, usage->nvcsw, usage->nivcsw,
+                usage->wait_ticks, usage->page_faults, miss, usage->name);
+    }
+}
+
+/**
+ * Print the latency histogram, one line per non-empty bucket
+ */
+static void show_histogram (sched_latency_t * latency) {
+    printf("wakeups: %u, avg: %u us, max: %u us\n", latency->count,
+            latency->count ? latency->total_us / latency->count : 0, latency->max_us);
+
+    for (int i = 0; i < SCHED_LAT_HIST_SIZE; i++) {
+        if (latency->hist[i] == 0) {
+            continue;
+        }
+
+        if (i == SCHED_LAT_HIST_SIZE - 1) {
+            printf("%8u+      us: %u\n", 1u << i, latency->hist[i]);
+        } else {
+            printf("%8u-%-8u us: %u\n", i ? 1u << i : 0, (1u << (i + 1)) - 1, latency->hist[i]);
+        }
+    }
+}
+
+/**
+ * Print the global histogram, then the latency of each task
+ */
+static int show_latency (void) {
+    sched_latency_t latency;
+    if (sched_latency(-1, &latency) < 0) {
+        fprintf(stderr, "get latency failed\n");
+        return -1;
+    }
+    show_histogram(&latency);
+
+    int count = task_list(new_list, TOP_TASK_MAX);
+    printf("\n%10s %8s %8s %8s %s\n", "PID", "WAKEUPS", "AVG(us)", "MAX(us)", "NAME");
+    for (int i = 0; i < count; i++) {
+        // the task may have exited
+        if (sched_latency(new_list[i].pid, &latency) < 0) {
+            continue;
+        }
+
+        printf("%10d %8u %8u %8u %s\n", new_list[i].pid, latency.count,
+                latency.count ? latency.total_us / latency.count : 0,
+                latency.max_us, new_list[i].name);
+    }
+    return 0;
+}
+
+int main (int argc, char ** argv) {
+    int iterations = 5;
+    int delay = TOP_DELAY_DEFAULT;
+
+    int latency = 0;
+    int ch;
+    while ((ch = getopt(argc, argv, "n:d:lh")) != -1) {
+        switch (ch) {
+            case 'h':
+                puts("show tasks and cpu usage");
+                puts("Usage: top [-n iterations] [-d delay_ms] [-l]");
+                optind = 1;        // getopt need to be reset
+                return 0;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'd':
+                delay = atoi(optarg);
+                break;
+            case 'l':
+                latency = 1;
+                break;
+            case '?':
+                if (optarg) {
+                    fprintf(stderr, "Unknown option: -%s\n", optarg);
+                }
+                optind = 1;
+                return -1;
+        }
+    }
+    optind = 1;
+
+    if (latency) {
+        return show_latency();
+    }
+
+    if (delay < OS_TICK_MS) {
+        delay = OS_TICK_MS;
+    }
+
+    int old_count = task_list(old_list, TOP_TASK_MAX);
+    if (old_count < 0) {
+        fprintf(stderr, "get task list failed\n");
+        return -1;
+    }
+
+    // only one sample, the usage can't be computed
+    if (iterations <= 0) {
+        for (int i = 0; i < old_count; i++) {
+            new_list[i] = old_list[i];
+        }
+        show_tasks(old_count, 0, 0);
+        return 0;
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        msleep(delay);
+
+        int new_count = task_list(new_list, TOP_TASK_MAX);
+        if (new_count < 0) {
+            fprintf(stderr, "get task list failed\n");
+            return -1;
+        }
+
+        printf("%s%s", ESC_CLEAR_SCREEN, ESC_MOVE_CURSOR(0, 0));
+        printf("top - %d tasks, interval %d ms, tick %d ms\n", new_count, delay, OS_TICK_MS);
+        show_tasks(new_count, old_count, delay / OS_TICK_MS);
+        fflush(stdout);
+
+        for (int j = 0; j < new_count; j++) {
+            old_list[j] = new_list[j];
+        }
+        old_count = new_count;
+    }
+
+    return 0;
+}
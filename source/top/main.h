@@ -0,0 +1,16 @@
+/**
+ * Task monitor
+ */
+#ifndef MAIN_H
+#define MAIN_H
+
+#include "os_cfg.h"
+
+#define ESC_CMD2(Pn, cmd)		    "\x1b["#Pn#cmd
+#define ESC_CLEAR_SCREEN		    ESC_CMD2(2, J)	// clear all screen
+#define	ESC_MOVE_CURSOR(row, col)  "\x1b["#row";"#col"H"
+
+#define TOP_TASK_MAX            (TASK_NR + CPU_NR + 1)  // app tasks, idle tasks and first task
+#define TOP_DELAY_DEFAULT       1000        // ms between two samples
+
+#endif